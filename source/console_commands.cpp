@@ -6,11 +6,15 @@
 #include "pluginglobals.h"
 #include "pluginutil.h"
 #include "waypoints/waypoint_manager.h"
+#include "waypoints/waypoint_pathcache.h"
+#include "sdk/bsp_collision.h"
 
 
 #include <string>
 #include <fstream>
 #include <filesystem>
+#include <chrono>
+#include <random>
 
 static void ConCommand_ModInfo()
 {
@@ -34,6 +38,79 @@ static void ConCommand_EngineInfo()
 	LOG_CONSOLE(PLID, "Engine info:\nMap: %s\nClients %i Entities %i\nTime: %.4f", map, clients, entities, time);
 }
 
+static void ConCommand_PathCacheInfo()
+{
+	if (CMD_ARGC() > 1 && strcmp(CMD_ARGV(1), "reset") == 0)
+	{
+		ThePathCache->ResetCounters();
+		LOG_CONSOLE(PLID, "Path cache counters reset.");
+		return;
+	}
+
+	auto hits = ThePathCache->GetHits();
+	auto misses = ThePathCache->GetMisses();
+	auto total = hits + misses;
+	float rate = total > 0 ? static_cast<float>(hits) / static_cast<float>(total) * 100.0f : 0.0f;
+
+	LOG_CONSOLE(PLID, "Path cache info:\nCached paths: %i\nHits: %u (%u sub paths)\nMisses: %u\nHit rate: %.1f%%", ThePathCache->GetCachedPathCount(),
+		hits, ThePathCache->GetSubPathHits(), misses, rate);
+}
+
+static void ConCommand_BSPValidate()
+{
+	if (TheMapCollision == nullptr)
+	{
+		LOG_CONSOLE(PLID, "Map collision is not loaded!");
+		return;
+	}
+
+	const int count = CMD_ARGC() > 1 ? std::max(atoi(CMD_ARGV(1)), 1) : 1000;
+	auto& waypoints = TheWaypoints->GetTheWaypoints();
+	const Vector& mins = TheMapCollision->GetWorldMins();
+	const Vector& maxs = TheMapCollision->GetWorldMaxs();
+	std::mt19937 random(static_cast<unsigned int>(count));
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+	// Traces between waypoints when there are some, they are in the playable area
+	auto randompoint = [&]() {
+		if (waypoints.size() >= 2)
+		{
+			return waypoints[random() % waypoints.size()]->GetCenter();
+		}
+
+		return Vector(mins.x + (maxs.x - mins.x) * unit(random), mins.y + (maxs.y - mins.y) * unit(random), mins.z + (maxs.z - mins.z) * unit(random));
+	};
+
+	int mismatches = 0;
+	double enginetime = 0.0;
+	double bsptime = 0.0;
+
+	for (int i = 0; i < count; i++)
+	{
+		const Vector start = randompoint();
+		const Vector end = randompoint();
+		const int hull = i % BSPCollision::MAX_HULLS;
+
+		if (!TheMapCollision->ValidateTrace(start, end, hull, nullptr))
+		{
+			mismatches++;
+		}
+
+		TraceResult tr;
+		BSPTraceResult result;
+		auto t0 = std::chrono::steady_clock::now();
+		UTIL_TraceHull(start, end, ignore_monsters, hull, nullptr, &tr);
+		auto t1 = std::chrono::steady_clock::now();
+		TheMapCollision->TraceHull(start, end, hull, result);
+		auto t2 = std::chrono::steady_clock::now();
+		enginetime += std::chrono::duration<double, std::micro>(t1 - t0).count();
+		bsptime += std::chrono::duration<double, std::micro>(t2 - t1).count();
+	}
+
+	LOG_CONSOLE(PLID, "BSP trace validation:\nTraces: %i\nMismatches: %i\nEngine: %.2f us per trace\nBSP: %.2f us per trace", count, mismatches,
+		enginetime / count, bsptime / count);
+}
+
 static void ConCommand_CreateDirTest()
 {
 	TheWaypoints->Save();
@@ -45,4 +122,6 @@ void RegisterServerCommands()
 	g_engfuncs.pfnAddServerCommand("gb_addbot", ConCommand_AddBot);
 	g_engfuncs.pfnAddServerCommand("gb_engineinfo", ConCommand_EngineInfo);
 	g_engfuncs.pfnAddServerCommand("gb_createdirtest", ConCommand_CreateDirTest);
+	g_engfuncs.pfnAddServerCommand("gb_nav_path_cache", ConCommand_PathCacheInfo);
+	g_engfuncs.pfnAddServerCommand("gb_bsp_validate", ConCommand_BSPValidate);
 }
\ No newline at end of file
@@ -49,7 +49,17 @@
 #include "mods/mod_base.h"
 #include "manager.h"
 #include "waypoints/waypoint_manager.h"
+#include "waypoints/waypoint_pathmanager.h"
+#include "waypoints/waypoint_pathworker.h"
+#include "waypoints/waypoint_pathcache.h"
+#include "waypoints/waypoint_landmarks.h"
+#include "waypoints/waypoint_hierarchy.h"
+#include "waypoints/waypoint_flowfield.h"
+#include "waypoints/waypoint_overlay.h"
+#include "waypoints/waypoint_contraction.h"
+#include "waypoints/waypoint_distancetable.h"
 #include "sdk/chandle.h"
+#include "sdk/bsp_collision.h"
 
 void SV_GameInit(void)
 {
@@ -72,6 +82,51 @@ void SV_GameInit(void)
 		TheWaypoints = WaypointManagerFactory();
 	}
 
+	if (ThePathSearchManager == nullptr)
+	{
+		ThePathSearchManager = new CPathSearchManager;
+	}
+
+	if (ThePathCache == nullptr)
+	{
+		ThePathCache = new CPathCache;
+	}
+
+	if (TheLandmarks == nullptr)
+	{
+		TheLandmarks = new CLandmarkManager;
+	}
+
+	if (TheContractionHierarchy == nullptr)
+	{
+		TheContractionHierarchy = new CContractionManager;
+	}
+
+	if (TheDistanceTable == nullptr)
+	{
+		TheDistanceTable = new CDistanceTableManager;
+	}
+
+	if (TheWaypointHierarchy == nullptr)
+	{
+		TheWaypointHierarchy = new CWaypointHierarchy;
+	}
+
+	if (TheFlowFields == nullptr)
+	{
+		TheFlowFields = new CFlowFieldCache;
+	}
+
+	if (TheEdgeOverlays == nullptr)
+	{
+		TheEdgeOverlays = new CEdgeOverlayManager;
+	}
+
+	if (ThePathWorkers == nullptr)
+	{
+		ThePathWorkers = new CPathWorkerPool; // Worker threads are started on the first update
+	}
+
 	auto cvar = CVAR_GET_POINTER("sys_ticrate");
 	auto fps = CVAR_GET_POINTER("fps_max");
 
@@ -91,6 +146,15 @@ void SV_GameInit(void)
 	CVAR_REGISTER(&gb_debug_enabled);
 	CVAR_REGISTER(&gb_nav_zdraw);
 	CVAR_REGISTER(&gb_nav_quicksave);
+	CVAR_REGISTER(&gb_nav_search_budget);
+	CVAR_REGISTER(&gb_nav_path_threads);
+	CVAR_REGISTER(&gb_nav_path_cache_size);
+	CVAR_REGISTER(&gb_nav_landmarks);
+	CVAR_REGISTER(&gb_nav_flow_fields);
+	CVAR_REGISTER(&gb_nav_contraction);
+	CVAR_REGISTER(&gb_nav_generate_budget);
+	CVAR_REGISTER(&gb_nav_visibility);
+	CVAR_REGISTER(&gb_nav_distance_table_memory);
 
 	RegisterServerCommands();
 	RegisterWaypointEditingCommands();
@@ -111,6 +175,7 @@ int SV_Spawn(edict_t* pent)
 		PRECACHE_SOUND("buttons/button3.wav");
 		TheWaypoints->SetSpriteTexture(spr);
 		UTIL_SetBeamSpriteModel(spr);
+		TheMapCollision = CBSPCollision::LoadMap(STRING(gpGlobals->mapname));
 		TheWaypoints->OnMapChange();
 		gamemod->OnRoundRestart();
 	}
@@ -120,6 +185,7 @@ int SV_Spawn(edict_t* pent)
 
 void SV_StartFrame(void)
 {
+	TheWaypoints->Update();
 	TheBotManager->Update();
 	TheWaypoints->EditingUpdate();
 	RETURN_META(MRES_IGNORED);
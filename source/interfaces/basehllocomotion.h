@@ -3,6 +3,13 @@
 
 #include "locomotion.h"
 
+// Movement limits of the default Half-Life 1 player, shared with code that needs them without a bot
+namespace HalfLifeMovement
+{
+	constexpr float MaxJumpHeight = 52.0f; // Highest obstacle a player can jump on
+	constexpr float DeathDropHeight = 300.0f; // Falls higher than this are considered dangerous
+}
+
 /**
  * @brief Base implementation of the locomotion interface for the default Half-Life 1 movement style
 */
@@ -86,12 +93,12 @@ inline float CBaseHalfLifeLocomotion::GetMaxStepHeigh() const
 
 inline float CBaseHalfLifeLocomotion::GetMaxJumpHeigh() const
 {
-	return 52.0f;
+	return HalfLifeMovement::MaxJumpHeight;
 }
 
 inline float CBaseHalfLifeLocomotion::GetDeathDropHeigh() const
 {
-	return 300.0f;
+	return HalfLifeMovement::DeathDropHeight;
 }
 
 #endif // !BASE_HALF_LIFE_LOCOMOTION_H_
@@ -515,6 +515,7 @@ public:
 	virtual EventDesiredResult< Actor > OnUnstuck(Actor* me) { return TryContinue(); }
 	virtual EventDesiredResult< Actor > OnSight(Actor* me , CMemoryEntity* them) { return TryContinue(); }
 	virtual EventDesiredResult< Actor > OnLostSight(Actor* me, CMemoryEntity* them) { return TryContinue(); }
+	virtual EventDesiredResult< Actor > OnPathResult(Actor* me, CPathResult* result) { return TryContinue(); }
 
 	EventDesiredResult< Actor > TryContinue(EventResultPriorityType priority = RESULT_TRY) const;
 	EventDesiredResult< Actor > TryChangeTo(Action< Actor >* action, EventResultPriorityType priority = RESULT_TRY, const char* reason = nullptr) const;
@@ -657,6 +658,7 @@ private:
 	virtual void OnUnstuck() override { PROCESS_EVENT(OnUnstuck); }
 	virtual void OnSight(CMemoryEntity* them) override { PROCESS_EVENT_WITH_1_ARG(OnSight, them); }
 	virtual void OnLostSight(CMemoryEntity* them) override { PROCESS_EVENT_WITH_1_ARG(OnLostSight, them); }
+	virtual void OnPathResult(CPathResult* result) override { PROCESS_EVENT_WITH_1_ARG(OnPathResult, result); }
 
 	friend class IBehavior<Actor>;
 	IBehavior< Actor >* m_behavior;
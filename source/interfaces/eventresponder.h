@@ -9,6 +9,7 @@ enum MoveToFailureType
 };
 
 class CMemoryEntity;
+class CPathResult;
 
 class IEventResponder
 {
@@ -23,6 +24,7 @@ public:
 	virtual void OnUnstuck();
 	virtual void OnSight(CMemoryEntity* them);
 	virtual void OnLostSight(CMemoryEntity* them);
+	virtual void OnPathResult(CPathResult* result); // An asynchronous path request made by this bot has finished
 };
 
 inline void IEventResponder::OnStuck()
@@ -57,5 +59,13 @@ inline void IEventResponder::OnLostSight(CMemoryEntity* them)
 	}
 }
 
+inline void IEventResponder::OnPathResult(CPathResult* result)
+{
+	for (IEventResponder* sub = FirstContainedResponder(); sub; sub = NextContainedResponder(sub))
+	{
+		sub->OnPathResult(result);
+	}
+}
+
 #endif // !EVENT_RESPONDER_H_
 
@@ -12,6 +12,7 @@ void ILocomotion::Reset()
 	ClearStuckStatus();
 	m_motionVector = Vector(1.0f, 0.0f, 0.0f);
 	m_movementRequestTimer.Invalidate();
+	m_pathOverlay.Clear();
 }
 
 void ILocomotion::Update()
@@ -3,6 +3,7 @@
 
 #include "sdk/timers.h"
 #include "component.h"
+#include "waypoints/waypoint_overlay.h"
 
 class CWaypoint;
 class IPluginBot;
@@ -36,6 +37,9 @@ public:
 	virtual const Vector& GetFeet() const;
 
 	virtual bool IsWaypointTraversable(const CWaypoint* waypoint) const { return true; }
+	// Path cost modifiers of this bot, such as paths it recently failed to traverse
+	CEdgeCostOverlay& GetPathOverlay() { return m_pathOverlay; }
+	const CEdgeCostOverlay& GetPathOverlay() const { return m_pathOverlay; }
 
 	const bool IsStuck() const { return m_isStuck; }
 	const float GetStuckDuration() const { return m_stuckTimer.GetElapsedTime(); }
@@ -51,10 +55,12 @@ private:
 	IntervalTimer m_stuckTimer;
 	IntervalTimer m_movementRequestTimer;
 	CountdownTimer m_stillStuckTimer;
+	CEdgeCostOverlay m_pathOverlay;
 };
 
 inline ILocomotion::ILocomotion(IPluginBot* bot) : IBotComponent(bot),
-	m_stuckPos(0.0f, 0.0f, 0.0f)
+	m_stuckPos(0.0f, 0.0f, 0.0f),
+	m_pathOverlay()
 {
 	m_motionVector = Vector(1.0f, 0.0f, 0.0f);
 	m_isStuck = false;
@@ -11,7 +11,8 @@ CMemoryEntity::CMemoryEntity(edict_t* edict) :
 {
 	m_handle = edict;
 	m_timesinceknown = gpGlobals->time;
-	m_lastknownwaypoint = nullptr;
+	m_lastknownwaypoint = WaypointConst::InvalidPathConnection;
+	m_lastknownwaypointgen = 0;
 	m_lpkwasseen = false;
 	m_visible = false;
 	UpdatePosition();
@@ -24,10 +25,25 @@ void CMemoryEntity::UpdatePosition()
 		m_timesincelastseen = gpGlobals->time;
 		m_lastknownposition = Vector(m_handle->v.origin);
 		m_lastknownvelocity = Vector(m_handle->v.velocity);
-		m_lastknownwaypoint = TheWaypoints->GetNearestWaypoint(m_lastknownposition);
+		CWaypoint* nearest = TheWaypoints->GetNearestWaypoint(m_lastknownposition);
+
+		if (nearest != nullptr)
+		{
+			m_lastknownwaypoint = nearest->GetID();
+			m_lastknownwaypointgen = TheWaypoints->GetWaypointGeneration(m_lastknownwaypoint);
+		}
+		else
+		{
+			m_lastknownwaypoint = WaypointConst::InvalidPathConnection;
+		}
 	}
 }
 
+CWaypoint* CMemoryEntity::GetLastKnownWaypoint() const
+{
+	return TheWaypoints->GetWaypointOfID(m_lastknownwaypoint, m_lastknownwaypointgen);
+}
+
 void CMemoryEntity::UpdateVisibleStatus(const bool visible)
 {
 	if (visible)
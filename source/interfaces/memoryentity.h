@@ -33,7 +33,8 @@ public:
 	// Returns the time since this memorized entity was memorized
 	float GetTimeSinceMemorized() const;
 
-	CWaypoint* GetLastKnownWaypoint() const { return m_lastknownwaypoint; }
+	// Nearest waypoint of the LKP, nullptr if it was deleted since the last update
+	CWaypoint* GetLastKnownWaypoint() const;
 
 	const Vector& GetLastKnownPosition() const { return m_lastknownposition; }
 
@@ -44,7 +45,8 @@ public:
 
 private:
 	CHandle m_handle;
-	CWaypoint* m_lastknownwaypoint; // Nearest waypoint of the LKP
+	int m_lastknownwaypoint; // ID of the nearest waypoint of the LKP
+	unsigned int m_lastknownwaypointgen; // Generation of the LKP waypoint ID
 	Vector m_lastknownposition; // Last known position vector
 	Vector m_lastknownvelocity; // Velocity of the entity at the time of the last update
 	float m_timesinceknown; // Time since this entity was memorized
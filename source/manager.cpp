@@ -18,6 +18,12 @@
 #include "mods/mod_base.h"
 #include "waypoints/waypoint_manager.h"
 #include "waypoints/waypoint_pathfind.h"
+#include "waypoints/waypoint_pathworker.h"
+#include "waypoints/waypoint_landmarks.h"
+#include "waypoints/waypoint_overlay.h"
+#include "waypoints/waypoint_contraction.h"
+#include "waypoints/waypoint_distancetable.h"
+#include "waypoints/waypoint_pathmanager.h"
 #include "manager.h"
 
 CPluginBotManager* TheBotManager = nullptr;
@@ -39,6 +45,26 @@ void CPluginBotManager::Update()
 		bot->UpKeep(); // light-weight update every tick
 		bot->BeginUpdate(); // Update the bot if it's time to
 	}
+
+	TheLandmarks->Update(); // Keeps the path finding landmarks up to date with the waypoints
+	TheContractionHierarchy->Update(); // Drops the contraction hierarchy when the waypoints change, rebuilds it when they settle
+	TheDistanceTable->Update(); // Builds the all pairs distance table after the waypoints are loaded
+	TheEdgeOverlays->Update(); // Removes expired path cost overlays
+	ThePathSearchManager->Update(); // Runs path searches requested by bots
+	ThePathWorkers->Update(); // Collects asynchronous path searches finished by the worker threads
+
+	CPathResult result;
+
+	while (ThePathWorkers->GetNextResult(result))
+	{
+		edict_t* requester = result.GetRequester();
+		IPluginBot* bot = requester != nullptr ? GetBotOfEdict(requester) : nullptr;
+
+		if (bot != nullptr)
+		{
+			bot->OnPathResult(&result);
+		}
+	}
 }
 
 void CPluginBotManager::CreatePluginDirectories(const char* gamedir)
@@ -263,7 +289,7 @@ bool CPluginBotManager::ClientCommand(IPlayer* player, const char* command, cons
 				CWaypoint* wptstart = TheWaypoints->GetNearestWaypoint(start);
 				CWaypoint* wptend = TheWaypoints->GetNearestWaypoint(end);
 				IPathCostFunctor defaultcost;
-				CSimpleAStarSearch<IPathCostFunctor> search;
+				CBinaryHeapAStarSearch<IPathCostFunctor, CLandmarkHeuristic> search;
 
 				bool pfresult = search.BuildPath(wptstart, wptend, &end, defaultcost);
 
@@ -47,6 +47,16 @@
 #include "manager.h"
 #include "mods/mod_base.h"
 #include "waypoints/waypoint_manager.h"
+#include "waypoints/waypoint_pathmanager.h"
+#include "waypoints/waypoint_pathworker.h"
+#include "waypoints/waypoint_pathcache.h"
+#include "waypoints/waypoint_landmarks.h"
+#include "waypoints/waypoint_hierarchy.h"
+#include "waypoints/waypoint_flowfield.h"
+#include "waypoints/waypoint_overlay.h"
+#include "waypoints/waypoint_contraction.h"
+#include "waypoints/waypoint_distancetable.h"
+#include "sdk/bsp_collision.h"
 
 // Must provide at least one of these..
 static META_FUNCTIONS gMetaFunctionTable = {
@@ -131,10 +141,66 @@ C_DLLEXPORT int Meta_Detach(PLUG_LOADTIME /* now */,
 		delete gamemod;
 	}
 
+	if (ThePathSearchManager)
+	{
+		delete ThePathSearchManager;
+		ThePathSearchManager = nullptr;
+	}
+
+	if (ThePathCache)
+	{
+		delete ThePathCache;
+		ThePathCache = nullptr;
+	}
+
+	if (ThePathWorkers)
+	{
+		delete ThePathWorkers; // Joins the worker threads
+		ThePathWorkers = nullptr;
+	}
+
+	if (TheEdgeOverlays)
+	{
+		delete TheEdgeOverlays;
+		TheEdgeOverlays = nullptr;
+	}
+
+	if (TheFlowFields)
+	{
+		delete TheFlowFields;
+		TheFlowFields = nullptr;
+	}
+
+	if (TheWaypointHierarchy)
+	{
+		delete TheWaypointHierarchy;
+		TheWaypointHierarchy = nullptr;
+	}
+
+	if (TheDistanceTable)
+	{
+		delete TheDistanceTable; // Waits for the distance table build thread
+		TheDistanceTable = nullptr;
+	}
+
+	if (TheContractionHierarchy)
+	{
+		delete TheContractionHierarchy; // Waits for the hierarchy build thread
+		TheContractionHierarchy = nullptr;
+	}
+
+	if (TheLandmarks)
+	{
+		delete TheLandmarks; // Waits for the landmark build thread
+		TheLandmarks = nullptr;
+	}
+
 	if (TheWaypoints)
 	{
 		delete TheWaypoints;
 	}
 
+	TheMapCollision.reset();
+
 	return(TRUE);
 }
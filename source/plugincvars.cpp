@@ -4,4 +4,13 @@
 cvar_t gb_update_rate = { "gb_update_rate", "0.06", FCVAR_SERVER | FCVAR_EXTDLL };
 cvar_t gb_debug_enabled = { "gb_debug_enabled", "0", FCVAR_SERVER | FCVAR_EXTDLL };
 cvar_t gb_nav_zdraw = { "gb_nav_zdraw", "1", FCVAR_SERVER | FCVAR_EXTDLL };
-cvar_t gb_nav_quicksave = { "gb_nav_quicksave", "0", FCVAR_SERVER | FCVAR_EXTDLL };
\ No newline at end of file
+cvar_t gb_nav_quicksave = { "gb_nav_quicksave", "0", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_search_budget = { "gb_nav_search_budget", "1000", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_path_threads = { "gb_nav_path_threads", "-1", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_path_cache_size = { "gb_nav_path_cache_size", "128", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_landmarks = { "gb_nav_landmarks", "8", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_flow_fields = { "gb_nav_flow_fields", "8", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_contraction = { "gb_nav_contraction", "1", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_generate_budget = { "gb_nav_generate_budget", "2", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_visibility = { "gb_nav_visibility", "1", FCVAR_SERVER | FCVAR_EXTDLL };
+cvar_t gb_nav_distance_table_memory = { "gb_nav_distance_table_memory", "32", FCVAR_SERVER | FCVAR_EXTDLL };
\ No newline at end of file
@@ -5,5 +5,14 @@ extern cvar_t gb_update_rate;
 extern cvar_t gb_debug_enabled;
 extern cvar_t gb_nav_zdraw;
 extern cvar_t gb_nav_quicksave;
+extern cvar_t gb_nav_search_budget; // Number of path finding nodes incremental searches can expand per frame
+extern cvar_t gb_nav_path_threads; // Number of path finding worker threads, -1 for automatic, 0 runs requests on the main thread
+extern cvar_t gb_nav_path_cache_size; // Maximum number of paths in the path cache, 0 disables caching
+extern cvar_t gb_nav_landmarks; // Number of landmarks used by the ALT path finding heuristic, 0 disables landmarks
+extern cvar_t gb_nav_flow_fields; // Maximum number of goal flow fields kept in memory
+extern cvar_t gb_nav_contraction; // Builds a contraction hierarchy for long distance paths once the waypoints stop changing
+extern cvar_t gb_nav_generate_budget; // Milliseconds per frame the waypoint generator can use when tracing with the engine and when creating the waypoints
+extern cvar_t gb_nav_visibility; // Builds the waypoint visibility table in the background when the map collision is loaded
+extern cvar_t gb_nav_distance_table_memory; // Megabytes the all pairs waypoint distance table can use, A* is used for larger maps. 0 disables the table
 
 #endif // !PLUGIN_CVARS_H_
@@ -0,0 +1,525 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "bsp_collision.h"
+
+// BSP file layout, Half-Life uses version 30, Quake version 29 maps are also loaded by the engine
+constexpr int BSP_VERSION_QUAKE = 29;
+constexpr int BSP_VERSION_HALFLIFE = 30;
+// Engine and BSP traces whose end positions are this close are considered the same
+constexpr float BSP_VALIDATE_TOLERANCE = 1.0f;
+
+namespace
+{
+	enum BSPLump
+	{
+		LUMP_ENTITIES = 0,
+		LUMP_PLANES = 1,
+		LUMP_NODES = 5,
+		LUMP_CLIPNODES = 9,
+		LUMP_LEAFS = 10,
+		LUMP_MODELS = 14,
+
+		NUM_LUMPS = 15
+	};
+
+	struct dlump_t
+	{
+		int fileofs;
+		int filelen;
+	};
+
+	struct dheader_t
+	{
+		int version;
+		dlump_t lumps[NUM_LUMPS];
+	};
+
+	struct dplane_t
+	{
+		float normal[3];
+		float dist;
+		int type;
+	};
+
+	struct dnode_t
+	{
+		int planenum;
+		short children[2]; // Negative numbers are -(leafs + 1)
+		short mins[3];
+		short maxs[3];
+		unsigned short firstface;
+		unsigned short numfaces;
+	};
+
+	struct dclipnode_t
+	{
+		int planenum;
+		short children[2]; // Negative numbers are contents
+	};
+
+	struct dleaf_t
+	{
+		int contents;
+		int visofs;
+		short mins[3];
+		short maxs[3];
+		unsigned short firstmarksurface;
+		unsigned short nummarksurfaces;
+		unsigned char ambient_level[4];
+	};
+
+	struct dmodel_t
+	{
+		float mins[3];
+		float maxs[3];
+		float origin[3];
+		int headnode[BSPCollision::MAX_HULLS];
+		int visleafs;
+		int firstface;
+		int numfaces;
+	};
+
+	static_assert(sizeof(dplane_t) == 20 && sizeof(dnode_t) == 24 && sizeof(dclipnode_t) == 8 && sizeof(dleaf_t) == 28 && sizeof(dmodel_t) == 64, "BSP structure layout changed!");
+
+	// Gets the elements of a lump, nullptr if the lump is out of the file bounds
+	template <typename T>
+	const T* GetLump(const unsigned char* data, const size_t size, const dheader_t& header, const BSPLump lump, int& count)
+	{
+		const dlump_t& info = header.lumps[lump];
+
+		if (info.fileofs < 0 || info.filelen < 0 || static_cast<size_t>(info.fileofs) + static_cast<size_t>(info.filelen) > size || info.filelen % sizeof(T) != 0)
+			return nullptr;
+
+		count = info.filelen / static_cast<int>(sizeof(T));
+		return reinterpret_cast<const T*>(data + info.fileofs);
+	}
+}
+
+std::shared_ptr<const CBSPCollision> TheMapCollision;
+
+CBSPCollision::CBSPCollision() :
+	m_planes(),
+	m_pointnodes(),
+	m_clipnodes(),
+	m_mins(0.0f, 0.0f, 0.0f),
+	m_maxs(0.0f, 0.0f, 0.0f),
+	m_entities()
+{
+	for (auto& headnode : m_headnodes)
+	{
+		headnode = -1;
+	}
+}
+
+bool CBSPCollision::Load(const unsigned char* data, const size_t size, std::string& error)
+{
+	if (data == nullptr || size < sizeof(dheader_t))
+	{
+		error = "file is too small";
+		return false;
+	}
+
+	// The lumps aren't aligned in the file, the header is copied and the lump elements are read with memcpy
+	dheader_t header;
+	std::memcpy(&header, data, sizeof(dheader_t));
+
+	if (header.version != BSP_VERSION_HALFLIFE && header.version != BSP_VERSION_QUAKE)
+	{
+		error = "unsupported BSP version " + std::to_string(header.version);
+		return false;
+	}
+
+	int numplanes = 0;
+	int numnodes = 0;
+	int numclipnodes = 0;
+	int numleafs = 0;
+	int nummodels = 0;
+	int entitieslength = 0;
+	const dplane_t* planes = GetLump<dplane_t>(data, size, header, LUMP_PLANES, numplanes);
+	const dnode_t* nodes = GetLump<dnode_t>(data, size, header, LUMP_NODES, numnodes);
+	const dclipnode_t* clipnodes = GetLump<dclipnode_t>(data, size, header, LUMP_CLIPNODES, numclipnodes);
+	const dleaf_t* leafs = GetLump<dleaf_t>(data, size, header, LUMP_LEAFS, numleafs);
+	const dmodel_t* models = GetLump<dmodel_t>(data, size, header, LUMP_MODELS, nummodels);
+	const char* entities = GetLump<char>(data, size, header, LUMP_ENTITIES, entitieslength);
+
+	if (planes == nullptr || nodes == nullptr || clipnodes == nullptr || leafs == nullptr || models == nullptr || entities == nullptr)
+	{
+		error = "lump out of bounds";
+		return false;
+	}
+
+	if (nummodels < 1 || numnodes < 1 || numleafs < 1)
+	{
+		error = "missing world model";
+		return false;
+	}
+
+	m_planes.resize(static_cast<size_t>(numplanes));
+
+	for (int i = 0; i < numplanes; i++)
+	{
+		dplane_t plane;
+		std::memcpy(&plane, &planes[i], sizeof(dplane_t));
+		m_planes[i].normal = Vector(plane.normal[0], plane.normal[1], plane.normal[2]);
+		m_planes[i].dist = plane.dist;
+		m_planes[i].type = plane.type;
+	}
+
+	// Like the engine, the point hull is made from the render nodes with the leaf contents as the children.
+	// Children always have a higher index than their parent in files written by the map compilers, nodes breaking
+	// this rule are rejected so a damaged file can't make the traces loop forever.
+	m_pointnodes.resize(static_cast<size_t>(numnodes));
+
+	for (int i = 0; i < numnodes; i++)
+	{
+		dnode_t node;
+		std::memcpy(&node, &nodes[i], sizeof(dnode_t));
+
+		if (node.planenum < 0 || node.planenum >= numplanes)
+		{
+			error = "invalid node plane";
+			return false;
+		}
+
+		m_pointnodes[i].plane = node.planenum;
+
+		for (int side = 0; side < 2; side++)
+		{
+			const int child = node.children[side];
+
+			if (child >= 0)
+			{
+				if (child <= i || child >= numnodes)
+				{
+					error = "invalid node child";
+					return false;
+				}
+
+				m_pointnodes[i].children[side] = child;
+			}
+			else
+			{
+				const int leaf = -1 - child;
+
+				if (leaf >= numleafs)
+				{
+					error = "invalid node leaf";
+					return false;
+				}
+
+				dleaf_t leafdata;
+				std::memcpy(&leafdata, &leafs[leaf], sizeof(dleaf_t));
+				m_pointnodes[i].children[side] = leafdata.contents < 0 ? leafdata.contents : CONTENTS_EMPTY;
+			}
+		}
+	}
+
+	m_clipnodes.resize(static_cast<size_t>(numclipnodes));
+
+	for (int i = 0; i < numclipnodes; i++)
+	{
+		dclipnode_t node;
+		std::memcpy(&node, &clipnodes[i], sizeof(dclipnode_t));
+
+		if (node.planenum < 0 || node.planenum >= numplanes)
+		{
+			error = "invalid clip node plane";
+			return false;
+		}
+
+		m_clipnodes[i].plane = node.planenum;
+
+		for (int side = 0; side < 2; side++)
+		{
+			const int child = node.children[side];
+
+			if (child >= 0 && (child <= i || child >= numclipnodes))
+			{
+				error = "invalid clip node child";
+				return false;
+			}
+
+			m_clipnodes[i].children[side] = child;
+		}
+	}
+
+	dmodel_t world;
+	std::memcpy(&world, &models[0], sizeof(dmodel_t));
+	m_mins = Vector(world.mins[0], world.mins[1], world.mins[2]);
+	m_maxs = Vector(world.maxs[0], world.maxs[1], world.maxs[2]);
+
+	for (int hull = 0; hull < BSPCollision::MAX_HULLS; hull++)
+	{
+		const int count = hull == 0 ? numnodes : numclipnodes;
+		const int headnode = world.headnode[hull];
+
+		// Hulls missing from the map don't collide with anything
+		m_headnodes[hull] = headnode >= 0 && headnode < count ? headnode : -1;
+	}
+
+	m_entities.assign(entities, strnlen(entities, static_cast<size_t>(entitieslength)));
+	return true;
+}
+
+bool CBSPCollision::LoadFromFile(const std::string& filename, std::string& error)
+{
+	std::fstream file;
+	file.open(filename, std::fstream::in | std::fstream::binary);
+
+	if (!file.is_open())
+	{
+		error = "failed to open " + filename;
+		return false;
+	}
+
+	file.seekg(0, std::fstream::end);
+	const std::streamoff size = file.tellg();
+	file.seekg(0, std::fstream::beg);
+
+	if (size <= 0)
+	{
+		error = "file is too small";
+		return false;
+	}
+
+	std::vector<unsigned char> data(static_cast<size_t>(size));
+	file.read(reinterpret_cast<char*>(data.data()), size);
+
+	if (!file.good())
+	{
+		error = "failed to read " + filename;
+		return false;
+	}
+
+	return Load(data.data(), data.size(), error);
+}
+
+std::shared_ptr<const CBSPCollision> CBSPCollision::LoadMap(const char* mapname)
+{
+	// The engine file system also finds maps inside pak files and the fallback game directories
+	std::string filename = "maps/";
+	filename.append(mapname);
+	filename.append(".bsp");
+
+	int length = 0;
+	byte* data = LOAD_FILE_FOR_ME(filename.c_str(), &length);
+
+	if (data == nullptr)
+	{
+		LOG_CONSOLE(PLID, "Map collision not loaded, failed to read \"%s\"!", filename.c_str());
+		return nullptr;
+	}
+
+	auto collision = std::make_shared<CBSPCollision>();
+	std::string error;
+	const bool result = collision->Load(data, static_cast<size_t>(length), error);
+	FREE_FILE(data);
+
+	if (!result)
+	{
+		LOG_CONSOLE(PLID, "Map collision not loaded, \"%s\": %s", filename.c_str(), error.c_str());
+		return nullptr;
+	}
+
+	return collision;
+}
+
+void CBSPCollision::TraceHull(const Vector& start, const Vector& end, const int hull, BSPTraceResult& result) const
+{
+	result.fraction = 1.0f;
+	result.endpos = end;
+	result.normal = Vector(0.0f, 0.0f, 0.0f);
+	result.planedist = 0.0f;
+	result.allsolid = true;
+	result.startsolid = false;
+	result.inopen = false;
+	result.inwater = false;
+
+	if (hull < 0 || hull >= BSPCollision::MAX_HULLS || m_headnodes[hull] < 0)
+	{
+		result.allsolid = false;
+		result.inopen = true;
+		return;
+	}
+
+	const std::vector<ClipNode>& nodes = GetHullNodes(hull);
+	RecursiveHullCheck(nodes, m_headnodes[hull], m_headnodes[hull], 0.0f, 1.0f, start, end, result);
+
+	if (result.allsolid)
+	{
+		result.startsolid = true;
+	}
+}
+
+int CBSPCollision::PointContents(const Vector& point, const int hull) const
+{
+	if (hull < 0 || hull >= BSPCollision::MAX_HULLS || m_headnodes[hull] < 0)
+		return CONTENTS_EMPTY;
+
+	return HullPointContents(GetHullNodes(hull), m_headnodes[hull], point);
+}
+
+int CBSPCollision::HullPointContents(const std::vector<ClipNode>& nodes, int num, const Vector& point) const
+{
+	while (num >= 0)
+	{
+		const ClipNode& node = nodes[num];
+		const Plane& plane = m_planes[node.plane];
+		const float distance = plane.type < 3 ? point[plane.type] - plane.dist : DotProduct(plane.normal, point) - plane.dist;
+		num = node.children[distance < 0.0f ? 1 : 0];
+	}
+
+	return num;
+}
+
+bool CBSPCollision::RecursiveHullCheck(const std::vector<ClipNode>& nodes, const int headnode, const int num, const float p1f, const float p2f, const Vector& p1, const Vector& p2, BSPTraceResult& trace) const
+{
+	// Reached a leaf
+	if (num < 0)
+	{
+		if (num != CONTENTS_SOLID)
+		{
+			trace.allsolid = false;
+
+			if (num == CONTENTS_EMPTY)
+			{
+				trace.inopen = true;
+			}
+			else
+			{
+				trace.inwater = true;
+			}
+		}
+		else
+		{
+			trace.startsolid = true;
+		}
+
+		return true; // Empty
+	}
+
+	const ClipNode& node = nodes[num];
+	const Plane& plane = m_planes[node.plane];
+	float t1;
+	float t2;
+
+	if (plane.type < 3)
+	{
+		t1 = p1[plane.type] - plane.dist;
+		t2 = p2[plane.type] - plane.dist;
+	}
+	else
+	{
+		t1 = DotProduct(plane.normal, p1) - plane.dist;
+		t2 = DotProduct(plane.normal, p2) - plane.dist;
+	}
+
+	if (t1 >= 0.0f && t2 >= 0.0f)
+		return RecursiveHullCheck(nodes, headnode, node.children[0], p1f, p2f, p1, p2, trace);
+
+	if (t1 < 0.0f && t2 < 0.0f)
+		return RecursiveHullCheck(nodes, headnode, node.children[1], p1f, p2f, p1, p2, trace);
+
+	// Put the crosspoint DIST_EPSILON units on the near side
+	float frac = t1 < 0.0f ? (t1 + BSPCollision::DIST_EPSILON) / (t1 - t2) : (t1 - BSPCollision::DIST_EPSILON) / (t1 - t2);
+	frac = frac < 0.0f ? 0.0f : (frac > 1.0f ? 1.0f : frac);
+
+	float midf = p1f + (p2f - p1f) * frac;
+	Vector mid = p1 + (p2 - p1) * frac;
+	const int side = t1 < 0.0f ? 1 : 0;
+
+	// Move up to the node
+	if (!RecursiveHullCheck(nodes, headnode, node.children[side], p1f, midf, p1, mid, trace))
+		return false;
+
+	// Go past the node
+	if (HullPointContents(nodes, node.children[side ^ 1], mid) != CONTENTS_SOLID)
+		return RecursiveHullCheck(nodes, headnode, node.children[side ^ 1], midf, p2f, mid, p2, trace);
+
+	// Never got out of the solid area
+	if (trace.allsolid)
+		return false;
+
+	// The other side of the node is solid, this is the impact point
+	if (side == 0)
+	{
+		trace.normal = plane.normal;
+		trace.planedist = plane.dist;
+	}
+	else
+	{
+		trace.normal = plane.normal * -1.0f;
+		trace.planedist = -plane.dist;
+	}
+
+	// Back up until the impact point is out of the solid, the epsilon can push it in on sharp corners
+	while (HullPointContents(nodes, headnode, mid) == CONTENTS_SOLID)
+	{
+		frac -= 0.1f;
+
+		if (frac < 0.0f)
+		{
+			trace.fraction = midf;
+			trace.endpos = mid;
+			return false;
+		}
+
+		midf = p1f + (p2f - p1f) * frac;
+		mid = p1 + (p2 - p1) * frac;
+	}
+
+	trace.fraction = midf;
+	trace.endpos = mid;
+	return false;
+}
+
+bool CBSPCollision::ValidateTrace(const Vector& start, const Vector& end, const int hull, edict_t* ignore) const
+{
+	TraceResult tr;
+	BSPTraceResult result;
+
+	if (hull == 0)
+	{
+		TRACE_LINE(start, end, 1, ignore, &tr); // ignore monsters
+	}
+	else
+	{
+		TRACE_HULL(start, end, 1, hull, ignore, &tr);
+	}
+
+	TraceHull(start, end, hull, result);
+
+	const bool hitworld = tr.pHit == nullptr || ENTINDEX(tr.pHit) == 0;
+	const Vector engineend(tr.vecEndPos);
+	bool valid = (tr.fStartSolid != 0) == result.startsolid;
+
+	if (hitworld || tr.flFraction >= 1.0f)
+	{
+		valid = valid && (engineend - result.endpos).Length() <= BSP_VALIDATE_TOLERANCE;
+	}
+	else
+	{
+		// Brush entities aren't in the world hulls, the BSP trace may only go further
+		valid = valid && result.fraction + BSP_VALIDATE_TOLERANCE / std::max((end - start).Length(), 1.0f) >= tr.flFraction;
+	}
+
+	if (!valid)
+	{
+		LOG_CONSOLE(PLID, "BSP trace mismatch, hull %i <%3.2f, %3.2f, %3.2f> to <%3.2f, %3.2f, %3.2f>\n Engine: fraction %.4f startsolid %i entity %i\n BSP: fraction %.4f startsolid %i",
+			hull, start.x, start.y, start.z, end.x, end.y, end.z, tr.flFraction, tr.fStartSolid, tr.pHit != nullptr ? ENTINDEX(tr.pHit) : 0,
+			result.fraction, result.startsolid ? 1 : 0);
+	}
+
+	return valid;
+}
@@ -0,0 +1,118 @@
+#ifndef SDK_BSP_COLLISION_H_
+#define SDK_BSP_COLLISION_H_
+
+#include <extdll.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace BSPCollision
+{
+	constexpr int MAX_HULLS = 4; // Point, human, large and head hulls, same numbers as the engine TRACE_HULL
+	constexpr float DIST_EPSILON = 0.03125f; // Impact points are pushed this far from the plane, same as the engine
+}
+
+/**
+ * @brief Result of a BSP trace, same meaning as the engine TraceResult fields
+*/
+struct BSPTraceResult
+{
+	float fraction; // 1 if nothing was hit
+	Vector endpos;
+	Vector normal; // Normal of the hit plane
+	float planedist;
+	bool allsolid; // The whole trace was in solid
+	bool startsolid; // The trace started in solid
+	bool inopen;
+	bool inwater;
+};
+
+/**
+ * @brief Collision hulls of the world model read from a map BSP file.
+ *
+ * Ports the engine hull traces so they can run without the engine. The data is never modified after loading,
+ * every method is const and keeps its state on the stack, so traces can run from any number of threads at the same time.
+ * Only the world is traced, brush entities (doors, func_wall, etc.) are ignored.
+*/
+class CBSPCollision
+{
+public:
+	CBSPCollision();
+
+	/**
+	 * @brief Reads the collision hulls from a BSP file in memory
+	 * @param data BSP file contents
+	 * @param size BSP file size in bytes
+	 * @param error Stores the reason the file couldn't be read
+	 * @return true if the hulls were read
+	*/
+	bool Load(const unsigned char* data, const size_t size, std::string& error);
+	// Reads the collision hulls from a BSP file on the disk, for tools running without the engine
+	bool LoadFromFile(const std::string& filename, std::string& error);
+	/**
+	 * @brief Reads the collision of the given map with the engine file system, main thread only
+	 * @param mapname Map name without extension
+	 * @return Map collision or nullptr if the BSP couldn't be read
+	*/
+	static std::shared_ptr<const CBSPCollision> LoadMap(const char* mapname);
+
+	/**
+	 * @brief Traces a hull through the world
+	 * @param start Trace start, the hull origin for hulls other than the point hull
+	 * @param end Trace end
+	 * @param hull Hull number, 0 for lines
+	 * @param result Trace result
+	*/
+	void TraceHull(const Vector& start, const Vector& end, const int hull, BSPTraceResult& result) const;
+	void TraceLine(const Vector& start, const Vector& end, BSPTraceResult& result) const { TraceHull(start, end, 0, result); }
+	// Contents of the world at the given point, engine CONTENTS_ values
+	int PointContents(const Vector& point, const int hull = 0) const;
+
+	/**
+	 * @brief Compares a trace against the engine trace, logs differences. Main thread only, used to validate the port
+	 * @param start Trace start
+	 * @param end Trace end
+	 * @param hull Hull number
+	 * @param ignore Entity ignored by the engine trace
+	 * @return true if both traces agree
+	*/
+	bool ValidateTrace(const Vector& start, const Vector& end, const int hull, edict_t* ignore) const;
+
+	const Vector& GetWorldMins() const { return m_mins; }
+	const Vector& GetWorldMaxs() const { return m_maxs; }
+	// Entity lump text
+	const std::string& GetEntities() const { return m_entities; }
+
+private:
+	struct Plane
+	{
+		Vector normal;
+		float dist;
+		int type; // 0 to 2 for planes along the X, Y and Z axes
+	};
+
+	struct ClipNode
+	{
+		int plane;
+		int children[2]; // Node index, contents if negative
+	};
+
+	const std::vector<ClipNode>& GetHullNodes(const int hull) const { return hull == 0 ? m_pointnodes : m_clipnodes; }
+	int HullPointContents(const std::vector<ClipNode>& nodes, int num, const Vector& point) const;
+	bool RecursiveHullCheck(const std::vector<ClipNode>& nodes, const int headnode, const int num, const float p1f, const float p2f, const Vector& p1, const Vector& p2, BSPTraceResult& trace) const;
+
+	std::vector<Plane> m_planes;
+	std::vector<ClipNode> m_pointnodes; // Point hull built from the BSP nodes and leafs
+	std::vector<ClipNode> m_clipnodes; // Clip nodes shared by the other hulls
+	int m_headnodes[BSPCollision::MAX_HULLS];
+	Vector m_mins;
+	Vector m_maxs;
+	std::string m_entities;
+};
+
+// Collision of the current map, nullptr if the BSP couldn't be read. Replaced on the main thread, copy the pointer to use it from other threads
+extern std::shared_ptr<const CBSPCollision> TheMapCollision;
+
+#endif // !SDK_BSP_COLLISION_H_
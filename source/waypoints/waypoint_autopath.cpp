@@ -0,0 +1,315 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+#include "sdk/bsp_collision.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_autopath.h"
+
+// Pairs taken by a worker thread at once
+constexpr size_t AUTOPATH_BATCH_SIZE = 256;
+// Engine traces per frame when the map collision isn't loaded
+constexpr size_t AUTOPATH_ENGINE_TRACES_PER_FRAME = 256;
+constexpr int AUTOPATH_MAX_THREADS = 8;
+// Seconds between progress reports to the editor
+constexpr float AUTOPATH_REPORT_INTERVAL = 1.0f;
+// Waypoints with a larger height difference aren't connected, same as CWaypoint::AutoPathTo
+constexpr float AUTOPATH_MAX_HEIGHT_DIFF = 18.0f;
+
+CAutoPathBuilder::CAutoPathBuilder() :
+	m_candidates(),
+	m_results(),
+	m_collision(),
+	m_threads(),
+	m_next(0),
+	m_done(0),
+	m_cancel(false)
+{
+	m_nextreport = 0.0f;
+	m_running = false;
+	m_checking = false;
+}
+
+CAutoPathBuilder::~CAutoPathBuilder()
+{
+	StopWorkers();
+}
+
+bool CAutoPathBuilder::Start(const float radius)
+{
+	if (m_running)
+		return false;
+
+	m_candidates.clear();
+
+	auto& waypoints = TheWaypoints->GetTheWaypoints();
+	std::vector<CWaypoint*> nearby;
+
+	for (auto waypoint : waypoints)
+	{
+		nearby.clear();
+		TheWaypoints->CollectWaypointsInRadius(waypoint->GetPosition(), radius * radius, nearby);
+
+		for (auto other : nearby)
+		{
+			// Each pair is traced once, the trace is the same in both directions
+			if (other->GetID() <= waypoint->GetID() || fabsf(waypoint->GetZ() - other->GetZ()) >= AUTOPATH_MAX_HEIGHT_DIFF)
+				continue;
+
+			AutoPathCandidate candidate;
+			candidate.from = waypoint->GetID();
+			candidate.to = other->GetID();
+			candidate.fromgeneration = TheWaypoints->GetWaypointGeneration(candidate.from);
+			candidate.togeneration = TheWaypoints->GetWaypointGeneration(candidate.to);
+			candidate.start = waypoint->GetPosition();
+			candidate.end = other->GetPosition();
+			m_candidates.push_back(candidate);
+		}
+	}
+
+	m_results.assign(m_candidates.size(), 0);
+	m_next = 0;
+	m_done = 0;
+	m_cancel = false;
+	m_nextreport = gpGlobals->time + AUTOPATH_REPORT_INTERVAL;
+	m_collision = TheMapCollision;
+	m_running = true;
+	m_checking = false;
+
+	if (m_collision != nullptr)
+	{
+		const int count = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, AUTOPATH_MAX_THREADS);
+
+		for (int i = 0; i < count; i++)
+		{
+			m_threads.emplace_back(&CAutoPathBuilder::WorkerMain, this);
+		}
+	}
+
+	LOG_CONSOLE(PLID, "Rebuilding waypoint paths, %i pairs to test with %s.", static_cast<int>(m_candidates.size()),
+		m_collision != nullptr ? "map collision traces" : "engine traces");
+	return true;
+}
+
+void CAutoPathBuilder::Update()
+{
+	if (!m_running)
+		return;
+
+	if (m_checking)
+	{
+		if (RunEngineChecks())
+		{
+			Apply();
+		}
+		else if (gpGlobals->time >= m_nextreport)
+		{
+			m_nextreport = gpGlobals->time + AUTOPATH_REPORT_INTERVAL;
+			char message[64];
+			snprintf(message, sizeof(message), "Checking paths against brush entities... %i%% \n",
+				static_cast<int>(static_cast<float>(m_next.load()) / static_cast<float>(m_candidates.size()) * 100.0f));
+			Report(message);
+		}
+
+		return;
+	}
+
+	if (m_collision == nullptr)
+	{
+		RunEngineTraces();
+	}
+
+	if (m_done.load(std::memory_order_acquire) < m_candidates.size())
+	{
+		if (gpGlobals->time >= m_nextreport)
+		{
+			m_nextreport = gpGlobals->time + AUTOPATH_REPORT_INTERVAL;
+			char message[64];
+			snprintf(message, sizeof(message), "Rebuilding paths... %i%% \n", static_cast<int>(GetProgress() * 100.0f));
+			Report(message);
+		}
+
+		return;
+	}
+
+	const bool worldonly = m_collision != nullptr;
+	StopWorkers();
+
+	if (worldonly)
+	{
+		// The map collision doesn't see brush entities, the clear pairs are checked with engine traces first
+		m_next = 0;
+		m_checking = true;
+		return;
+	}
+
+	Apply();
+}
+
+void CAutoPathBuilder::Cancel()
+{
+	if (!m_running)
+		return;
+
+	StopWorkers();
+	m_candidates.clear();
+	m_results.clear();
+	m_running = false;
+	m_checking = false;
+}
+
+float CAutoPathBuilder::GetProgress() const
+{
+	if (m_candidates.empty())
+		return 1.0f;
+
+	return static_cast<float>(m_done.load(std::memory_order_relaxed)) / static_cast<float>(m_candidates.size());
+}
+
+void CAutoPathBuilder::WorkerMain()
+{
+	const size_t count = m_candidates.size();
+	BSPTraceResult result;
+
+	while (!m_cancel.load(std::memory_order_relaxed))
+	{
+		const size_t first = m_next.fetch_add(AUTOPATH_BATCH_SIZE);
+
+		if (first >= count)
+			break;
+
+		const size_t last = std::min(first + AUTOPATH_BATCH_SIZE, count);
+
+		for (size_t i = first; i < last; i++)
+		{
+			m_collision->TraceLine(m_candidates[i].start, m_candidates[i].end, result);
+			m_results[i] = result.fraction >= 1.0f && !result.startsolid ? 1 : 0;
+		}
+
+		m_done.fetch_add(last - first, std::memory_order_release);
+	}
+}
+
+void CAutoPathBuilder::RunEngineTraces()
+{
+	const size_t first = m_next.load(std::memory_order_relaxed);
+	const size_t last = std::min(first + AUTOPATH_ENGINE_TRACES_PER_FRAME, m_candidates.size());
+	TraceResult tr;
+
+	for (size_t i = first; i < last; i++)
+	{
+		UTIL_TraceLine(m_candidates[i].start, m_candidates[i].end, ignore_monsters, dont_ignore_glass, TheWaypoints->GetEditor(), &tr);
+		m_results[i] = tr.flFraction >= 1.0f ? 1 : 0;
+	}
+
+	m_next.store(last, std::memory_order_relaxed);
+	m_done.store(last, std::memory_order_release);
+}
+
+bool CAutoPathBuilder::RunEngineChecks()
+{
+	size_t index = m_next.load(std::memory_order_relaxed);
+	size_t traces = 0;
+	TraceResult tr;
+
+	// Pairs blocked by the world stay blocked, only the clear ones use the frame budget
+	for (; index < m_candidates.size() && traces < AUTOPATH_ENGINE_TRACES_PER_FRAME; index++)
+	{
+		if (m_results[index] == 0)
+			continue;
+
+		UTIL_TraceLine(m_candidates[index].start, m_candidates[index].end, ignore_monsters, dont_ignore_glass, TheWaypoints->GetEditor(), &tr);
+		m_results[index] = tr.flFraction >= 1.0f ? 1 : 0;
+		traces++;
+	}
+
+	m_next.store(index, std::memory_order_relaxed);
+	return index >= m_candidates.size();
+}
+
+void CAutoPathBuilder::Apply()
+{
+	int added = 0;
+	int removed = 0;
+
+	for (size_t i = 0; i < m_candidates.size(); i++)
+	{
+		const AutoPathCandidate& candidate = m_candidates[i];
+		CWaypoint* from = TheWaypoints->GetWaypointOfID(candidate.from, candidate.fromgeneration);
+		CWaypoint* to = TheWaypoints->GetWaypointOfID(candidate.to, candidate.togeneration);
+
+		// Deleted while the traces were running
+		if (from == nullptr || to == nullptr)
+			continue;
+
+		if (m_results[i] != 0)
+		{
+			for (int direction = 0; direction < 2; direction++)
+			{
+				CWaypoint* start = direction == 0 ? from : to;
+				CWaypoint* end = direction == 0 ? to : from;
+
+				if (!start->HasPathTo(end) && start->AddPathTo(end))
+				{
+					added++;
+				}
+			}
+		}
+		else
+		{
+			for (int direction = 0; direction < 2; direction++)
+			{
+				CWaypoint* start = direction == 0 ? from : to;
+				CWaypoint* end = direction == 0 ? to : from;
+
+				if (start->GetPathTypeTo(end) == WaypointPath::PATH_NORMAL && start->DeletePathTo(end))
+				{
+					removed++;
+				}
+			}
+		}
+	}
+
+	LOG_CONSOLE(PLID, "Waypoint paths rebuilt, %i added and %i removed.", added, removed);
+
+	char message[96];
+	snprintf(message, sizeof(message), "Paths rebuilt! %i added, %i removed. \n", added, removed);
+	Report(message);
+
+	m_candidates.clear();
+	m_results.clear();
+	m_running = false;
+	m_checking = false;
+}
+
+void CAutoPathBuilder::StopWorkers()
+{
+	m_cancel = true;
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+
+	m_threads.clear();
+	m_collision.reset();
+}
+
+void CAutoPathBuilder::Report(const char* message)
+{
+	edict_t* editor = TheWaypoints->GetEditor();
+
+	if (editor != nullptr)
+	{
+		ClientPrint(VARS(editor), HUD_PRINTCONSOLE, message);
+	}
+}
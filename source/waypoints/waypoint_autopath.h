@@ -0,0 +1,76 @@
+#ifndef WAYPOINT_AUTOPATH_H_
+#define WAYPOINT_AUTOPATH_H_
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+
+class CBSPCollision;
+
+/**
+ * @brief Waypoint pair tested by the bulk path rebuild
+*/
+struct AutoPathCandidate
+{
+	int from;
+	int to;
+	unsigned int fromgeneration;
+	unsigned int togeneration;
+	Vector start;
+	Vector end;
+};
+
+/**
+ * @brief Rebuilds the automatic paths of every waypoint.
+ *
+ * Candidate pairs are gathered with the spatial index when the rebuild starts. The traces run on worker threads
+ * when the map collision is loaded, otherwise engine traces are spread over several frames. The map collision only has
+ * the world hull, so pairs it finds clear are traced again with the engine over several frames, brush entities block
+ * them like they block CWaypoint::AutoPathTo. The results are applied
+ * in a single frame once every pair was tested: clear pairs get paths in both directions and normal paths between
+ * blocked pairs are removed. Paths of other types and paths between waypoints out of the radius are kept.
+*/
+class CAutoPathBuilder
+{
+public:
+	CAutoPathBuilder();
+	~CAutoPathBuilder();
+
+	/**
+	 * @brief Starts a rebuild of all waypoints
+	 * @param radius Maximum distance between connected waypoints
+	 * @return false if a rebuild is already running
+	*/
+	bool Start(const float radius);
+	// Called every frame, applies the results when the traces are done
+	void Update();
+	// Stops the rebuild without changing any path
+	void Cancel();
+	bool IsRunning() const { return m_running; }
+	// Fraction of the pairs tested
+	float GetProgress() const;
+
+private:
+	void WorkerMain();
+	// Runs engine traces on the main thread when there is no map collision
+	void RunEngineTraces();
+	// Traces the pairs found clear by the map collision again with the engine, returns true once every pair was checked
+	bool RunEngineChecks();
+	void Apply();
+	void StopWorkers();
+	void Report(const char* message);
+
+	std::vector<AutoPathCandidate> m_candidates;
+	std::vector<unsigned char> m_results; // 1 if the pair at the same index is clear
+	std::shared_ptr<const CBSPCollision> m_collision; // nullptr when using engine traces
+	std::vector<std::thread> m_threads;
+	std::atomic<size_t> m_next; // Next pair to test
+	std::atomic<size_t> m_done; // Number of pairs tested
+	std::atomic<bool> m_cancel;
+	float m_nextreport;
+	bool m_running;
+	bool m_checking; // Map collision traces are done, checking the clear pairs against brush entities
+};
+
+#endif // !WAYPOINT_AUTOPATH_H_
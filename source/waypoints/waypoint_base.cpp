@@ -8,6 +8,7 @@
 
 #include <fstream>
 #include <filesystem>
+#include <algorithm>
 
 #include "manager.h"
 #include "mods/mod_base.h"
@@ -15,6 +16,8 @@
 #include "interfaces/player.h"
 #include "interfaces/pluginbot.h"
 #include "bots/basebot.h"
+#include "plugincvars.h"
+#include "sdk/bsp_collision.h"
 #include "waypoint_manager.h"
 #include "waypoint_base.h"
 
@@ -24,6 +27,7 @@ static Color s_jumpcolor(255, 0, 0, 220); // Jump path color
 static Color s_gapcolor(202, 21, 123, 220); // Gap jump path color
 static Color s_anglepathcolor(255, 165, 0, 220); // Ramp/Stairs path color
 static Color s_ladderpathcolor(127, 0, 127, 220);
+static Color s_droppathcolor(0, 160, 255, 220); // Drop path color
 
 // Same as MESSAGE_BEGIN but doesn't cause duplication errors
 static void startMessage(int dest, int type, const float* origin, edict_t* ed)
@@ -31,17 +35,11 @@ static void startMessage(int dest, int type, const float* origin, edict_t* ed)
 	g_engfuncs.pfnMessageBegin(dest, type, origin, ed);
 }
 
-CWaypoint::CWaypoint() : m_position()
+CWaypoint::CWaypoint() : m_position(),
+	m_paths()
 {
 	m_id = -1;
 	m_yaw = 0.0f;
-
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
-	{
-		m_paths[i] = WaypointConst::InvalidPathConnection;
-		m_pathstype[i] = WaypointPath::PATH_NORMAL; // default to normal
-		m_connections[i] = nullptr;
-	}
 }
 
 CWaypoint::~CWaypoint()
@@ -55,32 +53,60 @@ void CWaypoint::Init(const int id, const Vector& position, const float yaw)
 	m_yaw = yaw;
 }
 
-void CWaypoint::Save(std::fstream& file, const int version)
-{
-	file.write(reinterpret_cast<char*>(&m_id), sizeof(int));
-	file.write(reinterpret_cast<char*>(&m_position), sizeof(Vector));
-	file.write(reinterpret_cast<char*>(&m_yaw), sizeof(float));
-	file.write(reinterpret_cast<char*>(&m_paths), static_cast<std::streamsize>(WaypointConst::MaxPaths) * sizeof(int));
-	file.write(reinterpret_cast<char*>(&m_pathstype), static_cast<std::streamsize>(WaypointConst::MaxPaths) * sizeof(int));
-}
-
 bool CWaypoint::Load(std::fstream& file, const int version)
 {
+	int paths[WaypointConst::MaxPaths];
+	int pathstype[WaypointConst::MaxPaths];
+
 	file.read(reinterpret_cast<char*>(&m_id), sizeof(int));
 	file.read(reinterpret_cast<char*>(&m_position), sizeof(Vector));
 	file.read(reinterpret_cast<char*>(&m_yaw), sizeof(float));
-	file.read(reinterpret_cast<char*>(&m_paths), static_cast<std::streamsize>(WaypointConst::MaxPaths) * sizeof(int));
-	file.read(reinterpret_cast<char*>(&m_pathstype), static_cast<std::streamsize>(WaypointConst::MaxPaths) * sizeof(int));
+	file.read(reinterpret_cast<char*>(paths), static_cast<std::streamsize>(WaypointConst::MaxPaths) * sizeof(int));
+	file.read(reinterpret_cast<char*>(pathstype), static_cast<std::streamsize>(WaypointConst::MaxPaths) * sizeof(int));
 
 	if (file.good() == false)
 	{
-		LOG_CONSOLE(PLID, "Failed to load waypoint data from file!");
 		return false;
 	}
 
+	m_paths.clear();
+
+	for (int i = 0; i < WaypointConst::MaxPaths; i++)
+	{
+		if (paths[i] == WaypointConst::InvalidPathConnection)
+			continue;
+
+		WaypointPath::PathType type = WaypointPath::PATH_NORMAL;
+
+		if (pathstype[i] > WaypointPath::PATH_NORMAL && pathstype[i] < WaypointPath::MAX_PATH_TYPES)
+		{
+			type = static_cast<WaypointPath::PathType>(pathstype[i]);
+		}
+
+		m_paths.push_back(WaypointConnection{ paths[i], type, nullptr });
+	}
+
 	return true;
 }
 
+void CWaypoint::LoadPaths(const int* targets, const unsigned char* types, const int count)
+{
+	m_paths.clear();
+	m_paths.reserve(count);
+
+	for (int i = 0; i < count; i++)
+	{
+		WaypointPath::PathType type = WaypointPath::PATH_NORMAL;
+
+		if (types[i] < WaypointPath::MAX_PATH_TYPES)
+		{
+			type = static_cast<WaypointPath::PathType>(types[i]);
+		}
+
+		m_paths.push_back(WaypointConnection{ targets[i], type, nullptr });
+	}
+}
+
 void CWaypoint::Draw()
 {
 	InternalDraw(s_normalcolor);
@@ -88,16 +114,14 @@ void CWaypoint::Draw()
 
 void CWaypoint::DrawPath()
 {
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
+	for (auto& path : m_paths)
 	{
-		if (m_paths[i] != WaypointConst::InvalidPathConnection)
+		if (path.waypoint != nullptr)
 		{
-			CWaypoint* other = TheWaypoints->GetWaypointOfID(m_paths[i]);
-
 			Vector start = GetCenter();
-			Vector end = other->GetCenter();
+			Vector end = path.waypoint->GetCenter();
 
-			switch (m_pathstype[i])
+			switch (path.type)
 			{
 			case WaypointPath::PATH_JUMP:
 				InternalDraw(s_jumpcolor, start, end);
@@ -111,6 +135,9 @@ void CWaypoint::DrawPath()
 			case WaypointPath::PATH_LADDER:
 				InternalDraw(s_ladderpathcolor, start, end);
 				break;
+			case WaypointPath::PATH_DROP:
+				InternalDraw(s_droppathcolor, start, end);
+				break;
 			case WaypointPath::PATH_NORMAL:
 			default:
 				InternalDraw(s_pathcolor, start, end);
@@ -122,23 +149,20 @@ void CWaypoint::DrawPath()
 
 void CWaypoint::PostAllWaypointsLoaded()
 {
-	for (int p = 0; p < WaypointConst::MaxPaths; p++)
+	for (auto& path : m_paths)
 	{
-		m_connections[p] = TheWaypoints->GetWaypointOfID(m_paths[p]);
+		path.waypoint = TheWaypoints->GetWaypointOfID(path.id);
 	}
+
+	// Drop connections to waypoints that doesn't exists
+	auto end = std::remove_if(m_paths.begin(), m_paths.end(), [](const WaypointConnection& path) { return path.waypoint == nullptr; });
+	m_paths.erase(end, m_paths.end());
 }
 
 void CWaypoint::NotifyWaypointDeletion(const int id)
 {
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
-	{
-		if (m_paths[i] == id)
-		{
-			m_paths[i] = WaypointConst::InvalidPathConnection;
-			m_pathstype[i] = WaypointPath::PATH_NORMAL;
-			m_connections[i] = nullptr;
-		}
-	}
+	auto end = std::remove_if(m_paths.begin(), m_paths.end(), [id](const WaypointConnection& path) { return path.id == id; });
+	m_paths.erase(end, m_paths.end());
 }
 
 void CWaypoint::PrintWaypointInfo(IPlayer* player)
@@ -148,16 +172,7 @@ void CWaypoint::PrintWaypointInfo(IPlayer* player)
 	sprintf(buffer, "Waypoint #%i at <%3.2f, %3.2f, %3.2f> (%3.2f) \n", m_id, m_position[0], m_position[1], m_position[2], m_yaw);
 	ClientPrint(vars, HUD_PRINTCONSOLE, buffer);
 
-	int counter = 0;
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
-	{
-		if (m_paths[i] != WaypointConst::InvalidPathConnection)
-		{
-			counter++;
-		}
-	}
-
-	sprintf(buffer, "Waypoint is connected to %i other waypoints.", counter);
+	sprintf(buffer, "Waypoint is connected to %i other waypoints.", GetPathCount());
 	ClientPrint(vars, HUD_PRINTCONSOLE, buffer);
 }
 
@@ -166,22 +181,13 @@ bool CWaypoint::AddPathTo(CWaypoint* other)
 	if (other == this)
 		return false;
 
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
-	{
-		if (m_paths[i] == other->GetID())
-		{
-			return true; // path already exists
-		}
-		else if (m_paths[i] == WaypointConst::InvalidPathConnection)
-		{
-			m_paths[i] = other->GetID();
-			m_pathstype[i] = WaypointPath::PATH_NORMAL;
-			m_connections[i] = other;
-			return true;
-		}
-	}
+	if (HasPathTo(other))
+		return true; // path already exists
 
-	return false;
+	m_paths.push_back(WaypointConnection{ other->GetID(), WaypointPath::PATH_NORMAL, other });
+	TheWaypoints->GetJournal().AppendPath(WaypointJournal::RECORD_ADDPATH, GetID(), other->GetID(), WaypointPath::PATH_NORMAL);
+	TheWaypoints->OnGraphModified(GetID(), other->GetID());
+	return true;
 }
 
 bool CWaypoint::SetPathTypeTo(CWaypoint* other, WaypointPath::PathType type)
@@ -189,11 +195,13 @@ bool CWaypoint::SetPathTypeTo(CWaypoint* other, WaypointPath::PathType type)
 	if (other == this)
 		return false;
 
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
+	for (auto& path : m_paths)
 	{
-		if (m_paths[i] == other->GetID())
+		if (path.id == other->GetID())
 		{
-			m_pathstype[i] = type;
+			path.type = type;
+			TheWaypoints->GetJournal().AppendPath(WaypointJournal::RECORD_SETPATHTYPE, GetID(), other->GetID(), type);
+			TheWaypoints->OnGraphModified(GetID(), other->GetID());
 			return true;
 		}
 	}
@@ -206,14 +214,14 @@ bool CWaypoint::DeletePathTo(CWaypoint* other)
 	if (other == this)
 		return false;
 
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
+	const int id = other->GetID();
+	auto end = std::remove_if(m_paths.begin(), m_paths.end(), [id](const WaypointConnection& path) { return path.id == id; });
+
+	if (end != m_paths.end())
 	{
-		if (m_paths[i] == other->GetID())
-		{
-			m_paths[i] = WaypointConst::InvalidPathConnection;
-			m_pathstype[i] = WaypointPath::PATH_NORMAL;
-			m_connections[i] = nullptr;
-		}
+		m_paths.erase(end, m_paths.end());
+		TheWaypoints->GetJournal().AppendPath(WaypointJournal::RECORD_DELETEPATH, GetID(), id, WaypointPath::PATH_NORMAL);
+		TheWaypoints->OnGraphModified(GetID(), id);
 	}
 
 	return true;
@@ -236,6 +244,11 @@ void CWaypoint::AutoPathTo(CWaypoint* other)
 	
 	UTIL_TraceLine(start, end, ignore_monsters, dont_ignore_glass, TheWaypoints->GetEditor(), &tr);
 
+	if (gb_debug_enabled.value > 0.0f && TheMapCollision != nullptr)
+	{
+		TheMapCollision->ValidateTrace(start, end, 0, TheWaypoints->GetEditor());
+	}
+
 	if (tr.flFraction == 1.0f) // no obstruction between both waypoint origins
 	{
 		AddPathTo(other);
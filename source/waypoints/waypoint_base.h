@@ -4,6 +4,7 @@
 #include "sdk/math_vectors.h"
 #include "sdk/color.h"
 #include <cstring>
+#include <vector>
 
 class IPlayer;
 class CPluginPlayer;
@@ -13,9 +14,13 @@ namespace WaypointConst
 	constexpr float WaypointHeight = 72.0f;
 	constexpr float WaypointCenter = 72.0f / 2.0f;
 	constexpr float WaypointDrawDistance = 512.0f * 512.0f; // Squared distance for waypoint drawing
-	constexpr int MaxPaths = 64;
+	constexpr int MaxPaths = 64; // Number of path slots per waypoint in the version 0 file format
 	constexpr int InvalidPathConnection = -1;
 	constexpr float AuthPathDistance = 400.0f * 400.0f;
+	constexpr float SpatialCellSize = 256.0f; // Size of the spatial index grid cells
+	constexpr float ClusterSize = 1024.0f; // Horizontal size of the hierarchical path finding clusters
+	constexpr float ClusterHeight = 512.0f; // Vertical size of the hierarchical path finding clusters
+	constexpr size_t MaxGraphEditLog = 4096; // Number of graph edits remembered by the waypoint manager
 }
 
 namespace WaypointPath
@@ -27,6 +32,7 @@ namespace WaypointPath
 		PATH_GAPJUMP, // Requires jumping over a gap on the floor
 		PATH_RAMPSTAIRS, // Walk straigh for stairs and ramps
 		PATH_LADDER, // Ladder movement
+		PATH_DROP, // Walk off a ledge higher than a step, can't be used the other way
 
 		MAX_PATH_TYPES
 	};
@@ -61,6 +67,10 @@ namespace WaypointPath
 		{
 			return PATH_LADDER;
 		}
+		else if (strcmp(name, "drop") == 0)
+		{
+			return PATH_DROP;
+		}
 		else
 		{
 			return PATH_NORMAL;
@@ -81,6 +91,8 @@ namespace WaypointPath
 			return "RAMP/STAIRS";
 		case WaypointPath::PATH_LADDER:
 			return "LADDER";
+		case WaypointPath::PATH_DROP:
+			return "DROP";
 		case WaypointPath::MAX_PATH_TYPES:
 		default:
 			return "UNKNOWN";
@@ -88,6 +100,18 @@ namespace WaypointPath
 	}
 }
 
+class CWaypoint;
+
+/**
+ * @brief A path connection from a waypoint to another
+*/
+struct WaypointConnection
+{
+	int id; // ID of the connected waypoint
+	WaypointPath::PathType type; // Type of path
+	CWaypoint* waypoint; // Pointer to the connected waypoint
+};
+
 class CWaypoint
 {
 public:
@@ -101,11 +125,18 @@ public:
 
 	int GetID() const { return m_id; }
 
-	void Save(std::fstream& file, const int version);
+	// Reads a version 0 waypoint record
 	bool Load(std::fstream& file, const int version);
+	/**
+	 * @brief Sets the path connections from file arrays, connected waypoints are resolved by PostAllWaypointsLoaded
+	 * @param targets Connected waypoint IDs
+	 * @param types Path types
+	 * @param count Number of paths
+	*/
+	void LoadPaths(const int* targets, const unsigned char* types, const int count);
 
-	virtual void SaveCustom(std::fstream& file, const int subVersion) {}
-	virtual bool LoadCustom(std::fstream& file, const int subVersion) { return true; }
+	virtual void SaveCustom(std::iostream& file, const int subVersion) {}
+	virtual bool LoadCustom(std::iostream& file, const int subVersion) { return true; }
 
 	virtual void Draw();
 	virtual void DrawPath();
@@ -130,8 +161,11 @@ public:
 	Vector GetCenter();
 
 	float GetZ() const { return m_position.z; }
+	float GetYaw() const { return m_yaw; }
 
-	int* GetPaths() { return m_paths; }
+	// Number of path connections from this waypoint
+	int GetPathCount() const { return static_cast<int>(m_paths.size()); }
+	const WaypointConnection& GetPath(const int index) const { return m_paths[index]; }
 
 	// Returns true if this waypoint has a path connection to the other waypoint
 	bool HasPathTo(CWaypoint* other) const;
@@ -142,7 +176,7 @@ public:
 	
 	/**
 	 * @brief Gets a waypoint pointer at the given path index
-	 * @param index Path connection array index
+	 * @param index Path connection index
 	 * @return Waypoint pointer or nullptr if no connection at the given index
 	*/
 	CWaypoint* GetWaypointOfPath(const int index) const;
@@ -155,9 +189,7 @@ private:
 	int m_id; // waypoint ID
 	Vector m_position; // waypoint world position
 	float m_yaw; // waypoint direction (yaw)
-	int m_paths[WaypointConst::MaxPaths]; // Array of IDs of connected waypoints
-	int m_pathstype[WaypointConst::MaxPaths]; // Type of path
-	CWaypoint* m_connections[WaypointConst::MaxPaths]; // Pointers to connected waypoints
+	std::vector<WaypointConnection> m_paths; // Path connections to other waypoints
 };
 
 inline float CWaypoint::DistToSqr(const Vector& source) const
@@ -182,21 +214,14 @@ inline float CWaypoint::DistTo(const CWaypoint* other) const
 
 inline bool CWaypoint::HasPathTo(CWaypoint* other) const
 {
-	const int id = other->GetID();
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
-	{
-		if (m_paths[i] == id)
-			return true;
-	}
-
-	return false;
+	return HasPathTo(other->GetID());
 }
 
 inline bool CWaypoint::HasPathTo(const int id) const
 {
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
+	for (auto& path : m_paths)
 	{
-		if (m_paths[i] == id)
+		if (path.id == id)
 			return true;
 	}
 
@@ -205,22 +230,15 @@ inline bool CWaypoint::HasPathTo(const int id) const
 
 inline WaypointPath::PathType CWaypoint::GetPathTypeTo(CWaypoint* other) const
 {
-	const int id = other->GetID();
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
-	{
-		if (m_paths[i] == id)
-			return static_cast<WaypointPath::PathType>(m_pathstype[i]);
-	}
-
-	return WaypointPath::MAX_PATH_TYPES;
+	return GetPathTypeTo(other->GetID());
 }
 
 inline WaypointPath::PathType CWaypoint::GetPathTypeTo(const int id) const
 {
-	for (int i = 0; i < WaypointConst::MaxPaths; i++)
+	for (auto& path : m_paths)
 	{
-		if (m_paths[i] == id)
-			return static_cast<WaypointPath::PathType>(m_pathstype[i]);
+		if (path.id == id)
+			return path.type;
 	}
 
 	return WaypointPath::MAX_PATH_TYPES;
@@ -228,7 +246,10 @@ inline WaypointPath::PathType CWaypoint::GetPathTypeTo(const int id) const
 
 inline CWaypoint* CWaypoint::GetWaypointOfPath(const int index) const
 {
-	return m_connections[index];
+	if (index < 0 || index >= static_cast<int>(m_paths.size()))
+		return nullptr;
+
+	return m_paths[index].waypoint;
 }
 
 #endif // !WAYPOINT_BASE_H_
@@ -0,0 +1,69 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_chunk.h"
+
+CWaypointChunk::CWaypointChunk(const std::uint32_t tag)
+{
+	m_tag = tag;
+	m_loaded = false;
+	m_failed = false;
+}
+
+CWaypointChunk::~CWaypointChunk()
+{
+}
+
+bool CWaypointChunk::EnsureLoaded()
+{
+	if (m_loaded)
+		return true;
+
+	if (m_failed || TheWaypoints == nullptr || TheWaypoints->IsLoading())
+		return false;
+
+	const std::string* data = TheWaypoints->GetChunkData(m_tag);
+	bool result = false;
+
+	if (data != nullptr)
+	{
+		result = Read(reinterpret_cast<const unsigned char*>(data->data()), data->size());
+	}
+	else
+	{
+		result = Read(nullptr, 0);
+	}
+
+	if (!result)
+	{
+		// The original data is still saved back to the file
+		Clear();
+		m_failed = true;
+		const char name[5] = { static_cast<char>(m_tag & 0xFF), static_cast<char>((m_tag >> 8) & 0xFF), static_cast<char>((m_tag >> 16) & 0xFF), static_cast<char>(m_tag >> 24), 0 };
+		LOG_CONSOLE(PLID, "Failed to read waypoint data chunk \"%s\"!", name);
+		return false;
+	}
+
+	m_loaded = true;
+	return true;
+}
+
+void CWaypointChunk::Invalidate()
+{
+	if (m_loaded)
+	{
+		Clear();
+	}
+
+	m_loaded = false;
+	m_failed = false;
+}
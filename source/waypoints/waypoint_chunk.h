@@ -0,0 +1,54 @@
+#ifndef WAYPOINT_CHUNK_H_
+#define WAYPOINT_CHUNK_H_
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Mod data stored in its own tagged chunk of the waypoint file.
+ *
+ * Loading the waypoints only copies the chunk bytes, the chunk is parsed the first time its owner calls EnsureLoaded.
+ * Chunks without a registered owner and chunks that were never accessed are written back unchanged when saving,
+ * so mods only pay for the data they use.
+ * Register the chunk with the waypoint manager, unregister it before it's destroyed.
+*/
+class CWaypointChunk
+{
+public:
+	CWaypointChunk(const std::uint32_t tag);
+	virtual ~CWaypointChunk();
+
+	std::uint32_t GetTag() const { return m_tag; }
+
+	/**
+	 * @brief Parses the chunk if it wasn't parsed since the waypoints were loaded
+	 * @return false if the waypoints are still loading or the chunk data is invalid
+	*/
+	bool EnsureLoaded();
+	bool IsLoaded() const { return m_loaded; }
+	// Drops the parsed data, the chunk is parsed again on the next access
+	void Invalidate();
+
+protected:
+	/**
+	 * @brief Parses the chunk data
+	 * @param data Chunk data, nullptr if the waypoint file doesn't have the chunk
+	 * @param size Chunk size in bytes
+	 * @return false if the data is invalid
+	*/
+	virtual bool Read(const unsigned char* data, const size_t size) = 0;
+	// Serializes the chunk, only called for chunks that were parsed
+	virtual void Write(std::string& data) = 0;
+	// Releases the parsed data
+	virtual void Clear() = 0;
+
+private:
+	friend class CWaypointManager;
+
+	std::uint32_t m_tag; // WaypointFile::MakeChunkTag
+	bool m_loaded;
+	bool m_failed; // Invalid data isn't parsed again until the waypoints are reloaded
+};
+
+#endif // !WAYPOINT_CHUNK_H_
@@ -0,0 +1,923 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <queue>
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+#include "plugincvars.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_contraction.h"
+
+// Contraction hierarchy file header
+constexpr auto CONTRACTION_FILE_HEADER = "GBCONTRACT";
+constexpr int CONTRACTION_FILE_VERSION = 1;
+// The hierarchy is built after the waypoints stay unchanged for this many seconds
+constexpr float CONTRACTION_BUILD_DELAY = 5.0f;
+// Witness searches give up after settling this many nodes, a shortcut is added when they give up
+constexpr int CONTRACTION_WITNESS_LIMIT = 128;
+// Witness search limit when estimating priorities, missed witnesses only overestimate the shortcut count
+constexpr int CONTRACTION_PRIORITY_WITNESS_LIMIT = 24;
+
+CContractionManager* TheContractionHierarchy = nullptr;
+
+class CContractionFileHeader
+{
+public:
+	char header[11];
+	int version;
+	std::uint64_t graphhash;
+	int nodelimit;
+	int upedges;
+	int downedges;
+	int shortcuts;
+};
+
+namespace
+{
+	struct BuildEdge
+	{
+		int node; // Target of outgoing edges, source of incoming edges
+		float length;
+		int middle; // Contracted node of shortcuts, -1 for waypoint paths
+	};
+
+	/**
+	 * @brief Working graph of the contraction, nodes are removed as they're contracted
+	*/
+	class CContractionBuilder
+	{
+	public:
+		CContractionBuilder(const CWaypointGraph& graph);
+
+		// Contracts every node, the lists receive the edges of each node to higher ranked nodes
+		void Contract(std::vector<std::vector<BuildEdge>>& up, std::vector<std::vector<BuildEdge>>& down);
+
+	private:
+		// Adds an edge or shortens an existing one
+		void AddEdge(const int from, const int to, const float length, const int middle);
+		/**
+		 * @brief Finds the shortcuts needed to contract a node
+		 * @param node Node to contract
+		 * @param shortcuts If not nullptr, stores the shortcuts as (from, edge) pairs
+		 * @return Number of shortcuts needed
+		*/
+		int FindShortcuts(const int node, std::vector<std::pair<int, BuildEdge>>* shortcuts);
+		// Limited search for path lengths from the source that don't go through the ignored node, results are stored in m_distances
+		void WitnessSearch(const int source, const int ignored, const float maxlength, int targets, const int limit);
+		int GetPriority(const int node);
+		// Removes the edges of a contracted node from its neighbors
+		void RemoveNode(const int node);
+
+		int m_limit;
+		std::vector<std::vector<BuildEdge>> m_out;
+		std::vector<std::vector<BuildEdge>> m_in;
+		std::vector<bool> m_contracted;
+		std::vector<int> m_contractedneighbors;
+		// Witness search state
+		std::vector<float> m_distances;
+		std::vector<int> m_touched;
+		std::vector<std::pair<float, int>> m_queue;
+		std::vector<unsigned int> m_targets; // Witness search targets are marked with the current stamp
+		unsigned int m_targetstamp;
+	};
+
+	CContractionBuilder::CContractionBuilder(const CWaypointGraph& graph) :
+		m_out(graph.GetNodeLimit()),
+		m_in(graph.GetNodeLimit()),
+		m_contracted(graph.GetNodeLimit(), false),
+		m_contractedneighbors(graph.GetNodeLimit(), 0),
+		m_distances(graph.GetNodeLimit(), std::numeric_limits<float>::infinity()),
+		m_touched(),
+		m_queue(),
+		m_targets(graph.GetNodeLimit(), 0)
+	{
+		m_limit = graph.GetNodeLimit();
+		m_targetstamp = 0;
+
+		for (int id = 0; id < m_limit; id++)
+		{
+			if (!graph.IsValidNode(id))
+			{
+				m_contracted[id] = true;
+				continue;
+			}
+
+			for (int edge = graph.GetFirstEdge(id); edge < graph.GetLastEdge(id); edge++)
+			{
+				const int target = graph.GetEdgeTarget(edge);
+
+				if (target != id)
+				{
+					AddEdge(id, target, graph.GetEdgeLength(edge), -1);
+				}
+			}
+		}
+	}
+
+	void CContractionBuilder::Contract(std::vector<std::vector<BuildEdge>>& up, std::vector<std::vector<BuildEdge>>& down)
+	{
+		using QueueEntry = std::pair<int, int>;
+		std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+		std::vector<std::pair<int, BuildEdge>> shortcuts;
+
+		up.assign(m_limit, std::vector<BuildEdge>());
+		down.assign(m_limit, std::vector<BuildEdge>());
+
+		std::vector<int> priorities(m_limit, 0); // Latest priority of each node, older queue entries are skipped
+
+		for (int id = 0; id < m_limit; id++)
+		{
+			if (!m_contracted[id])
+			{
+				priorities[id] = GetPriority(id);
+				queue.emplace(priorities[id], id);
+			}
+		}
+
+		while (!queue.empty())
+		{
+			const int queuedpriority = queue.top().first;
+			const int node = queue.top().second;
+			queue.pop();
+
+			if (m_contracted[node] || priorities[node] != queuedpriority)
+				continue;
+
+			// Lazy update, priorities change as neighbors are contracted
+			const int priority = GetPriority(node);
+
+			if (!queue.empty() && priority > queue.top().first)
+			{
+				priorities[node] = priority;
+				queue.emplace(priority, node);
+				continue;
+			}
+
+			shortcuts.clear();
+			FindShortcuts(node, &shortcuts);
+
+			// Remaining edges lead to nodes contracted later, so higher in the hierarchy
+			for (auto& edge : m_out[node])
+			{
+				if (!m_contracted[edge.node])
+				{
+					up[node].push_back(edge);
+					m_contractedneighbors[edge.node]++;
+				}
+			}
+
+			for (auto& edge : m_in[node])
+			{
+				if (!m_contracted[edge.node])
+				{
+					down[node].push_back(edge);
+					m_contractedneighbors[edge.node]++;
+				}
+			}
+
+			m_contracted[node] = true;
+			RemoveNode(node);
+
+			for (auto& shortcut : shortcuts)
+			{
+				AddEdge(shortcut.first, shortcut.second.node, shortcut.second.length, shortcut.second.middle);
+			}
+
+			// Neighbor priorities changed the most
+			for (auto& edges : { &up[node], &down[node] })
+			{
+				for (auto& edge : *edges)
+				{
+					const int neighborpriority = GetPriority(edge.node);
+
+					if (neighborpriority != priorities[edge.node])
+					{
+						priorities[edge.node] = neighborpriority;
+						queue.emplace(neighborpriority, edge.node);
+					}
+				}
+			}
+		}
+	}
+
+	void CContractionBuilder::AddEdge(const int from, const int to, const float length, const int middle)
+	{
+		for (auto& edge : m_out[from])
+		{
+			if (edge.node == to)
+			{
+				if (length < edge.length)
+				{
+					edge.length = length;
+					edge.middle = middle;
+
+					for (auto& reverse : m_in[to])
+					{
+						if (reverse.node == from)
+						{
+							reverse.length = length;
+							reverse.middle = middle;
+							break;
+						}
+					}
+				}
+
+				return;
+			}
+		}
+
+		m_out[from].push_back({ to, length, middle });
+		m_in[to].push_back({ from, length, middle });
+	}
+
+	int CContractionBuilder::FindShortcuts(const int node, std::vector<std::pair<int, BuildEdge>>* shortcuts)
+	{
+		int count = 0;
+
+		for (auto& incoming : m_in[node])
+		{
+			if (m_contracted[incoming.node])
+				continue;
+
+			float maxlength = 0.0f;
+			int targets = 0;
+			m_targetstamp++;
+
+			for (auto& outgoing : m_out[node])
+			{
+				if (!m_contracted[outgoing.node] && outgoing.node != incoming.node)
+				{
+					maxlength = std::max(maxlength, incoming.length + outgoing.length);
+					m_targets[outgoing.node] = m_targetstamp;
+					targets++;
+				}
+			}
+
+			if (targets == 0)
+				continue;
+
+			WitnessSearch(incoming.node, node, maxlength, targets, shortcuts != nullptr ? CONTRACTION_WITNESS_LIMIT : CONTRACTION_PRIORITY_WITNESS_LIMIT);
+
+			for (auto& outgoing : m_out[node])
+			{
+				if (m_contracted[outgoing.node] || outgoing.node == incoming.node)
+					continue;
+
+				const float length = incoming.length + outgoing.length;
+
+				if (m_distances[outgoing.node] <= length)
+					continue; // Another path is as short
+
+				count++;
+
+				if (shortcuts != nullptr)
+				{
+					shortcuts->emplace_back(incoming.node, BuildEdge{ outgoing.node, length, node });
+				}
+			}
+		}
+
+		return count;
+	}
+
+	void CContractionBuilder::WitnessSearch(const int source, const int ignored, const float maxlength, int targets, const int limit)
+	{
+		using QueueEntry = std::pair<float, int>;
+		const auto compare = std::greater<QueueEntry>();
+
+		for (int id : m_touched)
+		{
+			m_distances[id] = std::numeric_limits<float>::infinity();
+		}
+
+		m_touched.clear();
+		m_distances[source] = 0.0f;
+		m_touched.push_back(source);
+		m_queue.clear();
+		m_queue.emplace_back(0.0f, source);
+		int settled = 0;
+
+		while (!m_queue.empty() && settled < limit)
+		{
+			std::pop_heap(m_queue.begin(), m_queue.end(), compare);
+			const QueueEntry entry = m_queue.back();
+			m_queue.pop_back();
+
+			if (entry.first > m_distances[entry.second])
+				continue;
+
+			if (entry.first > maxlength)
+				break;
+
+			settled++;
+
+			// Every target settled, their distances are final
+			if (m_targets[entry.second] == m_targetstamp && --targets == 0)
+				break;
+
+			for (auto& edge : m_out[entry.second])
+			{
+				if (m_contracted[edge.node] || edge.node == ignored)
+					continue;
+
+				const float distance = entry.first + edge.length;
+
+				if (distance < m_distances[edge.node])
+				{
+					if (m_distances[edge.node] == std::numeric_limits<float>::infinity())
+					{
+						m_touched.push_back(edge.node);
+					}
+
+					m_distances[edge.node] = distance;
+					m_queue.emplace_back(distance, edge.node);
+					std::push_heap(m_queue.begin(), m_queue.end(), compare);
+				}
+			}
+		}
+	}
+
+	int CContractionBuilder::GetPriority(const int node)
+	{
+		// Edge difference, nodes that add few shortcuts are contracted first. Contracted neighbors spread the contraction uniformly.
+		const int edges = static_cast<int>(m_out[node].size() + m_in[node].size());
+		return FindShortcuts(node, nullptr) - edges + m_contractedneighbors[node];
+	}
+
+	void CContractionBuilder::RemoveNode(const int node)
+	{
+		for (auto& edge : m_out[node])
+		{
+			auto& list = m_in[edge.node];
+			list.erase(std::remove_if(list.begin(), list.end(), [node](const BuildEdge& other) { return other.node == node; }), list.end());
+		}
+
+		for (auto& edge : m_in[node])
+		{
+			auto& list = m_out[edge.node];
+			list.erase(std::remove_if(list.begin(), list.end(), [node](const BuildEdge& other) { return other.node == node; }), list.end());
+		}
+
+		m_out[node].clear();
+		m_in[node].clear();
+	}
+}
+
+CContractionHierarchy::CContractionHierarchy() :
+	m_upoffsets(),
+	m_uptargets(),
+	m_uplengths(),
+	m_downoffsets(),
+	m_downsources(),
+	m_downlengths(),
+	m_shortcutkeys(),
+	m_shortcutmiddles()
+{
+	m_graphhash = 0;
+	m_nodelimit = 0;
+}
+
+CContractionHierarchy::~CContractionHierarchy()
+{
+}
+
+void CContractionHierarchy::Build(const CWaypointGraph& graph)
+{
+	Clear();
+	m_graphhash = graph.GetHash();
+	m_nodelimit = graph.GetNodeLimit();
+
+	std::vector<std::vector<BuildEdge>> up;
+	std::vector<std::vector<BuildEdge>> down;
+
+	{
+		CContractionBuilder builder(graph);
+		builder.Contract(up, down);
+	}
+
+	std::vector<std::pair<std::uint64_t, int>> shortcuts;
+	m_upoffsets.reserve(m_nodelimit + 1);
+	m_downoffsets.reserve(m_nodelimit + 1);
+
+	for (int id = 0; id < m_nodelimit; id++)
+	{
+		m_upoffsets.push_back(static_cast<int>(m_uptargets.size()));
+		m_downoffsets.push_back(static_cast<int>(m_downsources.size()));
+
+		for (auto& edge : up[id])
+		{
+			m_uptargets.push_back(edge.node);
+			m_uplengths.push_back(edge.length);
+
+			if (edge.middle >= 0)
+			{
+				shortcuts.emplace_back(MakeKey(id, edge.node), edge.middle);
+			}
+		}
+
+		for (auto& edge : down[id])
+		{
+			m_downsources.push_back(edge.node);
+			m_downlengths.push_back(edge.length);
+
+			if (edge.middle >= 0)
+			{
+				shortcuts.emplace_back(MakeKey(edge.node, id), edge.middle);
+			}
+		}
+	}
+
+	m_upoffsets.push_back(static_cast<int>(m_uptargets.size()));
+	m_downoffsets.push_back(static_cast<int>(m_downsources.size()));
+
+	std::sort(shortcuts.begin(), shortcuts.end());
+
+	for (auto& shortcut : shortcuts)
+	{
+		m_shortcutkeys.push_back(shortcut.first);
+		m_shortcutmiddles.push_back(shortcut.second);
+	}
+}
+
+void CContractionHierarchy::Save(const std::string& filename) const
+{
+	std::fstream file;
+	file.open(filename, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+
+	if (!file.is_open())
+	{
+		LOG_CONSOLE(PLID, "Failed to save contraction hierarchy file \"%s\"!", filename.c_str());
+		return;
+	}
+
+	CContractionFileHeader header{};
+	std::memcpy(header.header, CONTRACTION_FILE_HEADER, std::strlen(CONTRACTION_FILE_HEADER));
+	header.version = CONTRACTION_FILE_VERSION;
+	header.graphhash = m_graphhash;
+	header.nodelimit = m_nodelimit;
+	header.upedges = static_cast<int>(m_uptargets.size());
+	header.downedges = static_cast<int>(m_downsources.size());
+	header.shortcuts = static_cast<int>(m_shortcutkeys.size());
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(CContractionFileHeader));
+	file.write(reinterpret_cast<const char*>(m_upoffsets.data()), m_upoffsets.size() * sizeof(int));
+	file.write(reinterpret_cast<const char*>(m_uptargets.data()), m_uptargets.size() * sizeof(int));
+	file.write(reinterpret_cast<const char*>(m_uplengths.data()), m_uplengths.size() * sizeof(float));
+	file.write(reinterpret_cast<const char*>(m_downoffsets.data()), m_downoffsets.size() * sizeof(int));
+	file.write(reinterpret_cast<const char*>(m_downsources.data()), m_downsources.size() * sizeof(int));
+	file.write(reinterpret_cast<const char*>(m_downlengths.data()), m_downlengths.size() * sizeof(float));
+	file.write(reinterpret_cast<const char*>(m_shortcutkeys.data()), m_shortcutkeys.size() * sizeof(std::uint64_t));
+	file.write(reinterpret_cast<const char*>(m_shortcutmiddles.data()), m_shortcutmiddles.size() * sizeof(int));
+	file.close();
+}
+
+bool CContractionHierarchy::Load(const std::string& filename, const CWaypointGraph& graph)
+{
+	std::fstream file;
+	file.open(filename, std::fstream::in | std::fstream::binary);
+
+	if (!file.is_open())
+		return false;
+
+	CContractionFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(CContractionFileHeader));
+	header.header[sizeof(header.header) - 1] = 0;
+
+	if (!file || strcmp(header.header, CONTRACTION_FILE_HEADER) != 0 || header.version != CONTRACTION_FILE_VERSION)
+	{
+		LOG_CONSOLE(PLID, "Invalid contraction hierarchy file \"%s\"!", filename.c_str());
+		return false;
+	}
+
+	// Built for different waypoints, the hierarchy will be rebuilt
+	if (header.graphhash != graph.GetHash() || header.nodelimit != graph.GetNodeLimit() || header.upedges < 0 || header.downedges < 0 || header.shortcuts < 0)
+		return false;
+
+	Clear();
+	m_upoffsets.resize(header.nodelimit + 1);
+	m_uptargets.resize(header.upedges);
+	m_uplengths.resize(header.upedges);
+	m_downoffsets.resize(header.nodelimit + 1);
+	m_downsources.resize(header.downedges);
+	m_downlengths.resize(header.downedges);
+	m_shortcutkeys.resize(header.shortcuts);
+	m_shortcutmiddles.resize(header.shortcuts);
+
+	file.read(reinterpret_cast<char*>(m_upoffsets.data()), m_upoffsets.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(m_uptargets.data()), m_uptargets.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(m_uplengths.data()), m_uplengths.size() * sizeof(float));
+	file.read(reinterpret_cast<char*>(m_downoffsets.data()), m_downoffsets.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(m_downsources.data()), m_downsources.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(m_downlengths.data()), m_downlengths.size() * sizeof(float));
+	file.read(reinterpret_cast<char*>(m_shortcutkeys.data()), m_shortcutkeys.size() * sizeof(std::uint64_t));
+	file.read(reinterpret_cast<char*>(m_shortcutmiddles.data()), m_shortcutmiddles.size() * sizeof(int));
+
+	bool valid = static_cast<bool>(file) && m_upoffsets.front() == 0 && m_upoffsets.back() == header.upedges &&
+		m_downoffsets.front() == 0 && m_downoffsets.back() == header.downedges;
+
+	for (int id = 0; valid && id < header.nodelimit; id++)
+	{
+		valid = m_upoffsets[id] <= m_upoffsets[id + 1] && m_downoffsets[id] <= m_downoffsets[id + 1];
+	}
+
+	for (int edge = 0; valid && edge < header.upedges; edge++)
+	{
+		valid = m_uptargets[edge] >= 0 && m_uptargets[edge] < header.nodelimit;
+	}
+
+	for (int edge = 0; valid && edge < header.downedges; edge++)
+	{
+		valid = m_downsources[edge] >= 0 && m_downsources[edge] < header.nodelimit;
+	}
+
+	// Shortcuts are binary searched and unpacked through their middle node
+	for (int shortcut = 0; valid && shortcut < header.shortcuts; shortcut++)
+	{
+		const std::uint64_t key = m_shortcutkeys[shortcut];
+		const std::uint32_t from = static_cast<std::uint32_t>(key >> 32);
+		const std::uint32_t to = static_cast<std::uint32_t>(key);
+		const int middle = m_shortcutmiddles[shortcut];
+
+		valid = (shortcut == 0 || m_shortcutkeys[shortcut - 1] < key) && from < static_cast<std::uint32_t>(header.nodelimit) &&
+			to < static_cast<std::uint32_t>(header.nodelimit) && middle >= 0 && middle < header.nodelimit &&
+			static_cast<std::uint32_t>(middle) != from && static_cast<std::uint32_t>(middle) != to;
+	}
+
+	if (!valid)
+	{
+		LOG_CONSOLE(PLID, "Contraction hierarchy file \"%s\" is corrupted!", filename.c_str());
+		Clear();
+		return false;
+	}
+
+	m_graphhash = header.graphhash;
+	m_nodelimit = header.nodelimit;
+	return true;
+}
+
+bool CContractionHierarchy::UnpackEdge(const int from, const int to, std::vector<int>& path) const
+{
+	// Shortcuts are expanded with an explicit stack, the hierarchy can be deep
+	std::vector<std::pair<int, int>> stack;
+	stack.emplace_back(from, to);
+	// A shortcut unpacks to a path without loops, more steps than that means the shortcuts form a cycle
+	const size_t maxsteps = 2 * static_cast<size_t>(m_nodelimit);
+	size_t steps = 0;
+
+	while (!stack.empty())
+	{
+		if (++steps > maxsteps)
+			return false;
+
+		const std::pair<int, int> edge = stack.back();
+		stack.pop_back();
+		const int middle = FindShortcutMiddle(edge.first, edge.second);
+
+		if (middle < 0)
+		{
+			path.push_back(edge.second);
+		}
+		else
+		{
+			stack.emplace_back(middle, edge.second);
+			stack.emplace_back(edge.first, middle);
+		}
+	}
+
+	return true;
+}
+
+int CContractionHierarchy::FindShortcutMiddle(const int from, const int to) const
+{
+	const std::uint64_t key = MakeKey(from, to);
+	auto it = std::lower_bound(m_shortcutkeys.begin(), m_shortcutkeys.end(), key);
+
+	if (it == m_shortcutkeys.end() || *it != key)
+		return -1;
+
+	return m_shortcutmiddles[it - m_shortcutkeys.begin()];
+}
+
+void CContractionHierarchy::Clear()
+{
+	m_graphhash = 0;
+	m_nodelimit = 0;
+	m_upoffsets.clear();
+	m_uptargets.clear();
+	m_uplengths.clear();
+	m_downoffsets.clear();
+	m_downsources.clear();
+	m_downlengths.clear();
+	m_shortcutkeys.clear();
+	m_shortcutmiddles.clear();
+}
+
+CContractionQuery::CContractionQuery() :
+	m_nodes()
+{
+	m_stamp = 0;
+	m_settled = 0;
+}
+
+float CContractionQuery::FindPath(const CContractionHierarchy& hierarchy, const int startid, const int goalid, std::vector<int>& path)
+{
+	path.clear();
+	m_settled = 0;
+
+	if (startid < 0 || goalid < 0 || startid >= hierarchy.GetNodeLimit() || goalid >= hierarchy.GetNodeLimit())
+		return -1.0f;
+
+	Prepare(hierarchy.GetNodeLimit());
+
+	constexpr int FORWARD = 0;
+	constexpr int BACKWARD = 1;
+	const auto compare = std::greater<QueueEntry>();
+
+	SetDistance(FORWARD, startid, 0.0f, -1);
+	SetDistance(BACKWARD, goalid, 0.0f, -1);
+
+	float best = std::numeric_limits<float>::infinity();
+	int meeting = -1;
+
+	if (startid == goalid)
+	{
+		best = 0.0f;
+		meeting = startid;
+	}
+
+	// Both searches only go up, they can stop once their closest node is further than the best path
+	for (int direction = FORWARD; ; direction = 1 - direction)
+	{
+		std::vector<QueueEntry>& queue = m_queues[direction];
+		std::vector<QueueEntry>& other = m_queues[1 - direction];
+		const bool done = queue.empty() || queue.front().first >= best;
+		const bool otherdone = other.empty() || other.front().first >= best;
+
+		if (done && otherdone)
+			break;
+
+		if (done)
+			continue;
+
+		std::pop_heap(queue.begin(), queue.end(), compare);
+		const QueueEntry entry = queue.back();
+		queue.pop_back();
+		const int id = entry.second;
+
+		if (entry.first > GetDistance(direction, id))
+			continue;
+
+		m_settled++;
+		const float opposite = GetDistance(1 - direction, id);
+
+		if (opposite >= 0.0f && entry.first + opposite < best)
+		{
+			best = entry.first + opposite;
+			meeting = id;
+		}
+
+		if (direction == FORWARD)
+		{
+			for (int edge = hierarchy.GetFirstUpEdge(id); edge < hierarchy.GetLastUpEdge(id); edge++)
+			{
+				const int next = hierarchy.GetUpEdgeTarget(edge);
+				const float distance = entry.first + hierarchy.GetUpEdgeLength(edge);
+				const float current = GetDistance(FORWARD, next);
+
+				if (current < 0.0f || distance < current)
+				{
+					SetDistance(FORWARD, next, distance, id);
+				}
+			}
+		}
+		else
+		{
+			for (int edge = hierarchy.GetFirstDownEdge(id); edge < hierarchy.GetLastDownEdge(id); edge++)
+			{
+				const int next = hierarchy.GetDownEdgeSource(edge);
+				const float distance = entry.first + hierarchy.GetDownEdgeLength(edge);
+				const float current = GetDistance(BACKWARD, next);
+
+				if (current < 0.0f || distance < current)
+				{
+					SetDistance(BACKWARD, next, distance, id);
+				}
+			}
+		}
+	}
+
+	if (meeting < 0)
+		return -1.0f;
+
+	// Hierarchy path: start up to the meeting node, then down to the goal
+	m_nodes.clear();
+
+	for (int id = meeting; id >= 0; id = m_parents[FORWARD][id])
+	{
+		m_nodes.push_back(id);
+	}
+
+	std::reverse(m_nodes.begin(), m_nodes.end());
+
+	for (int id = m_parents[BACKWARD][meeting]; id >= 0; id = m_parents[BACKWARD][id])
+	{
+		m_nodes.push_back(id);
+	}
+
+	path.push_back(m_nodes.front());
+
+	for (size_t index = 1; index < m_nodes.size(); index++)
+	{
+		if (!hierarchy.UnpackEdge(m_nodes[index - 1], m_nodes[index], path))
+		{
+			path.clear();
+			return -1.0f;
+		}
+	}
+
+	return best;
+}
+
+void CContractionQuery::Prepare(const int limit)
+{
+	for (int direction = 0; direction < 2; direction++)
+	{
+		if (static_cast<int>(m_distances[direction].size()) < limit)
+		{
+			m_distances[direction].resize(limit);
+			m_parents[direction].resize(limit);
+			m_stamps[direction].resize(limit, 0);
+		}
+
+		m_queues[direction].clear();
+	}
+
+	m_stamp++;
+
+	if (m_stamp == 0)
+	{
+		// Stamp wrapped around, old stamps could collide with new queries
+		for (int direction = 0; direction < 2; direction++)
+		{
+			std::fill(m_stamps[direction].begin(), m_stamps[direction].end(), 0U);
+		}
+
+		m_stamp = 1;
+	}
+}
+
+void CContractionQuery::SetDistance(const int direction, const int id, const float distance, const int parent)
+{
+	m_stamps[direction][id] = m_stamp;
+	m_distances[direction][id] = distance;
+	m_parents[direction][id] = parent;
+	m_queues[direction].emplace_back(distance, id);
+	std::push_heap(m_queues[direction].begin(), m_queues[direction].end(), std::greater<QueueEntry>());
+}
+
+CContractionManager::CContractionManager() :
+	m_hierarchy(),
+	m_building(),
+	m_thread(),
+	m_buildfinished(false),
+	m_pathids()
+{
+	m_buildhash = 0;
+	m_loadhash = 0;
+	m_loadtried = false;
+	m_lasthash = 0;
+	m_buildtime = 0.0f;
+}
+
+CContractionManager::~CContractionManager()
+{
+	Stop();
+}
+
+void CContractionManager::Update()
+{
+	if (m_buildfinished.load())
+	{
+		FinishBuild();
+	}
+
+	std::shared_ptr<const CWaypointGraph> graph = TheWaypoints->GetGraphSnapshot();
+	std::shared_ptr<const CContractionHierarchy> hierarchy = GetHierarchy();
+
+	// Drop the hierarchy as soon as the waypoints change
+	if (hierarchy && !hierarchy->IsValidFor(*graph))
+	{
+		std::atomic_store(&m_hierarchy, std::shared_ptr<const CContractionHierarchy>());
+		hierarchy.reset();
+	}
+
+	if (gb_nav_contraction.value <= 0.0f || hierarchy || IsBuilding() || graph->GetNodeCount() == 0)
+		return;
+
+	if (!m_loadtried || m_loadhash != graph->GetHash())
+	{
+		m_loadtried = true;
+		m_loadhash = graph->GetHash();
+		auto loaded = std::make_shared<CContractionHierarchy>();
+
+		if (loaded->Load(TheWaypoints->GetWaypointFilePath(".wpc"), *graph))
+		{
+			std::atomic_store(&m_hierarchy, std::shared_ptr<const CContractionHierarchy>(loaded));
+			return;
+		}
+	}
+
+	// Only for authored maps, wait until the waypoints stop changing
+	if (m_lasthash != graph->GetHash() || TheWaypoints->IsEditing())
+	{
+		m_lasthash = graph->GetHash();
+		m_buildtime = gpGlobals->time + CONTRACTION_BUILD_DELAY;
+		return;
+	}
+
+	if (gpGlobals->time >= m_buildtime)
+	{
+		StartBuild(graph);
+	}
+}
+
+void CContractionManager::Stop()
+{
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	m_buildfinished.store(false);
+	m_building.reset();
+}
+
+bool CContractionManager::IsAvailable() const
+{
+	std::shared_ptr<const CContractionHierarchy> hierarchy = GetHierarchy();
+	return hierarchy && hierarchy->IsValidFor(TheWaypoints->GetGraph());
+}
+
+bool CContractionManager::FindPath(CWaypoint* start, CWaypoint* goal, std::vector<CWaypoint*>& path)
+{
+	path.clear();
+
+	if (start == nullptr || goal == nullptr)
+		return false;
+
+	std::shared_ptr<const CContractionHierarchy> hierarchy = GetHierarchy();
+	const CWaypointGraph& graph = TheWaypoints->GetGraph();
+
+	if (!hierarchy || !hierarchy->IsValidFor(graph))
+		return false;
+
+	if (CContractionQuery::GetSharedQuery().FindPath(*hierarchy, start->GetID(), goal->GetID(), m_pathids) < 0.0f)
+		return false;
+
+	for (int id : m_pathids)
+	{
+		path.push_back(graph.GetWaypoint(id));
+	}
+
+	return true;
+}
+
+void CContractionManager::StartBuild(std::shared_ptr<const CWaypointGraph> graph)
+{
+	std::shared_ptr<CContractionHierarchy> building = std::make_shared<CContractionHierarchy>();
+
+	m_building = building;
+	m_buildhash = graph->GetHash();
+	m_buildfinished.store(false);
+
+	// The graph snapshot is kept alive by the thread
+	m_thread = std::thread([this, graph, building]() {
+		building->Build(*graph);
+		m_buildfinished.store(true);
+	});
+}
+
+void CContractionManager::FinishBuild()
+{
+	m_thread.join();
+	m_buildfinished.store(false);
+
+	// Waypoints changed while the hierarchy was built
+	if (TheWaypoints->GetGraphSnapshot()->GetHash() == m_buildhash)
+	{
+		std::atomic_store(&m_hierarchy, std::shared_ptr<const CContractionHierarchy>(m_building));
+		m_building->Save(TheWaypoints->GetWaypointFilePath(".wpc"));
+		LOG_MESSAGE(PLID, "Built path finding contraction hierarchy with %i shortcuts.", m_building->GetShortcutCount());
+	}
+
+	m_building.reset();
+}
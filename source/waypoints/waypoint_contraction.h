@@ -0,0 +1,179 @@
+#ifndef WAYPOINT_CONTRACTION_H_
+#define WAYPOINT_CONTRACTION_H_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <functional>
+#include <utility>
+#include <cstdint>
+
+#include "waypoint_graph.h"
+
+/**
+ * @brief Contraction hierarchy of the waypoint graph for fast long distance queries on maps that are not being edited.
+ *
+ * Waypoints are contracted one at a time in order of importance, shortcuts are added between their neighbors
+ * when no other path is as short. Queries run a bidirectional search that only goes up the hierarchy,
+ * shortcuts are unpacked into waypoints afterwards. Distances are path lengths, cost functors are not used.
+ * The hierarchy is immutable once built and tied to the hash of the graph it was built from.
+*/
+class CContractionHierarchy
+{
+public:
+	CContractionHierarchy();
+	~CContractionHierarchy();
+
+	// Contracts the graph, safe to call from any thread
+	void Build(const CWaypointGraph& graph);
+	void Save(const std::string& filename) const;
+	/**
+	 * @brief Loads the hierarchy from a file
+	 * @param filename File to load
+	 * @param graph The hierarchy is rejected if it was built from a different graph
+	 * @return true if the hierarchy was loaded
+	*/
+	bool Load(const std::string& filename, const CWaypointGraph& graph);
+
+	std::uint64_t GetGraphHash() const { return m_graphhash; }
+	int GetNodeLimit() const { return m_nodelimit; }
+	int GetShortcutCount() const { return static_cast<int>(m_shortcutkeys.size()); }
+	// Checks if the hierarchy can be used on the given graph
+	bool IsValidFor(const CWaypointGraph& graph) const { return m_graphhash == graph.GetHash() && m_nodelimit == graph.GetNodeLimit(); }
+
+	// Edges to higher ranked nodes, for the search from the start
+	int GetFirstUpEdge(const int id) const { return m_upoffsets[id]; }
+	int GetLastUpEdge(const int id) const { return m_upoffsets[id + 1]; }
+	int GetUpEdgeTarget(const int edge) const { return m_uptargets[edge]; }
+	float GetUpEdgeLength(const int edge) const { return m_uplengths[edge]; }
+	// Edges from higher ranked nodes, for the search from the goal
+	int GetFirstDownEdge(const int id) const { return m_downoffsets[id]; }
+	int GetLastDownEdge(const int id) const { return m_downoffsets[id + 1]; }
+	int GetDownEdgeSource(const int edge) const { return m_downsources[edge]; }
+	float GetDownEdgeLength(const int edge) const { return m_downlengths[edge]; }
+
+	/**
+	 * @brief Appends the waypoints of a hierarchy edge, excluding the first one
+	 * @param from Edge source
+	 * @param to Edge target
+	 * @param path Waypoint IDs are appended to this
+	 * @return false if the shortcuts of the edge form a cycle
+	*/
+	bool UnpackEdge(const int from, const int to, std::vector<int>& path) const;
+
+private:
+	static std::uint64_t MakeKey(const int from, const int to) { return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(from)) << 32) | static_cast<std::uint32_t>(to); }
+	// Middle node of a shortcut, -1 if the edge is a waypoint path
+	int FindShortcutMiddle(const int from, const int to) const;
+	void Clear();
+
+	std::uint64_t m_graphhash;
+	int m_nodelimit;
+	std::vector<int> m_upoffsets;
+	std::vector<int> m_uptargets;
+	std::vector<float> m_uplengths;
+	std::vector<int> m_downoffsets;
+	std::vector<int> m_downsources;
+	std::vector<float> m_downlengths;
+	std::vector<std::uint64_t> m_shortcutkeys; // Sorted (from, to) keys of shortcut edges
+	std::vector<int> m_shortcutmiddles; // Middle node of each shortcut
+};
+
+/**
+ * @brief Search state of contraction hierarchy queries, reused between queries so they don't allocate
+*/
+class CContractionQuery
+{
+public:
+	CContractionQuery();
+
+	/**
+	 * @brief Finds the shortest path between two waypoints
+	 * @param hierarchy Hierarchy to search
+	 * @param startid Start waypoint ID
+	 * @param goalid Goal waypoint ID
+	 * @param path Stores the waypoint IDs of the path
+	 * @return Path length, negative if there is no path
+	*/
+	float FindPath(const CContractionHierarchy& hierarchy, const int startid, const int goalid, std::vector<int>& path);
+	// Number of nodes settled by the last query
+	int GetSettledNodeCount() const { return m_settled; }
+
+	// Query state shared by queries on the calling thread
+	static CContractionQuery& GetSharedQuery()
+	{
+		thread_local CContractionQuery query;
+		return query;
+	}
+
+private:
+	using QueueEntry = std::pair<float, int>;
+
+	void Prepare(const int limit);
+	float GetDistance(const int direction, const int id) const { return m_stamps[direction][id] == m_stamp ? m_distances[direction][id] : -1.0f; }
+	void SetDistance(const int direction, const int id, const float distance, const int parent);
+
+	std::vector<float> m_distances[2]; // Forward and backward distances
+	std::vector<int> m_parents[2];
+	std::vector<unsigned int> m_stamps[2];
+	std::vector<QueueEntry> m_queues[2]; // Binary min heaps, kept to reuse their memory
+	std::vector<int> m_nodes; // Hierarchy path before unpacking
+	unsigned int m_stamp;
+	int m_settled;
+};
+
+/**
+ * @brief Keeps the contraction hierarchy of the waypoints.
+ *
+ * The hierarchy is loaded from the sidecar file next to the waypoint file if its graph hash matches,
+ * otherwise it's built on a background thread once the waypoints stop changing and saved.
+ * It's dropped as soon as the graph is modified and never built while waypoints are being edited.
+*/
+class CContractionManager
+{
+public:
+	CContractionManager();
+	virtual ~CContractionManager();
+
+	// Called every server frame
+	void Update();
+	// Waits for the background build to finish
+	void Stop();
+
+	// Current hierarchy, nullptr if not available. Safe to call from any thread
+	std::shared_ptr<const CContractionHierarchy> GetHierarchy() const { return std::atomic_load(&m_hierarchy); }
+	bool IsBuilding() const { return m_thread.joinable(); }
+	// Checks if the hierarchy matches the current waypoints
+	bool IsAvailable() const;
+
+	/**
+	 * @brief Finds the shortest path between two waypoints
+	 * @param start Start waypoint
+	 * @param goal Goal waypoint
+	 * @param path Stores the path waypoints
+	 * @return false if there is no path or the hierarchy isn't available, check IsAvailable to tell them apart
+	*/
+	bool FindPath(CWaypoint* start, CWaypoint* goal, std::vector<CWaypoint*>& path);
+
+private:
+	void StartBuild(std::shared_ptr<const CWaypointGraph> graph);
+	void FinishBuild();
+
+	std::shared_ptr<const CContractionHierarchy> m_hierarchy; // Published hierarchy, only accessed with atomic loads and stores
+	std::shared_ptr<CContractionHierarchy> m_building; // Hierarchy being built by the background thread
+	std::thread m_thread;
+	std::atomic<bool> m_buildfinished;
+	std::uint64_t m_buildhash; // Hash of the graph being built
+	std::uint64_t m_loadhash; // Hash of the graph the sidecar load was tried for
+	bool m_loadtried;
+	std::uint64_t m_lasthash; // Graph hash seen on the last update
+	float m_buildtime; // The hierarchy is built once the graph stays unchanged until this time
+	std::vector<int> m_pathids;
+};
+
+// Contraction hierarchy manager singleton
+extern CContractionManager* TheContractionHierarchy;
+
+#endif // !WAYPOINT_CONTRACTION_H_
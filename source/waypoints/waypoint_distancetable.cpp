@@ -0,0 +1,391 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <cfloat>
+#include <cmath>
+
+#include "plugincvars.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_pathfind.h"
+#include "waypoint_landmarks.h"
+#include "waypoint_distancetable.h"
+
+// Quantized distance of unreachable waypoints, the longest path of a row is stored as the value below it
+constexpr std::uint16_t DISTANCE_TABLE_UNREACHABLE = 0xFFFF;
+// First edge of waypoints without a path, waypoints with this many paths can't be stored
+constexpr std::uint8_t DISTANCE_TABLE_NO_HOP = 0xFF;
+constexpr int DISTANCE_TABLE_MAX_THREADS = 8;
+// Table is rebuilt after the waypoints stay unchanged for this many seconds while editing
+constexpr float DISTANCE_TABLE_BUILD_DELAY = 5.0f;
+
+CDistanceTableManager* TheDistanceTable = nullptr;
+
+CDistanceTable::CDistanceTable() :
+	m_scales(),
+	m_distances(),
+	m_hops()
+{
+	m_graphhash = 0;
+	m_nodelimit = 0;
+}
+
+CDistanceTable::~CDistanceTable()
+{
+}
+
+void CDistanceTable::Build(const CWaypointGraph& graph, const int threads, const std::atomic<bool>& cancel)
+{
+	const int limit = graph.GetNodeLimit();
+	const size_t rowsize = static_cast<size_t>(limit);
+
+	m_graphhash = graph.GetHash();
+	m_nodelimit = limit;
+	m_scales.assign(rowsize, 1.0f);
+	m_distances.assign(rowsize * rowsize, DISTANCE_TABLE_UNREACHABLE);
+	m_hops.assign(rowsize * rowsize, DISTANCE_TABLE_NO_HOP);
+
+	std::atomic<int> nextrow(0);
+
+	// Each thread takes a row and searches from it, only the owner of a row writes to it
+	auto worker = [&]() {
+		std::vector<float> distances;
+		std::vector<std::uint8_t> hops;
+
+		for (int id = nextrow++; id < limit && !cancel.load(std::memory_order_relaxed); id = nextrow++)
+		{
+			if (!graph.IsValidNode(id))
+				continue;
+
+			ComputeRow(graph, id, distances, hops);
+
+			float longest = 0.0f;
+
+			for (int other = 0; other < limit; other++)
+			{
+				if (distances[other] < FLT_MAX)
+				{
+					longest = std::max(longest, distances[other]);
+				}
+			}
+
+			const float scale = longest > 0.0f ? longest / static_cast<float>(DISTANCE_TABLE_UNREACHABLE - 1) : 1.0f;
+			std::uint16_t* row = &m_distances[static_cast<size_t>(id) * rowsize];
+			m_scales[id] = scale;
+
+			for (int other = 0; other < limit; other++)
+			{
+				if (distances[other] < FLT_MAX)
+				{
+					const long quantized = std::lround(distances[other] / scale);
+					row[other] = static_cast<std::uint16_t>(std::min(quantized, static_cast<long>(DISTANCE_TABLE_UNREACHABLE - 1)));
+				}
+			}
+
+			std::copy(hops.begin(), hops.end(), m_hops.begin() + static_cast<size_t>(id) * rowsize);
+		}
+	};
+
+	std::vector<std::thread> helpers;
+
+	for (int i = 1; i < threads; i++)
+	{
+		helpers.emplace_back(worker);
+	}
+
+	worker();
+
+	for (auto& helper : helpers)
+	{
+		helper.join();
+	}
+
+	if (cancel.load())
+	{
+		m_nodelimit = 0;
+		m_scales.clear();
+		m_distances.clear();
+		m_hops.clear();
+	}
+}
+
+size_t CDistanceTable::GetMemoryUsage(const int nodelimit)
+{
+	const size_t rowsize = static_cast<size_t>(nodelimit);
+	return rowsize * rowsize * (sizeof(std::uint16_t) + sizeof(std::uint8_t)) + rowsize * sizeof(float);
+}
+
+bool CDistanceTable::CanBuild(const CWaypointGraph& graph, const size_t maxmemory)
+{
+	if (GetMemoryUsage(graph.GetNodeLimit()) > maxmemory)
+		return false;
+
+	for (int id = 0; id < graph.GetNodeLimit(); id++)
+	{
+		if (graph.IsValidNode(id) && graph.GetLastEdge(id) - graph.GetFirstEdge(id) >= DISTANCE_TABLE_NO_HOP)
+			return false;
+	}
+
+	return true;
+}
+
+float CDistanceTable::GetDistance(const int id, const int goalid) const
+{
+	if (id < 0 || goalid < 0 || id >= m_nodelimit || goalid >= m_nodelimit)
+		return FLT_MAX;
+
+	const std::uint16_t distance = m_distances[static_cast<size_t>(id) * m_nodelimit + goalid];
+
+	if (distance == DISTANCE_TABLE_UNREACHABLE)
+		return FLT_MAX;
+
+	return static_cast<float>(distance) * m_scales[id];
+}
+
+int CDistanceTable::GetNextHop(const CWaypointGraph& graph, const int id, const int goalid) const
+{
+	if (id < 0 || goalid < 0 || id >= m_nodelimit || goalid >= m_nodelimit)
+		return -1;
+
+	if (id == goalid)
+		return m_distances[static_cast<size_t>(id) * m_nodelimit + goalid] == DISTANCE_TABLE_UNREACHABLE ? -1 : goalid;
+
+	const std::uint8_t hop = m_hops[static_cast<size_t>(id) * m_nodelimit + goalid];
+
+	if (hop == DISTANCE_TABLE_NO_HOP)
+		return -1;
+
+	return graph.GetEdgeTarget(graph.GetFirstEdge(id) + hop);
+}
+
+void CDistanceTable::ComputeRow(const CWaypointGraph& graph, const int source, std::vector<float>& distances, std::vector<std::uint8_t>& hops)
+{
+	using QueueEntry = std::pair<float, int>;
+	const int limit = graph.GetNodeLimit();
+	std::vector<QueueEntry> queue;
+
+	distances.assign(limit, FLT_MAX);
+	hops.assign(limit, DISTANCE_TABLE_NO_HOP);
+	distances[source] = 0.0f;
+	queue.emplace_back(0.0f, source);
+
+	while (!queue.empty())
+	{
+		std::pop_heap(queue.begin(), queue.end(), std::greater<QueueEntry>());
+		const QueueEntry current = queue.back();
+		queue.pop_back();
+
+		// Stale entry, the node was reached with a shorter path
+		if (current.first > distances[current.second])
+			continue;
+
+		const int id = current.second;
+
+		for (int edge = graph.GetFirstEdge(id); edge < graph.GetLastEdge(id); edge++)
+		{
+			const int target = graph.GetEdgeTarget(edge);
+			const float distance = current.first + graph.GetEdgeLength(edge);
+
+			if (distance >= distances[target])
+				continue;
+
+			distances[target] = distance;
+			// Paths from the source take the first edge, everything else inherits it from the parent
+			hops[target] = id == source ? static_cast<std::uint8_t>(edge - graph.GetFirstEdge(source)) : hops[id];
+			queue.emplace_back(distance, target);
+			std::push_heap(queue.begin(), queue.end(), std::greater<QueueEntry>());
+		}
+	}
+}
+
+CDistanceTableManager::CDistanceTableManager() :
+	m_table(),
+	m_building(),
+	m_thread(),
+	m_buildfinished(false),
+	m_cancel(false),
+	m_pathids()
+{
+	m_buildhash = 0;
+	m_lasthash = 0;
+	m_skippedhash = 0;
+	m_buildtime = 0.0f;
+}
+
+CDistanceTableManager::~CDistanceTableManager()
+{
+	Stop();
+}
+
+void CDistanceTableManager::Update()
+{
+	if (m_buildfinished.load())
+	{
+		FinishBuild();
+	}
+
+	std::shared_ptr<const CWaypointGraph> graph = TheWaypoints->GetGraphSnapshot();
+	std::shared_ptr<const CDistanceTable> table = GetTable();
+
+	// Drop the table as soon as the waypoints change, queries fall back to A* until the new one is built
+	if (table && !table->IsValidFor(*graph))
+	{
+		std::atomic_store(&m_table, std::shared_ptr<const CDistanceTable>());
+		table.reset();
+	}
+
+	// The running build is outdated, no need to finish it
+	if (IsBuilding() && m_buildhash != graph->GetHash())
+	{
+		m_cancel.store(true);
+	}
+
+	if (gb_nav_distance_table_memory.value <= 0.0f || table || IsBuilding() || graph->GetNodeCount() == 0)
+		return;
+
+	// Built right after the waypoints are loaded, wait until they stop changing while editing
+	if (m_lasthash != graph->GetHash())
+	{
+		m_lasthash = graph->GetHash();
+		m_buildtime = TheWaypoints->IsEditing() ? gpGlobals->time + DISTANCE_TABLE_BUILD_DELAY : gpGlobals->time;
+	}
+
+	if (gpGlobals->time < m_buildtime)
+		return;
+
+	const size_t maxmemory = static_cast<size_t>(gb_nav_distance_table_memory.value * 1024.0f * 1024.0f);
+
+	if (!CDistanceTable::CanBuild(*graph, maxmemory))
+	{
+		if (m_skippedhash != graph->GetHash())
+		{
+			m_skippedhash = graph->GetHash();
+			LOG_MESSAGE(PLID, "Waypoint distance table needs %i KB and doesn't fit in gb_nav_distance_table_memory, using A* for path distances.",
+				static_cast<int>(CDistanceTable::GetMemoryUsage(graph->GetNodeLimit()) / 1024));
+		}
+
+		return;
+	}
+
+	StartBuild(graph);
+}
+
+void CDistanceTableManager::Stop()
+{
+	m_cancel.store(true);
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	m_cancel.store(false);
+	m_buildfinished.store(false);
+	m_building.reset();
+}
+
+bool CDistanceTableManager::IsAvailable() const
+{
+	std::shared_ptr<const CDistanceTable> table = GetTable();
+	return table && table->IsValidFor(TheWaypoints->GetGraph());
+}
+
+float CDistanceTableManager::GetPathDistance(CWaypoint* start, CWaypoint* goal)
+{
+	if (start == nullptr || goal == nullptr)
+		return FLT_MAX;
+
+	std::shared_ptr<const CDistanceTable> table = GetTable();
+	const CWaypointGraph& graph = TheWaypoints->GetGraph();
+
+	if (table && table->IsValidFor(graph))
+		return table->GetDistance(start->GetID(), goal->GetID());
+
+	if (!SearchPath(start, goal))
+		return FLT_MAX;
+
+	float distance = 0.0f;
+
+	for (size_t i = 1; i < m_pathids.size(); i++)
+	{
+		distance += graph.GetPosition(m_pathids[i - 1]).DistTo(graph.GetPosition(m_pathids[i]));
+	}
+
+	return distance;
+}
+
+CWaypoint* CDistanceTableManager::GetNextHop(CWaypoint* start, CWaypoint* goal)
+{
+	if (start == nullptr || goal == nullptr)
+		return nullptr;
+
+	std::shared_ptr<const CDistanceTable> table = GetTable();
+	const CWaypointGraph& graph = TheWaypoints->GetGraph();
+
+	if (table && table->IsValidFor(graph))
+	{
+		const int next = table->GetNextHop(graph, start->GetID(), goal->GetID());
+		return next >= 0 ? graph.GetWaypoint(next) : nullptr;
+	}
+
+	if (!SearchPath(start, goal))
+		return nullptr;
+
+	return graph.GetWaypoint(m_pathids.size() > 1 ? m_pathids[1] : m_pathids[0]);
+}
+
+void CDistanceTableManager::StartBuild(std::shared_ptr<const CWaypointGraph> graph)
+{
+	const int threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, DISTANCE_TABLE_MAX_THREADS);
+	std::shared_ptr<CDistanceTable> building = std::make_shared<CDistanceTable>();
+
+	m_building = building;
+	m_buildhash = graph->GetHash();
+	m_buildfinished.store(false);
+
+	// The graph snapshot is kept alive by the thread
+	m_thread = std::thread([this, graph, building, threads]() {
+		building->Build(*graph, threads, m_cancel);
+		m_buildfinished.store(true);
+	});
+}
+
+void CDistanceTableManager::FinishBuild()
+{
+	m_thread.join();
+	m_cancel.store(false);
+	m_buildfinished.store(false);
+
+	// Waypoints changed while the table was built
+	if (!m_building->IsEmpty() && m_building->IsValidFor(*TheWaypoints->GetGraphSnapshot()))
+	{
+		std::atomic_store(&m_table, std::shared_ptr<const CDistanceTable>(m_building));
+		LOG_MESSAGE(PLID, "Built waypoint distance table, %i KB.", static_cast<int>(CDistanceTable::GetMemoryUsage(m_building->GetNodeLimit()) / 1024));
+	}
+
+	m_building.reset();
+}
+
+bool CDistanceTableManager::SearchPath(CWaypoint* start, CWaypoint* goal)
+{
+	IPathCostFunctor defaultcost;
+	CBinaryHeapAStarSearch<IPathCostFunctor, CLandmarkHeuristic> search;
+
+	if (search.BuildPath(TheWaypoints->GetGraph(), start->GetID(), goal->GetID(), nullptr, defaultcost) != PathSearch::STATUS_FOUND)
+	{
+		m_pathids.clear();
+		return false;
+	}
+
+	m_pathids = search.GetPathIDs();
+	return !m_pathids.empty();
+}
@@ -0,0 +1,132 @@
+#ifndef WAYPOINT_DISTANCE_TABLE_H_
+#define WAYPOINT_DISTANCE_TABLE_H_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+#include "waypoint_graph.h"
+
+class CWaypoint;
+
+/**
+ * @brief All pairs shortest path table for small maps.
+ *
+ * Stores the path length between every pair of waypoints quantized to 16 bits, relative to the longest path from the
+ * same start, and the first edge of the shortest path as an index into the start waypoint paths, 3 bytes per pair.
+ * Distances use the graph edge lengths.
+ * Tables are immutable once built and tied to the hash of the graph they were built from.
+*/
+class CDistanceTable
+{
+public:
+	CDistanceTable();
+	~CDistanceTable();
+
+	/**
+	 * @brief Runs a Dijkstra search from every waypoint, safe to call from any thread
+	 * @param graph Graph to build the table from
+	 * @param threads Number of threads searching
+	 * @param cancel The build stops early when set, the table is left empty
+	*/
+	void Build(const CWaypointGraph& graph, const int threads, const std::atomic<bool>& cancel);
+	// Memory needed by a table for the given number of waypoint IDs in bytes
+	static size_t GetMemoryUsage(const int nodelimit);
+	// Checks if a table for the graph fits in the given memory and every first edge can be stored
+	static bool CanBuild(const CWaypointGraph& graph, const size_t maxmemory);
+
+	int GetNodeLimit() const { return m_nodelimit; }
+	bool IsEmpty() const { return m_distances.empty(); }
+	// Checks if the table can be used on the given graph
+	bool IsValidFor(const CWaypointGraph& graph) const { return m_graphhash == graph.GetHash() && m_nodelimit == graph.GetNodeLimit(); }
+
+	/**
+	 * @brief Path length between two waypoints
+	 * @param id Start waypoint ID
+	 * @param goalid Goal waypoint ID
+	 * @return Path length, within half a quantization step of the exact length. FLT_MAX if there is no path
+	*/
+	float GetDistance(const int id, const int goalid) const;
+	/**
+	 * @brief Next waypoint on the shortest path between two waypoints
+	 * @param graph Graph the table was built from
+	 * @param id Start waypoint ID
+	 * @param goalid Goal waypoint ID
+	 * @return Waypoint ID after the start, the goal ID if start and goal are the same, -1 if there is no path
+	*/
+	int GetNextHop(const CWaypointGraph& graph, const int id, const int goalid) const;
+
+private:
+	// Shortest path lengths and first edges from a single waypoint
+	static void ComputeRow(const CWaypointGraph& graph, const int source, std::vector<float>& distances, std::vector<std::uint8_t>& hops);
+
+	std::uint64_t m_graphhash;
+	int m_nodelimit;
+	std::vector<float> m_scales; // Path length of one distance unit, per start waypoint ID
+	std::vector<std::uint16_t> m_distances; // A row per start waypoint ID
+	std::vector<std::uint8_t> m_hops; // First edge index relative to the start waypoint first edge, a row per start waypoint ID
+};
+
+/**
+ * @brief Keeps the distance table up to date with the waypoints and answers path distance queries.
+ *
+ * The table is built on background threads after the waypoints are loaded and rebuilt once they stop changing.
+ * It's only built when it fits in gb_nav_distance_table_memory, queries fall back to A* searches when it doesn't
+ * or while it's being built.
+*/
+class CDistanceTableManager
+{
+public:
+	CDistanceTableManager();
+	virtual ~CDistanceTableManager();
+
+	// Called every server frame
+	void Update();
+	// Stops the background build
+	void Stop();
+
+	// Current table, may be outdated or nullptr. Safe to call from any thread
+	std::shared_ptr<const CDistanceTable> GetTable() const { return std::atomic_load(&m_table); }
+	bool IsBuilding() const { return m_thread.joinable(); }
+	// Checks if the table matches the current waypoints
+	bool IsAvailable() const;
+
+	/**
+	 * @brief Shortest path length between two waypoints, main thread only
+	 * @param start Start waypoint
+	 * @param goal Goal waypoint
+	 * @return Path length, FLT_MAX if there is no path
+	*/
+	float GetPathDistance(CWaypoint* start, CWaypoint* goal);
+	/**
+	 * @brief Next waypoint on the shortest path between two waypoints, main thread only
+	 * @param start Start waypoint
+	 * @param goal Goal waypoint
+	 * @return Waypoint after the start, nullptr if there is no path
+	*/
+	CWaypoint* GetNextHop(CWaypoint* start, CWaypoint* goal);
+
+private:
+	void StartBuild(std::shared_ptr<const CWaypointGraph> graph);
+	void FinishBuild();
+	// A* search used when the table isn't available, the path IDs are stored in m_pathids
+	bool SearchPath(CWaypoint* start, CWaypoint* goal);
+
+	std::shared_ptr<const CDistanceTable> m_table; // Published table, only accessed with atomic loads and stores
+	std::shared_ptr<CDistanceTable> m_building; // Table being built by the background thread
+	std::thread m_thread;
+	std::atomic<bool> m_buildfinished;
+	std::atomic<bool> m_cancel;
+	std::uint64_t m_buildhash; // Graph hash of the table being built
+	std::uint64_t m_lasthash; // Graph hash seen on the last update
+	std::uint64_t m_skippedhash; // Graph hash the too large message was logged for
+	float m_buildtime; // Table is built once the graph stays unchanged until this time
+	std::vector<int> m_pathids;
+};
+
+// Distance table manager singleton
+extern CDistanceTableManager* TheDistanceTable;
+
+#endif // !WAYPOINT_DISTANCE_TABLE_H_
@@ -0,0 +1,521 @@
+#ifndef WAYPOINT_DSTAR_LITE_H_
+#define WAYPOINT_DSTAR_LITE_H_
+
+#include <vector>
+#include <memory>
+#include <limits>
+#include <utility>
+#include <algorithm>
+
+#include "waypoint_pathfind.h"
+
+/**
+ * @brief Incremental path planner (D* Lite) that repairs its path when path costs change.
+ *
+ * The search runs backwards from the goal and keeps its state between calls. Calling BuildPath again with the
+ * same goal only repairs the part of the search affected by graph edits, reported cost changes and the bot
+ * moving along the path, so replanning around a closed door doesn't search the whole map again.
+ * Changing the goal starts a new search. Costs are edge costs taken from the cost functor, which must never
+ * return less than the straight line distance between waypoints for the search to stay correct.
+ * Only used from the main thread.
+ * @tparam CostFunc Path cost functor, a negative cost means the node can't be traversed
+*/
+template <typename CostFunc>
+class CDStarLiteSearch : public IAStarSearch<CostFunc>
+{
+public:
+	CDStarLiteSearch();
+	virtual ~CDStarLiteSearch();
+
+	/**
+	 * @brief Finds or repairs the path to the goal
+	 * @param start Current waypoint of the bot
+	 * @param end Goal waypoint, the search is restarted if it changed
+	 * @param goal Unused, the goal waypoint position is used
+	 * @param costFunc Path cost functor
+	 * @return true if a path was found
+	*/
+	virtual bool BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc) override;
+	virtual void ResetSearch() override;
+
+	/**
+	 * @brief Reports that the cost of a path changed outside of the waypoint graph, for example in an edge cost overlay.
+	 * The path is repaired on the next BuildPath call.
+	 * @param from Waypoint ID the path leaves from
+	 * @param to Waypoint ID the path leads to, unused since every path of the source waypoint is checked
+	*/
+	void OnPathCostChanged(const int from, const int to);
+	// Reports that the cost of every path leading to or leaving from the waypoint changed
+	void OnWaypointCostChanged(const int id);
+
+	std::vector<CWaypoint*>& GetPath() { return m_path; }
+	const std::vector<int>& GetPathIDs() const { return m_pathids; }
+	// Number of nodes expanded by the last BuildPath call
+	int GetExpandedNodeCount() const { return m_expanded; }
+	// Checks if a search is in progress and can be repaired
+	bool HasSearch() const { return m_graph != nullptr; }
+
+private:
+	using Key = std::pair<float, float>;
+
+	static constexpr float Infinity = std::numeric_limits<float>::infinity();
+
+	void Initialize(std::shared_ptr<const CWaypointGraph> graph, const int startid, const int goalid);
+	// Brings the search up to date with graph edits, returns false if the search must be restarted
+	bool ApplyGraphEdits(std::shared_ptr<const CWaypointGraph> graph);
+	void Resize(const int limit);
+	void AddPredecessors(const CWaypointGraph& graph, const int id, std::vector<int>& nodes) const;
+	float GetEdgeCost(const int from, const int to, const int edge, CostFunc& costFunc);
+	float GetHeuristic(const int id) const { return m_graph->GetPosition(m_startid).DistTo(m_graph->GetPosition(id)); }
+	Key CalculateKey(const int id) const;
+	void UpdateVertex(const int id, CostFunc& costFunc);
+	void ComputeShortestPath(CostFunc& costFunc);
+	bool ExtractPath(CostFunc& costFunc);
+
+	// Open list, a binary heap of node IDs with a position index for updates
+	bool IsInHeap(const int id) const { return m_heapindex[id] >= 0; }
+	bool IsKeyLess(const Key& a, const Key& b) const { return a.first < b.first || (a.first == b.first && a.second < b.second); }
+	void HeapPush(const int id, const Key& key);
+	void HeapRemove(const int id);
+	void HeapSiftUp(int index);
+	void HeapSiftDown(int index);
+
+	std::shared_ptr<const CWaypointGraph> m_graph; // Graph of the current search
+	unsigned int m_graphversion;
+	std::vector<float> m_g;
+	std::vector<float> m_rhs;
+	std::vector<Key> m_keys;
+	std::vector<int> m_heapindex;
+	std::vector<int> m_heap;
+	std::vector<int> m_pending; // Waypoints with cost changes reported since the last call
+	std::vector<CWaypoint*> m_path;
+	std::vector<int> m_pathids;
+	int m_startid;
+	int m_goalid;
+	float m_km; // Key modifier, sum of the heuristic distances the start moved
+	int m_expanded;
+};
+
+template<typename CostFunc>
+inline CDStarLiteSearch<CostFunc>::CDStarLiteSearch() :
+	m_graph(),
+	m_g(),
+	m_rhs(),
+	m_keys(),
+	m_heapindex(),
+	m_heap(),
+	m_pending(),
+	m_path(),
+	m_pathids()
+{
+	m_graphversion = 0;
+	m_startid = WaypointConst::InvalidPathConnection;
+	m_goalid = WaypointConst::InvalidPathConnection;
+	m_km = 0.0f;
+	m_expanded = 0;
+}
+
+template<typename CostFunc>
+inline CDStarLiteSearch<CostFunc>::~CDStarLiteSearch()
+{
+}
+
+template<typename CostFunc>
+inline bool CDStarLiteSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc)
+{
+	m_path.clear();
+	m_pathids.clear();
+	m_expanded = 0;
+
+	if (start == nullptr || end == nullptr)
+		return false;
+
+	std::shared_ptr<const CWaypointGraph> graph = TheWaypoints->GetGraphSnapshot();
+	const int startid = start->GetID();
+	const int goalid = end->GetID();
+
+	if (!graph->IsValidNode(startid) || !graph->IsValidNode(goalid))
+		return false;
+
+	if (m_graph == nullptr || goalid != m_goalid || !ApplyGraphEdits(graph) || !m_graph->IsValidNode(m_startid))
+	{
+		Initialize(graph, startid, goalid);
+	}
+	else if (startid != m_startid)
+	{
+		// The bot moved, keys already in the open list are kept valid by the key modifier
+		m_km += m_graph->GetPosition(m_startid).DistTo(m_graph->GetPosition(startid));
+		m_startid = startid;
+	}
+
+	for (int id : m_pending)
+	{
+		if (id >= 0 && id < m_graph->GetNodeLimit())
+		{
+			UpdateVertex(id, costFunc);
+		}
+	}
+
+	m_pending.clear();
+
+	if (!m_graph->IsReachable(startid, goalid))
+		return false;
+
+	ComputeShortestPath(costFunc);
+	return ExtractPath(costFunc);
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::ResetSearch()
+{
+	m_graph.reset();
+	m_g.clear();
+	m_rhs.clear();
+	m_keys.clear();
+	m_heapindex.clear();
+	m_heap.clear();
+	m_pending.clear();
+	m_path.clear();
+	m_pathids.clear();
+	m_startid = WaypointConst::InvalidPathConnection;
+	m_goalid = WaypointConst::InvalidPathConnection;
+	m_km = 0.0f;
+	m_expanded = 0;
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::OnPathCostChanged(const int from, const int to)
+{
+	m_pending.push_back(from);
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::OnWaypointCostChanged(const int id)
+{
+	if (m_graph == nullptr || id < 0 || id >= m_graph->GetNodeLimit())
+		return;
+
+	m_pending.push_back(id);
+	AddPredecessors(*m_graph, id, m_pending);
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::Initialize(std::shared_ptr<const CWaypointGraph> graph, const int startid, const int goalid)
+{
+	m_graph = graph;
+	m_graphversion = graph->GetVersion();
+	m_startid = startid;
+	m_goalid = goalid;
+	m_km = 0.0f;
+	m_heap.clear();
+	m_pending.clear();
+	m_g.assign(graph->GetNodeLimit(), Infinity);
+	m_rhs.assign(graph->GetNodeLimit(), Infinity);
+	m_keys.assign(graph->GetNodeLimit(), Key(Infinity, Infinity));
+	m_heapindex.assign(graph->GetNodeLimit(), -1);
+
+	m_rhs[goalid] = 0.0f;
+	HeapPush(goalid, CalculateKey(goalid));
+}
+
+template<typename CostFunc>
+inline bool CDStarLiteSearch<CostFunc>::ApplyGraphEdits(std::shared_ptr<const CWaypointGraph> graph)
+{
+	if (graph->GetVersion() == m_graphversion)
+		return true;
+
+	std::vector<int> edits;
+
+	if (!TheWaypoints->GetGraphEditsSince(m_graphversion, edits))
+		return false;
+
+	// The paths of edited waypoints changed, so did the paths leading to them
+	std::vector<int> affected;
+	std::shared_ptr<const CWaypointGraph> oldgraph = m_graph;
+	Resize(graph->GetNodeLimit());
+
+	for (int id : edits)
+	{
+		affected.push_back(id);
+		AddPredecessors(*oldgraph, id, affected);
+		AddPredecessors(*graph, id, affected);
+	}
+
+	m_graph = graph;
+	m_graphversion = graph->GetVersion();
+
+	for (int id : affected)
+	{
+		if (id < 0 || id >= graph->GetNodeLimit())
+			continue;
+
+		if (!graph->IsValidNode(id))
+		{
+			// Deleted waypoint
+			m_g[id] = Infinity;
+			m_rhs[id] = Infinity;
+
+			if (IsInHeap(id))
+			{
+				HeapRemove(id);
+			}
+
+			continue;
+		}
+
+		m_pending.push_back(id);
+	}
+
+	return true;
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::Resize(const int limit)
+{
+	if (limit <= static_cast<int>(m_g.size()))
+		return;
+
+	m_g.resize(limit, Infinity);
+	m_rhs.resize(limit, Infinity);
+	m_keys.resize(limit, Key(Infinity, Infinity));
+	m_heapindex.resize(limit, -1);
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::AddPredecessors(const CWaypointGraph& graph, const int id, std::vector<int>& nodes) const
+{
+	if (id < 0 || id >= graph.GetNodeLimit())
+		return;
+
+	for (int edge = graph.GetFirstReverseEdge(id); edge < graph.GetLastReverseEdge(id); edge++)
+	{
+		nodes.push_back(graph.GetReverseEdgeSource(edge));
+	}
+}
+
+template<typename CostFunc>
+inline float CDStarLiteSearch<CostFunc>::GetEdgeCost(const int from, const int to, const int edge, CostFunc& costFunc)
+{
+	const CWaypointGraph& graph = *m_graph;
+	CAStarNode fromnode;
+	CAStarNode tonode;
+	fromnode.Init(graph.GetWaypoint(from), from, graph.GetPosition(from));
+	tonode.Init(graph.GetWaypoint(to), to, graph.GetPosition(to));
+
+	// Cost functors return the total cost, with a zero cost parent that's the edge cost
+	const float cost = PathSearch::EvaluateCost(costFunc, &tonode, &fromnode, graph.GetEdgeType(edge));
+	return cost < 0.0f ? Infinity : cost;
+}
+
+template<typename CostFunc>
+inline typename CDStarLiteSearch<CostFunc>::Key CDStarLiteSearch<CostFunc>::CalculateKey(const int id) const
+{
+	const float value = std::min(m_g[id], m_rhs[id]);
+	return Key(value + GetHeuristic(id) + m_km, value);
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::UpdateVertex(const int id, CostFunc& costFunc)
+{
+	const CWaypointGraph& graph = *m_graph;
+
+	if (!graph.IsValidNode(id))
+		return;
+
+	if (id != m_goalid)
+	{
+		float rhs = Infinity;
+
+		for (int edge = graph.GetFirstEdge(id); edge < graph.GetLastEdge(id); edge++)
+		{
+			const int next = graph.GetEdgeTarget(edge);
+
+			if (m_g[next] == Infinity)
+				continue;
+
+			rhs = std::min(rhs, GetEdgeCost(id, next, edge, costFunc) + m_g[next]);
+		}
+
+		m_rhs[id] = rhs;
+	}
+
+	if (IsInHeap(id))
+	{
+		HeapRemove(id);
+	}
+
+	if (m_g[id] != m_rhs[id])
+	{
+		HeapPush(id, CalculateKey(id));
+	}
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::ComputeShortestPath(CostFunc& costFunc)
+{
+	const CWaypointGraph& graph = *m_graph;
+
+	while (!m_heap.empty() && (IsKeyLess(m_keys[m_heap.front()], CalculateKey(m_startid)) || m_rhs[m_startid] != m_g[m_startid]))
+	{
+		const int id = m_heap.front();
+		const Key oldkey = m_keys[id];
+		const Key newkey = CalculateKey(id);
+		m_expanded++;
+
+		if (IsKeyLess(oldkey, newkey))
+		{
+			// Key is outdated since the start moved
+			HeapRemove(id);
+			HeapPush(id, newkey);
+		}
+		else if (m_g[id] > m_rhs[id])
+		{
+			// Overconsistent, the cost went down
+			m_g[id] = m_rhs[id];
+			HeapRemove(id);
+
+			for (int edge = graph.GetFirstReverseEdge(id); edge < graph.GetLastReverseEdge(id); edge++)
+			{
+				UpdateVertex(graph.GetReverseEdgeSource(edge), costFunc);
+			}
+		}
+		else
+		{
+			// Underconsistent, the cost went up
+			m_g[id] = Infinity;
+			UpdateVertex(id, costFunc);
+
+			for (int edge = graph.GetFirstReverseEdge(id); edge < graph.GetLastReverseEdge(id); edge++)
+			{
+				UpdateVertex(graph.GetReverseEdgeSource(edge), costFunc);
+			}
+		}
+	}
+}
+
+template<typename CostFunc>
+inline bool CDStarLiteSearch<CostFunc>::ExtractPath(CostFunc& costFunc)
+{
+	const CWaypointGraph& graph = *m_graph;
+
+	if (m_g[m_startid] == Infinity && m_rhs[m_startid] == Infinity)
+		return false;
+
+	int current = m_startid;
+	const int maxsteps = graph.GetNodeCount();
+
+	m_path.push_back(graph.GetWaypoint(current));
+	m_pathids.push_back(current);
+
+	while (current != m_goalid)
+	{
+		int best = WaypointConst::InvalidPathConnection;
+		float bestcost = Infinity;
+
+		for (int edge = graph.GetFirstEdge(current); edge < graph.GetLastEdge(current); edge++)
+		{
+			const int next = graph.GetEdgeTarget(edge);
+
+			if (m_g[next] == Infinity)
+				continue;
+
+			const float cost = GetEdgeCost(current, next, edge, costFunc) + m_g[next];
+
+			if (cost < bestcost)
+			{
+				bestcost = cost;
+				best = next;
+			}
+		}
+
+		if (best == WaypointConst::InvalidPathConnection || static_cast<int>(m_pathids.size()) > maxsteps)
+		{
+			m_path.clear();
+			m_pathids.clear();
+			return false;
+		}
+
+		current = best;
+		m_path.push_back(graph.GetWaypoint(current));
+		m_pathids.push_back(current);
+	}
+
+	return true;
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::HeapPush(const int id, const Key& key)
+{
+	m_keys[id] = key;
+	m_heap.push_back(id);
+	m_heapindex[id] = static_cast<int>(m_heap.size()) - 1;
+	HeapSiftUp(m_heapindex[id]);
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::HeapRemove(const int id)
+{
+	const int index = m_heapindex[id];
+	const int last = m_heap.back();
+	m_heap.pop_back();
+	m_heapindex[id] = -1;
+
+	if (last == id)
+		return;
+
+	m_heap[index] = last;
+	m_heapindex[last] = index;
+	HeapSiftUp(index);
+	HeapSiftDown(m_heapindex[last]);
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::HeapSiftUp(int index)
+{
+	const int id = m_heap[index];
+
+	while (index > 0)
+	{
+		const int parent = (index - 1) / 2;
+
+		if (!IsKeyLess(m_keys[id], m_keys[m_heap[parent]]))
+			break;
+
+		m_heap[index] = m_heap[parent];
+		m_heapindex[m_heap[index]] = index;
+		index = parent;
+	}
+
+	m_heap[index] = id;
+	m_heapindex[id] = index;
+}
+
+template<typename CostFunc>
+inline void CDStarLiteSearch<CostFunc>::HeapSiftDown(int index)
+{
+	const int size = static_cast<int>(m_heap.size());
+	const int id = m_heap[index];
+
+	for (;;)
+	{
+		int child = index * 2 + 1;
+
+		if (child >= size)
+			break;
+
+		if (child + 1 < size && IsKeyLess(m_keys[m_heap[child + 1]], m_keys[m_heap[child]]))
+			child++;
+
+		if (!IsKeyLess(m_keys[m_heap[child]], m_keys[id]))
+			break;
+
+		m_heap[index] = m_heap[child];
+		m_heapindex[m_heap[index]] = index;
+		index = child;
+	}
+
+	m_heap[index] = id;
+	m_heapindex[id] = index;
+}
+
+#endif // !WAYPOINT_DSTAR_LITE_H_
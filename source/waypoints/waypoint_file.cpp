@@ -0,0 +1,421 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_file.h"
+
+namespace
+{
+	// Element size of the known sections, 0 for sections without fixed size elements
+	constexpr size_t s_elementsizes[WaypointFile::MAX_SECTION_TYPES] = {
+		sizeof(int), // SECTION_IDS
+		sizeof(float), // SECTION_POSITION_X
+		sizeof(float), // SECTION_POSITION_Y
+		sizeof(float), // SECTION_POSITION_Z
+		sizeof(float), // SECTION_YAW
+		sizeof(std::uint32_t), // SECTION_FLAGS
+		sizeof(std::uint32_t), // SECTION_PATH_OFFSETS
+		sizeof(int), // SECTION_PATH_TARGETS
+		sizeof(unsigned char), // SECTION_PATH_TYPES
+		0, // SECTION_CUSTOM
+		0, // SECTION_CHUNK
+	};
+
+	struct CRC32Table
+	{
+		std::uint32_t values[256];
+
+		CRC32Table()
+		{
+			for (std::uint32_t i = 0; i < 256; i++)
+			{
+				std::uint32_t crc = i;
+
+				for (int bit = 0; bit < 8; bit++)
+				{
+					crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+				}
+
+				values[i] = crc;
+			}
+		}
+	};
+
+	std::uint32_t AlignOffset(const std::uint32_t offset)
+	{
+		return (offset + WaypointFile::SectionAlignment - 1) & ~(WaypointFile::SectionAlignment - 1);
+	}
+}
+
+std::uint32_t WaypointFile::ComputeCRC32(const void* data, const size_t size, const std::uint32_t crc)
+{
+	static const CRC32Table table;
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	std::uint32_t value = ~crc;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		value = table.values[(value ^ bytes[i]) & 0xFF] ^ (value >> 8);
+	}
+
+	return ~value;
+}
+
+CWaypointFileView::CWaypointFileView()
+{
+	m_data = nullptr;
+	m_size = 0;
+
+	for (auto& section : m_sections)
+	{
+		section = nullptr;
+	}
+
+#ifdef _WIN32
+	m_filehandle = INVALID_HANDLE_VALUE;
+	m_mappinghandle = nullptr;
+#endif
+}
+
+CWaypointFileView::~CWaypointFileView()
+{
+	Close();
+}
+
+bool CWaypointFileView::Open(const std::string& filename)
+{
+	Close();
+	m_error.clear();
+
+	if (!Map(filename))
+	{
+		m_error = "Failed to map waypoint file \"" + filename + "\"!";
+		return false;
+	}
+
+	if (!Validate(filename))
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+void CWaypointFileView::Close()
+{
+	if (m_data != nullptr)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+#else
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+	}
+
+#ifdef _WIN32
+	if (m_mappinghandle != nullptr)
+	{
+		CloseHandle(m_mappinghandle);
+		m_mappinghandle = nullptr;
+	}
+
+	if (m_filehandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_filehandle);
+		m_filehandle = INVALID_HANDLE_VALUE;
+	}
+#endif
+
+	m_data = nullptr;
+	m_size = 0;
+
+	for (auto& section : m_sections)
+	{
+		section = nullptr;
+	}
+}
+
+const WaypointFileSection* CWaypointFileView::FindSection(const WaypointFile::SectionType type) const
+{
+	if (m_data == nullptr || type >= WaypointFile::MAX_SECTION_TYPES)
+		return nullptr;
+
+	return m_sections[type];
+}
+
+bool CWaypointFileView::Map(const std::string& filename)
+{
+#ifdef _WIN32
+	m_filehandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (m_filehandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+
+	if (GetFileSizeEx(m_filehandle, &size) == FALSE || size.QuadPart < static_cast<LONGLONG>(sizeof(WaypointFileHeader)))
+		return false;
+
+	m_mappinghandle = CreateFileMappingA(m_filehandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (m_mappinghandle == nullptr)
+		return false;
+
+	m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mappinghandle, FILE_MAP_READ, 0, 0, 0));
+	m_size = static_cast<size_t>(size.QuadPart);
+	return m_data != nullptr;
+#else
+	const int fd = ::open(filename.c_str(), O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+
+	if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(WaypointFileHeader)))
+	{
+		::close(fd);
+		return false;
+	}
+
+	void* data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping stays valid after the descriptor is closed
+
+	if (data == MAP_FAILED)
+		return false;
+
+	m_data = static_cast<const unsigned char*>(data);
+	m_size = static_cast<size_t>(info.st_size);
+	return true;
+#endif
+}
+
+bool CWaypointFileView::Validate(const std::string& filename)
+{
+	const WaypointFileHeader& header = GetHeader();
+
+	if (strncmp(header.header, WAYPOINT_FILE_HEADER, 7) != 0 || header.version != WaypointFile::MappedVersion)
+	{
+		m_error = "File \"" + filename + "\" is not a version " + std::to_string(WaypointFile::MappedVersion) + " waypoint file!";
+		return false;
+	}
+
+	if (header.filesize != m_size || header.num_waypoints < 0 || header.idlimit < 0 || header.idlimit > WaypointFile::MaxWaypointIDs || header.num_sections < 0 || header.num_sections > WaypointFile::MaxSections)
+	{
+		m_error = "Waypoint file \"" + filename + "\" has an invalid header!";
+		return false;
+	}
+
+	const size_t tableend = sizeof(WaypointFileHeader) + static_cast<size_t>(header.num_sections) * sizeof(WaypointFileSection);
+
+	if (tableend > m_size)
+	{
+		m_error = "Waypoint file \"" + filename + "\" is truncated!";
+		return false;
+	}
+
+	if (WaypointFile::ComputeCRC32(m_data + sizeof(WaypointFileHeader), m_size - sizeof(WaypointFileHeader)) != header.crc)
+	{
+		m_error = "Waypoint file \"" + filename + "\" is corrupted, CRC mismatch!";
+		return false;
+	}
+
+	const WaypointFileSection* table = reinterpret_cast<const WaypointFileSection*>(m_data + sizeof(WaypointFileHeader));
+	// Section bounds are checked in 64 bits, they would wrap on 32 bit builds
+	const std::uint64_t filesize = m_size;
+
+	for (int i = 0; i < header.num_sections; i++)
+	{
+		const WaypointFileSection& section = table[i];
+
+		if (section.offset < tableend || section.offset % WaypointFile::SectionAlignment != 0 || section.offset > filesize || section.size > filesize - section.offset)
+		{
+			m_error = "Waypoint file \"" + filename + "\" has an invalid section!";
+			return false;
+		}
+
+		// Sections added by newer versions are skipped
+		if (section.type >= WaypointFile::MAX_SECTION_TYPES)
+			continue;
+
+		const std::uint64_t elementsize = s_elementsizes[section.type];
+
+		if (elementsize != 0 && static_cast<std::uint64_t>(section.count) * elementsize != section.size)
+		{
+			m_error = "Waypoint file \"" + filename + "\" has an invalid section!";
+			return false;
+		}
+
+		m_sections[section.type] = &section;
+	}
+
+	const std::uint32_t count = static_cast<std::uint32_t>(header.num_waypoints);
+	const WaypointFile::SectionType required[] = {
+		WaypointFile::SECTION_IDS, WaypointFile::SECTION_POSITION_X, WaypointFile::SECTION_POSITION_Y, WaypointFile::SECTION_POSITION_Z, WaypointFile::SECTION_YAW,
+	};
+
+	for (auto type : required)
+	{
+		if (m_sections[type] == nullptr || m_sections[type]->count != count)
+		{
+			m_error = "Waypoint file \"" + filename + "\" is missing waypoint data!";
+			return false;
+		}
+	}
+
+	if (m_sections[WaypointFile::SECTION_FLAGS] != nullptr && m_sections[WaypointFile::SECTION_FLAGS]->count != count)
+	{
+		m_sections[WaypointFile::SECTION_FLAGS] = nullptr;
+	}
+
+	const WaypointFileSection* offsets = m_sections[WaypointFile::SECTION_PATH_OFFSETS];
+	const WaypointFileSection* targets = m_sections[WaypointFile::SECTION_PATH_TARGETS];
+	const WaypointFileSection* types = m_sections[WaypointFile::SECTION_PATH_TYPES];
+
+	if (offsets == nullptr || targets == nullptr || types == nullptr || offsets->count != count + 1 || targets->count != types->count)
+	{
+		m_error = "Waypoint file \"" + filename + "\" is missing path data!";
+		return false;
+	}
+
+	// Path ranges must be in order so they can be used without bounds checks
+	const std::uint32_t* pathoffsets = GetOffsets();
+
+	if (pathoffsets[0] != 0 || pathoffsets[count] != targets->count)
+	{
+		m_error = "Waypoint file \"" + filename + "\" has invalid path data!";
+		return false;
+	}
+
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		if (pathoffsets[i] > pathoffsets[i + 1])
+		{
+			m_error = "Waypoint file \"" + filename + "\" has invalid path data!";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool WriteWaypointFile(const std::string& filename, const WaypointFileData& data, std::uint32_t& crc)
+{
+	struct SectionSource
+	{
+		WaypointFile::SectionType type;
+		const void* data;
+		size_t count;
+		size_t size;
+	};
+
+	const size_t count = data.ids.size();
+	std::vector<SectionSource> sections = {
+		{ WaypointFile::SECTION_IDS, data.ids.data(), count, count * sizeof(int) },
+		{ WaypointFile::SECTION_POSITION_X, data.positions[0].data(), count, count * sizeof(float) },
+		{ WaypointFile::SECTION_POSITION_Y, data.positions[1].data(), count, count * sizeof(float) },
+		{ WaypointFile::SECTION_POSITION_Z, data.positions[2].data(), count, count * sizeof(float) },
+		{ WaypointFile::SECTION_YAW, data.yaws.data(), count, count * sizeof(float) },
+		{ WaypointFile::SECTION_FLAGS, data.flags.data(), count, count * sizeof(std::uint32_t) },
+		{ WaypointFile::SECTION_PATH_OFFSETS, data.offsets.data(), data.offsets.size(), data.offsets.size() * sizeof(std::uint32_t) },
+		{ WaypointFile::SECTION_PATH_TARGETS, data.targets.data(), data.targets.size(), data.targets.size() * sizeof(int) },
+		{ WaypointFile::SECTION_PATH_TYPES, data.types.data(), data.types.size(), data.types.size() * sizeof(unsigned char) },
+		{ WaypointFile::SECTION_CUSTOM, data.custom.data(), data.custom.size(), data.custom.size() },
+	};
+
+	// Chunk sections store the tag in the element count
+	for (auto& chunk : data.chunks)
+	{
+		sections.push_back({ WaypointFile::SECTION_CHUNK, chunk.second.data(), chunk.first, chunk.second.size() });
+	}
+
+	if (sections.size() > static_cast<size_t>(WaypointFile::MaxSections))
+		return false;
+
+	const int numsections = static_cast<int>(sections.size());
+	std::vector<WaypointFileSection> table(sections.size());
+	std::uint32_t offset = static_cast<std::uint32_t>(sizeof(WaypointFileHeader) + sizeof(WaypointFileSection) * table.size());
+
+	for (int i = 0; i < numsections; i++)
+	{
+		offset = AlignOffset(offset);
+		table[i].type = sections[i].type;
+		table[i].count = static_cast<std::uint32_t>(sections[i].count);
+		table[i].offset = offset;
+		table[i].size = static_cast<std::uint32_t>(sections[i].size);
+		offset += table[i].size;
+	}
+
+	// Everything after the header is built in memory first, the CRC goes in the header
+	std::vector<char> buffer(offset - sizeof(WaypointFileHeader), 0);
+	std::memcpy(buffer.data(), table.data(), sizeof(WaypointFileSection) * table.size());
+
+	for (int i = 0; i < numsections; i++)
+	{
+		if (table[i].size > 0)
+		{
+			std::memcpy(buffer.data() + table[i].offset - sizeof(WaypointFileHeader), sections[i].data, table[i].size);
+		}
+	}
+
+	WaypointFileHeader header{};
+	std::memcpy(header.header, WAYPOINT_FILE_HEADER, std::strlen(WAYPOINT_FILE_HEADER));
+	header.version = WaypointFile::MappedVersion;
+	header.subversion = data.subversion;
+	header.num_waypoints = static_cast<int>(count);
+	header.idlimit = data.idlimit;
+	header.num_sections = numsections;
+	header.filesize = offset;
+	header.crc = WaypointFile::ComputeCRC32(buffer.data(), buffer.size());
+	header.journalbase = data.journalbase;
+	header.journalsequence = data.journalsequence;
+
+	const std::string temp = filename + ".tmp";
+	std::fstream file;
+	file.open(temp, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+
+	if (!file.is_open())
+		return false;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(WaypointFileHeader));
+	file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	const bool written = file.good();
+	file.close();
+
+	std::error_code error;
+
+	if (!written)
+	{
+		std::filesystem::remove(temp, error);
+		return false;
+	}
+
+	std::filesystem::rename(temp, filename, error);
+
+	if (error)
+	{
+		std::filesystem::remove(temp, error);
+		return false;
+	}
+
+	crc = header.crc;
+	return true;
+}
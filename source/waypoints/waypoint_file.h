@@ -0,0 +1,188 @@
+#ifndef WAYPOINT_FILE_H_
+#define WAYPOINT_FILE_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+namespace WaypointFile
+{
+	constexpr int LegacyVersion = 0; // Fixed size waypoint records with 64 path slots
+	constexpr int MappedVersion = 1; // Section based layout that is read from a memory mapped file
+	constexpr std::uint32_t SectionAlignment = 16; // Section data offsets are multiples of this
+	constexpr int MaxSections = 64;
+	constexpr int MaxWaypointIDs = 1 << 20; // Files with higher waypoint IDs are rejected, per ID arrays are sized from them
+
+	enum SectionType : std::uint32_t
+	{
+		SECTION_IDS = 0, // int per waypoint
+		SECTION_POSITION_X, // float per waypoint
+		SECTION_POSITION_Y, // float per waypoint
+		SECTION_POSITION_Z, // float per waypoint
+		SECTION_YAW, // float per waypoint
+		SECTION_FLAGS, // std::uint32_t per waypoint, reserved for waypoint flags
+		SECTION_PATH_OFFSETS, // std::uint32_t per waypoint plus one, index of the first path of each waypoint
+		SECTION_PATH_TARGETS, // int per path, ID of the connected waypoint
+		SECTION_PATH_TYPES, // unsigned char per path, WaypointPath::PathType
+		SECTION_CUSTOM, // Mod data written by the waypoint manager custom save functions
+		SECTION_CHUNK, // Tagged mod data chunk, read on first access by the chunk owner. May appear more than once
+
+		MAX_SECTION_TYPES
+	};
+
+	// Builds a chunk tag from four characters
+	constexpr std::uint32_t MakeChunkTag(const char a, const char b, const char c, const char d)
+	{
+		return static_cast<std::uint32_t>(static_cast<unsigned char>(a)) | (static_cast<std::uint32_t>(static_cast<unsigned char>(b)) << 8) |
+			(static_cast<std::uint32_t>(static_cast<unsigned char>(c)) << 16) | (static_cast<std::uint32_t>(static_cast<unsigned char>(d)) << 24);
+	}
+
+	/**
+	 * @brief Computes the CRC32 (IEEE 802.3) of a buffer
+	 * @param data Buffer
+	 * @param size Buffer size in bytes
+	 * @param crc CRC of the previous buffers when computing the CRC of data split in multiple buffers
+	 * @return CRC32
+	*/
+	std::uint32_t ComputeCRC32(const void* data, const size_t size, const std::uint32_t crc = 0);
+}
+
+/**
+ * @brief Header of version 1 waypoint files.
+ * The first fields have the same layout as the version 0 header so the version can be read before knowing the format.
+*/
+struct WaypointFileHeader
+{
+	char header[10];
+	int version;
+	int subversion;
+	int num_waypoints;
+	int idlimit; // All waypoint IDs are lower than this
+	int num_sections; // Number of entries in the section table that follows the header
+	std::uint32_t filesize;
+	std::uint32_t crc; // CRC32 of everything after the header
+	std::uint32_t journalbase; // Base CRC of the edit journal that was folded into this file
+	std::uint32_t journalsequence; // Last edit journal record folded into this file
+	std::uint32_t reserved[4];
+};
+
+static_assert(sizeof(WaypointFileHeader) == 64, "Waypoint file header layout changed!");
+
+/**
+ * @brief Entry of the section table
+*/
+struct WaypointFileSection
+{
+	std::uint32_t type; // WaypointFile::SectionType, unknown types are ignored
+	std::uint32_t count; // Number of elements, chunk tag of SECTION_CHUNK sections
+	std::uint32_t offset; // Offset of the section data from the start of the file
+	std::uint32_t size; // Size of the section data in bytes
+};
+
+static_assert(sizeof(WaypointFileSection) == 16, "Waypoint file section layout changed!");
+
+/**
+ * @brief Read only view of a version 1 waypoint file.
+ *
+ * The file is memory mapped and validated once when opened (bounds, alignment, CSR offsets and CRC),
+ * the section arrays can then be read without further checks. The view is only kept while loading,
+ * the waypoint manager copies the sections into its own waypoints.
+*/
+class CWaypointFileView
+{
+public:
+	CWaypointFileView();
+	~CWaypointFileView();
+
+	CWaypointFileView(const CWaypointFileView&) = delete;
+	CWaypointFileView& operator=(const CWaypointFileView&) = delete;
+
+	/**
+	 * @brief Maps and validates a waypoint file
+	 * @param filename File to open
+	 * @return true if the file is a valid version 1 waypoint file
+	*/
+	bool Open(const std::string& filename);
+	void Close();
+	bool IsOpen() const { return m_data != nullptr; }
+	// Reason the last Open call failed, errors are not logged so files can be opened from any thread
+	const std::string& GetError() const { return m_error; }
+
+	const WaypointFileHeader& GetHeader() const { return *reinterpret_cast<const WaypointFileHeader*>(m_data); }
+	int GetWaypointCount() const { return GetHeader().num_waypoints; }
+	int GetPathCount() const { return static_cast<int>(GetOffsets()[GetWaypointCount()]); }
+
+	const int* GetIDs() const { return GetArray<int>(WaypointFile::SECTION_IDS); }
+	const float* GetPositionsX() const { return GetArray<float>(WaypointFile::SECTION_POSITION_X); }
+	const float* GetPositionsY() const { return GetArray<float>(WaypointFile::SECTION_POSITION_Y); }
+	const float* GetPositionsZ() const { return GetArray<float>(WaypointFile::SECTION_POSITION_Z); }
+	const float* GetYaws() const { return GetArray<float>(WaypointFile::SECTION_YAW); }
+	// Waypoint flags, nullptr if the file doesn't have them
+	const std::uint32_t* GetFlags() const { return GetArray<std::uint32_t>(WaypointFile::SECTION_FLAGS); }
+	// Paths of the waypoint at index N are in the range [GetOffsets()[N], GetOffsets()[N + 1])
+	const std::uint32_t* GetOffsets() const { return GetArray<std::uint32_t>(WaypointFile::SECTION_PATH_OFFSETS); }
+	const int* GetPathTargets() const { return GetArray<int>(WaypointFile::SECTION_PATH_TARGETS); }
+	const unsigned char* GetPathTypes() const { return GetArray<unsigned char>(WaypointFile::SECTION_PATH_TYPES); }
+
+	// Gets a section table entry, nullptr if the file doesn't have the section
+	const WaypointFileSection* FindSection(const WaypointFile::SectionType type) const;
+	// Number of entries in the section table
+	int GetSectionCount() const { return GetHeader().num_sections; }
+	const WaypointFileSection& GetSection(const int index) const { return reinterpret_cast<const WaypointFileSection*>(m_data + sizeof(WaypointFileHeader))[index]; }
+	const unsigned char* GetSectionData(const WaypointFileSection& section) const { return m_data + section.offset; }
+
+private:
+	template <typename T>
+	const T* GetArray(const WaypointFile::SectionType type) const
+	{
+		const WaypointFileSection* section = m_sections[type];
+		return section != nullptr ? reinterpret_cast<const T*>(m_data + section->offset) : nullptr;
+	}
+
+	bool Map(const std::string& filename);
+	bool Validate(const std::string& filename);
+
+	const unsigned char* m_data;
+	size_t m_size;
+	const WaypointFileSection* m_sections[WaypointFile::MAX_SECTION_TYPES]; // Known sections, nullptr if missing
+	std::string m_error;
+#ifdef _WIN32
+	void* m_filehandle;
+	void* m_mappinghandle;
+#endif
+};
+
+/**
+ * @brief Waypoints in the version 1 file layout.
+ * Taken on the main thread so the file can be written from another thread while the waypoints keep changing.
+*/
+struct WaypointFileData
+{
+	int subversion;
+	int idlimit; // All waypoint IDs are lower than this
+	std::uint32_t journalbase;
+	std::uint32_t journalsequence;
+	std::vector<int> ids;
+	std::vector<float> positions[3]; // X, Y and Z
+	std::vector<float> yaws;
+	std::vector<std::uint32_t> flags;
+	std::vector<std::uint32_t> offsets; // CSR path offsets, one extra entry at the end
+	std::vector<int> targets;
+	std::vector<unsigned char> types;
+	std::string custom; // Mod data written by the custom save functions
+	std::vector<std::pair<std::uint32_t, std::string>> chunks; // Tagged mod data chunks
+};
+
+/**
+ * @brief Writes a version 1 waypoint file, safe to call from any thread.
+ * The file is written next to the destination and renamed over it, a crash never leaves a partial waypoint file.
+ * @param filename Waypoint file
+ * @param data Waypoints to write
+ * @param crc Stores the CRC of the written file
+ * @return true if the file was written
+*/
+bool WriteWaypointFile(const std::string& filename, const WaypointFileData& data, std::uint32_t& crc);
+
+#endif // !WAYPOINT_FILE_H_
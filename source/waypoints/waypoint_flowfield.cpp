@@ -0,0 +1,135 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <queue>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+#include "plugincvars.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_flowfield.h"
+
+CFlowFieldCache* TheFlowFields = nullptr;
+
+CFlowField::CFlowField() :
+	m_nexthops(),
+	m_distances()
+{
+	m_goalid = WaypointConst::InvalidPathConnection;
+	m_graphversion = 0;
+}
+
+void CFlowField::Build(const CWaypointGraph& graph, const int goalid)
+{
+	m_goalid = goalid;
+	m_graphversion = graph.GetVersion();
+	m_nexthops.assign(graph.GetNodeLimit(), WaypointConst::InvalidPathConnection);
+	m_distances.assign(graph.GetNodeLimit(), -1.0f);
+
+	if (!graph.IsValidNode(goalid))
+		return;
+
+	using QueueEntry = std::pair<float, int>;
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+	m_distances[goalid] = 0.0f;
+	queue.emplace(0.0f, goalid);
+
+	while (!queue.empty())
+	{
+		const QueueEntry entry = queue.top();
+		queue.pop();
+		const int id = entry.second;
+
+		if (entry.first > m_distances[id])
+			continue;
+
+		// Waypoints with a path leading to this one
+		for (int edge = graph.GetFirstReverseEdge(id); edge < graph.GetLastReverseEdge(id); edge++)
+		{
+			const int source = graph.GetReverseEdgeSource(edge);
+			const float distance = entry.first + graph.GetReverseEdgeLength(edge);
+
+			if (m_distances[source] < 0.0f || distance < m_distances[source])
+			{
+				m_distances[source] = distance;
+				m_nexthops[source] = id;
+				queue.emplace(distance, source);
+			}
+		}
+	}
+}
+
+CFlowFieldCache::CFlowFieldCache() :
+	m_fields(),
+	m_goals()
+{
+	m_graphversion = 0;
+	m_builds = 0;
+}
+
+CFlowFieldCache::~CFlowFieldCache()
+{
+}
+
+const CFlowField* CFlowFieldCache::GetFlowField(CWaypoint* goal)
+{
+	if (goal == nullptr)
+		return nullptr;
+
+	if (m_graphversion != TheWaypoints->GetGraphVersion())
+	{
+		Clear();
+		m_graphversion = TheWaypoints->GetGraphVersion();
+	}
+
+	auto it = m_goals.find(goal->GetID());
+
+	if (it != m_goals.end())
+	{
+		m_fields.splice(m_fields.begin(), m_fields, it->second);
+		return &m_fields.front();
+	}
+
+	const size_t capacity = static_cast<size_t>(std::max(1, static_cast<int>(gb_nav_flow_fields.value)));
+
+	while (m_fields.size() >= capacity)
+	{
+		m_goals.erase(m_fields.back().GetGoal());
+		m_fields.pop_back();
+	}
+
+	m_fields.emplace_front();
+	CFlowField& field = m_fields.front();
+	field.Build(TheWaypoints->GetGraph(), goal->GetID());
+	m_goals[goal->GetID()] = m_fields.begin();
+	m_builds++;
+	return &field;
+}
+
+CWaypoint* CFlowFieldCache::GetNextHop(CWaypoint* from, CWaypoint* goal)
+{
+	if (from == nullptr)
+		return nullptr;
+
+	const CFlowField* field = GetFlowField(goal);
+
+	if (field == nullptr)
+		return nullptr;
+
+	return TheWaypoints->GetWaypointOfID(field->GetNextHop(from->GetID()));
+}
+
+void CFlowFieldCache::Clear()
+{
+	m_fields.clear();
+	m_goals.clear();
+}
@@ -0,0 +1,82 @@
+#ifndef WAYPOINT_FLOW_FIELD_H_
+#define WAYPOINT_FLOW_FIELD_H_
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+
+#include "waypoint_graph.h"
+
+/**
+ * @brief Shortest path tree toward a single goal waypoint.
+ *
+ * Built with a Dijkstra search over the reverse paths from the goal, every waypoint that can reach the goal
+ * stores the next waypoint on its shortest path. Distances are path lengths.
+*/
+class CFlowField
+{
+public:
+	CFlowField();
+
+	void Build(const CWaypointGraph& graph, const int goalid);
+
+	int GetGoal() const { return m_goalid; }
+	unsigned int GetGraphVersion() const { return m_graphversion; }
+	// Next waypoint ID toward the goal, InvalidPathConnection if the goal can't be reached or id is the goal
+	int GetNextHop(const int id) const { return IsValidID(id) ? m_nexthops[id] : WaypointConst::InvalidPathConnection; }
+	// Path length to the goal, negative if the goal can't be reached
+	float GetDistance(const int id) const { return IsValidID(id) ? m_distances[id] : -1.0f; }
+	bool CanReachGoal(const int id) const { return GetDistance(id) >= 0.0f; }
+
+private:
+	bool IsValidID(const int id) const { return id >= 0 && id < static_cast<int>(m_nexthops.size()); }
+
+	int m_goalid;
+	unsigned int m_graphversion;
+	std::vector<int> m_nexthops;
+	std::vector<float> m_distances;
+};
+
+/**
+ * @brief LRU cache of flow fields shared by every bot.
+ *
+ * Fields are built on demand and dropped when the waypoints change. Only used from the main thread.
+*/
+class CFlowFieldCache
+{
+public:
+	CFlowFieldCache();
+	virtual ~CFlowFieldCache();
+
+	/**
+	 * @brief Gets the flow field toward a goal, building it if needed
+	 * @param goal Goal waypoint
+	 * @return Flow field or nullptr if the goal is invalid
+	*/
+	const CFlowField* GetFlowField(CWaypoint* goal);
+	/**
+	 * @brief Next waypoint on the shortest path toward the goal
+	 * @param from Current waypoint
+	 * @param goal Goal waypoint
+	 * @return Next waypoint or nullptr if the goal can't be reached or was already reached
+	*/
+	CWaypoint* GetNextHop(CWaypoint* from, CWaypoint* goal);
+	void Clear();
+
+	int GetFlowFieldCount() const { return static_cast<int>(m_fields.size()); }
+	// Number of fields built since the cache was created
+	unsigned int GetBuildCount() const { return m_builds; }
+
+private:
+	using FieldList = std::list<CFlowField>;
+
+	FieldList m_fields; // Most recently used first
+	std::unordered_map<int, FieldList::iterator> m_goals; // Fields by goal waypoint ID
+	unsigned int m_graphversion; // Graph version of the cached fields
+	unsigned int m_builds;
+};
+
+// Flow field cache singleton
+extern CFlowFieldCache* TheFlowFields;
+
+#endif // !WAYPOINT_FLOW_FIELD_H_
@@ -0,0 +1,749 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "plugincvars.h"
+#include "pluginutil.h"
+#include "mods/mod_base.h"
+#include "interfaces/basehllocomotion.h"
+#include "sdk/bsp_collision.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_generator.h"
+
+// The flood fill stops adding samples past this count
+constexpr size_t GENERATOR_MAX_SAMPLES = 65536;
+// Samples within this many grid cells of the cluster first sample can be merged into it
+constexpr int GENERATOR_MERGE_CELLS = 2;
+// Hull used for the movement traces, the standing player hull
+constexpr int GENERATOR_HULL = human_hull;
+// Distance from the standing player hull origin to the bottom of the hull
+constexpr float GENERATOR_HULL_HALF_HEIGHT = 36.0f;
+// Steeper floors can't be walked on, same limit as the player movement code
+constexpr float GENERATOR_MIN_GROUND_NORMAL = 0.7f;
+// Samples are on the same plane when their normals differ less than this and their distance to the plane is small
+constexpr float GENERATOR_COPLANAR_NORMAL = 0.99f;
+constexpr float GENERATOR_COPLANAR_DISTANCE = 2.0f;
+// Height differences below this are considered flat when typing paths
+constexpr float GENERATOR_FLAT_HEIGHT = 1.0f;
+// How far down the ground is searched under the spawn points
+constexpr float GENERATOR_SEED_DROP = 4096.0f;
+// Sample edges turned into cluster edges per step
+constexpr size_t GENERATOR_LINK_BATCH = 1024;
+// Seconds between progress reports to the editor
+constexpr float GENERATOR_REPORT_INTERVAL = 1.0f;
+
+// Player spawn points of the Half-Life multiplayer and single player games
+static const char* s_spawnclassnames[] = { "info_player_start", "info_player_deathmatch", "info_player_coop" };
+
+static const int s_directions[8][2] = { { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 } };
+
+static inline std::int64_t GeneratorCellKey(const int x, const int y)
+{
+	return static_cast<std::int64_t>((static_cast<std::uint64_t>(static_cast<std::uint32_t>(x)) << 32) | static_cast<std::uint32_t>(y));
+}
+
+static inline std::int64_t GeneratorEdgeKey(const int from, const int to)
+{
+	return static_cast<std::int64_t>((static_cast<std::uint64_t>(static_cast<std::uint32_t>(from)) << 32) | static_cast<std::uint32_t>(to));
+}
+
+// End of the gb_nav_generate_budget time slice of this frame
+static std::chrono::steady_clock::time_point GetFrameDeadline()
+{
+	const float budget = std::max(0.1f, gb_nav_generate_budget.value);
+	// Converted to the clock resolution first, adding a float duration to the clock would round the deadline to float precision
+	return std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float, std::milli>(budget));
+}
+
+CWaypointGenerator::CWaypointGenerator() :
+	m_samples(),
+	m_edges(),
+	m_cells(),
+	m_open(),
+	m_clustercenters(),
+	m_clusteredges(),
+	m_links(),
+	m_emitted(),
+	m_collision(),
+	m_worker(),
+	m_finished(false),
+	m_cancel(false),
+	m_samplecount(0),
+	m_gridorigin()
+{
+	m_phase = PHASE_DONE;
+	m_cursor = 0;
+	m_spacing = 32.0f;
+	m_stepheight = 18.0f;
+	m_jumpheight = HalfLifeMovement::MaxJumpHeight;
+	m_dropheight = HalfLifeMovement::DeathDropHeight;
+	m_nextreport = 0.0f;
+	m_created = 0;
+	m_pathsadded = 0;
+	m_running = false;
+	m_emitting = false;
+	m_truncated = false;
+}
+
+CWaypointGenerator::~CWaypointGenerator()
+{
+	StopWorker();
+}
+
+bool CWaypointGenerator::Start(const float spacing)
+{
+	if (m_running)
+		return false;
+
+	m_samples.clear();
+	m_edges.clear();
+	m_cells.clear();
+	m_open.clear();
+	m_clustercenters.clear();
+	m_clusteredges.clear();
+	m_links.clear();
+	m_emitted.clear();
+	m_samplecount = 0;
+	m_phase = PHASE_EXPLORE;
+	m_cursor = 0;
+	m_spacing = spacing;
+	m_truncated = false;
+	m_collision = TheMapCollision;
+
+	// Same limits as CBaseHalfLifeLocomotion, there is no locomotion interface outside of the bots
+	m_stepheight = CVAR_GET_FLOAT("sv_stepsize");
+
+	if (m_stepheight <= 0.0f)
+	{
+		m_stepheight = 18.0f;
+	}
+
+	m_jumpheight = HalfLifeMovement::MaxJumpHeight;
+	m_dropheight = HalfLifeMovement::DeathDropHeight;
+
+	bool hasorigin = false;
+
+	for (auto classname : s_spawnclassnames)
+	{
+		edict_t* spawn = nullptr;
+
+		while ((spawn = UTIL_FindEntityByClassname(spawn, classname)) != nullptr)
+		{
+			// The grid is aligned to the first spawn point
+			if (!hasorigin)
+			{
+				m_gridorigin = spawn->v.origin;
+				hasorigin = true;
+			}
+
+			AddSeed(spawn->v.origin);
+		}
+	}
+
+	if (m_samples.empty())
+	{
+		m_collision.reset();
+		m_phase = PHASE_DONE;
+		return false;
+	}
+
+	m_finished = false;
+	m_cancel = false;
+	m_nextreport = gpGlobals->time + GENERATOR_REPORT_INTERVAL;
+	m_running = true;
+
+	if (m_collision != nullptr)
+	{
+		m_worker = std::thread(&CWaypointGenerator::WorkerMain, this);
+	}
+
+	LOG_CONSOLE(PLID, "Generating waypoints from %i spawn points with %s.", static_cast<int>(m_samples.size()),
+		m_collision != nullptr ? "map collision traces" : "engine traces");
+	return true;
+}
+
+void CWaypointGenerator::Update()
+{
+	if (!m_running)
+		return;
+
+	if (m_emitting)
+	{
+		if (Emit() && gpGlobals->time >= m_nextreport)
+		{
+			m_nextreport = gpGlobals->time + GENERATOR_REPORT_INTERVAL;
+			const size_t total = m_clustercenters.size() + m_clusteredges.size();
+			char message[64];
+			snprintf(message, sizeof(message), "Creating waypoints... %i%% \n", static_cast<int>(m_cursor * 100 / std::max<size_t>(total, 1)));
+			Report(message);
+		}
+
+		return;
+	}
+
+	if (m_collision == nullptr)
+	{
+		RunFrameBudget();
+	}
+
+	if (!m_finished.load(std::memory_order_acquire))
+	{
+		if (gpGlobals->time >= m_nextreport)
+		{
+			m_nextreport = gpGlobals->time + GENERATOR_REPORT_INTERVAL;
+			char message[64];
+			snprintf(message, sizeof(message), "Generating waypoints... %i samples \n", static_cast<int>(m_samplecount.load(std::memory_order_relaxed)));
+			Report(message);
+		}
+
+		return;
+	}
+
+	StopWorker();
+	m_emitted.assign(m_clustercenters.size(), { -1, 0 });
+	m_cursor = 0;
+	m_created = 0;
+	m_pathsadded = 0;
+	m_emitting = true;
+}
+
+void CWaypointGenerator::Cancel()
+{
+	if (!m_running)
+		return;
+
+	StopWorker();
+	m_samples.clear();
+	m_edges.clear();
+	m_cells.clear();
+	m_open.clear();
+	m_clustercenters.clear();
+	m_clusteredges.clear();
+	m_links.clear();
+	m_emitted.clear();
+	m_phase = PHASE_DONE;
+	m_running = false;
+	m_emitting = false;
+}
+
+bool CWaypointGenerator::Step()
+{
+	switch (m_phase)
+	{
+	case PHASE_EXPLORE:
+	{
+		if (m_open.empty())
+		{
+			m_cursor = 0;
+			m_phase = PHASE_MERGE;
+			break;
+		}
+
+		const int index = m_open.front();
+		m_open.pop_front();
+		Explore(index);
+		break;
+	}
+	case PHASE_MERGE:
+	{
+		if (m_cursor >= m_samples.size())
+		{
+			m_cursor = 0;
+			m_phase = PHASE_LINK;
+			break;
+		}
+
+		if (m_samples[m_cursor].cluster < 0)
+		{
+			MergeCluster(static_cast<int>(m_cursor));
+		}
+
+		m_cursor++;
+		break;
+	}
+	case PHASE_LINK:
+	{
+		if (m_cursor >= m_edges.size())
+		{
+			m_links.clear();
+			m_cursor = 0;
+			m_phase = PHASE_VERIFY;
+			break;
+		}
+
+		LinkClusters();
+		break;
+	}
+	case PHASE_VERIFY:
+	{
+		if (m_cursor >= m_clusteredges.size())
+		{
+			auto removed = std::remove_if(m_clusteredges.begin(), m_clusteredges.end(), [](const GeneratorEdge& edge) {
+				return edge.type == WaypointPath::MAX_PATH_TYPES;
+			});
+
+			m_clusteredges.erase(removed, m_clusteredges.end());
+			m_phase = PHASE_DONE;
+			break;
+		}
+
+		GeneratorEdge& edge = m_clusteredges[m_cursor];
+
+		if (!VerifyEdge(edge))
+		{
+			edge.type = WaypointPath::MAX_PATH_TYPES;
+		}
+
+		m_cursor++;
+		break;
+	}
+	default:
+		break;
+	}
+
+	return m_phase != PHASE_DONE;
+}
+
+void CWaypointGenerator::WorkerMain()
+{
+	while (!m_cancel.load(std::memory_order_relaxed) && Step())
+	{
+	}
+
+	m_finished.store(true, std::memory_order_release);
+}
+
+void CWaypointGenerator::RunFrameBudget()
+{
+	const auto deadline = GetFrameDeadline();
+
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		if (!Step())
+		{
+			m_finished.store(true, std::memory_order_release);
+			return;
+		}
+	}
+}
+
+void CWaypointGenerator::AddSeed(const Vector& position)
+{
+	const int x = static_cast<int>(roundf((position.x - m_gridorigin.x) / m_spacing));
+	const int y = static_cast<int>(roundf((position.y - m_gridorigin.y) / m_spacing));
+	const Vector start(m_gridorigin.x + x * m_spacing, m_gridorigin.y + y * m_spacing, position.z);
+	BSPTraceResult tr;
+
+	TraceHull(start, start - Vector(0.0f, 0.0f, GENERATOR_SEED_DROP), tr);
+
+	// Spawn point stuck in a wall once moved to the grid or floating above the void
+	if (tr.startsolid || tr.fraction >= 1.0f || tr.normal.z < GENERATOR_MIN_GROUND_NORMAL)
+		return;
+
+	// Spawn points near each other end at the same sample
+	if (FindSample(x, y, tr.endpos.z) >= 0)
+		return;
+
+	m_open.push_back(AddSample(x, y, tr.endpos, tr.normal));
+}
+
+void CWaypointGenerator::Explore(const int index)
+{
+	const Vector origin = m_samples[index].origin;
+	const int x = m_samples[index].x;
+	const int y = m_samples[index].y;
+
+	m_samples[index].firstedge = static_cast<int>(m_edges.size());
+
+	for (auto& direction : s_directions)
+	{
+		const int nx = x + direction[0];
+		const int ny = y + direction[1];
+		const Vector target(m_gridorigin.x + nx * m_spacing, m_gridorigin.y + ny * m_spacing, origin.z);
+		Vector landing;
+		Vector normal;
+		WaypointPath::PathType type;
+
+		if (!TryMove(origin, target, landing, normal, type))
+			continue;
+
+		int other = FindSample(nx, ny, landing.z);
+
+		if (other < 0)
+		{
+			if (m_samples.size() >= GENERATOR_MAX_SAMPLES)
+			{
+				m_truncated = true;
+				continue;
+			}
+
+			other = AddSample(nx, ny, landing, normal);
+			m_open.push_back(other);
+		}
+
+		if (other != index)
+		{
+			m_edges.push_back({ index, other, type });
+		}
+	}
+
+	m_samples[index].edgecount = static_cast<int>(m_edges.size()) - m_samples[index].firstedge;
+}
+
+bool CWaypointGenerator::TryMove(const Vector& origin, const Vector& target, Vector& landing, Vector& normal, WaypointPath::PathType& type) const
+{
+	BSPTraceResult tr;
+
+	// Step up, move forward and step down, like the player movement code
+	Vector raised = origin + Vector(0.0f, 0.0f, m_stepheight);
+	TraceHull(origin, raised, tr);
+
+	if (tr.startsolid)
+		return false;
+
+	raised = tr.endpos;
+	Vector ahead(target.x, target.y, raised.z);
+	TraceHull(raised, ahead, tr);
+	type = WaypointPath::PATH_NORMAL;
+
+	if (tr.fraction < 1.0f)
+	{
+		// Obstacle higher than a step, try to jump over it
+		raised = origin + Vector(0.0f, 0.0f, m_jumpheight);
+		TraceHull(origin, raised, tr);
+
+		if (tr.fraction < 1.0f)
+			return false;
+
+		ahead.z = raised.z;
+		TraceHull(raised, ahead, tr);
+
+		if (tr.fraction < 1.0f)
+			return false;
+
+		type = WaypointPath::PATH_JUMP;
+	}
+
+	// Find the floor, anything lower than the death drop height is unsafe
+	const Vector down = ahead - Vector(0.0f, 0.0f, (ahead.z - origin.z) + m_dropheight);
+	TraceHull(ahead, down, tr);
+
+	if (tr.startsolid || tr.fraction >= 1.0f || tr.normal.z < GENERATOR_MIN_GROUND_NORMAL)
+		return false;
+
+	landing = tr.endpos;
+	normal = tr.normal;
+
+	const Vector feet = landing - Vector(0.0f, 0.0f, GENERATOR_HULL_HALF_HEIGHT - 1.0f);
+	const int contents = m_collision != nullptr ? m_collision->PointContents(feet) : POINT_CONTENTS(feet);
+
+	if (contents == CONTENTS_SLIME || contents == CONTENTS_LAVA || contents == CONTENTS_SKY)
+		return false;
+
+	if (type == WaypointPath::PATH_JUMP)
+		return true;
+
+	// A hole between the samples must be jumped over
+	const Vector middle = (raised + ahead) * 0.5f;
+	const float lowest = std::min(origin.z, landing.z) - m_stepheight;
+	TraceHull(middle, Vector(middle.x, middle.y, lowest), tr);
+
+	if (tr.fraction >= 1.0f)
+	{
+		type = WaypointPath::PATH_GAPJUMP;
+	}
+	else if (fabsf(landing.z - origin.z) > GENERATOR_FLAT_HEIGHT && fabsf(landing.z - origin.z) <= m_stepheight)
+	{
+		type = WaypointPath::PATH_RAMPSTAIRS;
+	}
+	else if (origin.z - landing.z > m_stepheight)
+	{
+		type = WaypointPath::PATH_DROP;
+	}
+
+	return true;
+}
+
+int CWaypointGenerator::FindSample(const int x, const int y, const float z) const
+{
+	auto it = m_cells.find(GeneratorCellKey(x, y));
+
+	if (it == m_cells.end())
+		return -1;
+
+	for (int index : it->second)
+	{
+		if (fabsf(m_samples[index].origin.z - z) <= m_stepheight)
+			return index;
+	}
+
+	return -1;
+}
+
+int CWaypointGenerator::AddSample(const int x, const int y, const Vector& origin, const Vector& normal)
+{
+	GeneratorSample sample;
+	sample.origin = origin;
+	sample.normal = normal;
+	sample.x = x;
+	sample.y = y;
+	sample.cluster = -1;
+	sample.firstedge = 0;
+	sample.edgecount = 0;
+
+	const int index = static_cast<int>(m_samples.size());
+	m_samples.push_back(sample);
+	m_cells[GeneratorCellKey(x, y)].push_back(index);
+	m_samplecount.store(m_samples.size(), std::memory_order_relaxed);
+	return index;
+}
+
+void CWaypointGenerator::MergeCluster(const int index)
+{
+	const int cluster = static_cast<int>(m_clustercenters.size());
+	const GeneratorSample& first = m_samples[index];
+	std::vector<int> members;
+
+	members.push_back(index);
+	m_samples[index].cluster = cluster;
+
+	// Grow through walkable edges in both directions, limited to a square of cells and to the plane of the first sample
+	for (size_t i = 0; i < members.size(); i++)
+	{
+		const GeneratorSample& sample = m_samples[members[i]];
+
+		for (int e = sample.firstedge; e < sample.firstedge + sample.edgecount; e++)
+		{
+			const GeneratorEdge& edge = m_edges[e];
+			GeneratorSample& other = m_samples[edge.to];
+
+			if (edge.type != WaypointPath::PATH_NORMAL || other.cluster >= 0)
+				continue;
+
+			if (abs(other.x - first.x) > GENERATOR_MERGE_CELLS || abs(other.y - first.y) > GENERATOR_MERGE_CELLS)
+				continue;
+
+			if (DotProduct(other.normal, first.normal) < GENERATOR_COPLANAR_NORMAL ||
+				fabsf(DotProduct(other.origin - first.origin, first.normal)) > GENERATOR_COPLANAR_DISTANCE)
+				continue;
+
+			bool returns = false;
+
+			for (int r = other.firstedge; r < other.firstedge + other.edgecount; r++)
+			{
+				if (m_edges[r].to == members[i] && m_edges[r].type == WaypointPath::PATH_NORMAL)
+				{
+					returns = true;
+					break;
+				}
+			}
+
+			if (!returns)
+				continue;
+
+			other.cluster = cluster;
+			members.push_back(edge.to);
+		}
+	}
+
+	// The waypoint goes at the sample closest to the middle of the cluster
+	Vector middle(0.0f, 0.0f, 0.0f);
+
+	for (int member : members)
+	{
+		middle = middle + m_samples[member].origin;
+	}
+
+	middle = middle * (1.0f / static_cast<float>(members.size()));
+
+	int center = index;
+	float best = (m_samples[index].origin - middle).Length();
+
+	for (int member : members)
+	{
+		const float distance = (m_samples[member].origin - middle).Length();
+
+		if (distance < best)
+		{
+			best = distance;
+			center = member;
+		}
+	}
+
+	m_clustercenters.push_back(center);
+}
+
+void CWaypointGenerator::LinkClusters()
+{
+	const size_t last = std::min(m_cursor + GENERATOR_LINK_BATCH, m_edges.size());
+
+	for (; m_cursor < last; m_cursor++)
+	{
+		const GeneratorEdge& edge = m_edges[m_cursor];
+		const int from = m_samples[edge.from].cluster;
+		const int to = m_samples[edge.to].cluster;
+
+		if (from == to)
+			continue;
+
+		auto result = m_links.emplace(GeneratorEdgeKey(from, to), m_clusteredges.size());
+
+		if (result.second)
+		{
+			m_clusteredges.push_back({ from, to, edge.type });
+			continue;
+		}
+
+		// Walking is preferred to jumping when the clusters are connected both ways
+		WaypointPath::PathType& type = m_clusteredges[result.first->second].type;
+		const bool walkable = type == WaypointPath::PATH_NORMAL || type == WaypointPath::PATH_RAMPSTAIRS;
+
+		if (edge.type == WaypointPath::PATH_RAMPSTAIRS && (type == WaypointPath::PATH_NORMAL || !walkable))
+		{
+			type = WaypointPath::PATH_RAMPSTAIRS;
+		}
+		else if (edge.type == WaypointPath::PATH_NORMAL && !walkable)
+		{
+			type = WaypointPath::PATH_NORMAL;
+		}
+	}
+}
+
+bool CWaypointGenerator::VerifyEdge(const GeneratorEdge& edge) const
+{
+	// Sample moves only tell the clusters touch, the bots move between the cluster centers
+	const Vector& start = m_samples[m_clustercenters[edge.from]].origin;
+	const Vector& end = m_samples[m_clustercenters[edge.to]].origin;
+	const float raise = edge.type == WaypointPath::PATH_JUMP ? m_jumpheight : m_stepheight;
+	BSPTraceResult tr;
+
+	TraceHull(start + Vector(0.0f, 0.0f, raise), end + Vector(0.0f, 0.0f, raise), tr);
+
+	if (!tr.startsolid && tr.fraction >= 1.0f)
+		return true;
+
+	// Drops need to move forward before going down
+	const float top = std::max(start.z, end.z) + raise;
+	TraceHull(Vector(start.x, start.y, top), Vector(end.x, end.y, top), tr);
+	return !tr.startsolid && tr.fraction >= 1.0f;
+}
+
+void CWaypointGenerator::TraceHull(const Vector& start, const Vector& end, BSPTraceResult& result) const
+{
+	if (m_collision != nullptr)
+	{
+		m_collision->TraceHull(start, end, GENERATOR_HULL, result);
+		return;
+	}
+
+	TraceResult tr;
+	UTIL_TraceHull(start, end, ignore_monsters, GENERATOR_HULL, nullptr, &tr);
+	result.fraction = tr.flFraction;
+	result.endpos = tr.vecEndPos;
+	result.normal = tr.vecPlaneNormal;
+	result.planedist = tr.flPlaneDist;
+	result.allsolid = tr.fAllSolid != 0;
+	result.startsolid = tr.fStartSolid != 0;
+	result.inopen = tr.fInOpen != 0;
+	result.inwater = tr.fInWater != 0;
+}
+
+bool CWaypointGenerator::Emit()
+{
+	const float groundoffset = gamemod->GetPlayerOriginGroundOffset();
+	const float mergedistance = m_spacing * m_spacing;
+	const auto deadline = GetFrameDeadline();
+	const size_t clusters = m_clustercenters.size();
+
+	// Waypoints first, the paths need both of their waypoints
+	for (; m_cursor < clusters + m_clusteredges.size() && std::chrono::steady_clock::now() < deadline; m_cursor++)
+	{
+		if (m_cursor < clusters)
+		{
+			Vector position = m_samples[m_clustercenters[m_cursor]].origin;
+			position.z -= groundoffset;
+
+			// Existing waypoints are kept and connected to the new ones
+			CWaypoint* waypoint = TheWaypoints->GetNearestWaypoint(position, mergedistance);
+
+			if (waypoint == nullptr)
+			{
+				waypoint = TheWaypoints->AddWaypoint(position, 0.0f);
+				m_created++;
+			}
+
+			m_emitted[m_cursor] = { waypoint->GetID(), TheWaypoints->GetWaypointGeneration(waypoint->GetID()) };
+			continue;
+		}
+
+		const GeneratorEdge& edge = m_clusteredges[m_cursor - clusters];
+		CWaypoint* from = TheWaypoints->GetWaypointOfID(m_emitted[edge.from].first, m_emitted[edge.from].second);
+		CWaypoint* to = TheWaypoints->GetWaypointOfID(m_emitted[edge.to].first, m_emitted[edge.to].second);
+
+		// Deleted by the editor since it was created
+		if (from == nullptr || to == nullptr)
+			continue;
+
+		if (from == to || from->HasPathTo(to) || !from->AddPathTo(to))
+			continue;
+
+		if (edge.type != WaypointPath::PATH_NORMAL)
+		{
+			from->SetPathTypeTo(to, edge.type);
+		}
+
+		m_pathsadded++;
+	}
+
+	if (m_cursor < clusters + m_clusteredges.size())
+		return true;
+
+	LOG_CONSOLE(PLID, "Waypoint generation done, %i samples, %i waypoints and %i paths added.%s", static_cast<int>(m_samples.size()),
+		m_created, m_pathsadded, m_truncated ? " The sample limit was reached, some areas weren't explored." : "");
+
+	char message[128];
+	snprintf(message, sizeof(message), "Waypoints generated! %i waypoints, %i paths added. \n", m_created, m_pathsadded);
+	Report(message);
+
+	m_samples.clear();
+	m_edges.clear();
+	m_cells.clear();
+	m_clustercenters.clear();
+	m_clusteredges.clear();
+	m_emitted.clear();
+	m_emitting = false;
+	m_running = false;
+	return false;
+}
+
+void CWaypointGenerator::StopWorker()
+{
+	m_cancel = true;
+
+	if (m_worker.joinable())
+	{
+		m_worker.join();
+	}
+
+	m_collision.reset();
+}
+
+void CWaypointGenerator::Report(const char* message)
+{
+	edict_t* editor = TheWaypoints->GetEditor();
+
+	if (editor != nullptr)
+	{
+		ClientPrint(VARS(editor), HUD_PRINTCONSOLE, message);
+	}
+}
@@ -0,0 +1,138 @@
+#ifndef WAYPOINT_GENERATOR_H_
+#define WAYPOINT_GENERATOR_H_
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#include "waypoint_base.h"
+
+class CBSPCollision;
+struct BSPTraceResult;
+
+/**
+ * @brief Standing position found by the generator flood fill
+*/
+struct GeneratorSample
+{
+	Vector origin; // Origin of a standing player hull
+	Vector normal; // Ground normal
+	int x; // Grid column
+	int y; // Grid row
+	int cluster; // Cluster the sample was merged into, -1 if not merged yet
+	int firstedge; // Index of the first edge leaving this sample, the edges of a sample are next to each other
+	int edgecount; // Edges are only known once the sample was explored
+};
+
+/**
+ * @brief Movement between two samples or two clusters
+*/
+struct GeneratorEdge
+{
+	int from;
+	int to;
+	WaypointPath::PathType type;
+};
+
+/**
+ * @brief Generates waypoints by walking the map from the player spawn points.
+ *
+ * A hull is moved on a grid from every spawn point. Each move steps up to the maximum step height, jumps over higher
+ * obstacles and drops down to the floor when the fall isn't deadly, the kind of movement decides the path type.
+ * Connected samples on the same plane are merged into clusters and every cluster becomes a waypoint.
+ * With the map collision loaded, the generator runs on a worker thread. Otherwise engine traces are done on the main
+ * thread, limited by the gb_nav_generate_budget time budget per frame. Waypoints and paths are then created on the main
+ * thread under the same budget.
+*/
+class CWaypointGenerator
+{
+public:
+	CWaypointGenerator();
+	~CWaypointGenerator();
+
+	/**
+	 * @brief Starts generating waypoints from the spawn points of the current map
+	 * @param spacing Distance between grid samples
+	 * @return false if the generator is already running or the map has no reachable spawn point
+	*/
+	bool Start(const float spacing);
+	// Called every frame, creates the waypoints when the generation is done
+	void Update();
+	// Stops the generation, waypoints that were already created are kept
+	void Cancel();
+	bool IsRunning() const { return m_running; }
+
+private:
+	enum GeneratorPhase
+	{
+		PHASE_EXPLORE = 0, // Flood fill of the grid
+		PHASE_MERGE, // Samples merged into clusters
+		PHASE_LINK, // Sample edges turned into cluster edges
+		PHASE_VERIFY, // Cluster edges traced between cluster centers
+		PHASE_DONE
+	};
+
+	// Does a small amount of work, returns false once the generation is done
+	bool Step();
+	void WorkerMain();
+	void RunFrameBudget();
+	// Finds the ground under a spawn point and adds it as a sample
+	void AddSeed(const Vector& position);
+	void Explore(const int index);
+	/**
+	 * @brief Moves a standing hull towards a target position
+	 * @param origin Hull origin, on the ground
+	 * @param target Target position, only X and Y are used
+	 * @param landing Stores the hull origin on the ground at the target
+	 * @param normal Stores the ground normal at the target
+	 * @param type Stores the path type needed for the move
+	 * @return false if the target can't be reached
+	*/
+	bool TryMove(const Vector& origin, const Vector& target, Vector& landing, Vector& normal, WaypointPath::PathType& type) const;
+	// Sample at the given cell and height, -1 if none
+	int FindSample(const int x, const int y, const float z) const;
+	int AddSample(const int x, const int y, const Vector& origin, const Vector& normal);
+	void MergeCluster(const int index);
+	// Turns a batch of sample edges into cluster edges
+	void LinkClusters();
+	bool VerifyEdge(const GeneratorEdge& edge) const;
+	void TraceHull(const Vector& start, const Vector& end, BSPTraceResult& result) const;
+	// Creates a batch of waypoints, then of paths, within the frame budget. Main thread only, returns false once done
+	bool Emit();
+	void StopWorker();
+	void Report(const char* message);
+
+	std::vector<GeneratorSample> m_samples;
+	std::vector<GeneratorEdge> m_edges; // Edges between samples
+	std::unordered_map<std::int64_t, std::vector<int>> m_cells; // Samples of each grid cell, floors above each other share a cell
+	std::deque<int> m_open; // Samples waiting to be explored
+	std::vector<int> m_clustercenters; // Sample at the center of each cluster
+	std::vector<GeneratorEdge> m_clusteredges; // Edges between clusters
+	std::unordered_map<std::int64_t, size_t> m_links; // Index of the cluster edge between two clusters, used while linking
+	std::vector<std::pair<int, unsigned int>> m_emitted; // ID and generation of the waypoint of each cluster, the editor can delete them between frames
+	std::shared_ptr<const CBSPCollision> m_collision; // nullptr when using engine traces
+	std::thread m_worker;
+	std::atomic<bool> m_finished; // Set by the worker thread when the generation is done
+	std::atomic<bool> m_cancel;
+	std::atomic<size_t> m_samplecount; // Number of samples, read by the main thread for progress reports
+	GeneratorPhase m_phase;
+	size_t m_cursor; // Position of the current phase, or of Emit in the clusters then in the cluster edges
+	Vector m_gridorigin;
+	float m_spacing;
+	float m_stepheight;
+	float m_jumpheight;
+	float m_dropheight;
+	float m_nextreport;
+	int m_created; // Waypoints created by Emit
+	int m_pathsadded; // Paths created by Emit
+	bool m_running;
+	bool m_emitting; // Exploration is done, waypoints are being created
+	bool m_truncated; // The sample limit was reached
+};
+
+#endif // !WAYPOINT_GENERATOR_H_
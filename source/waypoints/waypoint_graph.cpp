@@ -0,0 +1,389 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+#include <utility>
+
+#include "waypoint_base.h"
+#include "waypoint_graph.h"
+
+// Above this number of components the reachability table isn't built (4096 components is a 2 MB table)
+constexpr int MAX_REACHABILITY_COMPONENTS = 4096;
+// 64 bit FNV-1a
+constexpr std::uint64_t GRAPH_HASH_OFFSET = 14695981039346656037ULL;
+constexpr std::uint64_t GRAPH_HASH_PRIME = 1099511628211ULL;
+
+static void HashValue(std::uint64_t& hash, const void* data, const size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= GRAPH_HASH_PRIME;
+	}
+}
+
+CWaypointGraph::CWaypointGraph() :
+	m_offsets(),
+	m_targets(),
+	m_types(),
+	m_lengths(),
+	m_reverseoffsets(),
+	m_reversesources(),
+	m_reverseedges(),
+	m_positions(),
+	m_waypoints(),
+	m_components(),
+	m_weakcomponents(),
+	m_reachability()
+{
+	m_version = 0;
+	m_hash = GRAPH_HASH_OFFSET;
+	m_nodecount = 0;
+	m_componentcount = 0;
+	m_reachabilitywords = 0;
+	m_offsets.push_back(0);
+	m_reverseoffsets.push_back(0);
+}
+
+CWaypointGraph::~CWaypointGraph()
+{
+}
+
+void CWaypointGraph::Build(const std::vector<CWaypoint*>& waypoints, const int nodelimit, const unsigned int version)
+{
+	Clear();
+
+	m_version = version;
+	m_nodecount = static_cast<int>(waypoints.size());
+	m_waypoints.assign(static_cast<size_t>(nodelimit), nullptr);
+	m_positions.assign(static_cast<size_t>(nodelimit), Vector(0.0f, 0.0f, 0.0f));
+	m_offsets.assign(static_cast<size_t>(nodelimit) + 1, 0);
+
+	size_t edges = 0;
+
+	for (auto waypoint : waypoints)
+	{
+		const int id = waypoint->GetID();
+		m_waypoints[id] = waypoint;
+		m_positions[id] = waypoint->GetPosition();
+		edges += static_cast<size_t>(waypoint->GetPathCount());
+	}
+
+	m_targets.reserve(edges);
+	m_types.reserve(edges);
+	m_lengths.reserve(edges);
+
+	// Nodes are laid out in ID order
+	for (int id = 0; id < nodelimit; id++)
+	{
+		m_offsets[id] = static_cast<int>(m_targets.size());
+		CWaypoint* waypoint = m_waypoints[id];
+
+		if (waypoint == nullptr)
+			continue;
+
+		for (int i = 0; i < waypoint->GetPathCount(); i++)
+		{
+			const WaypointConnection& path = waypoint->GetPath(i);
+
+			if (path.id < 0 || path.id >= nodelimit || m_waypoints[path.id] == nullptr)
+				continue;
+
+			m_targets.push_back(path.id);
+			m_types.push_back(static_cast<unsigned char>(path.type));
+			m_lengths.push_back(waypoint->DistTo(m_waypoints[path.id]));
+		}
+	}
+
+	m_offsets[nodelimit] = static_cast<int>(m_targets.size());
+	BuildReverseEdges();
+	BuildComponents();
+	ComputeHash();
+}
+
+void CWaypointGraph::Clear()
+{
+	m_offsets.clear();
+	m_targets.clear();
+	m_types.clear();
+	m_lengths.clear();
+	m_reverseoffsets.clear();
+	m_reversesources.clear();
+	m_reverseedges.clear();
+	m_positions.clear();
+	m_waypoints.clear();
+	m_components.clear();
+	m_weakcomponents.clear();
+	m_reachability.clear();
+	m_reachabilitywords = 0;
+	m_hash = GRAPH_HASH_OFFSET;
+	m_nodecount = 0;
+	m_componentcount = 0;
+	m_offsets.push_back(0);
+	m_reverseoffsets.push_back(0);
+}
+
+bool CWaypointGraph::IsReachable(const int from, const int to) const
+{
+	const int fromcomponent = m_components[from];
+	const int tocomponent = m_components[to];
+
+	if (fromcomponent == tocomponent)
+		return true;
+
+	// Edges between components always go to a lower numbered component
+	if (fromcomponent < tocomponent)
+		return false;
+
+	if (!m_reachability.empty())
+	{
+		const std::uint64_t word = m_reachability[static_cast<size_t>(fromcomponent) * m_reachabilitywords + static_cast<size_t>(tocomponent >> 6)];
+		return (word & (1ULL << (tocomponent & 63))) != 0;
+	}
+
+	return m_weakcomponents[from] == m_weakcomponents[to];
+}
+
+void CWaypointGraph::BuildReverseEdges()
+{
+	const int limit = GetNodeLimit();
+	m_reverseoffsets.assign(static_cast<size_t>(limit) + 1, 0);
+	m_reversesources.resize(m_targets.size());
+	m_reverseedges.resize(m_targets.size());
+
+	for (auto target : m_targets)
+	{
+		m_reverseoffsets[target + 1]++;
+	}
+
+	for (int id = 0; id < limit; id++)
+	{
+		m_reverseoffsets[id + 1] += m_reverseoffsets[id];
+	}
+
+	std::vector<int> next(m_reverseoffsets.begin(), m_reverseoffsets.end() - 1);
+
+	for (int id = 0; id < limit; id++)
+	{
+		for (int edge = GetFirstEdge(id); edge < GetLastEdge(id); edge++)
+		{
+			const int slot = next[m_targets[edge]]++;
+			m_reversesources[slot] = id;
+			m_reverseedges[slot] = edge;
+		}
+	}
+}
+
+void CWaypointGraph::BuildComponents()
+{
+	const int limit = GetNodeLimit();
+	std::vector<int> index(limit, -1);
+	std::vector<int> lowlink(limit, 0);
+	std::vector<bool> onstack(limit, false);
+	std::vector<int> stack;
+	std::vector<std::pair<int, int>> callstack; // Node and next edge to visit
+	int counter = 0;
+
+	m_components.assign(limit, -1);
+	m_componentcount = 0;
+
+	for (int root = 0; root < limit; root++)
+	{
+		if (m_waypoints[root] == nullptr || index[root] != -1)
+			continue;
+
+		index[root] = lowlink[root] = counter++;
+		stack.push_back(root);
+		onstack[root] = true;
+		callstack.emplace_back(root, GetFirstEdge(root));
+
+		while (!callstack.empty())
+		{
+			const int node = callstack.back().first;
+			const int edge = callstack.back().second;
+
+			if (edge < GetLastEdge(node))
+			{
+				callstack.back().second++;
+				const int target = m_targets[edge];
+
+				if (index[target] == -1)
+				{
+					index[target] = lowlink[target] = counter++;
+					stack.push_back(target);
+					onstack[target] = true;
+					callstack.emplace_back(target, GetFirstEdge(target));
+				}
+				else if (onstack[target])
+				{
+					lowlink[node] = std::min(lowlink[node], index[target]);
+				}
+
+				continue;
+			}
+
+			if (lowlink[node] == index[node])
+			{
+				// Node is the root of a component
+				int member;
+
+				do
+				{
+					member = stack.back();
+					stack.pop_back();
+					onstack[member] = false;
+					m_components[member] = m_componentcount;
+				} while (member != node);
+
+				m_componentcount++;
+			}
+
+			callstack.pop_back();
+
+			if (!callstack.empty())
+			{
+				const int parent = callstack.back().first;
+				lowlink[parent] = std::min(lowlink[parent], lowlink[node]);
+			}
+		}
+	}
+
+	if (m_componentcount <= MAX_REACHABILITY_COMPONENTS)
+	{
+		BuildReachability();
+	}
+	else
+	{
+		BuildWeakComponents();
+	}
+}
+
+void CWaypointGraph::BuildReachability()
+{
+	const int limit = GetNodeLimit();
+	m_reachabilitywords = (static_cast<size_t>(m_componentcount) + 63) / 64;
+	m_reachability.assign(m_reachabilitywords * static_cast<size_t>(m_componentcount), 0);
+
+	// Group the nodes by component
+	std::vector<int> first(m_componentcount + 1, 0);
+	std::vector<int> members(m_nodecount);
+
+	for (int id = 0; id < limit; id++)
+	{
+		if (m_components[id] >= 0)
+		{
+			first[m_components[id] + 1]++;
+		}
+	}
+
+	for (int component = 0; component < m_componentcount; component++)
+	{
+		first[component + 1] += first[component];
+	}
+
+	std::vector<int> next(first.begin(), first.end() - 1);
+
+	for (int id = 0; id < limit; id++)
+	{
+		if (m_components[id] >= 0)
+		{
+			members[next[m_components[id]]++] = id;
+		}
+	}
+
+	// Components reached from a component always have a lower number, so they are complete when it's visited
+	for (int component = 0; component < m_componentcount; component++)
+	{
+		std::uint64_t* row = &m_reachability[static_cast<size_t>(component) * m_reachabilitywords];
+		row[component >> 6] |= 1ULL << (component & 63);
+
+		for (int i = first[component]; i < first[component + 1]; i++)
+		{
+			const int id = members[i];
+
+			for (int edge = GetFirstEdge(id); edge < GetLastEdge(id); edge++)
+			{
+				const int target = m_components[m_targets[edge]];
+
+				if (target == component)
+					continue;
+
+				const std::uint64_t* targetrow = &m_reachability[static_cast<size_t>(target) * m_reachabilitywords];
+
+				// Only the words up to the target component can have bits set
+				for (size_t word = 0; word <= static_cast<size_t>(target >> 6); word++)
+				{
+					row[word] |= targetrow[word];
+				}
+			}
+		}
+	}
+}
+
+void CWaypointGraph::ComputeHash()
+{
+	std::uint64_t hash = GRAPH_HASH_OFFSET;
+	const int limit = GetNodeLimit();
+	HashValue(hash, &limit, sizeof(limit));
+
+	for (int id = 0; id < limit; id++)
+	{
+		const unsigned char valid = m_waypoints[id] != nullptr ? 1 : 0;
+		HashValue(hash, &valid, sizeof(valid));
+	}
+
+	HashValue(hash, m_offsets.data(), m_offsets.size() * sizeof(int));
+	HashValue(hash, m_targets.data(), m_targets.size() * sizeof(int));
+	HashValue(hash, m_lengths.data(), m_lengths.size() * sizeof(float));
+	m_hash = hash;
+}
+
+void CWaypointGraph::BuildWeakComponents()
+{
+	const int limit = GetNodeLimit();
+	std::vector<int> parent(limit);
+
+	for (int id = 0; id < limit; id++)
+	{
+		parent[id] = id;
+	}
+
+	auto find = [&parent](int id) {
+		while (parent[id] != id)
+		{
+			parent[id] = parent[parent[id]];
+			id = parent[id];
+		}
+
+		return id;
+	};
+
+	for (int id = 0; id < limit; id++)
+	{
+		for (int edge = GetFirstEdge(id); edge < GetLastEdge(id); edge++)
+		{
+			const int a = find(id);
+			const int b = find(m_targets[edge]);
+
+			if (a != b)
+			{
+				parent[a] = b;
+			}
+		}
+	}
+
+	m_weakcomponents.resize(limit);
+
+	for (int id = 0; id < limit; id++)
+	{
+		m_weakcomponents[id] = find(id);
+	}
+}
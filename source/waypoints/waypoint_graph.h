@@ -0,0 +1,100 @@
+#ifndef WAYPOINT_GRAPH_H_
+#define WAYPOINT_GRAPH_H_
+
+#include <vector>
+#include <cstdint>
+
+#include "waypoint_base.h"
+
+/**
+ * @brief Compact snapshot of the waypoint graph in compressed sparse row layout.
+ *
+ * Nodes are indexed by waypoint ID. The edges leaving a node are stored contiguously,
+ * from GetFirstEdge(id) up to (but not including) GetLastEdge(id).
+ * Edges arriving at a node are also stored in reverse, from GetFirstReverseEdge(id) up to GetLastReverseEdge(id).
+ * The snapshot is rebuilt by the waypoint manager when the graph version changes.
+ * Strongly connected components are labelled on build so unreachable goals can be rejected without a search.
+*/
+class CWaypointGraph
+{
+public:
+	CWaypointGraph();
+	~CWaypointGraph();
+
+	/**
+	 * @brief Builds the graph from the given waypoints
+	 * @param waypoints Waypoints to build the graph from
+	 * @param nodelimit All waypoint IDs must be lower than this
+	 * @param version Graph version this snapshot represents
+	*/
+	void Build(const std::vector<CWaypoint*>& waypoints, const int nodelimit, const unsigned int version);
+	void Clear();
+
+	unsigned int GetVersion() const { return m_version; }
+	// Hash of the graph nodes, edges and edge lengths, used to validate precomputed data saved to disk
+	std::uint64_t GetHash() const { return m_hash; }
+	// Node IDs are in the range [0, GetNodeLimit())
+	int GetNodeLimit() const { return static_cast<int>(m_waypoints.size()); }
+	// Number of waypoints in the graph
+	int GetNodeCount() const { return m_nodecount; }
+	int GetEdgeCount() const { return static_cast<int>(m_targets.size()); }
+	bool IsValidNode(const int id) const { return id >= 0 && id < GetNodeLimit() && m_waypoints[id] != nullptr; }
+
+	int GetFirstEdge(const int id) const { return m_offsets[id]; }
+	int GetLastEdge(const int id) const { return m_offsets[id + 1]; }
+	int GetEdgeTarget(const int edge) const { return m_targets[edge]; }
+	WaypointPath::PathType GetEdgeType(const int edge) const { return static_cast<WaypointPath::PathType>(m_types[edge]); }
+	float GetEdgeLength(const int edge) const { return m_lengths[edge]; }
+
+	int GetFirstReverseEdge(const int id) const { return m_reverseoffsets[id]; }
+	int GetLastReverseEdge(const int id) const { return m_reverseoffsets[id + 1]; }
+	// Node the reverse edge comes from
+	int GetReverseEdgeSource(const int edge) const { return m_reversesources[edge]; }
+	// Forward edge index of the reverse edge
+	int GetReverseEdgeForward(const int edge) const { return m_reverseedges[edge]; }
+	float GetReverseEdgeLength(const int edge) const { return m_lengths[m_reverseedges[edge]]; }
+
+	const Vector& GetPosition(const int id) const { return m_positions[id]; }
+	CWaypoint* GetWaypoint(const int id) const { return m_waypoints[id]; }
+
+	// Strongly connected component of the node, components are numbered in reverse topological order
+	int GetComponent(const int id) const { return m_components[id]; }
+	int GetComponentCount() const { return m_componentcount; }
+	/**
+	 * @brief Checks if a node can be reached from another node, constant time.
+	 * May return true for unreachable pairs on huge graphs, never returns false for reachable pairs.
+	 * @param from Start node ID
+	 * @param to Goal node ID
+	 * @return false if there is no path between the nodes
+	*/
+	bool IsReachable(const int from, const int to) const;
+
+private:
+	void BuildReverseEdges();
+	// Labels strongly connected components with an iterative Tarjan search and builds the component reachability table
+	void BuildComponents();
+	void BuildReachability();
+	// Labels weakly connected components, used when the reachability table is too large
+	void BuildWeakComponents();
+	void ComputeHash();
+
+	std::vector<int> m_offsets; // Index of the first edge of each node, has one extra entry at the end
+	std::vector<int> m_targets; // Edge target node IDs
+	std::vector<unsigned char> m_types; // Edge path types
+	std::vector<float> m_lengths; // Edge lengths
+	std::vector<int> m_reverseoffsets; // Index of the first reverse edge of each node, has one extra entry at the end
+	std::vector<int> m_reversesources; // Reverse edge source node IDs
+	std::vector<int> m_reverseedges; // Forward edge index of each reverse edge
+	std::vector<Vector> m_positions; // Node positions
+	std::vector<CWaypoint*> m_waypoints; // Node waypoints, nullptr for unused IDs
+	std::vector<int> m_components; // Strongly connected component of each node
+	std::vector<int> m_weakcomponents; // Weakly connected component of each node, only when there is no reachability table
+	std::vector<std::uint64_t> m_reachability; // One bit row per component, bit N is set if component N can be reached
+	size_t m_reachabilitywords; // Number of 64 bit words per reachability row
+	unsigned int m_version;
+	std::uint64_t m_hash;
+	int m_nodecount;
+	int m_componentcount;
+};
+
+#endif // !WAYPOINT_GRAPH_H_
@@ -0,0 +1,533 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <unordered_set>
+#include <utility>
+#include <cmath>
+
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_hierarchy.h"
+
+// Cluster coordinates are packed into 21 bits each
+constexpr int CLUSTER_COORD_BITS = 21;
+constexpr int CLUSTER_COORD_BIAS = 1 << (CLUSTER_COORD_BITS - 1);
+constexpr std::uint64_t CLUSTER_COORD_MASK = (1ULL << CLUSTER_COORD_BITS) - 1ULL;
+
+CWaypointHierarchy* TheWaypointHierarchy = nullptr;
+
+CHierarchicalPath::CHierarchicalPath() :
+	m_nodes()
+{
+	m_nextsegment = 0;
+	m_graphversion = 0;
+	m_length = 0.0f;
+}
+
+void CHierarchicalPath::Clear()
+{
+	m_nodes.clear();
+	m_nextsegment = 0;
+	m_graphversion = 0;
+	m_length = 0.0f;
+}
+
+bool CHierarchicalPath::IsOutdated() const
+{
+	return m_graphversion != TheWaypoints->GetGraphVersion();
+}
+
+bool CHierarchicalPath::RefineNext(std::vector<CWaypoint*>& path)
+{
+	if (IsEmpty() || IsFullyRefined() || IsOutdated())
+		return false;
+
+	TheWaypointHierarchy->Update();
+
+	if (m_nextsegment == 0)
+	{
+		path.push_back(TheWaypoints->GetWaypointOfID(m_nodes[0]));
+	}
+
+	const int segments = static_cast<int>(m_nodes.size()) - 1;
+
+	while (m_nextsegment < segments)
+	{
+		const int from = m_nodes[m_nextsegment];
+		const int to = m_nodes[m_nextsegment + 1];
+
+		if (!TheWaypointHierarchy->RefineSegment(from, to, path))
+			return false;
+
+		m_nextsegment++;
+
+		// Stop once the path enters the next cluster
+		if (TheWaypointHierarchy->GetClusterOf(from) != TheWaypointHierarchy->GetClusterOf(to))
+			break;
+	}
+
+	return true;
+}
+
+CWaypointHierarchy::CWaypointHierarchy() :
+	m_graph(),
+	m_clusters(),
+	m_clusterkeys(),
+	m_nodeclusters(),
+	m_entrances(),
+	m_interedges(),
+	m_abstractedges()
+{
+	m_graphversion = 0;
+	m_entrancecount = 0;
+	m_lastrebuilt = 0;
+}
+
+CWaypointHierarchy::~CWaypointHierarchy()
+{
+}
+
+void CWaypointHierarchy::Update()
+{
+	std::shared_ptr<const CWaypointGraph> graph = TheWaypoints->GetGraphSnapshot();
+
+	if (m_graph && graph->GetVersion() == m_graphversion)
+		return;
+
+	std::vector<int> edits;
+	std::unordered_set<int> dirty;
+
+	if (!m_graph || !TheWaypoints->GetGraphEditsSince(m_graphversion, edits))
+	{
+		// Unknown changes, rebuild everything
+		m_clusters.clear();
+		m_clusterkeys.clear();
+		m_graph = graph;
+		AssignClusters();
+
+		for (int index = 0; index < GetClusterCount(); index++)
+		{
+			dirty.insert(index);
+		}
+	}
+	else
+	{
+		std::unordered_set<int> edited(edits.begin(), edits.end());
+
+		// Clusters the edited waypoints were in, including the other end of their paths to other clusters
+		for (auto id : edited)
+		{
+			const int cluster = GetClusterOf(id);
+
+			if (cluster >= 0)
+			{
+				dirty.insert(cluster);
+			}
+		}
+
+		for (auto& edge : m_interedges)
+		{
+			if (edited.count(edge.first) != 0 || edited.count(edge.second) != 0)
+			{
+				dirty.insert(m_nodeclusters[edge.first]);
+				dirty.insert(m_nodeclusters[edge.second]);
+			}
+		}
+
+		m_graph = graph;
+		AssignClusters();
+
+		// Clusters the edited waypoints are in now and clusters they link to
+		for (auto id : edited)
+		{
+			if (!m_graph->IsValidNode(id))
+				continue;
+
+			dirty.insert(m_nodeclusters[id]);
+
+			for (int edge = m_graph->GetFirstEdge(id); edge < m_graph->GetLastEdge(id); edge++)
+			{
+				dirty.insert(m_nodeclusters[m_graph->GetEdgeTarget(edge)]);
+			}
+		}
+	}
+
+	for (auto index : dirty)
+	{
+		RebuildCluster(index);
+	}
+
+	m_lastrebuilt = static_cast<int>(dirty.size());
+	m_graphversion = graph->GetVersion();
+	BuildAbstractGraph();
+}
+
+bool CWaypointHierarchy::FindPath(CWaypoint* start, CWaypoint* goal, CHierarchicalPath& path)
+{
+	path.Clear();
+
+	if (start == nullptr || goal == nullptr)
+		return false;
+
+	Update();
+
+	const int startid = start->GetID();
+	const int goalid = goal->GetID();
+
+	if (!m_graph->IsValidNode(startid) || !m_graph->IsValidNode(goalid) || !m_graph->IsReachable(startid, goalid))
+		return false;
+
+	path.m_graphversion = m_graphversion;
+
+	if (startid == goalid)
+	{
+		path.m_nodes.push_back(startid);
+		return true;
+	}
+
+	const int startcluster = m_nodeclusters[startid];
+	const int goalcluster = m_nodeclusters[goalid];
+
+	if (startcluster == goalcluster)
+	{
+		std::unordered_map<int, float> distances;
+		SearchCluster(startcluster, startid, false, goalid, distances, nullptr);
+		auto it = distances.find(goalid);
+
+		// Reached without leaving the cluster
+		if (it != distances.end())
+		{
+			path.m_nodes.push_back(startid);
+			path.m_nodes.push_back(goalid);
+			path.m_length = it->second;
+			return true;
+		}
+	}
+
+	// Temporary links from the start to the entrances of its cluster and from the goal cluster entrances to the goal
+	std::unordered_map<int, float> startlinks;
+	std::unordered_map<int, float> goallinks;
+	SearchCluster(startcluster, startid, false, -1, startlinks, nullptr);
+	SearchCluster(goalcluster, goalid, true, -1, goallinks, nullptr);
+
+	using QueueEntry = std::pair<float, int>;
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> open;
+	std::unordered_map<int, float> costs;
+	std::unordered_map<int, int> parents;
+	std::unordered_set<int> closed;
+	const Vector& goalposition = m_graph->GetPosition(goalid);
+
+	costs[startid] = 0.0f;
+	open.emplace(m_graph->GetPosition(startid).DistTo(goalposition), startid);
+
+	auto relax = [&](const int from, const int to, const float cost) {
+		auto it = costs.find(to);
+
+		if (it == costs.end() || cost < it->second)
+		{
+			costs[to] = cost;
+			parents[to] = from;
+			open.emplace(cost + m_graph->GetPosition(to).DistTo(goalposition), to);
+		}
+	};
+
+	bool found = false;
+
+	while (!open.empty())
+	{
+		const QueueEntry entry = open.top();
+		open.pop();
+		const int id = entry.second;
+
+		// Already expanded with a lower cost
+		if (!closed.insert(id).second)
+			continue;
+
+		const float cost = costs[id];
+
+		if (id == goalid)
+		{
+			found = true;
+			break;
+		}
+
+		if (id == startid)
+		{
+			for (auto& link : startlinks)
+			{
+				if (link.first != startid && m_entrances[link.first])
+				{
+					relax(id, link.first, cost + link.second);
+				}
+			}
+		}
+
+		for (auto& edge : m_abstractedges[id])
+		{
+			relax(id, edge.target, cost + edge.cost);
+		}
+
+		auto goallink = goallinks.find(id);
+
+		if (goallink != goallinks.end())
+		{
+			relax(id, goalid, cost + goallink->second);
+		}
+	}
+
+	if (!found)
+		return false;
+
+	for (int id = goalid; id != startid; id = parents[id])
+	{
+		path.m_nodes.push_back(id);
+	}
+
+	path.m_nodes.push_back(startid);
+	std::reverse(path.m_nodes.begin(), path.m_nodes.end());
+	path.m_length = costs[goalid];
+	return true;
+}
+
+int CWaypointHierarchy::GetClusterOf(const int id) const
+{
+	if (id < 0 || id >= static_cast<int>(m_nodeclusters.size()))
+		return -1;
+
+	return m_nodeclusters[id];
+}
+
+int CWaypointHierarchy::FindOrCreateCluster(const Vector& position)
+{
+	const int x = static_cast<int>(floorf(position.x / WaypointConst::ClusterSize));
+	const int y = static_cast<int>(floorf(position.y / WaypointConst::ClusterSize));
+	const int z = static_cast<int>(floorf(position.z / WaypointConst::ClusterHeight));
+	const std::uint64_t kx = static_cast<std::uint64_t>(x + CLUSTER_COORD_BIAS) & CLUSTER_COORD_MASK;
+	const std::uint64_t ky = static_cast<std::uint64_t>(y + CLUSTER_COORD_BIAS) & CLUSTER_COORD_MASK;
+	const std::uint64_t kz = static_cast<std::uint64_t>(z + CLUSTER_COORD_BIAS) & CLUSTER_COORD_MASK;
+	const std::uint64_t key = (kx << (CLUSTER_COORD_BITS * 2)) | (ky << CLUSTER_COORD_BITS) | kz;
+
+	auto it = m_clusterkeys.find(key);
+
+	if (it != m_clusterkeys.end())
+		return it->second;
+
+	const int index = static_cast<int>(m_clusters.size());
+	m_clusters.emplace_back();
+	m_clusterkeys[key] = index;
+	return index;
+}
+
+void CWaypointHierarchy::AssignClusters()
+{
+	const int limit = m_graph->GetNodeLimit();
+	m_nodeclusters.assign(limit, -1);
+	m_entrances.assign(limit, false);
+	m_interedges.clear();
+
+	for (auto& cluster : m_clusters)
+	{
+		cluster.nodes.clear();
+	}
+
+	for (int id = 0; id < limit; id++)
+	{
+		if (m_graph->IsValidNode(id))
+		{
+			const int cluster = FindOrCreateCluster(m_graph->GetPosition(id));
+			m_nodeclusters[id] = cluster;
+			m_clusters[cluster].nodes.push_back(id);
+		}
+	}
+
+	for (int id = 0; id < limit; id++)
+	{
+		for (int edge = m_graph->GetFirstEdge(id); edge < m_graph->GetLastEdge(id); edge++)
+		{
+			const int target = m_graph->GetEdgeTarget(edge);
+
+			if (m_nodeclusters[id] != m_nodeclusters[target])
+			{
+				m_entrances[id] = true;
+				m_entrances[target] = true;
+				m_interedges.emplace_back(id, target);
+			}
+		}
+	}
+}
+
+void CWaypointHierarchy::RebuildCluster(const int index)
+{
+	Cluster& cluster = m_clusters[index];
+	cluster.entrances.clear();
+	cluster.edges.clear();
+
+	for (auto id : cluster.nodes)
+	{
+		if (m_entrances[id])
+		{
+			cluster.entrances.push_back(id);
+		}
+	}
+
+	std::unordered_map<int, float> distances;
+
+	for (auto entrance : cluster.entrances)
+	{
+		distances.clear();
+		SearchCluster(index, entrance, false, -1, distances, nullptr);
+
+		for (auto other : cluster.entrances)
+		{
+			auto it = distances.find(other);
+
+			if (other != entrance && it != distances.end())
+			{
+				cluster.edges.emplace_back(entrance, AbstractEdge{ other, it->second });
+			}
+		}
+	}
+}
+
+void CWaypointHierarchy::BuildAbstractGraph()
+{
+	m_abstractedges.assign(m_graph->GetNodeLimit(), std::vector<AbstractEdge>());
+	m_entrancecount = 0;
+
+	for (auto& cluster : m_clusters)
+	{
+		m_entrancecount += static_cast<int>(cluster.entrances.size());
+
+		for (auto& edge : cluster.edges)
+		{
+			m_abstractedges[edge.first].push_back(edge.second);
+		}
+	}
+
+	for (auto& edge : m_interedges)
+	{
+		const float cost = m_graph->GetPosition(edge.first).DistTo(m_graph->GetPosition(edge.second));
+		m_abstractedges[edge.first].push_back(AbstractEdge{ edge.second, cost });
+	}
+}
+
+void CWaypointHierarchy::SearchCluster(const int cluster, const int source, const bool reverse, const int target,
+	std::unordered_map<int, float>& distances, std::unordered_map<int, int>* parents) const
+{
+	std::unordered_map<int, std::vector<std::pair<int, float>>> incoming;
+
+	if (reverse)
+	{
+		// Paths leading to each waypoint of the cluster, from the same cluster
+		for (auto id : m_clusters[cluster].nodes)
+		{
+			for (int edge = m_graph->GetFirstEdge(id); edge < m_graph->GetLastEdge(id); edge++)
+			{
+				const int next = m_graph->GetEdgeTarget(edge);
+
+				if (m_nodeclusters[next] == cluster)
+				{
+					incoming[next].emplace_back(id, m_graph->GetEdgeLength(edge));
+				}
+			}
+		}
+	}
+
+	using QueueEntry = std::pair<float, int>;
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> open;
+
+	distances[source] = 0.0f;
+	open.emplace(0.0f, source);
+
+	auto relax = [&](const int from, const int to, const float distance) {
+		auto it = distances.find(to);
+
+		if (it == distances.end() || distance < it->second)
+		{
+			distances[to] = distance;
+			open.emplace(distance, to);
+
+			if (parents != nullptr)
+			{
+				(*parents)[to] = from;
+			}
+		}
+	};
+
+	while (!open.empty())
+	{
+		const QueueEntry entry = open.top();
+		open.pop();
+		const int id = entry.second;
+
+		if (entry.first > distances[id])
+			continue;
+
+		if (id == target)
+			break;
+
+		if (reverse)
+		{
+			auto it = incoming.find(id);
+
+			if (it == incoming.end())
+				continue;
+
+			for (auto& link : it->second)
+			{
+				relax(id, link.first, entry.first + link.second);
+			}
+		}
+		else
+		{
+			for (int edge = m_graph->GetFirstEdge(id); edge < m_graph->GetLastEdge(id); edge++)
+			{
+				const int next = m_graph->GetEdgeTarget(edge);
+
+				if (m_nodeclusters[next] == cluster)
+				{
+					relax(id, next, entry.first + m_graph->GetEdgeLength(edge));
+				}
+			}
+		}
+	}
+}
+
+bool CWaypointHierarchy::RefineSegment(const int from, const int to, std::vector<CWaypoint*>& path) const
+{
+	if (!m_graph->IsValidNode(from) || !m_graph->IsValidNode(to))
+		return false;
+
+	if (m_nodeclusters[from] != m_nodeclusters[to])
+	{
+		// Segments between clusters are a single path
+		path.push_back(m_graph->GetWaypoint(to));
+		return true;
+	}
+
+	std::unordered_map<int, float> distances;
+	std::unordered_map<int, int> parents;
+	SearchCluster(m_nodeclusters[from], from, false, to, distances, &parents);
+
+	if (distances.find(to) == distances.end())
+		return false;
+
+	const size_t first = path.size();
+
+	for (int id = to; id != from; id = parents[id])
+	{
+		path.push_back(m_graph->GetWaypoint(id));
+	}
+
+	std::reverse(path.begin() + first, path.end());
+	return true;
+}
@@ -0,0 +1,130 @@
+#ifndef WAYPOINT_HIERARCHY_H_
+#define WAYPOINT_HIERARCHY_H_
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <cstdint>
+
+#include "waypoint_graph.h"
+
+/**
+ * @brief Path found on the abstract graph, refined into waypoints one cluster at a time
+*/
+class CHierarchicalPath
+{
+public:
+	CHierarchicalPath();
+
+	void Clear();
+	bool IsEmpty() const { return m_nodes.empty(); }
+	// Abstract path nodes: start waypoint, cluster entrances and goal waypoint IDs
+	int GetAbstractNodeCount() const { return static_cast<int>(m_nodes.size()); }
+	int GetAbstractNode(const int index) const { return m_nodes[index]; }
+	// Estimated path length
+	float GetLength() const { return m_length; }
+	bool IsFullyRefined() const { return m_nextsegment + 1 >= static_cast<int>(m_nodes.size()); }
+	// Checks if the waypoints changed since the path was found
+	bool IsOutdated() const;
+
+	/**
+	 * @brief Refines the path up to the first waypoint of the next cluster
+	 * @param path Refined waypoints are appended to this, the start waypoint is included on the first call
+	 * @return false if the path is outdated or fully refined
+	*/
+	bool RefineNext(std::vector<CWaypoint*>& path);
+
+private:
+	friend class CWaypointHierarchy;
+
+	std::vector<int> m_nodes;
+	int m_nextsegment; // Next abstract segment to refine
+	unsigned int m_graphversion; // Graph version the path was found on
+	float m_length;
+};
+
+/**
+ * @brief Two level abstraction of the waypoint graph for hierarchical path finding (HPA*).
+ *
+ * Waypoints are grouped in spatial clusters. Waypoints with paths to or from other clusters are entrances,
+ * the abstract graph links entrances of the same cluster with their intra-cluster distance and entrances of
+ * different clusters with their path. Long queries are answered on the abstract graph and refined lazily.
+ * Graph edits only rebuild the clusters they touch. Distances are path lengths, cost functors are not used.
+ * Only used from the main thread.
+*/
+class CWaypointHierarchy
+{
+public:
+	CWaypointHierarchy();
+	virtual ~CWaypointHierarchy();
+
+	// Brings the clusters up to date with the waypoints
+	void Update();
+
+	/**
+	 * @brief Finds a path on the abstract graph
+	 * @param start Start waypoint
+	 * @param goal Goal waypoint
+	 * @param path Stores the abstract path, refine it with CHierarchicalPath::RefineNext
+	 * @return true if a path was found
+	*/
+	bool FindPath(CWaypoint* start, CWaypoint* goal, CHierarchicalPath& path);
+
+	int GetClusterCount() const { return static_cast<int>(m_clusters.size()); }
+	int GetEntranceCount() const { return m_entrancecount; }
+	// Cluster index of a waypoint, -1 if the ID isn't used
+	int GetClusterOf(const int id) const;
+	// Number of clusters rebuilt by the last update
+	int GetLastRebuiltClusterCount() const { return m_lastrebuilt; }
+
+private:
+	friend class CHierarchicalPath;
+
+	struct AbstractEdge
+	{
+		int target;
+		float cost;
+	};
+
+	struct Cluster
+	{
+		std::vector<int> nodes;
+		std::vector<int> entrances;
+		std::vector<std::pair<int, AbstractEdge>> edges; // Intra-cluster edges between entrances
+	};
+
+	int FindOrCreateCluster(const Vector& position);
+	// Assigns every waypoint to its cluster and finds the entrances
+	void AssignClusters();
+	void RebuildCluster(const int index);
+	void BuildAbstractGraph();
+	/**
+	 * @brief Dijkstra search that doesn't leave a cluster
+	 * @param cluster Cluster index
+	 * @param source Source waypoint ID
+	 * @param reverse Search the paths leading to the source instead
+	 * @param target Stop once this waypoint is reached, -1 to search the whole cluster
+	 * @param distances Stores the distance of every reached waypoint
+	 * @param parents Optional, stores the previous waypoint of every reached waypoint
+	*/
+	void SearchCluster(const int cluster, const int source, const bool reverse, const int target,
+		std::unordered_map<int, float>& distances, std::unordered_map<int, int>* parents) const;
+	// Appends the waypoints of an abstract path segment, excluding the first one
+	bool RefineSegment(const int from, const int to, std::vector<CWaypoint*>& path) const;
+
+	std::shared_ptr<const CWaypointGraph> m_graph; // Graph the clusters were built from
+	std::vector<Cluster> m_clusters;
+	std::unordered_map<std::uint64_t, int> m_clusterkeys; // Cluster index of each grid cell
+	std::vector<int> m_nodeclusters; // Cluster index of each waypoint ID
+	std::vector<bool> m_entrances; // Entrance flag of each waypoint ID
+	std::vector<std::pair<int, int>> m_interedges; // Paths between clusters
+	std::vector<std::vector<AbstractEdge>> m_abstractedges; // Abstract graph edges leaving each waypoint ID
+	unsigned int m_graphversion;
+	int m_entrancecount;
+	int m_lastrebuilt;
+};
+
+// Waypoint hierarchy singleton
+extern CWaypointHierarchy* TheWaypointHierarchy;
+
+#endif // !WAYPOINT_HIERARCHY_H_
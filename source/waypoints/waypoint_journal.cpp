@@ -0,0 +1,288 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "waypoint_file.h"
+#include "waypoint_journal.h"
+
+// Journal file header
+constexpr auto JOURNAL_FILE_HEADER = "GBJOURNAL";
+constexpr int JOURNAL_FILE_VERSION = 1;
+// Written records are synced to the disk at most once per this many seconds
+constexpr float JOURNAL_SYNC_INTERVAL = 1.0f;
+
+class CJournalFileHeader
+{
+public:
+	char header[10];
+	int version;
+	std::uint32_t basecrc; // CRC of the waypoint file the records apply to
+};
+
+static std::uint32_t ComputeRecordCRC(const WaypointJournalRecord& record)
+{
+	return WaypointFile::ComputeCRC32(&record, offsetof(WaypointJournalRecord, crc));
+}
+
+CWaypointJournal::CWaypointJournal() :
+	m_filename(),
+	m_records()
+{
+	m_file = nullptr;
+	m_basecrc = 0;
+	m_sequence = 0;
+	m_nextsync = 0.0f;
+	m_open = false;
+	m_dirty = false;
+}
+
+CWaypointJournal::~CWaypointJournal()
+{
+	Close();
+}
+
+const char* CWaypointJournal::ReadRecords(const std::string& filename, const std::uint32_t basecrc, const std::uint32_t journalbase, const std::uint32_t journalsequence, std::vector<WaypointJournalRecord>& records)
+{
+	std::fstream file;
+	file.open(filename, std::fstream::in | std::fstream::binary);
+
+	if (!file.is_open())
+		return nullptr;
+
+	CJournalFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(CJournalFileHeader));
+
+	if (!file.good() || strncmp(header.header, JOURNAL_FILE_HEADER, sizeof(header.header) - 1) != 0 || header.version != JOURNAL_FILE_VERSION)
+		return "Waypoint journal is invalid, ignoring it.";
+
+	// The journal either belongs to the waypoint file or to the file it was saved from, in which case the saved records are skipped
+	std::uint32_t skipsequence = 0;
+	bool skip = false;
+
+	if (header.basecrc != basecrc)
+	{
+		if (header.basecrc != journalbase || basecrc == 0)
+			return "Waypoint journal doesn't match the waypoint file, ignoring it.";
+
+		skipsequence = journalsequence;
+		skip = true;
+	}
+
+	WaypointJournalRecord record;
+	const char* warning = nullptr;
+	std::uint32_t last = 0;
+	bool first = true;
+
+	while (file.read(reinterpret_cast<char*>(&record), sizeof(WaypointJournalRecord)))
+	{
+		// Stop at the first damaged record, it was being written when the server stopped
+		if (record.crc != ComputeRecordCRC(record) || record.type >= WaypointJournal::MAX_RECORD_TYPES || (!first && record.sequence != last + 1))
+		{
+			warning = "Waypoint journal has a damaged record, the edits after it are lost.";
+			break;
+		}
+
+		first = false;
+		last = record.sequence;
+
+		if (skip && record.sequence <= skipsequence)
+			continue;
+
+		records.push_back(record);
+	}
+
+	return warning;
+}
+
+void CWaypointJournal::Open(const std::string& filename, const std::uint32_t basecrc, const std::vector<WaypointJournalRecord>& records)
+{
+	Close();
+
+	m_filename = filename;
+	m_basecrc = basecrc;
+	m_records = records;
+	m_sequence = records.empty() ? 0 : records.back().sequence;
+	m_nextsync = 0.0f;
+	m_open = true;
+	m_dirty = false;
+
+	// Rebase the replayed records on the loaded file, an unrelated journal is replaced on the first edit
+	if (!m_records.empty())
+	{
+		Rewrite();
+	}
+}
+
+void CWaypointJournal::Close()
+{
+	if (m_file != nullptr)
+	{
+		Sync();
+		std::fclose(m_file);
+		m_file = nullptr;
+	}
+
+	m_records.clear();
+	m_open = false;
+	m_dirty = false;
+}
+
+void CWaypointJournal::AppendCreate(const int id, const Vector& position, const float yaw)
+{
+	WaypointJournalRecord record{};
+	record.type = WaypointJournal::RECORD_CREATE;
+	record.id = id;
+	record.otherid = WaypointConst::InvalidPathConnection;
+	record.position[0] = position.x;
+	record.position[1] = position.y;
+	record.position[2] = position.z;
+	record.yaw = yaw;
+	Append(record);
+}
+
+void CWaypointJournal::AppendDelete(const int id)
+{
+	WaypointJournalRecord record{};
+	record.type = WaypointJournal::RECORD_DELETE;
+	record.id = id;
+	record.otherid = WaypointConst::InvalidPathConnection;
+	Append(record);
+}
+
+void CWaypointJournal::AppendPath(const WaypointJournal::RecordType type, const int id, const int otherid, const WaypointPath::PathType pathtype)
+{
+	WaypointJournalRecord record{};
+	record.type = type;
+	record.pathtype = static_cast<unsigned char>(pathtype);
+	record.id = id;
+	record.otherid = otherid;
+	Append(record);
+}
+
+void CWaypointJournal::Update(const float time)
+{
+	if (!m_dirty || time < m_nextsync)
+		return;
+
+	Sync();
+	m_nextsync = time + JOURNAL_SYNC_INTERVAL;
+}
+
+void CWaypointJournal::Sync()
+{
+	if (m_file == nullptr)
+		return;
+
+	std::fflush(m_file);
+#ifdef _WIN32
+	_commit(_fileno(m_file));
+#else
+	fsync(fileno(m_file));
+#endif
+	m_dirty = false;
+}
+
+void CWaypointJournal::OnCompacted(const std::uint32_t basecrc, const std::uint32_t sequence)
+{
+	if (!m_open)
+		return;
+
+	m_basecrc = basecrc;
+	m_records.erase(std::remove_if(m_records.begin(), m_records.end(), [sequence](const WaypointJournalRecord& record) { return record.sequence <= sequence; }), m_records.end());
+
+	if (m_file != nullptr || !m_records.empty())
+	{
+		Rewrite();
+	}
+}
+
+void CWaypointJournal::Append(WaypointJournalRecord& record)
+{
+	if (!m_open)
+		return;
+
+	record.sequence = ++m_sequence;
+	record.crc = ComputeRecordCRC(record);
+	m_records.push_back(record);
+
+	if (m_file == nullptr)
+	{
+		Rewrite();
+		return;
+	}
+
+	std::fwrite(&record, sizeof(WaypointJournalRecord), 1, m_file);
+	m_dirty = true;
+}
+
+bool CWaypointJournal::Rewrite()
+{
+	if (m_file != nullptr)
+	{
+		std::fclose(m_file);
+		m_file = nullptr;
+	}
+
+	const std::string temp = m_filename + ".tmp";
+	std::FILE* file = std::fopen(temp.c_str(), "wb");
+
+	if (file == nullptr)
+	{
+		LOG_CONSOLE(PLID, "Failed to write waypoint journal \"%s\"!", m_filename.c_str());
+		return false;
+	}
+
+	CJournalFileHeader header{};
+	std::memcpy(header.header, JOURNAL_FILE_HEADER, std::strlen(JOURNAL_FILE_HEADER));
+	header.version = JOURNAL_FILE_VERSION;
+	header.basecrc = m_basecrc;
+
+	std::fwrite(&header, sizeof(CJournalFileHeader), 1, file);
+
+	if (!m_records.empty())
+	{
+		std::fwrite(m_records.data(), sizeof(WaypointJournalRecord), m_records.size(), file);
+	}
+
+	std::fflush(file);
+#ifdef _WIN32
+	_commit(_fileno(file));
+#else
+	fsync(fileno(file));
+#endif
+	const bool written = std::ferror(file) == 0;
+	std::fclose(file);
+
+	std::error_code error;
+
+	if (written)
+	{
+		std::filesystem::rename(temp, m_filename, error);
+	}
+
+	if (!written || error)
+	{
+		std::filesystem::remove(temp, error);
+		LOG_CONSOLE(PLID, "Failed to write waypoint journal \"%s\"!", m_filename.c_str());
+		return false;
+	}
+
+	m_file = std::fopen(m_filename.c_str(), "ab");
+	m_dirty = false;
+	return m_file != nullptr;
+}
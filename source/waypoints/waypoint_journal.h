@@ -0,0 +1,117 @@
+#ifndef WAYPOINT_JOURNAL_H_
+#define WAYPOINT_JOURNAL_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+#include "waypoint_base.h"
+
+namespace WaypointJournal
+{
+	enum RecordType : unsigned char
+	{
+		RECORD_CREATE = 0, // Waypoint created at the record position and yaw
+		RECORD_DELETE, // Waypoint deleted
+		RECORD_ADDPATH, // Path added from the waypoint to the other waypoint
+		RECORD_DELETEPATH, // Path deleted from the waypoint to the other waypoint
+		RECORD_SETPATHTYPE, // Type of the path from the waypoint to the other waypoint changed
+
+		MAX_RECORD_TYPES
+	};
+}
+
+/**
+ * @brief Waypoint edit stored in the journal
+*/
+struct WaypointJournalRecord
+{
+	unsigned char type; // WaypointJournal::RecordType
+	unsigned char pathtype; // WaypointPath::PathType of path records
+	unsigned short reserved;
+	std::uint32_t sequence; // Increases by one every record
+	int id; // Edited waypoint
+	int otherid; // Other waypoint of path records
+	float position[3]; // Position of created waypoints
+	float yaw; // Yaw of created waypoints
+	std::uint32_t crc; // CRC32 of the fields above, records torn by a crash are detected with it
+};
+
+static_assert(sizeof(WaypointJournalRecord) == 36, "Waypoint journal record layout changed!");
+
+/**
+ * @brief Append only log of waypoint edits, stored next to the waypoint file.
+ *
+ * The journal belongs to the waypoint file with its base CRC. Records are replayed on top of that file when it's loaded.
+ * Saving the waypoints folds the records into a new waypoint file, which stores the journal base and the last record
+ * sequence so the records are not replayed twice if the server stops before the journal is rebased on the new file.
+ * Records are written as soon as they are appended and synced to the disk in batches.
+*/
+class CWaypointJournal
+{
+public:
+	CWaypointJournal();
+	~CWaypointJournal();
+
+	CWaypointJournal(const CWaypointJournal&) = delete;
+	CWaypointJournal& operator=(const CWaypointJournal&) = delete;
+
+	/**
+	 * @brief Reads the records not folded into a waypoint file yet, safe to call from any thread
+	 * @param filename Journal file
+	 * @param basecrc CRC of the waypoint file, 0 if there is no waypoint file
+	 * @param journalbase Journal base CRC stored in the waypoint file
+	 * @param journalsequence Last journal record stored in the waypoint file
+	 * @param records Stores the records to replay, in order
+	 * @return Warning for the main thread to log, nullptr if the journal was read without problems
+	*/
+	static const char* ReadRecords(const std::string& filename, const std::uint32_t basecrc, const std::uint32_t journalbase, const std::uint32_t journalsequence, std::vector<WaypointJournalRecord>& records);
+
+	/**
+	 * @brief Starts journaling the edits of a waypoint file
+	 * @param filename Journal file
+	 * @param basecrc CRC of the waypoint file, 0 if there is no waypoint file
+	 * @param records Records replayed on load, kept in the journal until they are saved in the waypoint file
+	*/
+	void Open(const std::string& filename, const std::uint32_t basecrc, const std::vector<WaypointJournalRecord>& records);
+	// Syncs and closes the journal, edits are no longer recorded
+	void Close();
+	bool IsOpen() const { return m_open; }
+
+	void AppendCreate(const int id, const Vector& position, const float yaw);
+	void AppendDelete(const int id);
+	void AppendPath(const WaypointJournal::RecordType type, const int id, const int otherid, const WaypointPath::PathType pathtype);
+
+	// Syncs the journal if records were written since the last sync and the sync interval passed
+	void Update(const float time);
+	// Writes the records to the disk
+	void Sync();
+	/**
+	 * @brief Rebases the journal on a new waypoint file, records folded into it are dropped
+	 * @param basecrc CRC of the new waypoint file
+	 * @param sequence Last record folded into the new waypoint file
+	*/
+	void OnCompacted(const std::uint32_t basecrc, const std::uint32_t sequence);
+
+	std::uint32_t GetBaseCRC() const { return m_basecrc; }
+	// Sequence of the last record
+	std::uint32_t GetSequence() const { return m_sequence; }
+	int GetRecordCount() const { return static_cast<int>(m_records.size()); }
+
+private:
+	void Append(WaypointJournalRecord& record);
+	// Writes the header and the current records to a new journal file and keeps it open for appending
+	bool Rewrite();
+
+	std::string m_filename;
+	std::FILE* m_file; // nullptr until the first record is written
+	std::vector<WaypointJournalRecord> m_records; // Records not folded into the waypoint file
+	std::uint32_t m_basecrc;
+	std::uint32_t m_sequence;
+	float m_nextsync;
+	bool m_open;
+	bool m_dirty; // Records were written since the last sync
+};
+
+#endif // !WAYPOINT_JOURNAL_H_
@@ -0,0 +1,398 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <queue>
+#include <functional>
+#include <utility>
+#include <cstring>
+#include <cfloat> // Linux, for FLT_MAX
+
+#include "plugincvars.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_landmarks.h"
+
+// Landmark file header
+constexpr auto LANDMARK_FILE_HEADER = "GBLANDMARK";
+constexpr int LANDMARK_FILE_VERSION = 1;
+// Maximum number of landmarks
+constexpr int MAX_LANDMARKS = 32;
+// Tables are rebuilt after the waypoints stay unchanged for this many seconds
+constexpr float LANDMARK_BUILD_DELAY = 5.0f;
+
+CLandmarkManager* TheLandmarks = nullptr;
+
+class CLandmarkFileHeader
+{
+public:
+	char header[11];
+	int version;
+	std::uint64_t graphhash;
+	int nodelimit;
+	int landmarks;
+};
+
+CLandmarkTable::CLandmarkTable() :
+	m_landmarks(),
+	m_from(),
+	m_to()
+{
+	m_graphhash = 0;
+	m_nodelimit = 0;
+}
+
+CLandmarkTable::~CLandmarkTable()
+{
+}
+
+void CLandmarkTable::Build(const CWaypointGraph& graph, const int count)
+{
+	const int limit = graph.GetNodeLimit();
+	const int landmarks = std::min(std::min(count, MAX_LANDMARKS), graph.GetNodeCount());
+
+	m_graphhash = graph.GetHash();
+	m_nodelimit = limit;
+	m_landmarks.clear();
+	m_from.assign(static_cast<size_t>(landmarks) * limit, FLT_MAX);
+	m_to.assign(static_cast<size_t>(landmarks) * limit, FLT_MAX);
+
+	if (landmarks <= 0)
+		return;
+
+	// First landmark is the waypoint furthest away from the center of the map
+	Vector center(0.0f, 0.0f, 0.0f);
+
+	for (int id = 0; id < limit; id++)
+	{
+		if (graph.IsValidNode(id))
+		{
+			center = center + graph.GetPosition(id);
+		}
+	}
+
+	center = center * (1.0f / static_cast<float>(graph.GetNodeCount()));
+	int landmark = -1;
+	float best = -1.0f;
+
+	for (int id = 0; id < limit; id++)
+	{
+		if (graph.IsValidNode(id) && graph.GetPosition(id).DistToSqr(center) > best)
+		{
+			best = graph.GetPosition(id).DistToSqr(center);
+			landmark = id;
+		}
+	}
+
+	// Farthest point selection, the next landmark is the waypoint furthest away from every landmark selected so far
+	std::vector<float> closest(limit, FLT_MAX);
+
+	for (int index = 0; index < landmarks && landmark != -1; index++)
+	{
+		float* from = &m_from[static_cast<size_t>(index) * limit];
+		float* to = &m_to[static_cast<size_t>(index) * limit];
+		m_landmarks.push_back(landmark);
+		ComputeDistances(graph, landmark, false, from);
+		ComputeDistances(graph, landmark, true, to);
+
+		landmark = -1;
+		best = 0.0f;
+
+		for (int id = 0; id < limit; id++)
+		{
+			if (!graph.IsValidNode(id))
+				continue;
+
+			// Waypoints not connected to any landmark have the highest priority
+			closest[id] = std::min(closest[id], std::min(from[id], to[id]));
+
+			if (closest[id] > best)
+			{
+				best = closest[id];
+				landmark = id;
+			}
+		}
+	}
+
+	// Less waypoints than landmarks
+	m_from.resize(m_landmarks.size() * limit);
+	m_to.resize(m_landmarks.size() * limit);
+}
+
+void CLandmarkTable::Save(const std::string& filename) const
+{
+	std::fstream file;
+	file.open(filename, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+
+	if (!file.is_open())
+	{
+		LOG_CONSOLE(PLID, "Failed to save landmark file \"%s\"!", filename.c_str());
+		return;
+	}
+
+	CLandmarkFileHeader header{};
+	std::memcpy(header.header, LANDMARK_FILE_HEADER, std::strlen(LANDMARK_FILE_HEADER));
+	header.version = LANDMARK_FILE_VERSION;
+	header.graphhash = m_graphhash;
+	header.nodelimit = m_nodelimit;
+	header.landmarks = GetLandmarkCount();
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(CLandmarkFileHeader));
+	file.write(reinterpret_cast<const char*>(m_landmarks.data()), m_landmarks.size() * sizeof(int));
+	file.write(reinterpret_cast<const char*>(m_from.data()), m_from.size() * sizeof(float));
+	file.write(reinterpret_cast<const char*>(m_to.data()), m_to.size() * sizeof(float));
+	file.close();
+}
+
+bool CLandmarkTable::Load(const std::string& filename, const CWaypointGraph& graph)
+{
+	std::fstream file;
+	file.open(filename, std::fstream::in | std::fstream::binary);
+
+	if (!file.is_open())
+		return false;
+
+	CLandmarkFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(CLandmarkFileHeader));
+	header.header[sizeof(header.header) - 1] = 0;
+
+	if (!file || strcmp(header.header, LANDMARK_FILE_HEADER) != 0 || header.version != LANDMARK_FILE_VERSION)
+	{
+		LOG_CONSOLE(PLID, "Invalid landmark file \"%s\"!", filename.c_str());
+		return false;
+	}
+
+	// Built for different waypoints, tables will be rebuilt
+	if (header.graphhash != graph.GetHash() || header.nodelimit != graph.GetNodeLimit() || header.landmarks < 0 || header.landmarks > MAX_LANDMARKS)
+		return false;
+
+	const size_t size = static_cast<size_t>(header.landmarks) * header.nodelimit;
+	m_graphhash = header.graphhash;
+	m_nodelimit = header.nodelimit;
+	m_landmarks.resize(header.landmarks);
+	m_from.resize(size);
+	m_to.resize(size);
+
+	file.read(reinterpret_cast<char*>(m_landmarks.data()), m_landmarks.size() * sizeof(int));
+	file.read(reinterpret_cast<char*>(m_from.data()), m_from.size() * sizeof(float));
+	file.read(reinterpret_cast<char*>(m_to.data()), m_to.size() * sizeof(float));
+
+	if (!file)
+	{
+		LOG_CONSOLE(PLID, "Landmark file \"%s\" is truncated!", filename.c_str());
+		m_landmarks.clear();
+		m_from.clear();
+		m_to.clear();
+		m_graphhash = 0;
+		return false;
+	}
+
+	return true;
+}
+
+float CLandmarkTable::GetLowerBound(const int id, const int goalid) const
+{
+	float bound = 0.0f;
+
+	for (int landmark = 0; landmark < GetLandmarkCount(); landmark++)
+	{
+		// d(id, goal) >= d(landmark, goal) - d(landmark, id)
+		const float fromgoal = GetDistanceFrom(landmark, goalid);
+		const float fromid = GetDistanceFrom(landmark, id);
+
+		if (fromgoal != FLT_MAX && fromid != FLT_MAX)
+		{
+			bound = std::max(bound, fromgoal - fromid);
+		}
+
+		// d(id, goal) >= d(id, landmark) - d(goal, landmark)
+		const float toid = GetDistanceTo(landmark, id);
+		const float togoal = GetDistanceTo(landmark, goalid);
+
+		if (toid != FLT_MAX && togoal != FLT_MAX)
+		{
+			bound = std::max(bound, toid - togoal);
+		}
+	}
+
+	return bound;
+}
+
+void CLandmarkTable::ComputeDistances(const CWaypointGraph& graph, const int source, const bool reverse, float* distances)
+{
+	using QueueEntry = std::pair<float, int>;
+	std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> queue;
+
+	distances[source] = 0.0f;
+	queue.emplace(0.0f, source);
+
+	while (!queue.empty())
+	{
+		const QueueEntry entry = queue.top();
+		queue.pop();
+		const int id = entry.second;
+
+		if (entry.first > distances[id])
+			continue;
+
+		if (reverse)
+		{
+			for (int edge = graph.GetFirstReverseEdge(id); edge < graph.GetLastReverseEdge(id); edge++)
+			{
+				const int target = graph.GetReverseEdgeSource(edge);
+				const float distance = entry.first + graph.GetReverseEdgeLength(edge);
+
+				if (distance < distances[target])
+				{
+					distances[target] = distance;
+					queue.emplace(distance, target);
+				}
+			}
+		}
+		else
+		{
+			for (int edge = graph.GetFirstEdge(id); edge < graph.GetLastEdge(id); edge++)
+			{
+				const int target = graph.GetEdgeTarget(edge);
+				const float distance = entry.first + graph.GetEdgeLength(edge);
+
+				if (distance < distances[target])
+				{
+					distances[target] = distance;
+					queue.emplace(distance, target);
+				}
+			}
+		}
+	}
+}
+
+CLandmarkManager::CLandmarkManager() :
+	m_table(),
+	m_building(),
+	m_thread(),
+	m_buildfinished(false)
+{
+	m_buildhash = 0;
+	m_loadhash = 0;
+	m_loadtried = false;
+	m_lasthash = 0;
+	m_buildtime = 0.0f;
+}
+
+CLandmarkManager::~CLandmarkManager()
+{
+	Stop();
+}
+
+void CLandmarkManager::Update()
+{
+	if (m_buildfinished.load())
+	{
+		FinishBuild();
+	}
+
+	if (gb_nav_landmarks.value <= 0.0f || IsBuilding())
+		return;
+
+	std::shared_ptr<const CWaypointGraph> graph = TheWaypoints->GetGraphSnapshot();
+
+	if (graph->GetNodeCount() == 0)
+		return;
+
+	std::shared_ptr<const CLandmarkTable> table = GetTable();
+
+	if (table && table->IsValidFor(*graph))
+		return;
+
+	if (!m_loadtried || m_loadhash != graph->GetHash())
+	{
+		m_loadtried = true;
+		m_loadhash = graph->GetHash();
+		auto loaded = std::make_shared<CLandmarkTable>();
+
+		if (loaded->Load(TheWaypoints->GetWaypointFilePath(".wpl"), *graph))
+		{
+			std::atomic_store(&m_table, std::shared_ptr<const CLandmarkTable>(loaded));
+			return;
+		}
+	}
+
+	// Wait until the waypoints stop changing
+	if (m_lasthash != graph->GetHash())
+	{
+		m_lasthash = graph->GetHash();
+		m_buildtime = gpGlobals->time + LANDMARK_BUILD_DELAY;
+	}
+
+	if (gpGlobals->time >= m_buildtime || table == nullptr)
+	{
+		StartBuild(graph);
+	}
+}
+
+void CLandmarkManager::Stop()
+{
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	m_buildfinished.store(false);
+	m_building.reset();
+}
+
+void CLandmarkManager::StartBuild(std::shared_ptr<const CWaypointGraph> graph)
+{
+	const int count = static_cast<int>(gb_nav_landmarks.value);
+	std::shared_ptr<CLandmarkTable> building = std::make_shared<CLandmarkTable>();
+
+	m_building = building;
+	m_buildhash = graph->GetHash();
+	m_buildfinished.store(false);
+
+	// The graph snapshot is kept alive by the thread
+	m_thread = std::thread([this, graph, building, count]() {
+		building->Build(*graph, count);
+		m_buildfinished.store(true);
+	});
+}
+
+void CLandmarkManager::FinishBuild()
+{
+	m_thread.join();
+	m_buildfinished.store(false);
+	std::atomic_store(&m_table, std::shared_ptr<const CLandmarkTable>(m_building));
+
+	// Don't save tables for waypoints that changed while they were built
+	if (TheWaypoints->GetGraphSnapshot()->GetHash() == m_buildhash)
+	{
+		m_building->Save(TheWaypoints->GetWaypointFilePath(".wpl"));
+		LOG_MESSAGE(PLID, "Built %i path finding landmarks.", m_building->GetLandmarkCount());
+	}
+
+	m_building.reset();
+}
+
+CLandmarkHeuristic::CLandmarkHeuristic() :
+	m_table()
+{
+	m_graph = nullptr;
+	m_graphversion = 0;
+}
+
+void CLandmarkHeuristic::Refresh(const CWaypointGraph& graph)
+{
+	m_graph = &graph;
+	m_graphversion = graph.GetVersion();
+	m_table = TheLandmarks != nullptr ? TheLandmarks->GetTable() : nullptr;
+
+	if (m_table && !m_table->IsValidFor(graph))
+	{
+		m_table.reset();
+	}
+}
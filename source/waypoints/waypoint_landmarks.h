@@ -0,0 +1,143 @@
+#ifndef WAYPOINT_LANDMARKS_H_
+#define WAYPOINT_LANDMARKS_H_
+
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <cstdint>
+
+#include "waypoint_graph.h"
+
+/**
+ * @brief Landmark distance tables for the ALT (A*, landmarks, triangle inequality) heuristic.
+ *
+ * Stores the shortest path distance from every landmark to every waypoint and from every waypoint to every landmark.
+ * Distances use the graph edge lengths, the bounds are admissible for cost functors that never cost less than the path length.
+ * Tables are immutable once built and tied to the hash of the graph they were built from.
+*/
+class CLandmarkTable
+{
+public:
+	CLandmarkTable();
+	~CLandmarkTable();
+
+	/**
+	 * @brief Selects the landmarks and computes the distance tables, safe to call from any thread
+	 * @param graph Graph to build the tables from
+	 * @param count Number of landmarks
+	*/
+	void Build(const CWaypointGraph& graph, const int count);
+	void Save(const std::string& filename) const;
+	/**
+	 * @brief Loads tables from a file
+	 * @param filename File to load
+	 * @param graph Tables are rejected if they were built from a different graph
+	 * @return true if the tables were loaded
+	*/
+	bool Load(const std::string& filename, const CWaypointGraph& graph);
+
+	std::uint64_t GetGraphHash() const { return m_graphhash; }
+	int GetLandmarkCount() const { return static_cast<int>(m_landmarks.size()); }
+	int GetLandmark(const int index) const { return m_landmarks[index]; }
+	// Checks if the tables can be used on the given graph
+	bool IsValidFor(const CWaypointGraph& graph) const { return m_graphhash == graph.GetHash() && m_nodelimit == graph.GetNodeLimit(); }
+
+	/**
+	 * @brief Lower bound of the path length between two waypoints
+	 * @param id Start waypoint ID
+	 * @param goalid Goal waypoint ID
+	 * @return Path length lower bound
+	*/
+	float GetLowerBound(const int id, const int goalid) const;
+
+private:
+	// Single source shortest path lengths, over the reverse edges if reverse is set
+	static void ComputeDistances(const CWaypointGraph& graph, const int source, const bool reverse, float* distances);
+
+	float GetDistanceFrom(const int landmark, const int id) const { return m_from[static_cast<size_t>(landmark) * m_nodelimit + id]; }
+	float GetDistanceTo(const int landmark, const int id) const { return m_to[static_cast<size_t>(landmark) * m_nodelimit + id]; }
+
+	std::uint64_t m_graphhash;
+	int m_nodelimit;
+	std::vector<int> m_landmarks; // Landmark waypoint IDs
+	std::vector<float> m_from; // Distance from each landmark to each waypoint, a row per landmark
+	std::vector<float> m_to; // Distance from each waypoint to each landmark, a row per landmark
+};
+
+/**
+ * @brief Keeps the landmark tables up to date with the waypoints.
+ *
+ * Tables are loaded from the sidecar file next to the waypoint file if its graph hash matches,
+ * otherwise they are built on a background thread and saved once finished.
+*/
+class CLandmarkManager
+{
+public:
+	CLandmarkManager();
+	virtual ~CLandmarkManager();
+
+	// Called every server frame
+	void Update();
+	// Waits for the background build to finish
+	void Stop();
+
+	// Current tables, may be outdated or nullptr. Safe to call from any thread
+	std::shared_ptr<const CLandmarkTable> GetTable() const { return std::atomic_load(&m_table); }
+	bool IsBuilding() const { return m_thread.joinable(); }
+
+private:
+	void StartBuild(std::shared_ptr<const CWaypointGraph> graph);
+	void FinishBuild();
+
+	std::shared_ptr<const CLandmarkTable> m_table; // Published tables, only accessed with atomic loads and stores
+	std::shared_ptr<CLandmarkTable> m_building; // Tables being built by the background thread
+	std::thread m_thread;
+	std::atomic<bool> m_buildfinished;
+	std::uint64_t m_buildhash; // Hash of the graph being built
+	std::uint64_t m_loadhash; // Hash of the graph the sidecar load was tried for
+	bool m_loadtried;
+	std::uint64_t m_lasthash; // Graph hash seen on the last update
+	float m_buildtime; // Tables are built once the graph stays unchanged until this time
+};
+
+/**
+ * @brief ALT heuristic, falls back to the straight line distance when the landmark tables don't match the graph
+*/
+class CLandmarkHeuristic
+{
+public:
+	CLandmarkHeuristic();
+
+	float operator() (const CWaypointGraph& graph, const int id, const int goalid, const Vector& goal)
+	{
+		if (&graph != m_graph || graph.GetVersion() != m_graphversion)
+		{
+			Refresh(graph);
+		}
+
+		float distance = graph.GetPosition(id).DistTo(goal);
+
+		if (m_table)
+		{
+			distance = std::max(distance, m_table->GetLowerBound(id, goalid));
+		}
+
+		return distance;
+	}
+
+private:
+	// Gets the current tables when the graph changes, m_table is nullptr if they don't match the graph
+	void Refresh(const CWaypointGraph& graph);
+
+	std::shared_ptr<const CLandmarkTable> m_table;
+	const CWaypointGraph* m_graph;
+	unsigned int m_graphversion;
+};
+
+// Landmark manager singleton
+extern CLandmarkManager* TheLandmarks;
+
+#endif // !WAYPOINT_LANDMARKS_H_
@@ -8,20 +8,31 @@
 #undef close
 
 #include <fstream>
+#include <sstream>
 #include <filesystem>
 #include <cstring>
 #include <cfloat> // Linux, for FLT_MAX
 
 #include "manager.h"
+#include "plugincvars.h"
 #include "pluginplayer.h"
 #include "mods/mod_base.h"
+#include "sdk/bsp_collision.h"
 #include "interfaces/player.h"
 #include "interfaces/pluginbot.h"
 #include "bots/basebot.h"
 #include "waypoint_base.h"
 #include "waypoint_manager.h"
 #include "waypoint_pathfind.h"
+#include "waypoint_file.h"
+#include "waypoint_chunk.h"
 
+// The journal is folded into the waypoint file once it has this many records
+constexpr int WAYPOINT_JOURNAL_COMPACT_RECORDS = 1024;
+// Minimum time between automatic journal compactions
+constexpr float WAYPOINT_JOURNAL_COMPACT_INTERVAL = 60.0f;
+
+// Start of the waypoint file header, the same on every version
 class CWaypointFileHeader
 {
 public:
@@ -41,20 +52,57 @@ CWaypointManager::CWaypointManager() :
 	m_editmode(false),
 	m_loaded(false),
 	m_pathstart(-1),
+	m_pathstartgen(0),
 	m_waypoints(),
-	m_editor()
+	m_slots(),
+	m_freeids(),
+	m_epoch(0),
+	m_spatialindex(),
+	m_graph(std::make_shared<CWaypointGraph>()),
+	m_graphversion(1),
+	m_editlog(),
+	m_editor(),
+	m_journal(),
+	m_iothread(),
+	m_iofinished(false),
+	m_loaddata(),
+	m_savedata(),
+	m_loading(false),
+	m_savequeued(false),
+	m_nextcompaction(0.0f),
+	m_chunkdata(),
+	m_chunks(),
+	m_pathbuilder(),
+	m_generator(),
+	m_visibility()
 {
 	m_waypoints.clear();
 }
 
 CWaypointManager::~CWaypointManager()
 {
+	if (m_iothread.joinable())
+	{
+		m_iothread.join();
+	}
+
+	if (m_loaddata != nullptr)
+	{
+		for (auto waypoint : m_loaddata->waypoints)
+		{
+			delete waypoint;
+		}
+	}
+
 	for (auto waypoint : m_waypoints)
 	{
 		delete waypoint;
 	}
 
 	m_waypoints.clear();
+	m_spatialindex.Clear();
+	m_raster.Clear();
+	ClearSlots();
 }
 
 void CWaypointManager::EditingUpdate()
@@ -63,13 +111,12 @@ void CWaypointManager::EditingUpdate()
 	{
 		m_editupdatetimer = gpGlobals->time + 1.0f;
 		Vector origin(m_editor->v.origin);
-		
-		for (auto waypoint : m_waypoints)
+		std::vector<CWaypoint*> visible;
+		CollectWaypointsInRadius(origin, WaypointConst::WaypointDrawDistance, visible);
+
+		for (auto waypoint : visible)
 		{
-			if (waypoint->DistToSqr(origin) <= WaypointConst::WaypointDrawDistance)
-			{
-				waypoint->Draw();
-			}
+			waypoint->Draw();
 		}
 
 		CWaypoint* nearest = GetNearestWaypoint(origin, WaypointConst::WaypointDrawDistance);
@@ -116,7 +163,7 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 			else if (strcmp(args[0], "waypoint") == 0)
 			{
 				ClientPrint(client, HUD_PRINTCONSOLE, "Goldbot waypoint editing commands: \n");
-				ClientPrint(client, HUD_PRINTCONSOLE, "becomeeditor addwaypoint save info createpath createpathboth deletepath deletepathboth info setpathtype setpathtypeboth \n");
+				ClientPrint(client, HUD_PRINTCONSOLE, "becomeeditor addwaypoint save info createpath createpathboth deletepath deletepathboth info setpathtype setpathtypeboth rebuildpaths generate \n");
 				ClientPrint(client, HUD_PRINTCONSOLE, "Note: Waypoint editing must be enabled on the server. \n");
 				return true;
 			}
@@ -146,6 +193,12 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 					return true;
 				}
 
+				if (m_loading)
+				{
+					ClientPrint(client, HUD_PRINTCONSOLE, "Waypoints are still loading! \n");
+					return true;
+				}
+
 				if (strcmp(args[1], "addwaypoint") == 0)
 				{
 					CreateWaypoint(player);
@@ -168,8 +221,77 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 				}
 				else if (strcmp(args[1], "save") == 0)
 				{
+					if (gb_nav_quicksave.value > 0.0f && m_journal.IsOpen())
+					{
+						// Edits are already in the journal, the waypoint file is rewritten when the journal grows
+						m_journal.Sync();
+						ClientPrint(client, HUD_PRINTCONSOLE, "Waypoint edits saved to the journal! \n");
+						return true;
+					}
+
 					Save();
-					ClientPrint(client, HUD_PRINTCONSOLE, "Waypoints saved! \n");
+					ClientPrint(client, HUD_PRINTCONSOLE, "Saving waypoints... \n");
+					return true;
+				}
+				else if (strcmp(args[1], "rebuildpaths") == 0)
+				{
+					float radius = sqrtf(m_authpathdist);
+
+					if (argc >= 3)
+					{
+						radius = static_cast<float>(atof(args[2]));
+					}
+
+					if (radius <= 0.0f)
+					{
+						ClientPrint(client, HUD_PRINTCONSOLE, "Usage: gb waypoint rebuildpaths [radius] \n");
+						return true;
+					}
+
+					if (!m_pathbuilder.Start(radius))
+					{
+						ClientPrint(client, HUD_PRINTCONSOLE, "Paths are already being rebuilt! \n");
+						return true;
+					}
+
+					ClientPrint(client, HUD_PRINTCONSOLE, "Rebuilding paths... \n");
+					return true;
+				}
+				else if (strcmp(args[1], "generate") == 0)
+				{
+					if (argc >= 3 && strcmp(args[2], "stop") == 0)
+					{
+						m_generator.Cancel();
+						ClientPrint(client, HUD_PRINTCONSOLE, "Waypoint generation stopped. \n");
+						return true;
+					}
+
+					float spacing = 32.0f;
+
+					if (argc >= 3)
+					{
+						spacing = static_cast<float>(atof(args[2]));
+					}
+
+					if (spacing < 16.0f)
+					{
+						ClientPrint(client, HUD_PRINTCONSOLE, "Usage: gb waypoint generate [spacing|stop] \nSpacing must be at least 16. \n");
+						return true;
+					}
+
+					if (m_generator.IsRunning())
+					{
+						ClientPrint(client, HUD_PRINTCONSOLE, "Waypoints are already being generated! \n");
+						return true;
+					}
+
+					if (!m_generator.Start(spacing))
+					{
+						ClientPrint(client, HUD_PRINTCONSOLE, "No player spawn point to start from! \n");
+						return true;
+					}
+
+					ClientPrint(client, HUD_PRINTCONSOLE, "Generating waypoints... \n");
 					return true;
 				}
 				else if (strcmp(args[1], "createpathboth") == 0)
@@ -181,13 +303,21 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 						if (m_pathstart == WaypointConst::InvalidPathConnection)
 						{
 							m_pathstart = wpt->GetID();
+							m_pathstartgen = GetWaypointGeneration(m_pathstart);
 							ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint set. Now go to the target waypoint and use this command again! \n");
 							EMIT_SOUND_DYN(player->GetEdict(), CHAN_ITEM, "buttons/button3.wav", VOL_NORM, ATTN_NORM, 0, PITCH_NORM);
 						}
 						else
 						{
-							auto start = GetWaypointOfID(m_pathstart);
+							auto start = GetWaypointOfID(m_pathstart, m_pathstartgen);
 							m_pathstart = WaypointConst::InvalidPathConnection;
+
+							if (start == nullptr)
+							{
+								ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint was deleted! \n");
+								return true;
+							}
+
 							bool result = start->AddPathTo(wpt) && wpt->AddPathTo(start);
 
 							if (!result)
@@ -213,12 +343,20 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 						if (m_pathstart == WaypointConst::InvalidPathConnection)
 						{
 							m_pathstart = wpt->GetID();
+							m_pathstartgen = GetWaypointGeneration(m_pathstart);
 							ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint set. Now go to the target waypoint and use this command again! \n");
 						}
 						else
 						{
-							auto start = GetWaypointOfID(m_pathstart);
+							auto start = GetWaypointOfID(m_pathstart, m_pathstartgen);
 							m_pathstart = WaypointConst::InvalidPathConnection;
+
+							if (start == nullptr)
+							{
+								ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint was deleted! \n");
+								return true;
+							}
+
 							bool result = start->AddPathTo(wpt);
 
 							if (!result)
@@ -244,13 +382,21 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 						if (m_pathstart == WaypointConst::InvalidPathConnection)
 						{
 							m_pathstart = wpt->GetID();
+							m_pathstartgen = GetWaypointGeneration(m_pathstart);
 							ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint set. Now go to the target waypoint and use this command again! \n");
 							EMIT_SOUND_DYN(player->GetEdict(), CHAN_ITEM, "buttons/button3.wav", VOL_NORM, ATTN_NORM, 0, PITCH_NORM);
 						}
 						else
 						{
-							auto start = GetWaypointOfID(m_pathstart);
+							auto start = GetWaypointOfID(m_pathstart, m_pathstartgen);
 							m_pathstart = WaypointConst::InvalidPathConnection;
+
+							if (start == nullptr)
+							{
+								ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint was deleted! \n");
+								return true;
+							}
+
 							bool result = start->DeletePathTo(wpt) && wpt->DeletePathTo(start);
 
 							if (!result)
@@ -276,13 +422,21 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 						if (m_pathstart == WaypointConst::InvalidPathConnection)
 						{
 							m_pathstart = wpt->GetID();
+							m_pathstartgen = GetWaypointGeneration(m_pathstart);
 							ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint set. Now go to the target waypoint and use this command again! \n");
 							EMIT_SOUND_DYN(player->GetEdict(), CHAN_ITEM, "buttons/button3.wav", VOL_NORM, ATTN_NORM, 0, PITCH_NORM);
 						}
 						else
 						{
-							auto start = GetWaypointOfID(m_pathstart);
+							auto start = GetWaypointOfID(m_pathstart, m_pathstartgen);
 							m_pathstart = WaypointConst::InvalidPathConnection;
+
+							if (start == nullptr)
+							{
+								ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint was deleted! \n");
+								return true;
+							}
+
 							bool result = start->DeletePathTo(wpt);
 
 							if (!result)
@@ -328,13 +482,21 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 						if (m_pathstart == WaypointConst::InvalidPathConnection)
 						{
 							m_pathstart = wpt->GetID();
+							m_pathstartgen = GetWaypointGeneration(m_pathstart);
 							ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint set. Now go to the target waypoint and use this command again! \n");
 							EMIT_SOUND_DYN(player->GetEdict(), CHAN_ITEM, "buttons/button3.wav", VOL_NORM, ATTN_NORM, 0, PITCH_NORM);
 						}
 						else
 						{
-							auto start = GetWaypointOfID(m_pathstart);
+							auto start = GetWaypointOfID(m_pathstart, m_pathstartgen);
 							m_pathstart = WaypointConst::InvalidPathConnection;
+
+							if (start == nullptr)
+							{
+								ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint was deleted! \n");
+								return true;
+							}
+
 							bool result = start->SetPathTypeTo(wpt, type) && wpt->SetPathTypeTo(start, type);
 
 							if (!result)
@@ -356,7 +518,7 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 					if (argc < 3)
 					{
 						ClientPrint(client, HUD_PRINTCONSOLE, "Usage: gb waypoint setpathtype <type>\n");
-						ClientPrint(client, HUD_PRINTCONSOLE, "Valid types: normal jump (gap/gapjump) (stairs/ramp)");
+						ClientPrint(client, HUD_PRINTCONSOLE, "Valid types: normal jump (gap/gapjump) (stairs/ramp) drop");
 						return true;
 					}
 
@@ -368,13 +530,21 @@ bool CWaypointManager::ClientCommand(IPlayer* player, const char* command, const
 						if (m_pathstart == WaypointConst::InvalidPathConnection)
 						{
 							m_pathstart = wpt->GetID();
+							m_pathstartgen = GetWaypointGeneration(m_pathstart);
 							ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint set. Now go to the target waypoint and use this command again! \n");
 							EMIT_SOUND_DYN(player->GetEdict(), CHAN_ITEM, "buttons/button3.wav", VOL_NORM, ATTN_NORM, 0, PITCH_NORM);
 						}
 						else
 						{
-							auto start = GetWaypointOfID(m_pathstart);
+							auto start = GetWaypointOfID(m_pathstart, m_pathstartgen);
 							m_pathstart = WaypointConst::InvalidPathConnection;
+
+							if (start == nullptr)
+							{
+								ClientPrint(client, HUD_PRINTCONSOLE, "First waypoint was deleted! \n");
+								return true;
+							}
+
 							bool result = start->SetPathTypeTo(wpt, type);
 
 							if (!result)
@@ -439,26 +609,13 @@ CWaypoint* CWaypointManager::WaypointFactory()
 
 CWaypoint* CWaypointManager::CreateWaypoint(IPlayer* player)
 {
-	int id = 0;
-
-	for (auto waypoint : m_waypoints)
-	{
-		if (id != waypoint->GetID()) // first the first available ID
-		{
-			break;
-		}
-
-		id++;
-	}
-
 	// The position vector must be a new object otherwise we will sink the waypointer into the ground
 	Vector position = Vector(player->GetPosition());
 	auto& eyes = player->GetEyeAngles();
-	auto wpt = WaypointFactory();
 
 	position[2] = position[2] - gamemod->GetPlayerOriginGroundOffset();
 
-	wpt->Init(id ,position, eyes[YAW]);
+	auto wpt = AddWaypoint(position, eyes[YAW]);
 
 	std::vector<CWaypoint*> nearbywpts;
 	CollectWaypointsInRadius(position, m_authpathdist, nearbywpts);
@@ -470,7 +627,6 @@ CWaypoint* CWaypointManager::CreateWaypoint(IPlayer* player)
 	}
 
 	EMIT_SOUND_DYN(player->GetEdict(), CHAN_ITEM, "weapons/xbow_hit1.wav", VOL_NORM, ATTN_NORM, 0, PITCH_NORM);
-	m_waypoints.push_back(wpt);
 
 	if (IS_DEDICATED_SERVER() != 0)
 	{
@@ -480,6 +636,21 @@ CWaypoint* CWaypointManager::CreateWaypoint(IPlayer* player)
 	return wpt;
 }
 
+CWaypoint* CWaypointManager::AddWaypoint(const Vector& position, const float yaw)
+{
+	const int id = AllocateID();
+	auto wpt = WaypointFactory();
+
+	wpt->Init(id, position, yaw);
+	m_journal.AppendCreate(id, position, yaw);
+	m_waypoints.push_back(wpt);
+	m_spatialindex.Insert(wpt);
+	m_raster.Insert(wpt);
+	StoreInSlot(wpt);
+	OnGraphModified(wpt->GetID());
+	return wpt;
+}
+
 bool CWaypointManager::DeleteWaypoint(CWaypoint* todelete)
 {
 	const int id = todelete->GetID();
@@ -487,7 +658,11 @@ bool CWaypointManager::DeleteWaypoint(CWaypoint* todelete)
 
 	if (it != m_waypoints.end())
 	{
+		m_journal.AppendDelete(id);
 		m_waypoints.erase(it);
+		m_spatialindex.Remove(todelete);
+		m_raster.Remove(todelete, m_spatialindex);
+		ReleaseID(id);
 		delete todelete;
 
 		for (auto waypoint : m_waypoints)
@@ -495,6 +670,8 @@ bool CWaypointManager::DeleteWaypoint(CWaypoint* todelete)
 			waypoint->NotifyWaypointDeletion(id);
 		}
 
+		OnGraphModified(id);
+
 		EMIT_SOUND_DYN(m_editor.Get(), CHAN_ITEM, "weapons/mine_activate.wav", VOL_NORM, ATTN_NORM, 0, PITCH_NORM);
 		return true;
 	}
@@ -502,56 +679,54 @@ bool CWaypointManager::DeleteWaypoint(CWaypoint* todelete)
 	return false;
 }
 
-void CWaypointManager::Save()
+std::string CWaypointManager::GetWaypointFilePath(const char* extension)
 {
-	std::fstream file;
 	std::unique_ptr<char[]> gamedir(new char[256]);
 	GET_GAME_DIR(gamedir.get());
 	std::string gameroot = std::string(gamedir.get());
 	std::string map = std::string(STRING(gpGlobals->mapname));
 	std::string wptdir = std::string("/addons/goldbot/waypoints/");
 	std::string dir = gameroot + wptdir + gamemod->GetModDataDirectory();
-	std::string filename = dir + "/" + map + ".wpt";
-
-	file.open(filename, std::fstream::out | std::fstream::binary | std::fstream::trunc);
-
-	CWaypointFileHeader header{};
-	int subversion = GetSubversion();
-
-	strncpy(header.header, WAYPOINT_FILE_HEADER, 7);
-	header.header[9] = 0;
-
-	header.version = GetVersion();
-	header.subversion = subversion;
-	header.num_waypoints = static_cast<int>(m_waypoints.size());
-
-	file.write(reinterpret_cast<char*>(&header), sizeof(CWaypointFileHeader));
+	return dir + "/" + map + extension;
+}
 
-	PreWaypointCustomSave(file, subversion);
+void CWaypointManager::Save()
+{
+	if (m_loading)
+	{
+		LOG_CONSOLE(PLID, "Waypoints can't be saved while they are loading!");
+		return;
+	}
 
-	for (auto waypoint : m_waypoints)
+	// Saved once the current save finishes, it has a snapshot without the latest edits
+	if (m_iothread.joinable())
 	{
-		waypoint->Save(file, GetVersion());
-		waypoint->SaveCustom(file, subversion);
+		m_savequeued = true;
+		return;
 	}
 
-	PostWaypointCustomSave(file, subversion);
+	m_savequeued = false;
+	m_savedata = std::make_unique<WaypointSaveData>();
+	m_savedata->filename = GetWaypointFilePath(".wpt");
+	m_savedata->crc = 0;
+	m_savedata->success = false;
+	TakeFileSnapshot(m_savedata->file);
 
-	LOG_CONSOLE(PLID, "Waypoints saved! %s", filename.c_str());
-	file.close();
+	WaypointSaveData* data = m_savedata.get();
+
+	StartIO([data]() {
+		data->success = WriteWaypointFile(data->filename, data->file, data->crc);
+	});
 }
 
 bool CWaypointManager::Load()
 {
-	std::fstream file;
-	std::unique_ptr<char[]> gamedir(new char[256]);
-	GET_GAME_DIR(gamedir.get());
-	std::string gameroot = std::string(gamedir.get());
-	std::string map = std::string(STRING(gpGlobals->mapname));
-	std::string wptdir = std::string("/addons/goldbot/waypoints/");
-	std::string dir = gameroot + wptdir + gamemod->GetModDataDirectory();
-	std::string filename = dir + "/" + map + ".wpt";
-
+	// A pending save must be written before the file is read again
+	WaitForIO();
+	m_pathbuilder.Cancel();
+	m_generator.Cancel();
+	m_visibility.Stop();
+	m_journal.Close();
 
 	// Clear waypoints (for file reloads)
 	for (auto waypoint : m_waypoints)
@@ -560,77 +735,570 @@ bool CWaypointManager::Load()
 	}
 
 	m_waypoints.clear();
+	m_spatialindex.Clear();
+	m_raster.Clear();
+	ClearSlots();
+	OnGraphModified();
+	m_chunkdata.clear();
 
-	file.open(filename, std::fstream::in | std::fstream::binary);
+	for (auto chunk : m_chunks)
+	{
+		chunk->Invalidate();
+	}
+
+	m_loaded = false;
+	m_loading = true;
+	m_savequeued = false;
+
+	m_loaddata = std::make_unique<WaypointLoadData>();
+	m_loaddata->filename = GetWaypointFilePath(".wpt");
+	m_loaddata->journalfile = GetWaypointFilePath(".wpj");
+	m_loaddata->crc = 0;
+	m_loaddata->journalbase = 0;
+	m_loaddata->journalsequence = 0;
+	m_loaddata->version = 0;
+	m_loaddata->subversion = 0;
+	m_loaddata->found = false;
+	m_loaddata->success = false;
+
+	WaypointLoadData* data = m_loaddata.get();
+
+	StartIO([this, data]() {
+		ReadWaypoints(*data);
+	});
+
+	return true;
+}
+
+void CWaypointManager::ReadWaypoints(WaypointLoadData& data)
+{
+	std::fstream file;
+	file.open(data.filename, std::fstream::in | std::fstream::binary);
 
 	if (file.is_open() == false || file.eof() == true)
 	{
-		LOG_CONSOLE(PLID, "Waypoints for \"%s\" not loaded. File not found!", map.c_str());
-		if (file.is_open()) { file.close(); }
-		return false;
+		// Waypoints created before the first save are only in the journal
+		const char* warning = CWaypointJournal::ReadRecords(data.journalfile, 0, 0, 0, data.records);
+
+		if (warning != nullptr)
+		{
+			data.warning = warning;
+		}
+
+		return;
 	}
 
+	data.found = true;
+
+	// The start of the header is the same on every version
 	CWaypointFileHeader header{};
 
 	file.read(reinterpret_cast<char*>(&header), sizeof(CWaypointFileHeader));
 
 	if (strncmp(header.header, WAYPOINT_FILE_HEADER, 7) != 0)
 	{
-		LOG_CONSOLE(PLID, "File \"%s\" is not a GoldBot waypoint file!", filename.c_str());
-		file.close();
-		return false;
+		data.error = "File \"" + data.filename + "\" is not a GoldBot waypoint file!";
+		return;
 	}
 
 	if (header.version > GetVersion())
 	{
-		LOG_CONSOLE(PLID, "Invalid waypoint version for file \"%s\"!", filename.c_str());
-		file.close();
-		return false;
+		data.error = "Invalid waypoint version for file \"" + data.filename + "\"!";
+		return;
 	}
 
-	if (PreWaypointCustomLoad(file, header.subversion) == false)
+	data.version = header.version;
+	data.subversion = header.subversion;
+
+	if (header.version == WaypointFile::LegacyVersion)
+	{
+		if (LoadLegacy(file, data, header.num_waypoints) == false)
+			return;
+
+		// Version 0 files don't have a CRC, the journal is matched against the CRC of the whole file
+		std::ifstream crcfile(data.filename, std::ifstream::binary);
+		std::vector<char> contents((std::istreambuf_iterator<char>(crcfile)), std::istreambuf_iterator<char>());
+		data.crc = WaypointFile::ComputeCRC32(contents.data(), contents.size());
+		data.journalbase = data.crc;
+	}
+	else
+	{
+		if (LoadMapped(file, data) == false)
+			return;
+	}
+
+	if (PostWaypointCustomLoad(file, header.subversion) == false)
+	{
+		data.error = "Failed to load the mod waypoint data of \"" + data.filename + "\"!";
+		return;
+	}
+
+	const char* warning = CWaypointJournal::ReadRecords(data.journalfile, data.crc, data.journalbase, data.journalsequence, data.records);
+
+	if (warning != nullptr)
+	{
+		data.warning = warning;
+	}
+
+	data.success = true;
+}
+
+bool CWaypointManager::LoadLegacy(std::fstream& file, WaypointLoadData& data, const int count)
+{
+	if (PreWaypointCustomLoad(file, data.subversion) == false)
 	{
-		file.close();
+		data.error = "Failed to load the mod waypoint data of \"" + data.filename + "\"!";
 		return false;
 	}
 
-	for (int i = 0; i < header.num_waypoints; i++)
+	std::vector<bool> usedids;
+
+	for (int i = 0; i < count; i++)
 	{
 		CWaypoint* wpt = WaypointFactory();
 
-		if (wpt->Load(file, header.version) == false)
+		if (wpt->Load(file, WaypointFile::LegacyVersion) == false || wpt->LoadCustom(file, data.subversion) == false)
 		{
+			data.error = "Failed to load waypoint data from \"" + data.filename + "\"!";
 			delete wpt;
-			file.close();
 			return false;
 		}
 
-		if (wpt->LoadCustom(file, header.subversion) == false)
+		const int id = wpt->GetID();
+
+		// IDs are capped like in version 1 files, the ID table is sized from them
+		if (id >= 0 && id < WaypointFile::MaxWaypointIDs && id >= static_cast<int>(usedids.size()))
+		{
+			usedids.resize(static_cast<size_t>(id) + 1, false);
+		}
+
+		if (id < 0 || id >= WaypointFile::MaxWaypointIDs || usedids[id])
 		{
+			data.error = "Waypoint file \"" + data.filename + "\" has an invalid or duplicated waypoint ID #" + std::to_string(id) + "!";
 			delete wpt;
-			file.close();
 			return false;
 		}
 
-		m_waypoints.push_back(wpt);
+		usedids[id] = true;
+		data.waypoints.push_back(wpt);
 	}
 
-	if (PostWaypointCustomLoad(file, header.subversion) == false)
+	return true;
+}
+
+bool CWaypointManager::LoadMapped(std::fstream& file, WaypointLoadData& data)
+{
+	CWaypointFileView view;
+
+	if (view.Open(data.filename) == false)
+	{
+		data.error = view.GetError();
+		return false;
+	}
+
+	const int count = view.GetWaypointCount();
+	const int* ids = view.GetIDs();
+	const float* x = view.GetPositionsX();
+	const float* y = view.GetPositionsY();
+	const float* z = view.GetPositionsZ();
+	const float* yaws = view.GetYaws();
+	const std::uint32_t* offsets = view.GetOffsets();
+	const int* targets = view.GetPathTargets();
+	const unsigned char* types = view.GetPathTypes();
+	data.crc = view.GetHeader().crc;
+	data.journalbase = view.GetHeader().journalbase;
+	data.journalsequence = view.GetHeader().journalsequence;
+
+	// Mod data is read from the custom section with the regular file functions
+	const WaypointFileSection* custom = view.FindSection(WaypointFile::SECTION_CUSTOM);
+
+	if (custom != nullptr)
+	{
+		file.seekg(custom->offset);
+	}
+
+	if (PreWaypointCustomLoad(file, data.subversion) == false)
 	{
-		file.close();
+		data.error = "Failed to load the mod waypoint data of \"" + data.filename + "\"!";
 		return false;
 	}
 
+	// Chunks are only copied, their owners parse them on first access
+	for (int i = 0; i < view.GetSectionCount(); i++)
+	{
+		const WaypointFileSection& section = view.GetSection(i);
+
+		if (section.type == WaypointFile::SECTION_CHUNK)
+		{
+			const char* chunk = reinterpret_cast<const char*>(view.GetSectionData(section));
+			data.chunks.emplace_back(section.count, std::string(chunk, section.size));
+		}
+	}
+
+	std::vector<bool> usedids(static_cast<size_t>(view.GetHeader().idlimit), false);
+	data.waypoints.reserve(static_cast<size_t>(count));
+
+	for (int i = 0; i < count; i++)
+	{
+		if (ids[i] < 0 || ids[i] >= static_cast<int>(usedids.size()) || usedids[ids[i]])
+		{
+			data.error = "Waypoint file \"" + data.filename + "\" has an invalid or duplicated waypoint ID #" + std::to_string(ids[i]) + "!";
+			return false;
+		}
+
+		CWaypoint* wpt = WaypointFactory();
+		wpt->Init(ids[i], Vector(x[i], y[i], z[i]), yaws[i]);
+		wpt->LoadPaths(targets + offsets[i], types + offsets[i], static_cast<int>(offsets[i + 1] - offsets[i]));
+
+		if (wpt->LoadCustom(file, data.subversion) == false)
+		{
+			data.error = "Failed to load the mod waypoint data of \"" + data.filename + "\"!";
+			delete wpt;
+			return false;
+		}
+
+		usedids[ids[i]] = true;
+		data.waypoints.push_back(wpt);
+	}
+
+	return true;
+}
+
+void CWaypointManager::TakeFileSnapshot(WaypointFileData& data)
+{
+	const size_t count = m_waypoints.size();
+
+	data.subversion = GetSubversion();
+	data.idlimit = GetWaypointIDLimit();
+	data.journalbase = m_journal.GetBaseCRC();
+	data.journalsequence = m_journal.GetSequence();
+	data.ids.reserve(count);
+	data.yaws.reserve(count);
+	data.flags.assign(count, 0);
+	data.offsets.reserve(count + 1);
+
+	for (auto& axis : data.positions)
+	{
+		axis.reserve(count);
+	}
+
+	for (auto waypoint : m_waypoints)
+	{
+		const Vector& position = waypoint->GetPosition();
+		data.ids.push_back(waypoint->GetID());
+		data.positions[0].push_back(position.x);
+		data.positions[1].push_back(position.y);
+		data.positions[2].push_back(position.z);
+		data.yaws.push_back(waypoint->GetYaw());
+		data.offsets.push_back(static_cast<std::uint32_t>(data.targets.size()));
+
+		for (int i = 0; i < waypoint->GetPathCount(); i++)
+		{
+			data.targets.push_back(waypoint->GetPath(i).id);
+			data.types.push_back(static_cast<unsigned char>(waypoint->GetPath(i).type));
+		}
+	}
+
+	data.offsets.push_back(static_cast<std::uint32_t>(data.targets.size()));
+
+	// Mod data is written to memory, the waypoints may change while the file is written
+	std::stringstream custom(std::stringstream::in | std::stringstream::out | std::stringstream::binary);
+
+	PreWaypointCustomSave(custom, data.subversion);
+
+	for (auto waypoint : m_waypoints)
+	{
+		waypoint->SaveCustom(custom, data.subversion);
+	}
+
+	PostWaypointCustomSave(custom, data.subversion);
+	data.custom = custom.str();
+
+	// Chunks that were never parsed are saved as they were loaded
+	for (auto chunk : m_chunks)
+	{
+		if (chunk->IsLoaded())
+		{
+			std::string& chunkdata = m_chunkdata[chunk->GetTag()];
+			chunkdata.clear();
+			chunk->Write(chunkdata);
+		}
+	}
+
+	data.chunks.reserve(m_chunkdata.size());
+
+	for (auto& chunk : m_chunkdata)
+	{
+		data.chunks.emplace_back(chunk.first, chunk.second);
+	}
+
+	std::sort(data.chunks.begin(), data.chunks.end(), [](const std::pair<std::uint32_t, std::string>& a, const std::pair<std::uint32_t, std::string>& b) { return a.first < b.first; });
+}
+
+void CWaypointManager::RegisterChunk(CWaypointChunk* chunk)
+{
+	if (std::find(m_chunks.begin(), m_chunks.end(), chunk) == m_chunks.end())
+	{
+		m_chunks.push_back(chunk);
+	}
+}
+
+void CWaypointManager::UnregisterChunk(CWaypointChunk* chunk)
+{
+	m_chunks.erase(std::remove(m_chunks.begin(), m_chunks.end(), chunk), m_chunks.end());
+}
+
+const std::string* CWaypointManager::GetChunkData(const std::uint32_t tag) const
+{
+	auto it = m_chunkdata.find(tag);
+	return it != m_chunkdata.end() ? &it->second : nullptr;
+}
+
+void CWaypointManager::ReplayJournal(const std::vector<WaypointJournalRecord>& records)
+{
+	for (auto& record : records)
+	{
+		CWaypoint* waypoint = GetWaypointOfID(record.id);
+		CWaypoint* other = GetWaypointOfID(record.otherid);
+
+		switch (record.type)
+		{
+		case WaypointJournal::RECORD_CREATE:
+		{
+			// Same ID cap as the waypoint files, the slot table is sized from the ID
+			if (waypoint != nullptr || record.id < 0 || record.id >= WaypointFile::MaxWaypointIDs)
+				break;
+
+			CWaypoint* wpt = WaypointFactory();
+			wpt->Init(record.id, Vector(record.position[0], record.position[1], record.position[2]), record.yaw);
+			StoreInSlot(wpt);
+			m_waypoints.push_back(wpt);
+			break;
+		}
+		case WaypointJournal::RECORD_DELETE:
+		{
+			if (waypoint == nullptr)
+				break;
+
+			m_waypoints.erase(std::find(m_waypoints.begin(), m_waypoints.end(), waypoint));
+			ReleaseID(record.id);
+			delete waypoint;
+
+			for (auto wpt : m_waypoints)
+			{
+				wpt->NotifyWaypointDeletion(record.id);
+			}
+
+			break;
+		}
+		case WaypointJournal::RECORD_ADDPATH:
+			if (waypoint != nullptr && other != nullptr)
+			{
+				waypoint->AddPathTo(other);
+			}
+
+			break;
+		case WaypointJournal::RECORD_DELETEPATH:
+			if (waypoint != nullptr && other != nullptr)
+			{
+				waypoint->DeletePathTo(other);
+			}
+
+			break;
+		case WaypointJournal::RECORD_SETPATHTYPE:
+			if (waypoint != nullptr && other != nullptr && record.pathtype < WaypointPath::MAX_PATH_TYPES)
+			{
+				waypoint->SetPathTypeTo(other, static_cast<WaypointPath::PathType>(record.pathtype));
+			}
+
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void CWaypointManager::Update()
+{
+	if (m_iothread.joinable() && m_iofinished.load(std::memory_order_acquire))
+	{
+		FinishIO();
+	}
+
+	if (!m_iothread.joinable() && !m_loading)
+	{
+		if (m_savequeued)
+		{
+			Save();
+		}
+		else if (m_journal.GetRecordCount() >= WAYPOINT_JOURNAL_COMPACT_RECORDS && gpGlobals->time >= m_nextcompaction)
+		{
+			// Fold the journal into the waypoint file so it doesn't keep growing
+			m_nextcompaction = gpGlobals->time + WAYPOINT_JOURNAL_COMPACT_INTERVAL;
+			Save();
+		}
+	}
+
+	m_pathbuilder.Update();
+	m_generator.Update();
+	m_visibility.Update();
+
+	// Waypoints were added outside the raster
+	if (m_raster.IsDirty())
+	{
+		m_raster.Build(m_waypoints);
+	}
+
+	m_journal.Update(gpGlobals->time);
+}
+
+void CWaypointManager::StartIO(std::function<void()> task)
+{
+	m_iofinished.store(false, std::memory_order_relaxed);
+	m_iothread = std::thread([this, task]() {
+		task();
+		m_iofinished.store(true, std::memory_order_release);
+	});
+}
+
+void CWaypointManager::WaitForIO()
+{
+	if (m_iothread.joinable())
+	{
+		FinishIO();
+	}
+}
+
+void CWaypointManager::FinishIO()
+{
+	m_iothread.join();
+
+	if (m_loaddata != nullptr)
+	{
+		FinishLoad();
+	}
+
+	if (m_savedata != nullptr)
+	{
+		FinishSave();
+	}
+}
+
+void CWaypointManager::FinishLoad()
+{
+	std::unique_ptr<WaypointLoadData> data = std::move(m_loaddata);
+	m_loading = false;
+
+	if (!data->error.empty())
+	{
+		LOG_CONSOLE(PLID, "%s", data->error.c_str());
+	}
+
+	if (!data->warning.empty())
+	{
+		LOG_CONSOLE(PLID, "%s", data->warning.c_str());
+	}
+
+	if (data->found && !data->success)
+	{
+		// Edits of a file that failed to load are not journaled, the journal may still be replayed once the file is fixed
+		for (auto waypoint : data->waypoints)
+		{
+			delete waypoint;
+		}
+
+		return;
+	}
+
+	if (!data->found && data->records.empty())
+	{
+		LOG_CONSOLE(PLID, "Waypoints for \"%s\" not loaded. File not found!", STRING(gpGlobals->mapname));
+	}
+
+	for (auto waypoint : data->waypoints)
+	{
+		StoreInSlot(waypoint);
+		m_waypoints.push_back(waypoint);
+	}
+
+	data->waypoints.clear();
+
+	for (auto& chunk : data->chunks)
+	{
+		m_chunkdata[chunk.first] = std::move(chunk.second);
+	}
+
+	ReplayJournal(data->records);
+
+	// IDs not used by the file are available for new waypoints
+	for (int i = 0; i < static_cast<int>(m_slots.size()); i++)
+	{
+		if (m_slots[i].waypoint == nullptr)
+		{
+			m_freeids.push(i);
+		}
+	}
+
 	for (auto wpt : m_waypoints)
 	{
 		wpt->PostAllWaypointsLoaded();
+		m_spatialindex.Insert(wpt);
 	}
-	
-	LOG_MESSAGE(PLID, "Waypoints loaded successfully! \n Number of Waypoints: %i \n Version/Subversion: %i/%i ", 
-		header.num_waypoints, header.version, header.subversion);
-	file.close();
+
+	m_raster.Build(m_waypoints);
+	OnGraphModified();
+	m_journal.Open(data->journalfile, data->crc, data->records);
+
+	if (!data->found)
+	{
+		if (!data->records.empty())
+		{
+			LOG_CONSOLE(PLID, "Recovered %i unsaved waypoint edits from the journal.", static_cast<int>(data->records.size()));
+			m_loaded = true;
+		}
+
+		return;
+	}
+
+	LOG_MESSAGE(PLID, "Waypoints loaded successfully! \n Number of Waypoints: %i \n Version/Subversion: %i/%i ",
+		static_cast<int>(m_waypoints.size()), data->version, data->subversion);
+
+	if (!data->records.empty())
+	{
+		LOG_CONSOLE(PLID, "Recovered %i unsaved waypoint edits from the journal.", static_cast<int>(data->records.size()));
+	}
+
+	if (data->version < GetVersion())
+	{
+		LOG_CONSOLE(PLID, "Waypoint file \"%s\" uses an old format, it will be upgraded when saved.", data->filename.c_str());
+	}
+
 	m_loaded = true;
-	return true;
+}
+
+void CWaypointManager::FinishSave()
+{
+	std::unique_ptr<WaypointSaveData> data = std::move(m_savedata);
+
+	if (!data->success)
+	{
+		LOG_CONSOLE(PLID, "Failed to save waypoints to \"%s\"!", data->filename.c_str());
+		NotifyEditor("Failed to save waypoints! \n");
+		return;
+	}
+
+	// Edits made while the file was written stay in the journal
+	m_journal.OnCompacted(data->crc, data->file.journalsequence);
+	LOG_CONSOLE(PLID, "Waypoints saved! %s", data->filename.c_str());
+	NotifyEditor("Waypoints saved! \n");
+}
+
+void CWaypointManager::NotifyEditor(const char* message)
+{
+	if (m_editor.IsValid())
+	{
+		ClientPrint(VARS(m_editor.Get()), HUD_PRINTCONSOLE, message);
+	}
 }
 
 void CWaypointManager::ToggleEditing()
@@ -649,69 +1317,201 @@ void CWaypointManager::ToggleEditing()
 
 CWaypoint* CWaypointManager::GetWaypointOfID(const int id)
 {
-	for (auto waypoint : m_waypoints)
+	if (id < 0 || id >= static_cast<int>(m_slots.size()))
+		return nullptr;
+
+	return m_slots[id].waypoint;
+}
+
+CWaypoint* CWaypointManager::GetWaypointOfID(const int id, const unsigned int generation)
+{
+	if (id < 0 || id >= static_cast<int>(m_slots.size()))
+		return nullptr;
+
+	const WaypointSlot& slot = m_slots[id];
+
+	if (slot.generation != generation)
+		return nullptr; // stale ID, the waypoint was deleted and the ID may have been reused
+
+	return slot.waypoint;
+}
+
+unsigned int CWaypointManager::GetWaypointGeneration(const int id) const
+{
+	if (id < 0 || id >= static_cast<int>(m_slots.size()))
+		return 0;
+
+	return m_slots[id].generation;
+}
+
+CWaypoint* CWaypointManager::GetNearestWaypoint(const Vector& position)
+{
+	return GetNearestWaypoint(position, FLT_MAX);
+}
+
+CWaypoint* CWaypointManager::GetNearestWaypoint(const Vector& position, const float maxdistsqr)
+{
+	CWaypoint* nearest = nullptr;
+
+	// The raster only answers when its waypoint is the nearest one, so the distance limit can be checked afterwards
+	if (m_raster.FindNearest(position, nearest))
+		return nearest->DistToSqr(position) <= maxdistsqr ? nearest : nullptr;
+
+	return m_spatialindex.FindNearest(position, maxdistsqr);
+}
+
+bool CWaypointManager::CanSee(CWaypoint* from, CWaypoint* to)
+{
+	if (from == to)
+		return true;
+
+	const CVisibilityTable* table = m_visibility.GetTable(m_graphversion);
+
+	if (table != nullptr)
 	{
-		if (waypoint->GetID() == id)
-		{
-			return waypoint;
-		}
+		return table->CanSee(from->GetID(), to->GetID());
 	}
 
-	return nullptr;
+	const Vector eyes(0.0f, 0.0f, m_visibility.GetEyeHeight());
+	std::shared_ptr<const CBSPCollision> collision = TheMapCollision;
+
+	// Same world only trace as the table, so the answer doesn't change once the table is built
+	if (collision != nullptr)
+	{
+		BSPTraceResult result;
+		collision->TraceLine(from->GetPosition() + eyes, to->GetPosition() + eyes, result);
+		return result.fraction >= 1.0f && !result.startsolid;
+	}
+
+	TraceResult tr;
+	UTIL_TraceLine(from->GetPosition() + eyes, to->GetPosition() + eyes, ignore_monsters, ignore_glass, nullptr, &tr);
+	return tr.flFraction >= 1.0f;
 }
 
-CWaypoint* CWaypointManager::GetNearestWaypoint(const Vector& position)
+int CWaypointManager::CollectWaypointsInRadius(const Vector& source, const float radius, std::vector<CWaypoint*>& waypointvector)
 {
-	float nearest = FLT_MAX;
-	float distance = 0.0f;
-	CWaypoint* best = nullptr;
+	return m_spatialindex.CollectInRadius(source, radius, waypointvector);
+}
 
-	for (auto waypoint : m_waypoints)
+void CWaypointManager::OnGraphModified(const int id, const int otherid)
+{
+	m_graphversion++;
+	m_editlog.push_back({ m_graphversion, id });
+
+	if (id != WaypointConst::InvalidPathConnection && otherid != WaypointConst::InvalidPathConnection)
 	{
-		distance = waypoint->DistToSqr(position);
+		m_editlog.push_back({ m_graphversion, otherid });
+	}
 
-		if (distance < nearest)
+	while (m_editlog.size() > WaypointConst::MaxGraphEditLog)
+	{
+		// Drop whole versions so the oldest version left is complete
+		const unsigned int dropped = m_editlog.front().version;
+
+		while (!m_editlog.empty() && m_editlog.front().version == dropped)
 		{
-			best = waypoint;
-			nearest = distance;
+			m_editlog.pop_front();
 		}
 	}
+}
+
+bool CWaypointManager::GetGraphEditsSince(const unsigned int version, std::vector<int>& ids) const
+{
+	if (version == m_graphversion)
+		return true;
+
+	// The log doesn't go back far enough
+	if (version > m_graphversion || m_editlog.empty() || m_editlog.front().version > version + 1)
+		return false;
+
+	for (auto it = m_editlog.rbegin(); it != m_editlog.rend() && it->version > version; it++)
+	{
+		if (it->id == WaypointConst::InvalidPathConnection)
+			return false;
+
+		ids.push_back(it->id);
+	}
 
-	return best;
+	return true;
 }
 
-CWaypoint* CWaypointManager::GetNearestWaypoint(const Vector& position, const float maxdistsqr)
+const CWaypointGraph& CWaypointManager::GetGraph()
 {
-	float nearest = FLT_MAX;
-	float distance = 0.0f;
-	CWaypoint* best = nullptr;
+	return *GetGraphSnapshot();
+}
 
-	for (auto waypoint : m_waypoints)
+std::shared_ptr<const CWaypointGraph> CWaypointManager::GetGraphSnapshot()
+{
+	if (m_graph->GetVersion() != m_graphversion)
 	{
-		distance = waypoint->DistToSqr(position);
+		// Build a new snapshot instead of modifying the current one, it may still be in use by path finding threads
+		auto graph = std::make_shared<CWaypointGraph>();
+		graph->Build(m_waypoints, GetWaypointIDLimit(), m_graphversion);
+		m_graph = graph;
+	}
+
+	return m_graph;
+}
 
-		if (distance <= maxdistsqr && distance < nearest)
+int CWaypointManager::AllocateID()
+{
+	while (!m_freeids.empty())
+	{
+		const int id = m_freeids.top();
+		m_freeids.pop();
+
+		if (id < static_cast<int>(m_slots.size()) && m_slots[id].waypoint == nullptr)
 		{
-			best = waypoint;
-			nearest = distance;
+			return id;
 		}
 	}
 
-	return best;
+	// No gaps, append a new slot
+	return static_cast<int>(m_slots.size());
 }
 
-int CWaypointManager::CollectWaypointsInRadius(const Vector& source, const float radius, std::vector<CWaypoint*>& waypointvector)
+bool CWaypointManager::StoreInSlot(CWaypoint* waypoint)
 {
-	int counter = 0;
+	const int id = waypoint->GetID();
 
-	for (auto waypoint : m_waypoints)
+	if (id < 0)
+		return false;
+
+	if (id >= static_cast<int>(m_slots.size()))
 	{
-		if (waypoint->DistToSqr(source) <= radius)
-		{
-			waypointvector.push_back(waypoint);
-			counter++;
-		}
+		m_slots.resize(static_cast<size_t>(id) + 1, WaypointSlot{ nullptr, m_epoch });
+	}
+
+	if (m_slots[id].waypoint != nullptr)
+		return false;
+
+	m_slots[id].waypoint = waypoint;
+	return true;
+}
+
+void CWaypointManager::ReleaseID(const int id)
+{
+	if (id < 0 || id >= static_cast<int>(m_slots.size()))
+		return;
+
+	m_slots[id].waypoint = nullptr;
+	m_slots[id].generation++;
+	m_freeids.push(id);
+}
+
+void CWaypointManager::ClearSlots()
+{
+	// The table is sized by the highest ID, keeping it would carry the ID limit of a large map over to the next ones.
+	// New slots start above every generation handed out so far, stale IDs from the previous file are still detected
+	for (auto& slot : m_slots)
+	{
+		m_epoch = std::max(m_epoch, slot.generation + 1);
 	}
 
-	return counter;
+	m_slots.clear();
+
+	while (!m_freeids.empty())
+	{
+		m_freeids.pop();
+	}
 }
@@ -4,17 +4,83 @@
 #include <algorithm>
 #include <iterator>
 #include <vector>
+#include <queue>
+#include <deque>
+#include <functional>
 #include <unordered_map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <atomic>
 
 #include "sdk/chandle.h"
+#include "waypoint_spatial.h"
+#include "waypoint_raster.h"
+#include "waypoint_graph.h"
+#include "waypoint_file.h"
+#include "waypoint_journal.h"
+#include "waypoint_autopath.h"
+#include "waypoint_generator.h"
+#include "waypoint_visibility.h"
 
 constexpr auto WAYPOINT_FILE_HEADER = "GOLDBOT";
 
+/**
+ * @brief Entry of the graph edit log
+*/
+struct WaypointGraphEdit
+{
+	unsigned int version; // Graph version after the edit
+	int id; // Waypoint ID whose paths changed, InvalidPathConnection if every waypoint changed
+};
+
 class IPlayer;
 class CWaypoint;
 class CPluginPlayer;
+class CWaypointChunk;
 class Vector;
 
+/**
+ * @brief Waypoints read by the I/O thread, moved into the waypoint manager on the main thread
+*/
+struct WaypointLoadData
+{
+	std::string filename;
+	std::string journalfile;
+	std::vector<CWaypoint*> waypoints; // Owned by the load data until moved into the manager
+	std::vector<WaypointJournalRecord> records; // Journal records to replay on top of the waypoints
+	std::vector<std::pair<std::uint32_t, std::string>> chunks; // Mod data chunks, copied without parsing
+	std::string error; // Logged by the main thread
+	std::string warning; // Logged by the main thread
+	std::uint32_t crc; // CRC of the waypoint file, 0 if there is no file
+	std::uint32_t journalbase; // Journal the waypoint file was saved from
+	std::uint32_t journalsequence; // Last journal record saved in the waypoint file
+	int version;
+	int subversion;
+	bool found; // The waypoint file exists
+	bool success;
+};
+
+/**
+ * @brief Waypoint snapshot written by the I/O thread
+*/
+struct WaypointSaveData
+{
+	std::string filename;
+	WaypointFileData file;
+	std::uint32_t crc; // CRC of the written file
+	bool success;
+};
+
+/**
+ * @brief Entry of the waypoint ID slot table
+*/
+struct WaypointSlot
+{
+	CWaypoint* waypoint; // Waypoint using this ID, nullptr if the ID is free
+	unsigned int generation; // Incremented every time the ID is released, starts at the manager epoch
+};
+
 class CWaypointManager
 {
 public:
@@ -23,6 +89,8 @@ public:
 
 	// Called every frame when waypoint editing is enabled
 	virtual void EditingUpdate();
+	// Called every frame, moves loaded waypoints in, finishes saves and syncs the edit journal
+	void Update();
 
 	virtual void OnMapChange();
 
@@ -32,11 +100,13 @@ public:
 	virtual CWaypoint* WaypointFactory();
 	// Creates and stores a new waypoint
 	virtual CWaypoint* CreateWaypoint(IPlayer*player);
+	// Creates and stores a new waypoint at the given position without adding paths
+	CWaypoint* AddWaypoint(const Vector& position, const float yaw);
 
 	bool DeleteWaypoint(CWaypoint* todelete);
 
 	// Waypoint core version, non virtual because it's the same for all mods
-	int GetVersion() { return 0; }
+	int GetVersion() { return 1; }
 	// Waypoint sub-version, mods can override these
 	virtual int GetSubversion() { return 0; }
 
@@ -47,18 +117,35 @@ public:
 
 	// Base Save/Load, not virtual because there shouldn't be overriden
 
+	// Saves the waypoints in the background, the editor is told when the file is written
 	void Save();
+	// Loads the waypoints of the current map in the background, they are available once IsLoading returns false
 	bool Load();
+	bool IsLoading() const { return m_loading; }
+	bool IsSaving() const { return m_savedata != nullptr; }
+	// Path of the current map waypoint file with the given extension, other waypoint data files are stored next to it
+	std::string GetWaypointFilePath(const char* extension);
 
-	// Mod specific custom save data, before waypoint data
+	// Mod specific custom save data, before waypoint data.
+	// Saves write to memory on the main thread, loads are called from the I/O thread.
+	// New mod data should use CWaypointChunk instead, it's parsed on first access rather than on every load
 
-	virtual void PreWaypointCustomSave(std::fstream& file, const int subVersion) {}
-	virtual bool PreWaypointCustomLoad(std::fstream& file, const int subVersion) { return true; }
+	virtual void PreWaypointCustomSave(std::iostream& file, const int subVersion) {}
+	virtual bool PreWaypointCustomLoad(std::iostream& file, const int subVersion) { return true; }
 
 	// Mod specific custom save data, after waypoint data
 
-	virtual void PostWaypointCustomSave(std::fstream& file, const int subVersion) {}
-	virtual bool PostWaypointCustomLoad(std::fstream& file, const int subVersion) { return true; }
+	virtual void PostWaypointCustomSave(std::iostream& file, const int subVersion) {}
+	virtual bool PostWaypointCustomLoad(std::iostream& file, const int subVersion) { return true; }
+
+	// Registers mod data stored in its own waypoint file chunk
+	void RegisterChunk(CWaypointChunk* chunk);
+	void UnregisterChunk(CWaypointChunk* chunk);
+	// Raw data of a waypoint file chunk, nullptr if the file doesn't have it
+	const std::string* GetChunkData(const std::uint32_t tag) const;
+
+	// Edits are recorded in the journal until the waypoints are saved
+	CWaypointJournal& GetJournal() { return m_journal; }
 
 	// Gets the current waypoint editor, nullptr if no editor
 	edict_t* GetEditor() { return m_editor.Get(); }
@@ -69,9 +156,26 @@ public:
 	void ToggleEditing();
 
 	CWaypoint* GetWaypointOfID(const int id);
+	// Same as above but returns nullptr if the ID was released since the generation was read
+	CWaypoint* GetWaypointOfID(const int id, const unsigned int generation);
+	// Generation of the given waypoint ID, used to detect stale IDs
+	unsigned int GetWaypointGeneration(const int id) const;
+	// Size of the ID slot table, all waypoint IDs are lower than this
+	int GetWaypointIDLimit() const { return static_cast<int>(m_slots.size()); }
 	CWaypoint* GetNearestWaypoint(const Vector& position);
 	// Maximum distance is squared
 	CWaypoint* GetNearestWaypoint(const Vector& position, const float maxdistsqr);
+	/**
+	 * @brief Checks if there is a clear line of sight between the eyes of players standing on two waypoints
+	 *
+	 * With the map collision loaded, only the world geometry blocks the view: the precomputed visibility table is read,
+	 * or a world trace is done while the table is being built. Brush entities don't block it in both cases.
+	 * Without the map collision there is never a table and an engine trace is done, brush entities block the view.
+	 * @param from Waypoint
+	 * @param to Other waypoint
+	 * @return true if the waypoints can see each other
+	*/
+	bool CanSee(CWaypoint* from, CWaypoint* to);
 
 	/**
 	 * @brief Collects waypoints in a radius
@@ -82,17 +186,85 @@ public:
 	*/
 	int CollectWaypointsInRadius(const Vector& source, const float radius, std::vector<CWaypoint*>& waypointvector);
 
+	/**
+	 * @brief Called when waypoints or paths are added, removed or changed
+	 * @param id Waypoint that was changed, InvalidPathConnection if every waypoint changed
+	 * @param otherid Other waypoint of the changed path
+	*/
+	void OnGraphModified(const int id = WaypointConst::InvalidPathConnection, const int otherid = WaypointConst::InvalidPathConnection);
+	unsigned int GetGraphVersion() const { return m_graphversion; }
+	/**
+	 * @brief Gets the waypoints changed since the given graph version
+	 * @param version Graph version
+	 * @param ids Stores the IDs of the changed waypoints, may contain duplicates
+	 * @return false if the changes aren't known and everything must be considered changed
+	*/
+	bool GetGraphEditsSince(const unsigned int version, std::vector<int>& ids) const;
+	// Gets the compact graph snapshot, rebuilt if the waypoints changed since the last call
+	const CWaypointGraph& GetGraph();
+	// Same as GetGraph but shares ownership, a snapshot is never modified after it's built so it can be read from other threads
+	std::shared_ptr<const CWaypointGraph> GetGraphSnapshot();
+
 protected:
 	int m_spriteTexture;
 	float m_editupdatetimer;
 	float m_authpathdist;
 
 private:
+	// Gets a free waypoint ID, lowest IDs are reused first
+	int AllocateID();
+	// Stores the waypoint at the slot of its ID
+	bool StoreInSlot(CWaypoint* waypoint);
+	// Frees the given ID, bumping the slot generation
+	void ReleaseID(const int id);
+	// Releases every ID, used when reloading waypoints
+	void ClearSlots();
+	// Reads the waypoint file and the journal, runs on the I/O thread
+	void ReadWaypoints(WaypointLoadData& data);
+	// Reads the fixed size waypoint records of version 0 files
+	bool LoadLegacy(std::fstream& file, WaypointLoadData& data, const int count);
+	// Copies the sections of version 1 files from a memory mapped view into new waypoints, mod data is still read from the file stream
+	bool LoadMapped(std::fstream& file, WaypointLoadData& data);
+	// Copies the waypoints to the file layout
+	void TakeFileSnapshot(WaypointFileData& data);
+	// Applies journal records on top of the loaded waypoints
+	void ReplayJournal(const std::vector<WaypointJournalRecord>& records);
+	void StartIO(std::function<void()> task);
+	// Waits for the I/O thread and handles its result
+	void WaitForIO();
+	void FinishIO();
+	void FinishLoad();
+	void FinishSave();
+	// Prints a message to the waypoint editor console
+	void NotifyEditor(const char* message);
+
 	bool m_editmode; // Controls editing mode
 	bool m_loaded;
 	int m_pathstart; // When creating a new path between waypoints, this holds the ID of the starting waypoint
+	unsigned int m_pathstartgen; // Generation of the path start waypoint ID
 	std::vector<CWaypoint*> m_waypoints; // Vector where all waypoints are stored
+	std::vector<WaypointSlot> m_slots; // Waypoints indexed by ID
+	std::priority_queue<int, std::vector<int>, std::greater<int>> m_freeids; // Released IDs available for new waypoints
+	unsigned int m_epoch; // First generation of the slots created since the last clear, higher than any generation handed out before
+	CWaypointSpatialIndex m_spatialindex; // Spatial index for nearest/radius queries
+	CWaypointRaster m_raster; // Nearest waypoint grid, answers most nearest queries before the spatial index
+	std::shared_ptr<const CWaypointGraph> m_graph; // Compact graph snapshot used by path finding, replaced when rebuilt
+	unsigned int m_graphversion; // Incremented every time the waypoint graph changes
+	std::deque<WaypointGraphEdit> m_editlog; // Recent graph edits, oldest first
 	CHandle m_editor; // waypoint editing player
+	CWaypointJournal m_journal; // Edits not folded into the waypoint file yet
+	std::thread m_iothread; // Loads or saves the waypoint file
+	std::atomic<bool> m_iofinished;
+	std::unique_ptr<WaypointLoadData> m_loaddata; // Load being done by the I/O thread
+	std::unique_ptr<WaypointSaveData> m_savedata; // Save being done by the I/O thread
+	bool m_loading;
+	bool m_savequeued; // Save requested while the I/O thread was busy
+	float m_nextcompaction; // The journal is folded into the waypoint file when it grows, at most once per interval
+	std::unordered_map<std::uint32_t, std::string> m_chunkdata; // Raw chunks of the loaded file, including chunks without an owner
+	std::vector<CWaypointChunk*> m_chunks; // Registered chunk owners
+	CAutoPathBuilder m_pathbuilder; // Bulk path rebuild started by the editor
+	CWaypointGenerator m_generator; // Automatic waypoint generation started by the editor
+	CVisibilityManager m_visibility; // Waypoint to waypoint visibility table
 };
 
 // Waypoint manager singleton
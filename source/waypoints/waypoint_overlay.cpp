@@ -0,0 +1,336 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_overlay.h"
+
+// Expired entries are removed at this interval
+constexpr float OVERLAY_CLEANUP_INTERVAL = 5.0f;
+constexpr size_t OVERLAY_MIN_CAPACITY = 16;
+
+CEdgeOverlayManager* TheEdgeOverlays = nullptr;
+
+CEdgeCostOverlay::CEdgeCostOverlay() :
+	m_entries()
+{
+	m_count = 0;
+	m_deleted = 0;
+}
+
+void CEdgeCostOverlay::SetMultiplier(const int from, const int to, const float multiplier, const float time, const float duration, const bool decay)
+{
+	Entry entry;
+	entry.key = MakeKey(from, to);
+	entry.multiplier = std::max(multiplier, 1.0f);
+	entry.start = time;
+	entry.expire = duration > 0.0f ? time + duration : 0.0f;
+	entry.decay = decay && duration > 0.0f;
+	Insert(entry);
+}
+
+void CEdgeCostOverlay::Block(const int from, const int to, const float time, const float duration)
+{
+	Entry entry;
+	entry.key = MakeKey(from, to);
+	entry.multiplier = -1.0f;
+	entry.start = time;
+	entry.expire = duration > 0.0f ? time + duration : 0.0f;
+	entry.decay = false;
+	Insert(entry);
+}
+
+bool CEdgeCostOverlay::Remove(const int from, const int to)
+{
+	if (m_count == 0)
+		return false;
+
+	const std::uint64_t key = MakeKey(from, to);
+	const size_t mask = m_entries.size() - 1;
+
+	for (size_t slot = GetSlot(key); m_entries[slot].key != EmptyKey; slot = (slot + 1) & mask)
+	{
+		if (m_entries[slot].key == key)
+		{
+			EraseSlot(slot);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CEdgeCostOverlay::RemoveWaypoint(const int id)
+{
+	if (m_count == 0)
+		return;
+
+	const std::uint32_t uid = static_cast<std::uint32_t>(id);
+
+	for (size_t slot = 0; slot < m_entries.size(); slot++)
+	{
+		const std::uint64_t key = m_entries[slot].key;
+
+		if (key == EmptyKey || key == DeletedKey)
+			continue;
+
+		if (static_cast<std::uint32_t>(key >> 32) == uid || static_cast<std::uint32_t>(key) == uid)
+		{
+			EraseSlot(slot);
+		}
+	}
+}
+
+void CEdgeCostOverlay::RemoveExpired(const float time)
+{
+	if (m_count == 0)
+		return;
+
+	for (size_t slot = 0; slot < m_entries.size(); slot++)
+	{
+		const Entry& entry = m_entries[slot];
+
+		if (entry.key == EmptyKey || entry.key == DeletedKey)
+			continue;
+
+		if (entry.expire > 0.0f && time >= entry.expire)
+		{
+			EraseSlot(slot);
+		}
+	}
+
+	// Start over once everything expired so the table doesn't fill up with deleted slots
+	if (m_count == 0)
+	{
+		Clear();
+	}
+}
+
+void CEdgeCostOverlay::Clear()
+{
+	m_entries.clear();
+	m_count = 0;
+	m_deleted = 0;
+}
+
+float CEdgeCostOverlay::Lookup(const int from, const int to, const float time) const
+{
+	const std::uint64_t key = MakeKey(from, to);
+	const size_t mask = m_entries.size() - 1;
+
+	for (size_t slot = GetSlot(key); m_entries[slot].key != EmptyKey; slot = (slot + 1) & mask)
+	{
+		const Entry& entry = m_entries[slot];
+
+		if (entry.key != key)
+			continue;
+
+		if (entry.expire > 0.0f && time >= entry.expire)
+			return 1.0f;
+
+		if (entry.decay)
+		{
+			const float remaining = (entry.expire - time) / (entry.expire - entry.start);
+			return 1.0f + (entry.multiplier - 1.0f) * std::min(remaining, 1.0f);
+		}
+
+		return entry.multiplier;
+	}
+
+	return 1.0f;
+}
+
+void CEdgeCostOverlay::Insert(const Entry& entry)
+{
+	// Keep at least half of the slots empty so probe sequences stay short
+	if (m_entries.empty())
+	{
+		Rehash(OVERLAY_MIN_CAPACITY);
+	}
+	else if (static_cast<size_t>(m_count + m_deleted + 1) * 2 > m_entries.size())
+	{
+		// Grow if live entries fill a quarter of the table, otherwise just drop the deleted slots
+		size_t capacity = m_entries.size();
+
+		while (static_cast<size_t>(m_count + 1) * 4 > capacity)
+		{
+			capacity *= 2;
+		}
+
+		Rehash(capacity);
+	}
+
+	const size_t mask = m_entries.size() - 1;
+	size_t target = m_entries.size();
+
+	for (size_t slot = GetSlot(entry.key); m_entries[slot].key != EmptyKey; slot = (slot + 1) & mask)
+	{
+		if (m_entries[slot].key == entry.key)
+		{
+			m_entries[slot] = entry;
+			return;
+		}
+
+		if (m_entries[slot].key == DeletedKey && target == m_entries.size())
+		{
+			target = slot;
+		}
+	}
+
+	if (target == m_entries.size())
+	{
+		target = GetSlot(entry.key);
+
+		while (m_entries[target].key != EmptyKey)
+		{
+			target = (target + 1) & mask;
+		}
+	}
+	else
+	{
+		m_deleted--;
+	}
+
+	m_entries[target] = entry;
+	m_count++;
+}
+
+void CEdgeCostOverlay::Rehash(const size_t capacity)
+{
+	std::vector<Entry> old;
+	old.swap(m_entries);
+
+	Entry empty{};
+	empty.key = EmptyKey;
+	m_entries.assign(capacity, empty);
+	m_count = 0;
+	m_deleted = 0;
+
+	const size_t mask = capacity - 1;
+
+	for (auto& entry : old)
+	{
+		if (entry.key == EmptyKey || entry.key == DeletedKey)
+			continue;
+
+		size_t slot = GetSlot(entry.key);
+
+		while (m_entries[slot].key != EmptyKey)
+		{
+			slot = (slot + 1) & mask;
+		}
+
+		m_entries[slot] = entry;
+		m_count++;
+	}
+}
+
+void CEdgeCostOverlay::EraseSlot(const size_t slot)
+{
+	m_entries[slot].key = DeletedKey;
+	m_count--;
+	m_deleted++;
+}
+
+CEdgeCostOverlayStack::CEdgeCostOverlayStack()
+{
+	for (int layer = 0; layer < MAX_LAYERS; layer++)
+	{
+		m_layers[layer] = nullptr;
+	}
+
+	m_time = 0.0f;
+}
+
+CEdgeCostOverlayStack::CEdgeCostOverlayStack(const CEdgeCostOverlay* global, const CEdgeCostOverlay* team, const CEdgeCostOverlay* bot, const float time)
+{
+	const CEdgeCostOverlay* layers[MAX_LAYERS] = { global, team, bot };
+
+	for (int layer = 0; layer < MAX_LAYERS; layer++)
+	{
+		m_layers[layer] = layers[layer] != nullptr && !layers[layer]->IsEmpty() ? layers[layer] : nullptr;
+	}
+
+	m_time = time;
+}
+
+CEdgeOverlayManager::CEdgeOverlayManager() :
+	m_global(),
+	m_teams()
+{
+	m_graphversion = 0;
+	m_nextcleanup = 0.0f;
+}
+
+CEdgeOverlayManager::~CEdgeOverlayManager()
+{
+}
+
+void CEdgeOverlayManager::Update()
+{
+	if (m_graphversion != TheWaypoints->GetGraphVersion())
+	{
+		// Entries of edited waypoints may point to paths that no longer exist or to reused waypoint IDs
+		std::vector<int> edits;
+
+		if (TheWaypoints->GetGraphEditsSince(m_graphversion, edits))
+		{
+			std::sort(edits.begin(), edits.end());
+			edits.erase(std::unique(edits.begin(), edits.end()), edits.end());
+
+			for (int id : edits)
+			{
+				m_global.RemoveWaypoint(id);
+
+				for (auto& team : m_teams)
+				{
+					team.second.RemoveWaypoint(id);
+				}
+			}
+		}
+		else
+		{
+			Clear();
+		}
+
+		m_graphversion = TheWaypoints->GetGraphVersion();
+	}
+
+	if (gpGlobals->time >= m_nextcleanup)
+	{
+		m_nextcleanup = gpGlobals->time + OVERLAY_CLEANUP_INTERVAL;
+		m_global.RemoveExpired(gpGlobals->time);
+
+		for (auto& team : m_teams)
+		{
+			team.second.RemoveExpired(gpGlobals->time);
+		}
+	}
+}
+
+void CEdgeOverlayManager::Clear()
+{
+	m_global.Clear();
+	m_teams.clear();
+}
+
+CEdgeCostOverlayStack CEdgeOverlayManager::GetStack(const int team, const CEdgeCostOverlay* bot) const
+{
+	const CEdgeCostOverlay* teamoverlay = nullptr;
+	auto it = team >= 0 ? m_teams.find(team) : m_teams.end();
+
+	if (it != m_teams.end())
+	{
+		teamoverlay = &it->second;
+	}
+
+	return CEdgeCostOverlayStack(&m_global, teamoverlay, bot, gpGlobals->time);
+}
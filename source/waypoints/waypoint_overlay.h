@@ -0,0 +1,174 @@
+#ifndef WAYPOINT_OVERLAY_H_
+#define WAYPOINT_OVERLAY_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+/**
+ * @brief Sparse path cost modifiers keyed by (from waypoint ID, to waypoint ID).
+ *
+ * Entries either multiply the path cost or block the path, they can expire and optionally decay back to
+ * the normal cost over their duration. Stored in an open addressing hash table, lookups on an empty overlay
+ * return right away. Not thread safe, copy the overlay to use it outside the main thread.
+*/
+class CEdgeCostOverlay
+{
+public:
+	CEdgeCostOverlay();
+
+	/**
+	 * @brief Sets the cost multiplier of a path
+	 * @param from Waypoint ID the path leaves from
+	 * @param to Waypoint ID the path leads to
+	 * @param multiplier Path cost multiplier, values below 1 are clamped to 1 so the search heuristic stays admissible
+	 * @param time Current time
+	 * @param duration Seconds until the entry expires, 0 for permanent entries
+	 * @param decay If true, the multiplier fades back to 1 over the duration
+	*/
+	void SetMultiplier(const int from, const int to, const float multiplier, const float time, const float duration = 0.0f, const bool decay = false);
+	/**
+	 * @brief Blocks a path
+	 * @param from Waypoint ID the path leaves from
+	 * @param to Waypoint ID the path leads to
+	 * @param time Current time
+	 * @param duration Seconds until the path is unblocked, 0 to block it until removed
+	*/
+	void Block(const int from, const int to, const float time, const float duration = 0.0f);
+	bool Remove(const int from, const int to);
+	// Removes every entry of paths leaving from or leading to the given waypoint
+	void RemoveWaypoint(const int id);
+	// Removes expired entries, shrinking the table isn't needed since expired entries are ignored by lookups
+	void RemoveExpired(const float time);
+	void Clear();
+
+	/**
+	 * @brief Gets the cost multiplier of a path
+	 * @param from Waypoint ID the path leaves from
+	 * @param to Waypoint ID the path leads to
+	 * @param time Current time
+	 * @return Cost multiplier, 1 if there is no entry for the path, negative if the path is blocked
+	*/
+	float GetMultiplier(const int from, const int to, const float time) const
+	{
+		if (m_count == 0)
+			return 1.0f;
+
+		return Lookup(from, to, time);
+	}
+
+	bool IsEmpty() const { return m_count == 0; }
+	int GetEntryCount() const { return m_count; }
+
+private:
+	struct Entry
+	{
+		std::uint64_t key;
+		float multiplier; // Negative if blocked
+		float start; // Time the entry was set
+		float expire; // Time the entry expires, 0 if permanent
+		bool decay;
+	};
+
+	static constexpr std::uint64_t EmptyKey = ~0ULL;
+	static constexpr std::uint64_t DeletedKey = ~0ULL - 1ULL;
+
+	static std::uint64_t MakeKey(const int from, const int to) { return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(from)) << 32) | static_cast<std::uint32_t>(to); }
+	size_t GetSlot(const std::uint64_t key) const { return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> 32) & (m_entries.size() - 1); }
+	float Lookup(const int from, const int to, const float time) const;
+	void Insert(const Entry& entry);
+	void Rehash(const size_t capacity);
+	void EraseSlot(const size_t slot);
+
+	std::vector<Entry> m_entries; // Capacity is always a power of two
+	int m_count; // Used slots
+	int m_deleted; // Deleted slots, reclaimed on rehash
+};
+
+/**
+ * @brief Overlay that never changes path costs, the default for path cost policies
+*/
+class CNoEdgeOverlay
+{
+public:
+	float GetMultiplier(const int from, const int to) const { return 1.0f; }
+};
+
+/**
+ * @brief Global, team and bot overlays evaluated together at a fixed time.
+ * The first blocked entry blocks the path, multipliers of every layer are combined.
+*/
+class CEdgeCostOverlayStack
+{
+public:
+	CEdgeCostOverlayStack();
+	/**
+	 * @param global Overlay shared by every bot, may be nullptr
+	 * @param team Overlay of the bot team, may be nullptr
+	 * @param bot Overlay of the bot, may be nullptr
+	 * @param time Time used to expire and decay entries
+	*/
+	CEdgeCostOverlayStack(const CEdgeCostOverlay* global, const CEdgeCostOverlay* team, const CEdgeCostOverlay* bot, const float time);
+
+	// Path cost multiplier, negative if the path is blocked
+	float GetMultiplier(const int from, const int to) const
+	{
+		float multiplier = 1.0f;
+
+		for (int layer = 0; layer < MAX_LAYERS; layer++)
+		{
+			if (m_layers[layer] == nullptr)
+				continue;
+
+			const float value = m_layers[layer]->GetMultiplier(from, to, m_time);
+
+			if (value < 0.0f)
+				return value;
+
+			multiplier *= value;
+		}
+
+		return multiplier;
+	}
+
+private:
+	static constexpr int MAX_LAYERS = 3;
+
+	const CEdgeCostOverlay* m_layers[MAX_LAYERS]; // Empty overlays are stored as nullptr
+	float m_time;
+};
+
+/**
+ * @brief Owns the global and team overlays, removes expired entries and entries of edited waypoints
+*/
+class CEdgeOverlayManager
+{
+public:
+	CEdgeOverlayManager();
+	virtual ~CEdgeOverlayManager();
+
+	void Update();
+	void Clear();
+
+	CEdgeCostOverlay& GetGlobalOverlay() { return m_global; }
+	// Gets the overlay of a team, the team numbers are defined by the mod
+	CEdgeCostOverlay& GetTeamOverlay(const int team) { return m_teams[team]; }
+	/**
+	 * @brief Builds an overlay stack for a bot at the current time
+	 * @param team Bot team, negative if the bot has no team
+	 * @param bot Bot overlay, may be nullptr
+	 * @return Overlay stack
+	*/
+	CEdgeCostOverlayStack GetStack(const int team, const CEdgeCostOverlay* bot) const;
+
+private:
+	CEdgeCostOverlay m_global;
+	std::unordered_map<int, CEdgeCostOverlay> m_teams;
+	unsigned int m_graphversion; // Graph version the overlays were last checked against
+	float m_nextcleanup;
+};
+
+// Edge overlay manager singleton
+extern CEdgeOverlayManager* TheEdgeOverlays;
+
+#endif // !WAYPOINT_OVERLAY_H_
@@ -0,0 +1,154 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+#include <functional>
+
+#include "plugincvars.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_pathcache.h"
+
+CPathCache* ThePathCache = nullptr;
+
+std::size_t CPathCache::CacheKeyHash::operator()(const CacheKey& key) const
+{
+	std::size_t hash = std::hash<std::size_t>()(key.profile);
+	hash ^= std::hash<int>()(key.start) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	hash ^= std::hash<int>()(key.goal) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+CPathCache::CPathCache() :
+	m_entries(),
+	m_index()
+{
+	m_graphversion = 0;
+	m_hits = 0;
+	m_subpathhits = 0;
+	m_misses = 0;
+}
+
+CPathCache::~CPathCache()
+{
+}
+
+bool CPathCache::Lookup(const int startid, const int goalid, const std::size_t profile, std::vector<CWaypoint*>& path)
+{
+	Validate();
+
+	auto it = m_index.find({ startid, goalid, profile });
+
+	if (it == m_index.end())
+	{
+		m_misses++;
+		return false;
+	}
+
+	const CacheIndex& index = it->second;
+	const std::vector<int>& ids = index.entry->path;
+	path.clear();
+	path.reserve(ids.size() - static_cast<size_t>(index.offset));
+
+	for (size_t i = static_cast<size_t>(index.offset); i < ids.size(); i++)
+	{
+		path.push_back(TheWaypoints->GetWaypointOfID(ids[i]));
+	}
+
+	m_hits++;
+
+	if (index.offset > 0)
+	{
+		m_subpathhits++;
+	}
+
+	// Move to the front of the LRU list
+	m_entries.splice(m_entries.begin(), m_entries, index.entry);
+	return true;
+}
+
+void CPathCache::Store(const std::size_t profile, const std::vector<CWaypoint*>& path)
+{
+	Validate();
+
+	const int capacity = static_cast<int>(gb_nav_path_cache_size.value);
+
+	if (path.empty() || capacity <= 0)
+		return;
+
+	const int goalid = path.back()->GetID();
+
+	// Already cached as a path or sub path
+	if (m_index.find({ path.front()->GetID(), goalid, profile }) != m_index.end())
+		return;
+
+	while (static_cast<int>(m_entries.size()) >= capacity)
+	{
+		EvictOldest();
+	}
+
+	m_entries.push_front(CacheEntry());
+	CacheEntry& entry = m_entries.front();
+	entry.profile = profile;
+	entry.path.reserve(path.size());
+
+	for (auto waypoint : path)
+	{
+		entry.path.push_back(waypoint->GetID());
+	}
+
+	// Index every waypoint of the path, sub paths to the same goal are served from this entry
+	for (size_t i = 0; i < entry.path.size(); i++)
+	{
+		m_index.emplace(CacheKey{ entry.path[i], goalid, profile }, CacheIndex{ m_entries.begin(), static_cast<int>(i) });
+	}
+}
+
+void CPathCache::Clear()
+{
+	m_entries.clear();
+	m_index.clear();
+}
+
+void CPathCache::ResetCounters()
+{
+	m_hits = 0;
+	m_subpathhits = 0;
+	m_misses = 0;
+}
+
+void CPathCache::Validate()
+{
+	const unsigned int version = TheWaypoints->GetGraphVersion();
+
+	if (m_graphversion != version)
+	{
+		Clear();
+		m_graphversion = version;
+	}
+}
+
+void CPathCache::EvictOldest()
+{
+	auto last = std::prev(m_entries.end());
+	const int goalid = last->path.back();
+
+	for (auto id : last->path)
+	{
+		auto it = m_index.find({ id, goalid, last->profile });
+
+		// Other entries may own the index of shared waypoints
+		if (it != m_index.end() && it->second.entry == last)
+		{
+			m_index.erase(it);
+		}
+	}
+
+	m_entries.erase(last);
+}
@@ -0,0 +1,180 @@
+#ifndef WAYPOINT_PATH_CACHE_H_
+#define WAYPOINT_PATH_CACHE_H_
+
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <typeinfo>
+#include <type_traits>
+#include <cstddef>
+
+#include "waypoint_pathfind.h"
+
+namespace PathSearch
+{
+	/**
+	 * @brief Tells if the paths of a cost functor only depend on its type.
+	 * Empty functors are stateless, other functors can declare it with a static constexpr bool IsStateless member.
+	*/
+	template <typename CostFunc, typename = void>
+	struct IsStatelessCost : std::is_empty<CostFunc> {};
+
+	template <typename CostFunc>
+	struct IsStatelessCost<CostFunc, std::void_t<decltype(CostFunc::IsStateless)>> : std::bool_constant<CostFunc::IsStateless> {};
+}
+
+/**
+ * @brief LRU cache of paths found by the A* searches.
+ *
+ * Paths are keyed by start waypoint ID, goal waypoint ID and cost profile (the cost functor type).
+ * Only stateless cost functors are cached: functors holding a bot traversal filter or edge cost overlays give
+ * different paths to each bot, and overlay changes don't change the graph version that flushes the cache.
+ * Every waypoint of a cached path is indexed, so a request whose start lies on a cached path to the same goal
+ * is served with the rest of that path. The whole cache is flushed when the waypoint graph version changes.
+ * Only used from the main thread.
+*/
+class CPathCache
+{
+public:
+	CPathCache();
+	virtual ~CPathCache();
+
+	/**
+	 * @brief Looks up a path
+	 * @param startid Start waypoint ID
+	 * @param goalid Goal waypoint ID
+	 * @param profile Cost profile
+	 * @param path Stores the path waypoints if found
+	 * @return true if the path was in the cache
+	*/
+	bool Lookup(const int startid, const int goalid, const std::size_t profile, std::vector<CWaypoint*>& path);
+	/**
+	 * @brief Stores a path, the first waypoint is the start and the last is the goal
+	 * @param profile Cost profile
+	 * @param path Path waypoints
+	*/
+	void Store(const std::size_t profile, const std::vector<CWaypoint*>& path);
+	// Removes all paths, the counters are kept
+	void Clear();
+	void ResetCounters();
+
+	int GetCachedPathCount() const { return static_cast<int>(m_entries.size()); }
+	unsigned int GetHits() const { return m_hits; }
+	// Hits that were served from part of a longer path
+	unsigned int GetSubPathHits() const { return m_subpathhits; }
+	unsigned int GetMisses() const { return m_misses; }
+
+	// Cost profile of a cost functor
+	template<typename CostFunc>
+	static std::size_t GetCostProfile() { return typeid(CostFunc).hash_code(); }
+
+private:
+	struct CacheKey
+	{
+		int start;
+		int goal;
+		std::size_t profile;
+
+		bool operator==(const CacheKey& other) const { return start == other.start && goal == other.goal && profile == other.profile; }
+	};
+
+	struct CacheKeyHash
+	{
+		std::size_t operator()(const CacheKey& key) const;
+	};
+
+	struct CacheEntry
+	{
+		std::size_t profile;
+		std::vector<int> path;
+	};
+
+	using EntryList = std::list<CacheEntry>;
+
+	struct CacheIndex
+	{
+		EntryList::iterator entry;
+		int offset; // Position of the start waypoint in the entry path
+	};
+
+	// Flushes the cache if the waypoints were edited
+	void Validate();
+	void EvictOldest();
+
+	EntryList m_entries; // Most recently used first
+	std::unordered_map<CacheKey, CacheIndex, CacheKeyHash> m_index;
+	unsigned int m_graphversion; // Graph version of the cached paths
+	unsigned int m_hits;
+	unsigned int m_subpathhits;
+	unsigned int m_misses;
+};
+
+/**
+ * @brief Wraps an A* search and serves repeated requests from the path cache
+ * @tparam CostFunc Path cost functor, paths are shared between every functor of the same type.
+ * Functors with state always run the search, see PathSearch::IsStatelessCost
+ * @tparam SearchType Search used on cache misses
+*/
+template <typename CostFunc, typename SearchType = CSimpleAStarSearch<CostFunc>>
+class CCachedAStarSearch : public IAStarSearch<CostFunc>
+{
+public:
+	CCachedAStarSearch() : m_search(), m_path() {}
+	virtual ~CCachedAStarSearch() {}
+
+	virtual bool BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc) override;
+	virtual void ResetSearch() override;
+	std::vector<CWaypoint*>& GetPath() { return m_path; }
+	SearchType& GetSearch() { return m_search; }
+
+private:
+	SearchType m_search;
+	std::vector<CWaypoint*> m_path;
+};
+
+// Path cache singleton
+extern CPathCache* ThePathCache;
+
+template<typename CostFunc, typename SearchType>
+inline bool CCachedAStarSearch<CostFunc, SearchType>::BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc)
+{
+	m_path.clear();
+
+	if (start == nullptr || end == nullptr)
+		return false;
+
+	// Per bot filters and overlays aren't part of the cache key
+	if constexpr (!PathSearch::IsStatelessCost<CostFunc>::value)
+	{
+		m_search.ResetSearch();
+		bool found = m_search.BuildPath(start, end, goal, costFunc);
+		m_path = m_search.GetPath();
+		return found;
+	}
+
+	const std::size_t profile = CPathCache::GetCostProfile<CostFunc>();
+
+	if (ThePathCache != nullptr && ThePathCache->Lookup(start->GetID(), end->GetID(), profile, m_path))
+		return true;
+
+	m_search.ResetSearch();
+	bool found = m_search.BuildPath(start, end, goal, costFunc);
+	m_path = m_search.GetPath();
+
+	// Only complete paths are cached
+	if (found && ThePathCache != nullptr && !m_path.empty() && m_path.front() == start && m_path.back() == end)
+	{
+		ThePathCache->Store(profile, m_path);
+	}
+
+	return found;
+}
+
+template<typename CostFunc, typename SearchType>
+inline void CCachedAStarSearch<CostFunc, SearchType>::ResetSearch()
+{
+	m_search.ResetSearch();
+	m_path.clear();
+}
+
+#endif // !WAYPOINT_PATH_CACHE_H_
@@ -3,29 +3,38 @@
 
 #include <queue>
 #include <vector>
+#include <limits>
+#include <algorithm>
 #include <unordered_map>
+#include <type_traits>
 #include "waypoint_base.h"
+#include "waypoint_graph.h"
 #include "waypoint_manager.h"
+#include "waypoint_pathmanager.h"
 
 class CAStarNode
 {
 public:
-	CAStarNode()
+	CAStarNode() : m_position(0.0f, 0.0f, 0.0f)
 	{
 		m_my = nullptr;
+		m_id = WaypointConst::InvalidPathConnection;
 		m_parent = nullptr;
 		m_h = 0.0f;
 		m_g = 0.0f;
+		m_heapindex = -1;
 		m_closed = false;
 		m_open = false;
 	}
 
-	CAStarNode(CWaypoint* my)
+	CAStarNode(CWaypoint* my) : m_position(my->GetPosition())
 	{
 		m_my = my;
+		m_id = my->GetID();
 		m_parent = nullptr;
 		m_h = 0.0f;
 		m_g = 0.0f;
+		m_heapindex = -1;
 		m_closed = false;
 		m_open = false;
 	}
@@ -34,6 +43,8 @@ public:
 	bool operator!=(const CAStarNode& other) const { return this->m_my != other.m_my; }
 	void SetParent(CAStarNode* value) { m_parent = value; }
 	CWaypoint* GetMyWaypoint() const { return m_my; }
+	int GetID() const { return m_id; } // Waypoint ID of this node
+	const Vector& GetPosition() const { return m_position; } // Position of this node waypoint, safe to use outside the main thread
 	CAStarNode* GetParent() const { return m_parent; }
 	void SetH(float v) { m_h = v; }
 	void SetG(float v) { m_g = v; }
@@ -50,15 +61,29 @@ public:
 		m_parent = nullptr;
 		m_h = 0.0f;
 		m_g = 0.0f;
+		m_heapindex = -1;
 		m_closed = false;
 		m_open = false;
 	}
+	// Resets the node and assigns it to a waypoint, used by pooled nodes
+	void Init(CWaypoint* my, const int id, const Vector& position)
+	{
+		m_my = my;
+		m_id = id;
+		m_position = position;
+		Reset();
+	}
+	int GetHeapIndex() const { return m_heapindex; } // Position in the open list heap, -1 if not in the heap
+	void SetHeapIndex(int index) { m_heapindex = index; }
 
 private:
 	CWaypoint* m_my;
+	int m_id;
+	Vector m_position;
 	CAStarNode* m_parent;
 	float m_h;
 	float m_g;
+	int m_heapindex;
 	bool m_closed;
 	bool m_open;
 };
@@ -78,9 +103,7 @@ public:
 		}
 		else
 		{
-			CWaypoint* fromwpt = from->GetMyWaypoint();
-			CWaypoint* towpt = to->GetMyWaypoint();
-			float dist = fromwpt->DistTo(towpt);
+			float dist = from->GetPosition().DistTo(to->GetPosition());
 			float cost = dist + from->GetG();
 			return cost;
 		}
@@ -88,6 +111,31 @@ public:
 };
 
 
+namespace PathSearch
+{
+	/**
+	 * @brief Calls a path cost functor. Functors that take the path type as a third argument receive the type of the path being evaluated.
+	 * Resolved at compile time so the call can be inlined by the searches.
+	 * @param costFunc Path cost functor
+	 * @param to Node being evaluated
+	 * @param from Parent node, nullptr for the start node
+	 * @param type Type of the path between the nodes
+	 * @return Cost to reach the node, negative if it can't be traversed
+	*/
+	template <typename CostFunc>
+	inline float EvaluateCost(CostFunc& costFunc, CAStarNode* to, CAStarNode* from, const WaypointPath::PathType type)
+	{
+		if constexpr (std::is_invocable_r_v<float, CostFunc&, CAStarNode*, CAStarNode*, WaypointPath::PathType>)
+		{
+			return costFunc(to, from, type);
+		}
+		else
+		{
+			return costFunc(to, from);
+		}
+	}
+}
+
 /**
  * @brief Abstract base class for performing an A* search;
  * @tparam CostFunc Heuristic cost functor
@@ -100,11 +148,24 @@ public:
 	virtual void ResetSearch() = 0;
 };
 
+/**
+ * @brief Straight line distance heuristic
+*/
+class CDistanceHeuristic
+{
+public:
+	float operator() (const CWaypointGraph& graph, const int id, const int goalid, const Vector& goal) const
+	{
+		return graph.GetPosition(id).DistTo(goal);
+	}
+};
+
 /**
  * @brief A Simple class for performaning an A star search
  * @tparam CostFunc Heuristic cost functor
+ * @tparam HeuristicFunc Heuristic functor
 */
-template <typename CostFunc>
+template <typename CostFunc, typename HeuristicFunc = CDistanceHeuristic>
 class CSimpleAStarSearch : public IAStarSearch<CostFunc>
 {
 public:
@@ -114,26 +175,30 @@ public:
 	virtual bool BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc);
 	virtual void ResetSearch();
 	std::vector<CWaypoint*>& GetPath();
+	HeuristicFunc& GetHeuristic() { return m_heuristic; }
 
 private:
 	CAStarNode* FindNodeInList(std::vector<CAStarNode*>* list, CWaypoint* waypoint);
 
+	HeuristicFunc m_heuristic;
 	std::vector<CWaypoint*> m_path;
 };
 
-template<typename CostFunc>
-inline CSimpleAStarSearch<CostFunc>::CSimpleAStarSearch()
+template<typename CostFunc, typename HeuristicFunc>
+inline CSimpleAStarSearch<CostFunc, HeuristicFunc>::CSimpleAStarSearch()
 {
 }
 
-template<typename CostFunc>
-inline CSimpleAStarSearch<CostFunc>::~CSimpleAStarSearch()
+template<typename CostFunc, typename HeuristicFunc>
+inline CSimpleAStarSearch<CostFunc, HeuristicFunc>::~CSimpleAStarSearch()
 {
 }
 
-template<typename CostFunc>
-inline bool CSimpleAStarSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc)
+template<typename CostFunc, typename HeuristicFunc>
+inline bool CSimpleAStarSearch<CostFunc, HeuristicFunc>::BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc)
 {
+	m_path.clear();
+
 	if (start == nullptr)
 		return false;
 
@@ -144,13 +209,20 @@ inline bool CSimpleAStarSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint*
 		return true;
 
 	Vector actualGoal = goal ? *goal : end->GetPosition();
+	const CWaypointGraph& graph = TheWaypoints->GetGraph();
+
+	// Start and goal on different components, no need to search
+	if (!graph.IsValidNode(start->GetID()) || !graph.IsValidNode(end->GetID()) || !graph.IsReachable(start->GetID(), end->GetID()))
+		return false;
+
 	CAStarNode* current = new CAStarNode(start);
+	bool found = false;
 	std::vector<CAStarNode*> m_openlist;
 	std::vector<CAStarNode*> m_closedlist;
 
 
-	current->SetH(start->DistTo(actualGoal));
-	float initialCost = costFunc(current, nullptr);
+	current->SetH(m_heuristic(graph, start->GetID(), end->GetID(), actualGoal));
+	float initialCost = PathSearch::EvaluateCost(costFunc, current, nullptr, WaypointPath::PATH_NORMAL);
 
 	if (initialCost < 0.0f)
 	{
@@ -166,7 +238,6 @@ inline bool CSimpleAStarSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint*
 	while (!m_openlist.empty())
 	{
 		// Step 1: Find an open node with the lowest F score
-		float bestF = std::numeric_limits<float>::max();
 		auto current_it = m_openlist.begin();
 		current = *current_it;
 
@@ -188,17 +259,20 @@ inline bool CSimpleAStarSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint*
 		current->Close();
 
 		if (current->GetMyWaypoint() == end)
+		{
+			found = true;
 			break;
+		}
 
 		// Step 3: Generate a list of basenode's successors
 		// Step 4: Loop each successor
 
-		for (int i = 0; i < WaypointConst::MaxPaths; i++)
-		{
-			CWaypoint* nextwpt = current->GetMyWaypoint()->GetWaypointOfPath(i);
+		const int currentid = current->GetMyWaypoint()->GetID();
 
-			if (nextwpt == nullptr)
-				continue;
+		for (int edge = graph.GetFirstEdge(currentid); edge < graph.GetLastEdge(currentid); edge++)
+		{
+			const int nextid = graph.GetEdgeTarget(edge);
+			CWaypoint* nextwpt = graph.GetWaypoint(nextid);
 
 			if (FindNodeInList(&m_closedlist, nextwpt) != nullptr)
 				continue;
@@ -208,9 +282,9 @@ inline bool CSimpleAStarSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint*
 			if (successor == nullptr)
 			{
 				successor = new CAStarNode(nextwpt);
-				float g = costFunc(successor, current);
+				float g = PathSearch::EvaluateCost(costFunc, successor, current, graph.GetEdgeType(edge));
 				successor->SetG(g);
-				successor->SetH(current->GetMyWaypoint()->DistTo(actualGoal));
+				successor->SetH(m_heuristic(graph, nextid, end->GetID(), actualGoal));
 				successor->SetParent(current);
 				successor->Open();
 				m_openlist.push_back(successor);
@@ -220,13 +294,14 @@ inline bool CSimpleAStarSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint*
 				if (current->GetF() < successor->GetF())
 				{
 					successor->SetParent(current);
-					successor->SetG(costFunc(successor, current));
+					successor->SetG(PathSearch::EvaluateCost(costFunc, successor, current, graph.GetEdgeType(edge)));
 				}
 			}
 		}
 	}
 
-	while (current != nullptr)
+	// The open list ran out before reaching the goal, don't return a partial path
+	while (found && current != nullptr)
 	{
 		m_path.push_back(current->GetMyWaypoint());
 		current = current->GetParent();
@@ -247,22 +322,23 @@ inline bool CSimpleAStarSearch<CostFunc>::BuildPath(CWaypoint* start, CWaypoint*
 	m_openlist.clear();
 	m_closedlist.clear();
 
-	return true;
+	return found;
 }
 
-template<typename CostFunc>
-inline void CSimpleAStarSearch<CostFunc>::ResetSearch()
+template<typename CostFunc, typename HeuristicFunc>
+inline void CSimpleAStarSearch<CostFunc, HeuristicFunc>::ResetSearch()
 {
+	m_path.clear();
 }
 
-template<typename CostFunc>
-inline std::vector<CWaypoint*>& CSimpleAStarSearch<CostFunc>::GetPath()
+template<typename CostFunc, typename HeuristicFunc>
+inline std::vector<CWaypoint*>& CSimpleAStarSearch<CostFunc, HeuristicFunc>::GetPath()
 {
 	return m_path;
 }
 
-template<typename CostFunc>
-inline CAStarNode* CSimpleAStarSearch<CostFunc>::FindNodeInList(std::vector<CAStarNode*>* list, CWaypoint* waypoint)
+template<typename CostFunc, typename HeuristicFunc>
+inline CAStarNode* CSimpleAStarSearch<CostFunc, HeuristicFunc>::FindNodeInList(std::vector<CAStarNode*>* list, CWaypoint* waypoint)
 {
 	for (auto node : *list)
 	{
@@ -273,5 +349,917 @@ inline CAStarNode* CSimpleAStarSearch<CostFunc>::FindNodeInList(std::vector<CASt
 	return nullptr;
 }
 
-#endif // !WAYPOINT_BASE_PATH_FINDING_H_
+/**
+ * @brief A* open list, binary min heap ordered by F score.
+ * Nodes store their position in the heap so their score can be decreased in place.
+*/
+class CAStarOpenList
+{
+public:
+	// Nodes left in the heap keep their index, pooled nodes are reset when reused
+	void Clear() { m_heap.clear(); }
+
+	void Reserve(const size_t size) { m_heap.reserve(size); }
+	bool IsEmpty() const { return m_heap.empty(); }
+	size_t GetSize() const { return m_heap.size(); }
+
+	void Push(CAStarNode* node)
+	{
+		m_heap.push_back(node);
+		node->SetHeapIndex(static_cast<int>(m_heap.size()) - 1);
+		SiftUp(node->GetHeapIndex());
+	}
 
+	// Removes and returns the node with the lowest F score
+	CAStarNode* Pop()
+	{
+		CAStarNode* top = m_heap.front();
+		CAStarNode* last = m_heap.back();
+		m_heap.pop_back();
+		top->SetHeapIndex(-1);
+
+		if (!m_heap.empty())
+		{
+			m_heap[0] = last;
+			last->SetHeapIndex(0);
+			SiftDown(0);
+		}
+
+		return top;
+	}
+
+	// Restores the heap order after the node F score was lowered
+	void Update(CAStarNode* node)
+	{
+		SiftUp(node->GetHeapIndex());
+	}
+
+private:
+	// Lower F first, ties are broken by the lower heuristic (closer to the goal)
+	static bool IsBetter(const CAStarNode* a, const CAStarNode* b)
+	{
+		const float fa = a->GetF();
+		const float fb = b->GetF();
+		return fa < fb || (fa == fb && a->GetH() < b->GetH());
+	}
+
+	void SiftUp(int index)
+	{
+		CAStarNode* node = m_heap[index];
+
+		while (index > 0)
+		{
+			const int parent = (index - 1) / 2;
+
+			if (!IsBetter(node, m_heap[parent]))
+				break;
+
+			m_heap[index] = m_heap[parent];
+			m_heap[index]->SetHeapIndex(index);
+			index = parent;
+		}
+
+		m_heap[index] = node;
+		node->SetHeapIndex(index);
+	}
+
+	void SiftDown(int index)
+	{
+		const int size = static_cast<int>(m_heap.size());
+		CAStarNode* node = m_heap[index];
+
+		for (;;)
+		{
+			int child = index * 2 + 1;
+
+			if (child >= size)
+				break;
+
+			if (child + 1 < size && IsBetter(m_heap[child + 1], m_heap[child]))
+				child++;
+
+			if (!IsBetter(m_heap[child], node))
+				break;
+
+			m_heap[index] = m_heap[child];
+			m_heap[index]->SetHeapIndex(index);
+			index = child;
+		}
+
+		m_heap[index] = node;
+		node->SetHeapIndex(index);
+	}
+
+	std::vector<CAStarNode*> m_heap;
+};
+
+/**
+ * @brief Storage for A* nodes indexed by waypoint ID.
+ *
+ * Nodes are reused between searches. Each search gets a new stamp, a node only belongs
+ * to the current search if its stamp matches, so nothing has to be cleared between searches.
+ * Memory is only allocated when the graph grows.
+*/
+class CAStarNodePool
+{
+public:
+	CAStarNodePool() : m_nodes(), m_stamps(), m_openlist()
+	{
+		m_graph = nullptr;
+		m_stamp = 0;
+	}
+
+	// Prepares the pool for a new search on the given graph
+	void BeginSearch(const CWaypointGraph& graph)
+	{
+		const size_t limit = static_cast<size_t>(graph.GetNodeLimit());
+
+		if (m_nodes.size() < limit)
+		{
+			m_nodes.resize(limit);
+			m_stamps.resize(limit, 0);
+			m_openlist.Reserve(limit);
+		}
+
+		m_openlist.Clear();
+		m_graph = &graph;
+		m_stamp++;
+
+		if (m_stamp == 0)
+		{
+			// Stamp wrapped around, old stamps could collide with new searches
+			std::fill(m_stamps.begin(), m_stamps.end(), 0U);
+			m_stamp = 1;
+		}
+	}
+
+	// Gets the node of the given ID, nodes not yet visited by the current search are reset
+	CAStarNode* GetNode(const int id)
+	{
+		CAStarNode* node = &m_nodes[id];
+
+		if (m_stamps[id] != m_stamp)
+		{
+			m_stamps[id] = m_stamp;
+			node->Init(m_graph->GetWaypoint(id), id, m_graph->GetPosition(id));
+		}
+
+		return node;
+	}
+
+	// Gets the node of the given ID if it was visited by the current search
+	CAStarNode* FindNode(const int id)
+	{
+		if (id < 0 || id >= static_cast<int>(m_nodes.size()) || m_stamps[id] != m_stamp)
+			return nullptr;
+
+		return &m_nodes[id];
+	}
+
+	CAStarOpenList& GetOpenList() { return m_openlist; }
+	const CWaypointGraph* GetGraph() const { return m_graph; }
+
+	/**
+	 * @brief Node pool shared by searches that run to completion on the calling thread
+	 * @return Thread local node pool
+	*/
+	static CAStarNodePool& GetSharedPool()
+	{
+		thread_local CAStarNodePool pool;
+		return pool;
+	}
+
+private:
+	std::vector<CAStarNode> m_nodes;
+	std::vector<unsigned int> m_stamps;
+	CAStarOpenList m_openlist;
+	const CWaypointGraph* m_graph;
+	unsigned int m_stamp;
+};
+
+namespace PathSearch
+{
+	enum Status
+	{
+		STATUS_PENDING = 0, // Search is still running
+		STATUS_FOUND, // A path to the goal was found
+		STATUS_FAILED, // No path to the goal exists
+
+		MAX_SEARCH_STATUS
+	};
+}
+
+/**
+ * @brief A* search using a binary heap open list and pooled nodes indexed by waypoint ID.
+ * Doesn't allocate memory once the pool and path vector have grown to the graph size.
+ * @tparam CostFunc Path cost functor, a negative cost means the node can't be traversed
+ * @tparam HeuristicFunc Heuristic functor
+*/
+template <typename CostFunc, typename HeuristicFunc = CDistanceHeuristic>
+class CBinaryHeapAStarSearch : public IAStarSearch<CostFunc>
+{
+public:
+	/**
+	 * @param pool Node pool to use, if nullptr the thread shared pool is used
+	*/
+	CBinaryHeapAStarSearch(CAStarNodePool* pool = nullptr);
+	virtual ~CBinaryHeapAStarSearch();
+
+	virtual bool BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc);
+	/**
+	 * @brief Searches a path on the given graph, doesn't access the waypoint manager so it's safe to call from worker threads
+	 * @param graph Graph to search, must not change during the search
+	 * @param startid Start waypoint ID
+	 * @param endid Goal waypoint ID
+	 * @param goal Optional goal position
+	 * @param costFunc Path cost functor
+	 * @return Search status
+	*/
+	PathSearch::Status BuildPath(const CWaypointGraph& graph, const int startid, const int endid, const Vector* goal, CostFunc& costFunc);
+	virtual void ResetSearch();
+	std::vector<CWaypoint*>& GetPath();
+	// Waypoint IDs of the path, the waypoint pointers of GetPath() are only valid on the main thread
+	const std::vector<int>& GetPathIDs() const { return m_pathids; }
+	HeuristicFunc& GetHeuristic() { return m_heuristic; }
+	PathSearch::Status GetStatus() const { return m_status; }
+	// Number of nodes expanded by the last search
+	int GetExpandedNodeCount() const { return m_expanded; }
+
+protected:
+	// Starts a new search, the search state is kept in the node pool
+	PathSearch::Status BeginSearch(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc);
+	PathSearch::Status BeginSearch(const CWaypointGraph& graph, const int startid, const int endid, const Vector* goal, CostFunc& costFunc);
+	// Restarts the current search from its start waypoint, used when the graph changes during a search
+	PathSearch::Status RestartSearch(CostFunc& costFunc);
+	/**
+	 * @brief Continues the current search
+	 * @param costFunc Path cost functor
+	 * @param maxexpansions Maximum number of nodes to expand
+	 * @param expanded Number of nodes expanded by this call will be stored here
+	 * @return Search status
+	*/
+	PathSearch::Status ContinueSearch(CostFunc& costFunc, const int maxexpansions, int& expanded);
+	unsigned int GetSearchGraphVersion() const { return m_graphversion; }
+
+private:
+	void BuildResultPath(CAStarNode* found);
+	CAStarNodePool& GetPool() { return m_pool ? *m_pool : CAStarNodePool::GetSharedPool(); }
+
+	CAStarNodePool* m_pool;
+	HeuristicFunc m_heuristic;
+	std::vector<CWaypoint*> m_path;
+	std::vector<int> m_pathids;
+	const CWaypointGraph* m_graph; // Graph of the current search
+	unsigned int m_graphversion; // Graph version of the current search
+	int m_startid;
+	unsigned int m_startgen;
+	int m_endid;
+	unsigned int m_endgen;
+	Vector m_goal;
+	bool m_hasgoal;
+	PathSearch::Status m_status;
+	int m_expanded;
+};
+
+template<typename CostFunc, typename HeuristicFunc>
+inline CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::CBinaryHeapAStarSearch(CAStarNodePool* pool) :
+	m_heuristic(),
+	m_path(),
+	m_pathids(),
+	m_goal(0.0f, 0.0f, 0.0f)
+{
+	m_pool = pool;
+	m_graph = nullptr;
+	m_graphversion = 0;
+	m_startid = WaypointConst::InvalidPathConnection;
+	m_startgen = 0;
+	m_endid = WaypointConst::InvalidPathConnection;
+	m_endgen = 0;
+	m_hasgoal = false;
+	m_status = PathSearch::STATUS_FAILED;
+	m_expanded = 0;
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::~CBinaryHeapAStarSearch()
+{
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline bool CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::BuildPath(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc)
+{
+	PathSearch::Status status = BeginSearch(start, end, goal, costFunc);
+
+	if (status == PathSearch::STATUS_PENDING)
+	{
+		int expanded = 0;
+		status = ContinueSearch(costFunc, std::numeric_limits<int>::max(), expanded);
+	}
+
+	return status == PathSearch::STATUS_FOUND;
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline PathSearch::Status CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::BuildPath(const CWaypointGraph& graph, const int startid, const int endid, const Vector* goal, CostFunc& costFunc)
+{
+	PathSearch::Status status = BeginSearch(graph, startid, endid, goal, costFunc);
+
+	if (status == PathSearch::STATUS_PENDING)
+	{
+		int expanded = 0;
+		status = ContinueSearch(costFunc, std::numeric_limits<int>::max(), expanded);
+	}
+
+	return status;
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline PathSearch::Status CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::BeginSearch(CWaypoint* start, CWaypoint* end, Vector* goal, CostFunc& costFunc)
+{
+	if (start == nullptr || end == nullptr)
+	{
+		ResetSearch();
+		return m_status;
+	}
+
+	m_startgen = TheWaypoints->GetWaypointGeneration(start->GetID());
+	m_endgen = TheWaypoints->GetWaypointGeneration(end->GetID());
+	return BeginSearch(TheWaypoints->GetGraph(), start->GetID(), end->GetID(), goal, costFunc);
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline PathSearch::Status CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::BeginSearch(const CWaypointGraph& graph, const int startid, const int endid, const Vector* goal, CostFunc& costFunc)
+{
+	m_path.clear();
+	m_pathids.clear();
+	m_expanded = 0;
+	m_status = PathSearch::STATUS_FAILED;
+	m_graph = &graph;
+	m_graphversion = graph.GetVersion();
+	m_startid = startid;
+	m_endid = endid;
+	m_hasgoal = goal != nullptr;
+
+	if (!graph.IsValidNode(m_startid) || !graph.IsValidNode(m_endid))
+		return m_status;
+
+	m_goal = goal ? *goal : graph.GetPosition(m_endid);
+
+	if (m_startid == m_endid)
+	{
+		m_path.push_back(graph.GetWaypoint(m_startid));
+		m_pathids.push_back(m_startid);
+		m_status = PathSearch::STATUS_FOUND;
+		return m_status;
+	}
+
+	// Start and goal on different components, no need to search
+	if (!graph.IsReachable(m_startid, m_endid))
+		return m_status;
+
+	CAStarNodePool& pool = GetPool();
+	pool.BeginSearch(graph);
+
+	CAStarNode* node = pool.GetNode(m_startid);
+	const float initialCost = PathSearch::EvaluateCost(costFunc, node, nullptr, WaypointPath::PATH_NORMAL);
+
+	if (initialCost < 0.0f)
+		return m_status;
+
+	node->SetG(initialCost);
+	node->SetH(m_heuristic(graph, m_startid, m_endid, m_goal));
+	node->Open();
+	pool.GetOpenList().Push(node);
+	m_status = PathSearch::STATUS_PENDING;
+	return m_status;
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline PathSearch::Status CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::RestartSearch(CostFunc& costFunc)
+{
+	CWaypoint* start = TheWaypoints->GetWaypointOfID(m_startid, m_startgen);
+	CWaypoint* end = TheWaypoints->GetWaypointOfID(m_endid, m_endgen);
+
+	if (start == nullptr || end == nullptr)
+	{
+		// One of the waypoints was deleted
+		m_path.clear();
+		m_status = PathSearch::STATUS_FAILED;
+		return m_status;
+	}
+
+	Vector goal = m_goal;
+	return BeginSearch(start, end, m_hasgoal ? &goal : nullptr, costFunc);
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline PathSearch::Status CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::ContinueSearch(CostFunc& costFunc, const int maxexpansions, int& expanded)
+{
+	expanded = 0;
+
+	if (m_status != PathSearch::STATUS_PENDING)
+		return m_status;
+
+	const CWaypointGraph& graph = *m_graph;
+	CAStarNodePool& pool = GetPool();
+	CAStarOpenList& openlist = pool.GetOpenList();
+
+	while (expanded < maxexpansions)
+	{
+		if (openlist.IsEmpty())
+		{
+			m_status = PathSearch::STATUS_FAILED;
+			return m_status;
+		}
+
+		CAStarNode* current = openlist.Pop();
+		current->Close();
+		expanded++;
+		m_expanded++;
+
+		const int currentid = current->GetID();
+
+		if (currentid == m_endid)
+		{
+			BuildResultPath(current);
+			m_status = PathSearch::STATUS_FOUND;
+			return m_status;
+		}
+
+		for (int edge = graph.GetFirstEdge(currentid); edge < graph.GetLastEdge(currentid); edge++)
+		{
+			const int nextid = graph.GetEdgeTarget(edge);
+			CAStarNode* successor = pool.GetNode(nextid);
+
+			if (successor->IsClosed())
+				continue;
+
+			const float g = PathSearch::EvaluateCost(costFunc, successor, current, graph.GetEdgeType(edge));
+
+			if (g < 0.0f)
+				continue; // not traversable
+
+			if (successor->IsOpen())
+			{
+				if (g < successor->GetG())
+				{
+					successor->SetParent(current);
+					successor->SetG(g);
+					openlist.Update(successor);
+				}
+			}
+			else
+			{
+				successor->SetParent(current);
+				successor->SetG(g);
+				successor->SetH(m_heuristic(graph, nextid, m_endid, m_goal));
+				successor->Open();
+				openlist.Push(successor);
+			}
+		}
+	}
+
+	return m_status;
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline void CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::BuildResultPath(CAStarNode* found)
+{
+	m_path.clear();
+	m_pathids.clear();
+
+	for (CAStarNode* node = found; node != nullptr; node = node->GetParent())
+	{
+		m_path.push_back(node->GetMyWaypoint());
+		m_pathids.push_back(node->GetID());
+	}
+
+	std::reverse(m_path.begin(), m_path.end());
+	std::reverse(m_pathids.begin(), m_pathids.end());
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline void CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::ResetSearch()
+{
+	m_path.clear();
+	m_pathids.clear();
+	m_expanded = 0;
+	m_status = PathSearch::STATUS_FAILED;
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline std::vector<CWaypoint*>& CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::GetPath()
+{
+	return m_path;
+}
+
+/**
+ * @brief Interface for searches that are spread over several frames
+*/
+class IIncrementalPathSearch
+{
+public:
+	virtual ~IIncrementalPathSearch() {}
+
+	/**
+	 * @brief Continues the search
+	 * @param maxexpansions Maximum number of nodes to expand
+	 * @param expanded Number of nodes expanded will be stored here
+	 * @return Search status
+	*/
+	virtual PathSearch::Status Update(const int maxexpansions, int& expanded) = 0;
+	virtual PathSearch::Status GetStatus() const = 0;
+};
+
+/**
+ * @brief Resumable A* search, keeps its state between frames and is updated by the path search manager.
+ * Has its own node pool since several searches can be in progress at the same time.
+ * @tparam CostFunc Path cost functor
+ * @tparam HeuristicFunc Heuristic functor
+*/
+template <typename CostFunc, typename HeuristicFunc = CDistanceHeuristic>
+class CTimeSlicedAStarSearch : public CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>, public IIncrementalPathSearch
+{
+public:
+	CTimeSlicedAStarSearch();
+	virtual ~CTimeSlicedAStarSearch();
+
+	/**
+	 * @brief Starts a new search, the search is updated by the path search manager until it finishes
+	 * @param start Start waypoint
+	 * @param end Goal waypoint
+	 * @param goal Optional goal position
+	 * @param costFunc Cost functor, copied and kept until the search finishes
+	 * @return Search status
+	*/
+	PathSearch::Status RequestPath(CWaypoint* start, CWaypoint* end, Vector* goal, const CostFunc& costFunc);
+	// Stops the current search
+	void Cancel();
+
+	virtual PathSearch::Status Update(const int maxexpansions, int& expanded) override;
+	virtual PathSearch::Status GetStatus() const override { return CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>::GetStatus(); }
+
+private:
+	CAStarNodePool m_searchpool;
+	CostFunc m_costfunc;
+};
+
+template<typename CostFunc, typename HeuristicFunc>
+inline CTimeSlicedAStarSearch<CostFunc, HeuristicFunc>::CTimeSlicedAStarSearch() : CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>(&m_searchpool),
+	m_searchpool(),
+	m_costfunc()
+{
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline CTimeSlicedAStarSearch<CostFunc, HeuristicFunc>::~CTimeSlicedAStarSearch()
+{
+	Cancel();
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline PathSearch::Status CTimeSlicedAStarSearch<CostFunc, HeuristicFunc>::RequestPath(CWaypoint* start, CWaypoint* end, Vector* goal, const CostFunc& costFunc)
+{
+	m_costfunc = costFunc;
+	PathSearch::Status status = this->BeginSearch(start, end, goal, m_costfunc);
+
+	if (status == PathSearch::STATUS_PENDING)
+	{
+		ThePathSearchManager->AddSearch(this);
+	}
+
+	return status;
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline void CTimeSlicedAStarSearch<CostFunc, HeuristicFunc>::Cancel()
+{
+	if (ThePathSearchManager != nullptr)
+	{
+		ThePathSearchManager->RemoveSearch(this);
+	}
+
+	this->ResetSearch();
+}
+
+template<typename CostFunc, typename HeuristicFunc>
+inline PathSearch::Status CTimeSlicedAStarSearch<CostFunc, HeuristicFunc>::Update(const int maxexpansions, int& expanded)
+{
+	expanded = 0;
+
+	if (GetStatus() == PathSearch::STATUS_PENDING && TheWaypoints->GetGraphVersion() != this->GetSearchGraphVersion())
+	{
+		// Waypoints changed since the search started, the node pool may point to deleted waypoints
+		if (this->RestartSearch(m_costfunc) != PathSearch::STATUS_PENDING)
+			return GetStatus();
+	}
+
+	return this->ContinueSearch(m_costfunc, maxexpansions, expanded);
+}
+
+/**
+ * @brief Search for the nearest of several goal waypoints, used to find the closest reachable item of a kind.
+ * Goals can have an extra cost added to their path cost to make them less desirable.
+ * The search stops once no better goal can be found and uses pooled nodes, so it doesn't allocate once grown.
+ * @tparam CostFunc Path cost functor, a negative cost means the node can't be traversed
+*/
+template <typename CostFunc>
+class CMultiGoalSearch
+{
+public:
+	/**
+	 * @param pool Node pool to use, if nullptr the thread shared pool is used
+	*/
+	CMultiGoalSearch(CAStarNodePool* pool = nullptr);
+	virtual ~CMultiGoalSearch();
+
+	// Removes every goal
+	void ClearGoals();
+	/**
+	 * @brief Adds a goal to the next searches
+	 * @param goal Goal waypoint
+	 * @param extracost Cost added to the path cost of this goal, negative values are clamped to zero
+	*/
+	void AddGoal(CWaypoint* goal, const float extracost = 0.0f);
+	// Same as above using a waypoint ID, for searches on worker threads
+	void AddGoal(const int goalid, const float extracost = 0.0f);
+	int GetGoalCount() const { return static_cast<int>(m_goals.size()); }
+
+	/**
+	 * @brief Searches the path to the goal with the lowest path cost plus extra cost
+	 * @param start Start waypoint
+	 * @param costFunc Path cost functor
+	 * @return true if a goal was found
+	*/
+	bool BuildPath(CWaypoint* start, CostFunc& costFunc);
+	/**
+	 * @brief Same as above on the given graph, doesn't access the waypoint manager so it's safe to call from worker threads
+	 * @param graph Graph to search, must not change during the search
+	 * @param startid Start waypoint ID
+	 * @param costFunc Path cost functor
+	 * @return Search status
+	*/
+	PathSearch::Status BuildPath(const CWaypointGraph& graph, const int startid, CostFunc& costFunc);
+	void ResetSearch();
+
+	// Goal found by the last search, nullptr if none was found
+	CWaypoint* GetFoundGoal() const { return m_path.empty() ? nullptr : m_path.back(); }
+	// Goal ID found by the last search, InvalidPathConnection if none was found
+	int GetFoundGoalID() const { return m_pathids.empty() ? WaypointConst::InvalidPathConnection : m_pathids.back(); }
+	// Path cost plus extra cost of the goal found
+	float GetFoundCost() const { return m_foundcost; }
+	std::vector<CWaypoint*>& GetPath() { return m_path; }
+	const std::vector<int>& GetPathIDs() const { return m_pathids; }
+	PathSearch::Status GetStatus() const { return m_status; }
+	// Number of nodes expanded by the last search
+	int GetExpandedNodeCount() const { return m_expanded; }
+
+private:
+	// Goals sets larger than this are searched without heuristic
+	static constexpr int MaxHeuristicGoals = 16;
+
+	struct Goal
+	{
+		int id;
+		float extracost;
+		Vector position;
+
+		bool operator<(const Goal& other) const { return id < other.id; }
+	};
+
+	// Prepares the goals for a search from the given waypoint, returns false if no goal can be reached
+	bool PrepareGoals(const CWaypointGraph& graph, const int startid);
+	const Goal* FindGoal(const int id) const;
+	// Lowest straight line distance plus extra cost of every goal, never overestimates the cost of the nearest goal
+	float GetHeuristic(const Vector& position) const;
+	void BuildResultPath(CAStarNode* found);
+	CAStarNodePool& GetPool() { return m_pool ? *m_pool : CAStarNodePool::GetSharedPool(); }
+
+	CAStarNodePool* m_pool;
+	std::vector<Goal> m_goals;
+	std::vector<CWaypoint*> m_path;
+	std::vector<int> m_pathids;
+	float m_foundcost;
+	bool m_useheuristic;
+	PathSearch::Status m_status;
+	int m_expanded;
+};
+
+template<typename CostFunc>
+inline CMultiGoalSearch<CostFunc>::CMultiGoalSearch(CAStarNodePool* pool) :
+	m_goals(),
+	m_path(),
+	m_pathids()
+{
+	m_pool = pool;
+	m_foundcost = 0.0f;
+	m_useheuristic = false;
+	m_status = PathSearch::STATUS_FAILED;
+	m_expanded = 0;
+}
+
+template<typename CostFunc>
+inline CMultiGoalSearch<CostFunc>::~CMultiGoalSearch()
+{
+}
+
+template<typename CostFunc>
+inline void CMultiGoalSearch<CostFunc>::ClearGoals()
+{
+	m_goals.clear();
+}
+
+template<typename CostFunc>
+inline void CMultiGoalSearch<CostFunc>::AddGoal(CWaypoint* goal, const float extracost)
+{
+	if (goal != nullptr)
+	{
+		AddGoal(goal->GetID(), extracost);
+	}
+}
+
+template<typename CostFunc>
+inline void CMultiGoalSearch<CostFunc>::AddGoal(const int goalid, const float extracost)
+{
+	Goal goal;
+	goal.id = goalid;
+	goal.extracost = std::max(extracost, 0.0f);
+	goal.position = Vector(0.0f, 0.0f, 0.0f);
+	m_goals.push_back(goal);
+}
+
+template<typename CostFunc>
+inline bool CMultiGoalSearch<CostFunc>::BuildPath(CWaypoint* start, CostFunc& costFunc)
+{
+	if (start == nullptr)
+	{
+		ResetSearch();
+		return false;
+	}
+
+	return BuildPath(TheWaypoints->GetGraph(), start->GetID(), costFunc) == PathSearch::STATUS_FOUND;
+}
+
+template<typename CostFunc>
+inline PathSearch::Status CMultiGoalSearch<CostFunc>::BuildPath(const CWaypointGraph& graph, const int startid, CostFunc& costFunc)
+{
+	ResetSearch();
+
+	if (!graph.IsValidNode(startid) || !PrepareGoals(graph, startid))
+		return m_status;
+
+	CAStarNodePool& pool = GetPool();
+	pool.BeginSearch(graph);
+	CAStarOpenList& openlist = pool.GetOpenList();
+
+	CAStarNode* node = pool.GetNode(startid);
+	const float initialCost = PathSearch::EvaluateCost(costFunc, node, nullptr, WaypointPath::PATH_NORMAL);
+
+	if (initialCost < 0.0f)
+		return m_status;
+
+	node->SetG(initialCost);
+	node->SetH(GetHeuristic(node->GetPosition()));
+	node->Open();
+	openlist.Push(node);
+
+	CAStarNode* found = nullptr;
+
+	while (!openlist.IsEmpty())
+	{
+		CAStarNode* current = openlist.Pop();
+
+		// Every node left costs more than the best goal, extra costs may have kept the search going after the first goal
+		if (found != nullptr && current->GetF() >= m_foundcost)
+			break;
+
+		current->Close();
+		m_expanded++;
+
+		const int currentid = current->GetID();
+		const Goal* goal = FindGoal(currentid);
+
+		if (goal != nullptr && (found == nullptr || current->GetG() + goal->extracost < m_foundcost))
+		{
+			found = current;
+			m_foundcost = current->GetG() + goal->extracost;
+		}
+
+		for (int edge = graph.GetFirstEdge(currentid); edge < graph.GetLastEdge(currentid); edge++)
+		{
+			const int nextid = graph.GetEdgeTarget(edge);
+			CAStarNode* successor = pool.GetNode(nextid);
+
+			if (successor->IsClosed())
+				continue;
+
+			const float g = PathSearch::EvaluateCost(costFunc, successor, current, graph.GetEdgeType(edge));
+
+			if (g < 0.0f)
+				continue; // not traversable
+
+			if (successor->IsOpen())
+			{
+				if (g < successor->GetG())
+				{
+					successor->SetParent(current);
+					successor->SetG(g);
+					openlist.Update(successor);
+				}
+			}
+			else
+			{
+				successor->SetParent(current);
+				successor->SetG(g);
+				successor->SetH(GetHeuristic(successor->GetPosition()));
+				successor->Open();
+				openlist.Push(successor);
+			}
+		}
+	}
+
+	if (found != nullptr)
+	{
+		BuildResultPath(found);
+		m_status = PathSearch::STATUS_FOUND;
+	}
+
+	return m_status;
+}
+
+template<typename CostFunc>
+inline void CMultiGoalSearch<CostFunc>::ResetSearch()
+{
+	m_path.clear();
+	m_pathids.clear();
+	m_foundcost = 0.0f;
+	m_expanded = 0;
+	m_status = PathSearch::STATUS_FAILED;
+}
+
+template<typename CostFunc>
+inline bool CMultiGoalSearch<CostFunc>::PrepareGoals(const CWaypointGraph& graph, const int startid)
+{
+	// Drop goals that can't be reached and keep the lowest extra cost of duplicated goals
+	std::sort(m_goals.begin(), m_goals.end(), [](const Goal& a, const Goal& b) {
+		return a.id < b.id || (a.id == b.id && a.extracost < b.extracost);
+	});
+
+	auto last = std::unique(m_goals.begin(), m_goals.end(), [](const Goal& a, const Goal& b) { return a.id == b.id; });
+	last = std::remove_if(m_goals.begin(), last, [&graph, startid](const Goal& goal) {
+		return !graph.IsValidNode(goal.id) || !graph.IsReachable(startid, goal.id);
+	});
+	m_goals.erase(last, m_goals.end());
+
+	for (auto& goal : m_goals)
+	{
+		goal.position = graph.GetPosition(goal.id);
+	}
+
+	m_useheuristic = static_cast<int>(m_goals.size()) <= MaxHeuristicGoals;
+	return !m_goals.empty();
+}
+
+template<typename CostFunc>
+inline const typename CMultiGoalSearch<CostFunc>::Goal* CMultiGoalSearch<CostFunc>::FindGoal(const int id) const
+{
+	Goal key;
+	key.id = id;
+	auto it = std::lower_bound(m_goals.begin(), m_goals.end(), key);
+
+	if (it == m_goals.end() || it->id != id)
+		return nullptr;
+
+	return &(*it);
+}
+
+template<typename CostFunc>
+inline float CMultiGoalSearch<CostFunc>::GetHeuristic(const Vector& position) const
+{
+	if (!m_useheuristic)
+		return 0.0f;
+
+	float best = std::numeric_limits<float>::max();
+
+	for (auto& goal : m_goals)
+	{
+		best = std::min(best, position.DistTo(goal.position) + goal.extracost);
+	}
+
+	return best;
+}
+
+template<typename CostFunc>
+inline void CMultiGoalSearch<CostFunc>::BuildResultPath(CAStarNode* found)
+{
+	for (CAStarNode* node = found; node != nullptr; node = node->GetParent())
+	{
+		m_path.push_back(node->GetMyWaypoint());
+		m_pathids.push_back(node->GetID());
+	}
+
+	std::reverse(m_path.begin(), m_path.end());
+	std::reverse(m_pathids.begin(), m_pathids.end());
+}
+
+#endif // !WAYPOINT_BASE_PATH_FINDING_H_
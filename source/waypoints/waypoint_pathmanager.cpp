@@ -0,0 +1,124 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+
+#include "plugincvars.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_pathfind.h"
+#include "waypoint_pathmanager.h"
+
+// Minimum number of nodes a search expands when it gets updated
+constexpr int MIN_SEARCH_SLICE = 16;
+
+CPathSearchManager* ThePathSearchManager = nullptr;
+
+CPathSearchManager::CPathSearchManager() :
+	m_searches()
+{
+	m_nextsearch = 0;
+	m_lastexpanded = 0;
+}
+
+CPathSearchManager::~CPathSearchManager()
+{
+}
+
+void CPathSearchManager::Update()
+{
+	m_lastexpanded = 0;
+	RemoveFinishedSearches();
+
+	if (m_searches.empty())
+		return;
+
+	int budget = std::max(1, static_cast<int>(gb_nav_search_budget.value));
+	bool progress = true;
+
+	// Keep handing out the remaining budget while searches are still pending and making progress
+	while (budget > 0 && progress && !m_searches.empty())
+	{
+		progress = false;
+		const size_t count = m_searches.size();
+		const int share = std::max(MIN_SEARCH_SLICE, budget / static_cast<int>(count));
+		m_nextsearch %= count;
+		const size_t first = m_nextsearch;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const size_t index = (first + i) % count;
+
+			if (budget <= 0)
+			{
+				// Out of budget, this search goes first on the next update
+				m_nextsearch = index;
+				break;
+			}
+
+			IIncrementalPathSearch* search = m_searches[index];
+
+			if (search == nullptr)
+				continue;
+
+			int expanded = 0;
+			PathSearch::Status status = search->Update(std::min(share, budget), expanded);
+			budget -= expanded;
+			m_lastexpanded += expanded;
+
+			if (expanded > 0)
+			{
+				progress = true;
+			}
+
+			if (status != PathSearch::STATUS_PENDING)
+			{
+				m_searches[index] = nullptr;
+			}
+		}
+
+		RemoveFinishedSearches();
+	}
+}
+
+void CPathSearchManager::AddSearch(IIncrementalPathSearch* search)
+{
+	if (std::find(m_searches.begin(), m_searches.end(), search) == m_searches.end())
+	{
+		m_searches.push_back(search);
+	}
+}
+
+void CPathSearchManager::RemoveSearch(IIncrementalPathSearch* search)
+{
+	// Entries are compacted on the next update
+	std::replace(m_searches.begin(), m_searches.end(), search, static_cast<IIncrementalPathSearch*>(nullptr));
+}
+
+void CPathSearchManager::Clear()
+{
+	m_searches.clear();
+	m_nextsearch = 0;
+}
+
+bool CPathSearchManager::IsSearchPending(IIncrementalPathSearch* search) const
+{
+	return std::find(m_searches.begin(), m_searches.end(), search) != m_searches.end();
+}
+
+int CPathSearchManager::GetPendingSearchCount() const
+{
+	return static_cast<int>(std::count_if(m_searches.begin(), m_searches.end(), [](IIncrementalPathSearch* search) { return search != nullptr; }));
+}
+
+void CPathSearchManager::RemoveFinishedSearches()
+{
+	auto end = std::remove(m_searches.begin(), m_searches.end(), static_cast<IIncrementalPathSearch*>(nullptr));
+	m_searches.erase(end, m_searches.end());
+}
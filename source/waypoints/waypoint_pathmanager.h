@@ -0,0 +1,41 @@
+#ifndef WAYPOINT_PATH_MANAGER_H_
+#define WAYPOINT_PATH_MANAGER_H_
+
+#include <vector>
+
+class IIncrementalPathSearch;
+
+/**
+ * @brief Updates incremental path searches, spreading a global per frame node budget between them
+*/
+class CPathSearchManager
+{
+public:
+	CPathSearchManager();
+	virtual ~CPathSearchManager();
+
+	// Called every server frame
+	void Update();
+
+	void AddSearch(IIncrementalPathSearch* search);
+	void RemoveSearch(IIncrementalPathSearch* search);
+	// Removes all searches, their status isn't changed
+	void Clear();
+
+	bool IsSearchPending(IIncrementalPathSearch* search) const;
+	int GetPendingSearchCount() const;
+	// Number of nodes expanded during the last update
+	int GetLastExpandedNodeCount() const { return m_lastexpanded; }
+
+private:
+	void RemoveFinishedSearches();
+
+	std::vector<IIncrementalPathSearch*> m_searches; // Pending searches, removed entries are set to nullptr until the next update
+	size_t m_nextsearch; // Index of the search that gets updated first on the next update
+	int m_lastexpanded;
+};
+
+// Path search manager singleton
+extern CPathSearchManager* ThePathSearchManager;
+
+#endif // !WAYPOINT_PATH_MANAGER_H_
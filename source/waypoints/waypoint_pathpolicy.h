@@ -0,0 +1,195 @@
+#ifndef WAYPOINT_PATH_POLICY_H_
+#define WAYPOINT_PATH_POLICY_H_
+
+#include <type_traits>
+
+#include "interfaces/locomotion.h"
+#include "waypoint_pathfind.h"
+#include "waypoint_overlay.h"
+
+/**
+ * Policy based path costs.
+ *
+ * A path policy combines a path type cost table, a traversal filter, an edge cost overlay and a heuristic weight as template parameters.
+ * Everything is resolved at compile time so the search expansion loop is inlined without virtual calls,
+ * except for filters that explicitly consult a bot interface.
+ *
+ * Cost tables must provide: static constexpr float GetMultiplier(WaypointPath::PathType type)
+ * A negative multiplier means paths of that type are never used.
+ *
+ * Filters must provide: bool operator()(const CAStarNode* node) const
+ *
+ * Overlays must provide: float GetMultiplier(int from, int to) const
+ * A negative multiplier means the path is blocked.
+*/
+
+/**
+ * @brief Path cost multipliers for bots that walk, ladders and jumps are slower than walking
+*/
+class CWalkingPathCosts
+{
+public:
+	static constexpr float GetMultiplier(const WaypointPath::PathType type) { return s_multipliers[type]; }
+
+private:
+	static constexpr float s_multipliers[WaypointPath::MAX_PATH_TYPES] = {
+		1.0f, // PATH_NORMAL
+		1.5f, // PATH_JUMP
+		2.0f, // PATH_GAPJUMP
+		1.0f, // PATH_RAMPSTAIRS
+		2.0f, // PATH_LADDER
+		1.0f, // PATH_DROP
+	};
+};
+
+/**
+ * @brief Path cost multipliers for bots that avoid risky movement, gap jumps are never used
+*/
+class CCautiousPathCosts
+{
+public:
+	static constexpr float GetMultiplier(const WaypointPath::PathType type) { return s_multipliers[type]; }
+
+private:
+	static constexpr float s_multipliers[WaypointPath::MAX_PATH_TYPES] = {
+		1.0f, // PATH_NORMAL
+		3.0f, // PATH_JUMP
+		-1.0f, // PATH_GAPJUMP
+		1.2f, // PATH_RAMPSTAIRS
+		4.0f, // PATH_LADDER
+		2.0f, // PATH_DROP
+	};
+};
+
+/**
+ * @brief Allows every waypoint
+*/
+class CNoTraversalFilter
+{
+public:
+	bool operator() (const CAStarNode* node) const { return true; }
+};
+
+/**
+ * @brief Asks the bot locomotion interface if a waypoint can be traversed.
+ * Only usable on the main thread.
+*/
+class CLocomotionTraversalFilter
+{
+public:
+	CLocomotionTraversalFilter(const ILocomotion* locomotion = nullptr) { m_locomotion = locomotion; }
+
+	bool operator() (const CAStarNode* node) const
+	{
+		return m_locomotion == nullptr || m_locomotion->IsWaypointTraversable(node->GetMyWaypoint());
+	}
+
+private:
+	const ILocomotion* m_locomotion;
+};
+
+/**
+ * @brief Path cost functor built from a cost table, a traversal filter and an edge cost overlay
+ * @tparam CostTable Path type cost multipliers
+ * @tparam TraversalFilter Waypoint filter, rejected waypoints are not traversable
+ * @tparam EdgeOverlay Per path cost multipliers, such as CEdgeCostOverlayStack
+*/
+template <typename CostTable, typename TraversalFilter = CNoTraversalFilter, typename EdgeOverlay = CNoEdgeOverlay>
+class CPolicyPathCost
+{
+public:
+	CPolicyPathCost() : m_filter(), m_overlay() {}
+	CPolicyPathCost(const TraversalFilter& filter) : m_filter(filter), m_overlay() {}
+	CPolicyPathCost(const TraversalFilter& filter, const EdgeOverlay& overlay) : m_filter(filter), m_overlay(overlay) {}
+
+	float operator() (CAStarNode* to, CAStarNode* from, const WaypointPath::PathType type)
+	{
+		if (!m_filter(to))
+		{
+			return -1.0f;
+		}
+
+		if (from == nullptr)
+		{
+			return 0.0f; // starting node
+		}
+
+		const float multiplier = CostTable::GetMultiplier(type);
+
+		if (multiplier < 0.0f)
+		{
+			return -1.0f;
+		}
+
+		const float overlay = m_overlay.GetMultiplier(from->GetID(), to->GetID());
+
+		if (overlay < 0.0f)
+		{
+			return -1.0f; // blocked
+		}
+
+		return from->GetG() + from->GetPosition().DistTo(to->GetPosition()) * multiplier * overlay;
+	}
+
+	// Searches that don't know the path type treat every path as normal
+	float operator() (CAStarNode* to, CAStarNode* from)
+	{
+		return (*this)(to, from, WaypointPath::PATH_NORMAL);
+	}
+
+	TraversalFilter& GetFilter() { return m_filter; }
+	EdgeOverlay& GetOverlay() { return m_overlay; }
+
+	// Paths only depend on the policy types when the filter and the overlay hold no state, used by the path cache
+	static constexpr bool IsStateless = std::is_empty_v<TraversalFilter> && std::is_empty_v<EdgeOverlay>;
+
+private:
+	TraversalFilter m_filter;
+	EdgeOverlay m_overlay;
+};
+
+/**
+ * @brief Scales another heuristic. Weights above 100% expand fewer nodes but may return longer paths.
+ * @tparam WeightPercent Heuristic weight in percent
+ * @tparam BaseHeuristic Heuristic to scale
+*/
+template <int WeightPercent, typename BaseHeuristic = CDistanceHeuristic>
+class CWeightedHeuristic
+{
+public:
+	float operator() (const CWaypointGraph& graph, const int id, const int goalid, const Vector& goal)
+	{
+		constexpr float weight = static_cast<float>(WeightPercent) / 100.0f;
+		return m_base(graph, id, goalid, goal) * weight;
+	}
+
+	BaseHeuristic& GetBase() { return m_base; }
+
+private:
+	BaseHeuristic m_base;
+};
+
+/**
+ * @brief Bundles the types used to search paths with a policy
+ * @tparam CostTable Path type cost multipliers
+ * @tparam TraversalFilter Waypoint filter
+ * @tparam EdgeOverlay Per path cost multipliers
+ * @tparam HeuristicWeightPercent Heuristic weight in percent
+*/
+template <typename CostTable, typename TraversalFilter = CNoTraversalFilter, typename EdgeOverlay = CNoEdgeOverlay, int HeuristicWeightPercent = 100>
+class CPathPolicy
+{
+public:
+	using CostFunc = CPolicyPathCost<CostTable, TraversalFilter, EdgeOverlay>;
+	using HeuristicFunc = CWeightedHeuristic<HeuristicWeightPercent>;
+	using Search = CBinaryHeapAStarSearch<CostFunc, HeuristicFunc>;
+	using TimeSlicedSearch = CTimeSlicedAStarSearch<CostFunc, HeuristicFunc>;
+	using MultiGoalSearch = CMultiGoalSearch<CostFunc>;
+};
+
+// Path policy for walking bots
+using CWalkingPathPolicy = CPathPolicy<CWalkingPathCosts, CLocomotionTraversalFilter, CEdgeCostOverlayStack>;
+// Path policy for cautious bots, cost multipliers never go below 1 so the plain distance heuristic is kept
+using CCautiousPathPolicy = CPathPolicy<CCautiousPathCosts, CLocomotionTraversalFilter, CEdgeCostOverlayStack>;
+
+#endif // !WAYPOINT_PATH_POLICY_H_
@@ -0,0 +1,345 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+
+#include "plugincvars.h"
+#include "interfaces/pluginbot.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_pathfind.h"
+#include "waypoint_pathworker.h"
+
+// Maximum number of worker threads
+constexpr int MAX_PATH_WORKERS = 8;
+// A job is ran again when the graph changes while it's running, up to this many times, then it fails
+constexpr int MAX_PATH_JOB_ATTEMPTS = 3;
+
+CPathWorkerPool* ThePathWorkers = nullptr;
+
+CPathResult::CPathResult() :
+	m_requester(),
+	m_path()
+{
+	m_requestid = -1;
+	m_status = PathSearch::STATUS_FAILED;
+}
+
+IPathJob::IPathJob() :
+	m_goal(0.0f, 0.0f, 0.0f),
+	m_requester(),
+	m_path()
+{
+	m_startid = WaypointConst::InvalidPathConnection;
+	m_endid = WaypointConst::InvalidPathConnection;
+	m_hasgoal = false;
+	m_requestid = -1;
+	m_startgen = 0;
+	m_endgen = 0;
+	m_graphversion = 0;
+	m_attempts = 0;
+	m_status = PathSearch::STATUS_PENDING;
+	m_next = nullptr;
+}
+
+IPathJob::~IPathJob()
+{
+}
+
+void IPathJob::SetResult(const PathSearch::Status status, const std::vector<int>& path)
+{
+	m_status = status;
+	m_path = path;
+}
+
+CPathWorkerPool::CPathWorkerPool() :
+	m_threads(),
+	m_queue(),
+	m_snapshot(),
+	m_completed(nullptr),
+	m_results()
+{
+	m_stopping = false;
+	m_started = false;
+	m_nextrequestid = 0;
+	m_pending = 0;
+}
+
+CPathWorkerPool::~CPathWorkerPool()
+{
+	Stop();
+}
+
+void CPathWorkerPool::Start()
+{
+	if (m_started)
+		return;
+
+	m_started = true;
+	m_stopping = false;
+	PublishSnapshot();
+
+	int count = static_cast<int>(gb_nav_path_threads.value);
+
+	if (count < 0)
+	{
+		// Automatic, leave one core for the game thread
+		count = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+	}
+
+	count = std::clamp(count, 0, MAX_PATH_WORKERS);
+
+	for (int i = 0; i < count; i++)
+	{
+		m_threads.emplace_back(&CPathWorkerPool::WorkerMain, this);
+	}
+
+	LOG_MESSAGE(PLID, "Started %i path finding worker threads.", count);
+}
+
+void CPathWorkerPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+
+	m_condition.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+
+	m_threads.clear();
+
+	for (auto job : m_queue)
+	{
+		delete job;
+	}
+
+	m_queue.clear();
+
+	for (IPathJob* job = PopAllCompleted(); job != nullptr;)
+	{
+		IPathJob* next = job->m_next;
+		delete job;
+		job = next;
+	}
+
+	m_results.clear();
+	std::atomic_store(&m_snapshot, std::shared_ptr<const CWaypointGraph>());
+	m_pending = 0;
+	m_started = false;
+}
+
+void CPathWorkerPool::Update()
+{
+	if (!m_started)
+	{
+		Start();
+	}
+
+	PublishSnapshot();
+
+	if (m_threads.empty())
+	{
+		// No workers, run the queued requests here
+		std::shared_ptr<const CWaypointGraph> graph = std::atomic_load(&m_snapshot);
+
+		while (!m_queue.empty())
+		{
+			IPathJob* job = m_queue.front();
+			m_queue.pop_front();
+			job->Run(*graph);
+			job->m_graphversion = graph->GetVersion();
+			PushCompleted(job);
+		}
+	}
+
+	for (IPathJob* job = PopAllCompleted(); job != nullptr;)
+	{
+		IPathJob* next = job->m_next;
+		FinishJob(job);
+		job = next;
+	}
+}
+
+bool CPathWorkerPool::GetNextResult(CPathResult& result)
+{
+	if (m_results.empty())
+		return false;
+
+	// CHandle can't be move assigned, copy the fields
+	CPathResult& front = m_results.front();
+	result.m_requestid = front.m_requestid;
+	result.m_status = front.m_status;
+	result.m_requester = front.m_requester;
+	result.m_path.swap(front.m_path);
+	m_results.pop_front();
+	return true;
+}
+
+int CPathWorkerPool::SubmitJob(IPathJob* job, IPluginBot* bot, CWaypoint* start, CWaypoint* end, Vector* goal)
+{
+	// Waypoints are swapped in by the main thread once the background load finishes
+	if (start == nullptr || end == nullptr || TheWaypoints->IsLoading())
+	{
+		delete job;
+		return -1;
+	}
+
+	job->m_requestid = m_nextrequestid;
+	m_nextrequestid = (m_nextrequestid + 1) & 0x7FFFFFFF;
+
+	if (bot != nullptr)
+	{
+		job->m_requester = bot->GetEdict();
+	}
+
+	job->m_startid = start->GetID();
+	job->m_startgen = TheWaypoints->GetWaypointGeneration(job->m_startid);
+	job->m_endid = end->GetID();
+	job->m_endgen = TheWaypoints->GetWaypointGeneration(job->m_endid);
+	job->m_hasgoal = goal != nullptr;
+	job->m_goal = goal ? *goal : end->GetPosition();
+
+	if (!m_started)
+	{
+		Start();
+	}
+
+	// Make sure the workers see the current waypoints
+	PublishSnapshot();
+	m_pending++;
+	QueueJob(job);
+	return job->m_requestid;
+}
+
+void CPathWorkerPool::QueueJob(IPathJob* job)
+{
+	job->m_status = PathSearch::STATUS_PENDING;
+	job->m_next = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(job);
+	}
+
+	m_condition.notify_one();
+}
+
+void CPathWorkerPool::WorkerMain()
+{
+	while (true)
+	{
+		IPathJob* job = nullptr;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+
+			if (m_stopping)
+				return;
+
+			job = m_queue.front();
+			m_queue.pop_front();
+		}
+
+		// Hold a reference, the main thread may publish a new snapshot while the search is running
+		std::shared_ptr<const CWaypointGraph> graph = std::atomic_load(&m_snapshot);
+		job->Run(*graph);
+		job->m_graphversion = graph->GetVersion();
+		PushCompleted(job);
+	}
+}
+
+void CPathWorkerPool::PublishSnapshot()
+{
+	std::shared_ptr<const CWaypointGraph> current = std::atomic_load(&m_snapshot);
+
+	if (current && current->GetVersion() == TheWaypoints->GetGraphVersion())
+		return;
+
+	std::atomic_store(&m_snapshot, TheWaypoints->GetGraphSnapshot());
+}
+
+void CPathWorkerPool::PushCompleted(IPathJob* job)
+{
+	IPathJob* head = m_completed.load(std::memory_order_relaxed);
+
+	do
+	{
+		job->m_next = head;
+	} while (!m_completed.compare_exchange_weak(head, job, std::memory_order_release, std::memory_order_relaxed));
+}
+
+IPathJob* CPathWorkerPool::PopAllCompleted()
+{
+	IPathJob* job = m_completed.exchange(nullptr, std::memory_order_acquire);
+	IPathJob* reversed = nullptr;
+
+	// The stack is in reverse completion order
+	while (job != nullptr)
+	{
+		IPathJob* next = job->m_next;
+		job->m_next = reversed;
+		reversed = job;
+		job = next;
+	}
+
+	return reversed;
+}
+
+void CPathWorkerPool::FinishJob(IPathJob* job)
+{
+	job->m_attempts++;
+	const bool endpointsvalid = TheWaypoints->GetWaypointOfID(job->m_startid, job->m_startgen) != nullptr &&
+		TheWaypoints->GetWaypointOfID(job->m_endid, job->m_endgen) != nullptr;
+
+	const bool graphchanged = job->m_graphversion != TheWaypoints->GetGraphVersion();
+
+	if (graphchanged && endpointsvalid && job->m_attempts < MAX_PATH_JOB_ATTEMPTS)
+	{
+		// Waypoints were edited while the job was running, search again on the new graph
+		PublishSnapshot();
+		QueueJob(job);
+		return;
+	}
+
+	CPathResult result;
+	result.m_requestid = job->m_requestid;
+	result.m_requester = job->m_requester;
+	// Path IDs of an old graph may have been deleted and reused by other waypoints
+	result.m_status = endpointsvalid && !graphchanged ? job->m_status : PathSearch::STATUS_FAILED;
+
+	if (result.m_status == PathSearch::STATUS_FOUND)
+	{
+		result.m_path.reserve(job->m_path.size());
+
+		for (auto id : job->m_path)
+		{
+			CWaypoint* waypoint = TheWaypoints->GetWaypointOfID(id);
+
+			if (waypoint == nullptr)
+			{
+				// A waypoint of the path was deleted
+				result.m_status = PathSearch::STATUS_FAILED;
+				result.m_path.clear();
+				break;
+			}
+
+			result.m_path.push_back(waypoint);
+		}
+	}
+
+	m_results.push_back(std::move(result));
+	m_pending--;
+	delete job;
+}
@@ -0,0 +1,182 @@
+#ifndef WAYPOINT_PATH_WORKER_H_
+#define WAYPOINT_PATH_WORKER_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "sdk/chandle.h"
+#include "waypoint_pathfind.h"
+
+class IPluginBot;
+
+/**
+ * @brief Result of an asynchronous path request, delivered to the bot that made the request
+*/
+class CPathResult
+{
+public:
+	CPathResult();
+
+	int GetRequestID() const { return m_requestid; }
+	PathSearch::Status GetStatus() const { return m_status; }
+	bool IsPathFound() const { return m_status == PathSearch::STATUS_FOUND; }
+	// The bot that made the request, nullptr if it's no longer valid
+	edict_t* GetRequester() const { return m_requester.Get(); }
+	// Waypoints of the path, from start to end
+	const std::vector<CWaypoint*>& GetPath() const { return m_path; }
+
+private:
+	friend class CPathWorkerPool;
+
+	int m_requestid;
+	PathSearch::Status m_status;
+	CHandle m_requester;
+	std::vector<CWaypoint*> m_path;
+};
+
+/**
+ * @brief A path search that runs on a path finding worker thread
+ *
+ * Jobs only see the read-only graph snapshot, they must not access the waypoint manager or the engine.
+*/
+class IPathJob
+{
+public:
+	IPathJob();
+	virtual ~IPathJob();
+
+	/**
+	 * @brief Runs the search, may be called from any thread
+	 * @param graph Graph snapshot to search
+	*/
+	virtual void Run(const CWaypointGraph& graph) = 0;
+
+protected:
+	void SetResult(const PathSearch::Status status, const std::vector<int>& path);
+
+	int m_startid;
+	int m_endid;
+	bool m_hasgoal;
+	Vector m_goal;
+
+private:
+	friend class CPathWorkerPool;
+
+	int m_requestid;
+	CHandle m_requester;
+	unsigned int m_startgen; // Start waypoint generation when the job was requested
+	unsigned int m_endgen; // End waypoint generation when the job was requested
+	unsigned int m_graphversion; // Version of the graph the job ran against
+	int m_attempts; // Number of times this job ran
+	PathSearch::Status m_status;
+	std::vector<int> m_path;
+	IPathJob* m_next; // Next job in the completion stack
+};
+
+/**
+ * @brief Path job that runs the binary heap A* search
+ * @tparam CostFunc Path cost functor, a copy is made per request. Must be safe to call outside the main thread.
+ * @tparam HeuristicFunc Heuristic functor
+*/
+template<typename CostFunc, typename HeuristicFunc = CDistanceHeuristic>
+class CPathJob : public IPathJob
+{
+public:
+	CPathJob(const CostFunc& costFunc) : m_costfunc(costFunc) {}
+
+	virtual void Run(const CWaypointGraph& graph) override
+	{
+		CBinaryHeapAStarSearch<CostFunc, HeuristicFunc> search;
+		PathSearch::Status status = search.BuildPath(graph, m_startid, m_endid, m_hasgoal ? &m_goal : nullptr, m_costfunc);
+		SetResult(status, search.GetPathIDs());
+	}
+
+private:
+	CostFunc m_costfunc;
+};
+
+/**
+ * @brief Runs path requests on worker threads.
+ *
+ * Requests are queued by the main thread and drained by the workers, which search a read-only graph snapshot.
+ * A new snapshot is published when the waypoints are edited, searches that are already running keep the old one alive.
+ * Their jobs are ran again on the new snapshot, and fail if the graph keeps changing.
+ * Finished jobs are pushed to a lock-free completion stack that the main thread drains on Update.
+ * Without worker threads, requests are ran on the main thread during Update.
+*/
+class CPathWorkerPool
+{
+public:
+	CPathWorkerPool();
+	virtual ~CPathWorkerPool();
+
+	// Starts the worker threads, the number of threads comes from the gb_nav_path_threads cvar
+	void Start();
+	// Stops the worker threads and discards all requests
+	void Stop();
+	// Called every server frame
+	void Update();
+
+	/**
+	 * @brief Requests a path, the result is delivered to the bot with the OnPathResult event
+	 * @tparam CostFunc Path cost functor, must not access the engine or the waypoint manager
+	 * @param bot Bot requesting the path
+	 * @param start Start waypoint
+	 * @param end Goal waypoint
+	 * @param goal Optional goal position
+	 * @param costFunc Path cost functor, copied
+	 * @return Request ID or -1 if the request is invalid
+	*/
+	template<typename CostFunc, typename HeuristicFunc = CDistanceHeuristic>
+	int RequestPath(IPluginBot* bot, CWaypoint* start, CWaypoint* end, Vector* goal, const CostFunc& costFunc);
+
+	/**
+	 * @brief Gets the next finished request, called from the main thread
+	 * @param result Stores the result
+	 * @return true if a result was available
+	*/
+	bool GetNextResult(CPathResult& result);
+
+	int GetWorkerCount() const { return static_cast<int>(m_threads.size()); }
+	// Number of requests that haven't been delivered yet
+	int GetPendingRequestCount() const { return m_pending; }
+
+private:
+	int SubmitJob(IPathJob* job, IPluginBot* bot, CWaypoint* start, CWaypoint* end, Vector* goal);
+	void QueueJob(IPathJob* job);
+	void WorkerMain();
+	// Publishes a new graph snapshot to the workers if the waypoints were edited
+	void PublishSnapshot();
+	void PushCompleted(IPathJob* job);
+	// Takes every finished job, in completion order
+	IPathJob* PopAllCompleted();
+	void FinishJob(IPathJob* job);
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex; // Protects the request queue
+	std::condition_variable m_condition;
+	std::deque<IPathJob*> m_queue; // Requests waiting for a worker
+	bool m_stopping;
+	bool m_started;
+	std::shared_ptr<const CWaypointGraph> m_snapshot; // Graph used by the workers, only accessed with atomic loads and stores
+	std::atomic<IPathJob*> m_completed; // Finished jobs, lock-free stack
+	std::deque<CPathResult> m_results; // Results waiting to be delivered
+	int m_nextrequestid;
+	int m_pending;
+};
+
+template<typename CostFunc, typename HeuristicFunc>
+inline int CPathWorkerPool::RequestPath(IPluginBot* bot, CWaypoint* start, CWaypoint* end, Vector* goal, const CostFunc& costFunc)
+{
+	return SubmitJob(new CPathJob<CostFunc, HeuristicFunc>(costFunc), bot, start, end, goal);
+}
+
+// Path finding worker pool singleton
+extern CPathWorkerPool* ThePathWorkers;
+
+#endif // !WAYPOINT_PATH_WORKER_H_
@@ -0,0 +1,289 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <cmath>
+#include <cfloat> // Linux, for FLT_MAX
+#include <algorithm>
+
+#include "waypoint_base.h"
+#include "waypoint_spatial.h"
+#include "waypoint_raster.h"
+
+// Waypoints only affect cells closer than this, cells further from every waypoint are answered by the spatial index
+constexpr float RASTER_RADIUS = 256.0f;
+constexpr float RASTER_CELL_SIZE = 32.0f;
+// Half the height of a standing player, floors above each other fall in different bands
+constexpr float RASTER_BAND_HEIGHT = 36.0f;
+// Cells are made larger until the raster fits, 16 MB of cells on 64 bit builds
+constexpr size_t RASTER_MAX_CELLS = 1 << 19;
+
+CWaypointRaster::CWaypointRaster() :
+	m_cells()
+{
+	Clear();
+}
+
+CWaypointRaster::~CWaypointRaster()
+{
+}
+
+void CWaypointRaster::Clear()
+{
+	m_cells.clear();
+	m_cellsize = RASTER_CELL_SIZE;
+	m_dirty = true;
+
+	for (int i = 0; i < 3; i++)
+	{
+		m_mins[i] = 0.0f;
+		m_size[i] = 0;
+	}
+}
+
+void CWaypointRaster::Build(const std::vector<CWaypoint*>& waypoints)
+{
+	Clear();
+
+	if (waypoints.empty())
+		return;
+
+	m_dirty = false;
+
+	Vector mins = waypoints[0]->GetPosition();
+	Vector maxs = mins;
+
+	for (auto waypoint : waypoints)
+	{
+		const Vector& position = waypoint->GetPosition();
+
+		for (int i = 0; i < 3; i++)
+		{
+			mins[i] = std::min(mins[i], position[i]);
+			maxs[i] = std::max(maxs[i], position[i]);
+		}
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		m_mins[i] = mins[i] - RASTER_RADIUS;
+	}
+
+	const float height = maxs.z - mins.z + RASTER_RADIUS * 2.0f;
+	m_size[2] = static_cast<int>(ceilf(height / RASTER_BAND_HEIGHT));
+
+	for (;;)
+	{
+		m_size[0] = static_cast<int>(ceilf((maxs.x - mins.x + RASTER_RADIUS * 2.0f) / m_cellsize));
+		m_size[1] = static_cast<int>(ceilf((maxs.y - mins.y + RASTER_RADIUS * 2.0f) / m_cellsize));
+
+		if (static_cast<size_t>(m_size[0]) * static_cast<size_t>(m_size[1]) * static_cast<size_t>(m_size[2]) <= RASTER_MAX_CELLS)
+			break;
+
+		m_cellsize *= 2.0f;
+
+		// Tall maps can't fit at any column size, every query goes to the spatial index
+		if (m_cellsize > RASTER_RADIUS * 2.0f)
+		{
+			m_size[0] = m_size[1] = m_size[2] = 0;
+			return;
+		}
+	}
+
+	m_cells.assign(static_cast<size_t>(m_size[0]) * m_size[1] * m_size[2], { { nullptr, nullptr }, { RASTER_RADIUS, RASTER_RADIUS }, RASTER_RADIUS });
+
+	for (auto waypoint : waypoints)
+	{
+		Splat(waypoint);
+	}
+}
+
+void CWaypointRaster::Insert(CWaypoint* waypoint)
+{
+	// Rebuilt anyway, or disabled because the map is too large
+	if (m_dirty || m_cells.empty())
+		return;
+
+	int coords[3];
+
+	// Cells around the waypoint may be missing, queries there are slow until the raster is rebuilt
+	if (!GetCellCoords(waypoint->GetPosition(), coords))
+	{
+		m_dirty = true;
+		return;
+	}
+
+	Splat(waypoint);
+}
+
+void CWaypointRaster::Remove(CWaypoint* waypoint, const CWaypointSpatialIndex& index)
+{
+	if (m_dirty || m_cells.empty())
+		return;
+
+	int mins[3], maxs[3];
+	GetCellRange(waypoint->GetPosition(), mins, maxs);
+	std::vector<CWaypoint*> neighbors;
+
+	for (int x = mins[0]; x <= maxs[0]; x++)
+	{
+		for (int y = mins[1]; y <= maxs[1]; y++)
+		{
+			for (int z = mins[2]; z <= maxs[2]; z++)
+			{
+				RasterCell& cell = m_cells[GetIndex(x, y, z)];
+
+				// Other cells keep a valid lower bound for the second distance
+				if (cell.waypoints[0] != waypoint && cell.waypoints[1] != waypoint)
+					continue;
+
+				const Vector center = GetCellCenter(x, y, z);
+				cell = { { nullptr, nullptr }, { RASTER_RADIUS, RASTER_RADIUS }, RASTER_RADIUS };
+				neighbors.clear();
+				index.CollectInRadius(center, RASTER_RADIUS * RASTER_RADIUS, neighbors);
+
+				for (auto neighbor : neighbors)
+				{
+					const float distance = neighbor->GetPosition().DistTo(center);
+
+					// Waypoints beyond the radius are already covered by the initial second distance
+					if (distance < RASTER_RADIUS)
+					{
+						UpdateCell(cell, neighbor, distance);
+					}
+				}
+			}
+		}
+	}
+}
+
+bool CWaypointRaster::FindNearest(const Vector& position, CWaypoint*& nearest) const
+{
+	int coords[3];
+
+	if (m_dirty || !GetCellCoords(position, coords))
+		return false;
+
+	const RasterCell& cell = m_cells[GetIndex(coords[0], coords[1], coords[2])];
+
+	if (cell.waypoints[0] == nullptr)
+		return false;
+
+	CWaypoint* best = cell.waypoints[0];
+	float distance = best->GetPosition().DistTo(position);
+
+	if (cell.waypoints[1] != nullptr)
+	{
+		const float other = cell.waypoints[1]->GetPosition().DistTo(position);
+
+		if (other < distance)
+		{
+			best = cell.waypoints[1];
+			distance = other;
+		}
+	}
+
+	// Any other waypoint is at least (third - offset) away from the position
+	const float offset = GetCellCenter(coords[0], coords[1], coords[2]).DistTo(position);
+
+	if (distance + offset >= cell.third)
+		return false;
+
+	nearest = best;
+	return true;
+}
+
+bool CWaypointRaster::GetCellCoords(const Vector& position, int coords[3]) const
+{
+	if (m_cells.empty())
+		return false;
+
+	coords[0] = static_cast<int>(floorf((position.x - m_mins[0]) / m_cellsize));
+	coords[1] = static_cast<int>(floorf((position.y - m_mins[1]) / m_cellsize));
+	coords[2] = static_cast<int>(floorf((position.z - m_mins[2]) / RASTER_BAND_HEIGHT));
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (coords[i] < 0 || coords[i] >= m_size[i])
+			return false;
+	}
+
+	return true;
+}
+
+void CWaypointRaster::GetCellRange(const Vector& position, int mins[3], int maxs[3]) const
+{
+	const float radius[3] = { RASTER_RADIUS / m_cellsize, RASTER_RADIUS / m_cellsize, RASTER_RADIUS / RASTER_BAND_HEIGHT };
+	const float sizes[3] = { m_cellsize, m_cellsize, RASTER_BAND_HEIGHT };
+
+	for (int i = 0; i < 3; i++)
+	{
+		const float coord = (position[i] - m_mins[i]) / sizes[i];
+		mins[i] = std::max(static_cast<int>(floorf(coord - radius[i])), 0);
+		maxs[i] = std::min(static_cast<int>(floorf(coord + radius[i])), m_size[i] - 1);
+	}
+}
+
+Vector CWaypointRaster::GetCellCenter(const int x, const int y, const int z) const
+{
+	return Vector(m_mins[0] + (static_cast<float>(x) + 0.5f) * m_cellsize,
+		m_mins[1] + (static_cast<float>(y) + 0.5f) * m_cellsize,
+		m_mins[2] + (static_cast<float>(z) + 0.5f) * RASTER_BAND_HEIGHT);
+}
+
+void CWaypointRaster::UpdateCell(RasterCell& cell, CWaypoint* waypoint, const float distance)
+{
+	if (distance < cell.distances[1])
+	{
+		// The second nearest is pushed out, it becomes the lower bound of the others
+		if (cell.waypoints[1] != nullptr)
+		{
+			cell.third = std::min(cell.third, cell.distances[1]);
+		}
+
+		const int slot = distance < cell.distances[0] ? 0 : 1;
+
+		if (slot == 0)
+		{
+			cell.waypoints[1] = cell.waypoints[0];
+			cell.distances[1] = cell.distances[0];
+		}
+
+		cell.waypoints[slot] = waypoint;
+		cell.distances[slot] = distance;
+	}
+	else
+	{
+		cell.third = std::min(cell.third, distance);
+	}
+}
+
+void CWaypointRaster::Splat(CWaypoint* waypoint)
+{
+	const Vector& position = waypoint->GetPosition();
+	int mins[3], maxs[3];
+	GetCellRange(position, mins, maxs);
+
+	for (int x = mins[0]; x <= maxs[0]; x++)
+	{
+		for (int y = mins[1]; y <= maxs[1]; y++)
+		{
+			for (int z = mins[2]; z <= maxs[2]; z++)
+			{
+				RasterCell& cell = m_cells[GetIndex(x, y, z)];
+				const float distsqr = GetCellCenter(x, y, z).DistToSqr(position);
+
+				// Waypoints beyond the third distance don't change the cell, this includes waypoints beyond the radius
+				if (distsqr >= cell.third * cell.third)
+					continue;
+
+				UpdateCell(cell, waypoint, sqrtf(distsqr));
+			}
+		}
+	}
+}
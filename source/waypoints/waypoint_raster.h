@@ -0,0 +1,75 @@
+#ifndef WAYPOINT_RASTER_H_
+#define WAYPOINT_RASTER_H_
+
+#include <vector>
+
+class CWaypoint;
+class CWaypointSpatialIndex;
+class Vector;
+
+/**
+ * @brief Dense 2.5D grid of the nearest waypoint to each cell center.
+ *
+ * Cells are square columns split in height bands over the waypoint bounds. Each cell stores its two nearest waypoints
+ * and a lower bound of the distance to any other waypoint, which tells if the closer of the two is also the nearest
+ * to a query position inside the cell. Waypoints only affect the cells within a fixed radius, so edits only update
+ * the cells around them. Queries the raster can't answer are left to the spatial index.
+*/
+class CWaypointRaster
+{
+public:
+	CWaypointRaster();
+	~CWaypointRaster();
+
+	// Removes every cell, the raster is rebuilt by the next call to Build
+	void Clear();
+	// Rebuilds the raster around the given waypoints, it stays dirty without waypoints
+	void Build(const std::vector<CWaypoint*>& waypoints);
+	// Updates the cells around a new waypoint, a waypoint outside the raster bounds flags it for a rebuild
+	void Insert(CWaypoint* waypoint);
+	/**
+	 * @brief Updates the cells around a removed waypoint
+	 * @param waypoint Removed waypoint, must still be valid
+	 * @param index Spatial index the waypoint was already removed from
+	*/
+	void Remove(CWaypoint* waypoint, const CWaypointSpatialIndex& index);
+
+	// The raster doesn't cover every waypoint and needs a rebuild
+	bool IsDirty() const { return m_dirty; }
+	size_t GetCellCount() const { return m_cells.size(); }
+
+	/**
+	 * @brief Finds the nearest waypoint to a position
+	 * @param position Search position
+	 * @param nearest Stores the nearest waypoint
+	 * @return false if the raster can't tell which waypoint is the nearest
+	*/
+	bool FindNearest(const Vector& position, CWaypoint*& nearest) const;
+
+private:
+	struct RasterCell
+	{
+		CWaypoint* waypoints[2]; // Two nearest waypoints to the cell center, nullptr if none is within the raster radius
+		float distances[2]; // Distance from the cell center to the two nearest waypoints
+		float third; // Lower bound of the distance from the cell center to any other waypoint
+	};
+
+	// Coordinates of the cell at the given position, false if outside the raster
+	bool GetCellCoords(const Vector& position, int coords[3]) const;
+	// Cells within the raster radius of a position, clamped to the raster
+	void GetCellRange(const Vector& position, int mins[3], int maxs[3]) const;
+	size_t GetIndex(const int x, const int y, const int z) const { return (static_cast<size_t>(x) * m_size[1] + y) * m_size[2] + z; }
+	Vector GetCellCenter(const int x, const int y, const int z) const;
+	// Applies a waypoint to a single cell
+	static void UpdateCell(RasterCell& cell, CWaypoint* waypoint, const float distance);
+	// Applies a waypoint to every cell within the raster radius
+	void Splat(CWaypoint* waypoint);
+
+	std::vector<RasterCell> m_cells; // X major, then Y, then height band
+	float m_mins[3]; // Raster bounds
+	float m_cellsize; // Horizontal cell size
+	int m_size[3]; // Number of cells on each axis
+	bool m_dirty;
+};
+
+#endif // !WAYPOINT_RASTER_H_
@@ -0,0 +1,308 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <cmath>
+#include <cfloat> // Linux, for FLT_MAX
+#include <algorithm>
+
+#include "waypoint_base.h"
+#include "waypoint_spatial.h"
+
+// Cell coordinates are packed into 21 bits each
+constexpr int CELL_COORD_BITS = 21;
+constexpr int CELL_COORD_BIAS = 1 << (CELL_COORD_BITS - 1);
+constexpr std::uint64_t CELL_COORD_MASK = (1ULL << CELL_COORD_BITS) - 1ULL;
+
+CWaypointSpatialIndex::CWaypointSpatialIndex() :
+	m_cells()
+{
+	Clear();
+}
+
+CWaypointSpatialIndex::~CWaypointSpatialIndex()
+{
+}
+
+void CWaypointSpatialIndex::Clear()
+{
+	m_cells.clear();
+	m_count = 0;
+
+	for (int i = 0; i < 3; i++)
+	{
+		m_mins[i] = 0;
+		m_maxs[i] = 0;
+	}
+}
+
+void CWaypointSpatialIndex::Insert(CWaypoint* waypoint)
+{
+	const Vector& position = waypoint->GetPosition();
+	const int coords[3] = { ToCellCoord(position.x), ToCellCoord(position.y), ToCellCoord(position.z) };
+
+	m_cells[MakeKey(coords[0], coords[1], coords[2])].push_back(waypoint);
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (m_count == 0)
+		{
+			m_mins[i] = coords[i];
+			m_maxs[i] = coords[i];
+		}
+		else
+		{
+			m_mins[i] = std::min(m_mins[i], coords[i]);
+			m_maxs[i] = std::max(m_maxs[i], coords[i]);
+		}
+	}
+
+	m_count++;
+}
+
+void CWaypointSpatialIndex::Remove(CWaypoint* waypoint)
+{
+	const Vector& position = waypoint->GetPosition();
+	auto it = m_cells.find(MakeKey(ToCellCoord(position.x), ToCellCoord(position.y), ToCellCoord(position.z)));
+
+	if (it == m_cells.end())
+		return;
+
+	Cell& cell = it->second;
+	auto found = std::find(cell.begin(), cell.end(), waypoint);
+
+	if (found == cell.end())
+		return;
+
+	// Order inside a cell doesn't matter
+	*found = cell.back();
+	cell.pop_back();
+	m_count--;
+
+	if (cell.empty())
+	{
+		m_cells.erase(it);
+	}
+
+	// Bounds are not shrunk, they only need to be conservative
+}
+
+CWaypoint* CWaypointSpatialIndex::FindNearest(const Vector& position, const float maxdistsqr) const
+{
+	if (m_count == 0)
+		return nullptr;
+
+	const int cx = ToCellCoord(position.x);
+	const int cy = ToCellCoord(position.y);
+	const int cz = ToCellCoord(position.z);
+	CWaypoint* best = nullptr;
+	float limit = maxdistsqr;
+
+	// Number of rings needed to cover every occupied cell
+	int maxring = 0;
+	maxring = std::max(maxring, std::max(cx - m_mins[0], m_maxs[0] - cx));
+	maxring = std::max(maxring, std::max(cy - m_mins[1], m_maxs[1] - cy));
+	maxring = std::max(maxring, std::max(cz - m_mins[2], m_maxs[2] - cz));
+
+	for (int r = 0; r <= maxring; r++)
+	{
+		if (r > 0)
+		{
+			// Any cell in ring r is at least (r - 1) cells away from the search position
+			const float ringdist = static_cast<float>(r - 1) * WaypointConst::SpatialCellSize;
+
+			if (ringdist * ringdist > limit)
+				break;
+
+			// Visiting the ring would cost more than visiting every occupied cell
+			const size_t ringcells = static_cast<size_t>(24 * r * r + 2);
+
+			if (ringcells > m_cells.size())
+			{
+				for (auto& pair : m_cells)
+				{
+					for (auto waypoint : pair.second)
+					{
+						const float distance = waypoint->DistToSqr(position);
+
+						if (distance <= limit && (best == nullptr || distance < limit))
+						{
+							best = waypoint;
+							limit = distance;
+						}
+					}
+				}
+
+				return best;
+			}
+		}
+
+		for (int dx = -r; dx <= r; dx++)
+		{
+			for (int dy = -r; dy <= r; dy++)
+			{
+				if (dx == -r || dx == r || dy == -r || dy == r)
+				{
+					for (int dz = -r; dz <= r; dz++)
+					{
+						SearchCell(cx + dx, cy + dy, cz + dz, position, best, limit);
+					}
+				}
+				else
+				{
+					// Interior columns only have their top and bottom cells on the ring
+					SearchCell(cx + dx, cy + dy, cz - r, position, best, limit);
+
+					if (r > 0)
+					{
+						SearchCell(cx + dx, cy + dy, cz + r, position, best, limit);
+					}
+				}
+			}
+		}
+	}
+
+	return best;
+}
+
+int CWaypointSpatialIndex::CollectInRadius(const Vector& source, const float radius, std::vector<CWaypoint*>& waypointvector) const
+{
+	if (m_count == 0 || radius < 0.0f)
+		return 0;
+
+	int counter = 0;
+	const float range = sqrtf(radius);
+	int mins[3], maxs[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		mins[i] = std::max(ToCellCoord(source[i] - range), m_mins[i]);
+		maxs[i] = std::min(ToCellCoord(source[i] + range), m_maxs[i]);
+
+		if (mins[i] > maxs[i])
+			return 0;
+	}
+
+	const size_t boxcells = static_cast<size_t>(maxs[0] - mins[0] + 1) * static_cast<size_t>(maxs[1] - mins[1] + 1) * static_cast<size_t>(maxs[2] - mins[2] + 1);
+
+	if (boxcells > m_cells.size())
+	{
+		// Large radius, cheaper to test every occupied cell
+		for (auto& pair : m_cells)
+		{
+			for (auto waypoint : pair.second)
+			{
+				if (waypoint->DistToSqr(source) <= radius)
+				{
+					waypointvector.push_back(waypoint);
+					counter++;
+				}
+			}
+		}
+
+		return counter;
+	}
+
+	for (int x = mins[0]; x <= maxs[0]; x++)
+	{
+		for (int y = mins[1]; y <= maxs[1]; y++)
+		{
+			for (int z = mins[2]; z <= maxs[2]; z++)
+			{
+				if (DistToCellSqr(source, x, y, z) > radius)
+					continue;
+
+				auto it = m_cells.find(MakeKey(x, y, z));
+
+				if (it == m_cells.end())
+					continue;
+
+				for (auto waypoint : it->second)
+				{
+					if (waypoint->DistToSqr(source) <= radius)
+					{
+						waypointvector.push_back(waypoint);
+						counter++;
+					}
+				}
+			}
+		}
+	}
+
+	return counter;
+}
+
+int CWaypointSpatialIndex::ToCellCoord(const float value)
+{
+	return static_cast<int>(floorf(value / WaypointConst::SpatialCellSize));
+}
+
+CWaypointSpatialIndex::CellKey CWaypointSpatialIndex::MakeKey(const int x, const int y, const int z)
+{
+	const CellKey kx = static_cast<CellKey>(x + CELL_COORD_BIAS) & CELL_COORD_MASK;
+	const CellKey ky = static_cast<CellKey>(y + CELL_COORD_BIAS) & CELL_COORD_MASK;
+	const CellKey kz = static_cast<CellKey>(z + CELL_COORD_BIAS) & CELL_COORD_MASK;
+	return (kx << (CELL_COORD_BITS * 2)) | (ky << CELL_COORD_BITS) | kz;
+}
+
+float CWaypointSpatialIndex::DistToCellSqr(const Vector& position, const int x, const int y, const int z)
+{
+	const int coords[3] = { x, y, z };
+	float distance = 0.0f;
+
+	for (int i = 0; i < 3; i++)
+	{
+		const float mins = static_cast<float>(coords[i]) * WaypointConst::SpatialCellSize;
+		const float maxs = mins + WaypointConst::SpatialCellSize;
+		float delta = 0.0f;
+
+		if (position[i] < mins)
+		{
+			delta = mins - position[i];
+		}
+		else if (position[i] > maxs)
+		{
+			delta = position[i] - maxs;
+		}
+
+		distance += delta * delta;
+	}
+
+	return distance;
+}
+
+void CWaypointSpatialIndex::SearchCell(const int x, const int y, const int z, const Vector& position, CWaypoint*& best, float& bestdistsqr) const
+{
+	if (IsOutOfBounds(x, y, z))
+		return;
+
+	// Early out, nothing in this cell can beat the best distance found so far
+	if (DistToCellSqr(position, x, y, z) > bestdistsqr)
+		return;
+
+	auto it = m_cells.find(MakeKey(x, y, z));
+
+	if (it == m_cells.end())
+		return;
+
+	for (auto waypoint : it->second)
+	{
+		const float distance = waypoint->DistToSqr(position);
+
+		if (distance <= bestdistsqr && (best == nullptr || distance < bestdistsqr))
+		{
+			best = waypoint;
+			bestdistsqr = distance;
+		}
+	}
+}
+
+bool CWaypointSpatialIndex::IsOutOfBounds(const int x, const int y, const int z) const
+{
+	return x < m_mins[0] || x > m_maxs[0] || y < m_mins[1] || y > m_maxs[1] || z < m_mins[2] || z > m_maxs[2];
+}
@@ -0,0 +1,65 @@
+#ifndef WAYPOINT_SPATIAL_INDEX_H_
+#define WAYPOINT_SPATIAL_INDEX_H_
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+class CWaypoint;
+class Vector;
+
+/**
+ * @brief Uniform 3D grid spatial index for waypoints.
+ *
+ * Waypoints are bucketed into cubic cells stored in a hash map keyed by the cell coordinates.
+ * Nearest and radius queries only visit the cells around the query position.
+*/
+class CWaypointSpatialIndex
+{
+public:
+	CWaypointSpatialIndex();
+	~CWaypointSpatialIndex();
+
+	// Removes all waypoints from the index
+	void Clear();
+	void Insert(CWaypoint* waypoint);
+	void Remove(CWaypoint* waypoint);
+
+	size_t GetCount() const { return m_count; }
+
+	/**
+	 * @brief Finds the nearest waypoint to the given position
+	 * @param position Search position
+	 * @param maxdistsqr Maximum squared distance, waypoints further than this are ignored
+	 * @return Nearest waypoint or nullptr if none was found
+	*/
+	CWaypoint* FindNearest(const Vector& position, const float maxdistsqr) const;
+
+	/**
+	 * @brief Collects waypoints in a radius
+	 * @param source Position
+	 * @param radius Squared radius
+	 * @param waypointvector Vector to store the waypoints at
+	 * @return Number of waypoints collected
+	*/
+	int CollectInRadius(const Vector& source, const float radius, std::vector<CWaypoint*>& waypointvector) const;
+
+private:
+	using CellKey = std::uint64_t;
+	using Cell = std::vector<CWaypoint*>;
+
+	static int ToCellCoord(const float value);
+	static CellKey MakeKey(const int x, const int y, const int z);
+	// Squared distance from the position to the closest point of the given cell
+	static float DistToCellSqr(const Vector& position, const int x, const int y, const int z);
+
+	void SearchCell(const int x, const int y, const int z, const Vector& position, CWaypoint*& best, float& bestdistsqr) const;
+	bool IsOutOfBounds(const int x, const int y, const int z) const;
+
+	std::unordered_map<CellKey, Cell> m_cells;
+	int m_mins[3]; // Lowest occupied cell coordinates
+	int m_maxs[3]; // Highest occupied cell coordinates
+	size_t m_count; // Number of waypoints in the index
+};
+
+#endif // !WAYPOINT_SPATIAL_INDEX_H_
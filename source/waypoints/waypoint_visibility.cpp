@@ -0,0 +1,433 @@
+#include <extdll.h>
+#include <meta_api.h>
+
+#undef open
+#undef read
+#undef write
+#undef close
+
+#include <fstream>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <cstring>
+
+#include "plugincvars.h"
+#include "mods/mod_base.h"
+#include "sdk/bsp_collision.h"
+#include "waypoint_base.h"
+#include "waypoint_manager.h"
+#include "waypoint_visibility.h"
+
+// Visibility file header
+constexpr auto VISIBILITY_FILE_HEADER = "GBVISIBLE";
+constexpr int VISIBILITY_FILE_VERSION = 1;
+// Bits per row block, rows are deduplicated in blocks of this size
+constexpr int VISIBILITY_BLOCK_BITS = 256;
+constexpr int VISIBILITY_BLOCK_WORDS = VISIBILITY_BLOCK_BITS / 64;
+// The table isn't built above this many waypoint IDs, the traces would take too long
+constexpr int VISIBILITY_MAX_WAYPOINTS = 16384;
+constexpr int VISIBILITY_MAX_THREADS = 8;
+// Standing player view offset above the player origin
+constexpr float VISIBILITY_VIEW_HEIGHT = 28.0f;
+// Table is rebuilt after the waypoints stay unchanged for this many seconds
+constexpr float VISIBILITY_BUILD_DELAY = 5.0f;
+// 64 bit FNV-1a, same as the graph hash
+constexpr std::uint64_t VISIBILITY_HASH_OFFSET = 14695981039346656037ULL;
+constexpr std::uint64_t VISIBILITY_HASH_PRIME = 1099511628211ULL;
+
+using VisibilityBlock = std::array<std::uint64_t, VISIBILITY_BLOCK_WORDS>;
+
+struct VisibilityBlockHash
+{
+	size_t operator()(const VisibilityBlock& block) const
+	{
+		std::uint64_t hash = VISIBILITY_HASH_OFFSET;
+
+		for (auto word : block)
+		{
+			hash = (hash ^ word) * VISIBILITY_HASH_PRIME;
+		}
+
+		return static_cast<size_t>(hash ^ (hash >> 32));
+	}
+};
+
+static void HashValue(std::uint64_t& hash, const void* data, const size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= VISIBILITY_HASH_PRIME;
+	}
+}
+
+class CVisibilityFileHeader
+{
+public:
+	char header[11];
+	int version;
+	std::uint64_t hash;
+	int nodelimit;
+	int blockbits;
+	std::uint32_t directorysize;
+	std::uint32_t poolsize; // Number of pool blocks
+};
+
+CVisibilityTable::CVisibilityTable() :
+	m_directory(),
+	m_pool()
+{
+	m_hash = 0;
+	m_nodelimit = 0;
+	m_blocksperrow = 0;
+}
+
+CVisibilityTable::~CVisibilityTable()
+{
+}
+
+void CVisibilityTable::Build(const CWaypointGraph& graph, const CBSPCollision& collision, const float eyeheight, const int threads, const std::atomic<bool>& cancel)
+{
+	const int limit = graph.GetNodeLimit();
+
+	m_hash = ComputeHash(graph, eyeheight);
+	m_nodelimit = limit;
+	m_blocksperrow = (limit + VISIBILITY_BLOCK_BITS - 1) / VISIBILITY_BLOCK_BITS;
+	m_directory.clear();
+	m_pool.clear();
+
+	const size_t rowwords = static_cast<size_t>(m_blocksperrow) * VISIBILITY_BLOCK_WORDS;
+	std::vector<std::uint64_t> rows(rowwords * limit, 0);
+	std::atomic<int> nextrow(0);
+
+	// Each thread takes a row and traces to the waypoints with a higher ID, only the owner of a row writes to it
+	auto worker = [&]() {
+		BSPTraceResult tr;
+
+		for (int id = nextrow++; id < limit && !cancel.load(std::memory_order_relaxed); id = nextrow++)
+		{
+			if (!graph.IsValidNode(id))
+				continue;
+
+			std::uint64_t* row = &rows[static_cast<size_t>(id) * rowwords];
+			const Vector eyes = graph.GetPosition(id) + Vector(0.0f, 0.0f, eyeheight);
+			row[id / 64] |= 1ULL << (id % 64);
+
+			for (int other = id + 1; other < limit; other++)
+			{
+				if (!graph.IsValidNode(other))
+					continue;
+
+				collision.TraceLine(eyes, graph.GetPosition(other) + Vector(0.0f, 0.0f, eyeheight), tr);
+
+				if (tr.fraction >= 1.0f && !tr.startsolid)
+				{
+					row[other / 64] |= 1ULL << (other % 64);
+				}
+			}
+		}
+	};
+
+	std::vector<std::thread> helpers;
+
+	for (int i = 1; i < threads; i++)
+	{
+		helpers.emplace_back(worker);
+	}
+
+	worker();
+
+	for (auto& helper : helpers)
+	{
+		helper.join();
+	}
+
+	if (cancel.load())
+	{
+		m_nodelimit = 0;
+		m_blocksperrow = 0;
+		return;
+	}
+
+	// Traces are the same in both directions, copy the upper triangle to the lower one
+	for (int id = 0; id < limit; id++)
+	{
+		const std::uint64_t* row = &rows[static_cast<size_t>(id) * rowwords];
+
+		for (int other = id + 1; other < limit; other++)
+		{
+			if ((row[other / 64] >> (other % 64)) & 1ULL)
+			{
+				rows[static_cast<size_t>(other) * rowwords + id / 64] |= 1ULL << (id % 64);
+			}
+		}
+	}
+
+	Compress(rows, rowwords);
+}
+
+void CVisibilityTable::Compress(const std::vector<std::uint64_t>& rows, const size_t rowwords)
+{
+	std::unordered_map<VisibilityBlock, std::uint32_t, VisibilityBlockHash> blocks;
+	VisibilityBlock block{};
+
+	// Block 0 is the empty block
+	m_pool.assign(VISIBILITY_BLOCK_WORDS, 0);
+	blocks.emplace(block, 0);
+	m_directory.resize(static_cast<size_t>(m_nodelimit) * m_blocksperrow);
+
+	for (size_t entry = 0; entry < m_directory.size(); entry++)
+	{
+		const std::uint64_t* words = &rows[(entry / m_blocksperrow) * rowwords + (entry % m_blocksperrow) * VISIBILITY_BLOCK_WORDS];
+		std::copy(words, words + VISIBILITY_BLOCK_WORDS, block.begin());
+
+		auto result = blocks.emplace(block, static_cast<std::uint32_t>(m_pool.size() / VISIBILITY_BLOCK_WORDS));
+
+		if (result.second)
+		{
+			m_pool.insert(m_pool.end(), block.begin(), block.end());
+		}
+
+		m_directory[entry] = result.first->second;
+	}
+}
+
+void CVisibilityTable::Save(const std::string& filename) const
+{
+	std::fstream file;
+	file.open(filename, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+
+	if (!file.is_open())
+	{
+		LOG_CONSOLE(PLID, "Failed to save visibility file \"%s\"!", filename.c_str());
+		return;
+	}
+
+	CVisibilityFileHeader header{};
+	std::memcpy(header.header, VISIBILITY_FILE_HEADER, std::strlen(VISIBILITY_FILE_HEADER));
+	header.version = VISIBILITY_FILE_VERSION;
+	header.hash = m_hash;
+	header.nodelimit = m_nodelimit;
+	header.blockbits = VISIBILITY_BLOCK_BITS;
+	header.directorysize = static_cast<std::uint32_t>(m_directory.size());
+	header.poolsize = static_cast<std::uint32_t>(m_pool.size() / VISIBILITY_BLOCK_WORDS);
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(CVisibilityFileHeader));
+	file.write(reinterpret_cast<const char*>(m_directory.data()), m_directory.size() * sizeof(std::uint32_t));
+	file.write(reinterpret_cast<const char*>(m_pool.data()), m_pool.size() * sizeof(std::uint64_t));
+	file.close();
+}
+
+bool CVisibilityTable::Load(const std::string& filename, const std::uint64_t hash, const int nodelimit)
+{
+	std::fstream file;
+	file.open(filename, std::fstream::in | std::fstream::binary);
+
+	if (!file.is_open())
+		return false;
+
+	CVisibilityFileHeader header{};
+	file.read(reinterpret_cast<char*>(&header), sizeof(CVisibilityFileHeader));
+	header.header[sizeof(header.header) - 1] = 0;
+
+	if (!file || strcmp(header.header, VISIBILITY_FILE_HEADER) != 0 || header.version != VISIBILITY_FILE_VERSION || header.blockbits != VISIBILITY_BLOCK_BITS)
+	{
+		LOG_CONSOLE(PLID, "Invalid visibility file \"%s\"!", filename.c_str());
+		return false;
+	}
+
+	// Built for different waypoints, the table will be rebuilt
+	if (header.hash != hash || header.nodelimit != nodelimit)
+		return false;
+
+	const int blocksperrow = (nodelimit + VISIBILITY_BLOCK_BITS - 1) / VISIBILITY_BLOCK_BITS;
+
+	if (header.directorysize != static_cast<std::uint64_t>(nodelimit) * blocksperrow || header.poolsize == 0)
+	{
+		LOG_CONSOLE(PLID, "Invalid visibility file \"%s\"!", filename.c_str());
+		return false;
+	}
+
+	m_directory.resize(header.directorysize);
+	m_pool.resize(static_cast<size_t>(header.poolsize) * VISIBILITY_BLOCK_WORDS);
+
+	file.read(reinterpret_cast<char*>(m_directory.data()), m_directory.size() * sizeof(std::uint32_t));
+	file.read(reinterpret_cast<char*>(m_pool.data()), m_pool.size() * sizeof(std::uint64_t));
+
+	const bool valid = std::all_of(m_directory.begin(), m_directory.end(), [&header](const std::uint32_t index) { return index < header.poolsize; });
+
+	if (!file || !valid)
+	{
+		LOG_CONSOLE(PLID, "Visibility file \"%s\" is truncated!", filename.c_str());
+		m_directory.clear();
+		m_pool.clear();
+		return false;
+	}
+
+	m_hash = header.hash;
+	m_nodelimit = header.nodelimit;
+	m_blocksperrow = blocksperrow;
+	return true;
+}
+
+std::uint64_t CVisibilityTable::ComputeHash(const CWaypointGraph& graph, const float eyeheight)
+{
+	std::uint64_t hash = VISIBILITY_HASH_OFFSET;
+	const int limit = graph.GetNodeLimit();
+
+	HashValue(hash, &limit, sizeof(limit));
+	HashValue(hash, &eyeheight, sizeof(eyeheight));
+
+	for (int id = 0; id < limit; id++)
+	{
+		if (!graph.IsValidNode(id))
+			continue;
+
+		const Vector& position = graph.GetPosition(id);
+		HashValue(hash, &id, sizeof(id));
+		HashValue(hash, &position.x, sizeof(float) * 3);
+	}
+
+	return hash;
+}
+
+bool CVisibilityTable::CanSee(const int id, const int otherid) const
+{
+	const std::uint32_t block = m_directory[static_cast<size_t>(id) * m_blocksperrow + otherid / VISIBILITY_BLOCK_BITS];
+	const int bit = otherid % VISIBILITY_BLOCK_BITS;
+	return ((m_pool[static_cast<size_t>(block) * VISIBILITY_BLOCK_WORDS + bit / 64] >> (bit % 64)) & 1ULL) != 0;
+}
+
+CVisibilityManager::CVisibilityManager() :
+	m_table(),
+	m_building(),
+	m_graph(),
+	m_thread(),
+	m_buildfinished(false),
+	m_cancel(false)
+{
+	m_hash = 0;
+	m_loadhash = 0;
+	m_loadtried = false;
+	m_tablevalid = false;
+	m_buildtime = 0.0f;
+}
+
+CVisibilityManager::~CVisibilityManager()
+{
+	Stop();
+}
+
+void CVisibilityManager::Update()
+{
+	if (m_buildfinished.load())
+	{
+		FinishBuild();
+	}
+
+	if (gb_nav_visibility.value <= 0.0f)
+	{
+		m_tablevalid = false;
+		return;
+	}
+
+	std::shared_ptr<const CWaypointGraph> graph = TheWaypoints->GetGraphSnapshot();
+
+	if (graph != m_graph)
+	{
+		// Path edits make a new snapshot without moving any waypoint, the hash tells if the table is still good
+		m_graph = graph;
+		const std::uint64_t hash = CVisibilityTable::ComputeHash(*graph, GetEyeHeight());
+
+		if (hash != m_hash)
+		{
+			m_hash = hash;
+			m_buildtime = gpGlobals->time + VISIBILITY_BUILD_DELAY;
+		}
+	}
+
+	m_tablevalid = m_table && m_table->GetHash() == m_hash && m_table->GetNodeLimit() == graph->GetNodeLimit();
+
+	if (m_tablevalid || IsBuilding() || graph->GetNodeCount() == 0 || graph->GetNodeLimit() > VISIBILITY_MAX_WAYPOINTS)
+		return;
+
+	if (!m_loadtried || m_loadhash != m_hash)
+	{
+		m_loadtried = true;
+		m_loadhash = m_hash;
+		auto loaded = std::make_shared<CVisibilityTable>();
+
+		if (loaded->Load(TheWaypoints->GetWaypointFilePath(".wpv"), m_hash, graph->GetNodeLimit()))
+		{
+			m_table = loaded;
+			m_tablevalid = true;
+			return;
+		}
+	}
+
+	// Only the world collision can be traced from other threads
+	std::shared_ptr<const CBSPCollision> collision = TheMapCollision;
+
+	if (collision == nullptr)
+		return;
+
+	if (gpGlobals->time >= m_buildtime || m_table == nullptr)
+	{
+		StartBuild(graph, collision);
+	}
+}
+
+void CVisibilityManager::Stop()
+{
+	m_cancel.store(true);
+
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	m_cancel.store(false);
+	m_buildfinished.store(false);
+	m_building.reset();
+}
+
+float CVisibilityManager::GetEyeHeight() const
+{
+	const float groundoffset = gamemod != nullptr ? gamemod->GetPlayerOriginGroundOffset() : 34.0f;
+	return groundoffset + VISIBILITY_VIEW_HEIGHT;
+}
+
+void CVisibilityManager::StartBuild(std::shared_ptr<const CWaypointGraph> graph, std::shared_ptr<const CBSPCollision> collision)
+{
+	const int threads = std::clamp(static_cast<int>(std::thread::hardware_concurrency()) - 1, 1, VISIBILITY_MAX_THREADS);
+	const float eyeheight = GetEyeHeight();
+	std::shared_ptr<CVisibilityTable> building = std::make_shared<CVisibilityTable>();
+
+	m_building = building;
+	m_buildfinished.store(false);
+
+	// The graph snapshot and the map collision are kept alive by the thread
+	m_thread = std::thread([this, graph, collision, building, eyeheight, threads]() {
+		building->Build(*graph, *collision, eyeheight, threads, m_cancel);
+		m_buildfinished.store(true);
+	});
+}
+
+void CVisibilityManager::FinishBuild()
+{
+	m_thread.join();
+	m_buildfinished.store(false);
+
+	// Don't keep tables for waypoints that changed while they were built
+	if (m_building->GetHash() == m_hash && !m_building->IsEmpty())
+	{
+		m_table = m_building;
+		m_building->Save(TheWaypoints->GetWaypointFilePath(".wpv"));
+		LOG_MESSAGE(PLID, "Built waypoint visibility table, %i KB.", static_cast<int>(m_building->GetMemoryUsage() / 1024));
+	}
+
+	m_building.reset();
+}
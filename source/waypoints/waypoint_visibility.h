@@ -0,0 +1,123 @@
+#ifndef WAYPOINT_VISIBILITY_H_
+#define WAYPOINT_VISIBILITY_H_
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <cstdint>
+
+#include "waypoint_graph.h"
+
+class CBSPCollision;
+
+/**
+ * @brief Compressed waypoint to waypoint visibility matrix.
+ *
+ * Each row is a bitset over the waypoint IDs, split in fixed size blocks. Rows store block indices into a pool of
+ * unique blocks, so empty blocks and blocks repeated between waypoints that see the same area are stored once.
+ * Visibility is traced between the eyes of a standing player at each waypoint, against the world only.
+ * Tables are immutable once built and tied to the hash of the waypoint positions they were built from.
+*/
+class CVisibilityTable
+{
+public:
+	CVisibilityTable();
+	~CVisibilityTable();
+
+	/**
+	 * @brief Traces every waypoint pair and compresses the result, safe to call from any thread
+	 * @param graph Graph to read the waypoint positions from
+	 * @param collision Map collision used for the traces
+	 * @param eyeheight Height of the eyes above the waypoint position
+	 * @param threads Number of threads tracing
+	 * @param cancel The build stops early when set, the table is left empty
+	*/
+	void Build(const CWaypointGraph& graph, const CBSPCollision& collision, const float eyeheight, const int threads, const std::atomic<bool>& cancel);
+	void Save(const std::string& filename) const;
+	/**
+	 * @brief Loads a table from a file
+	 * @param filename File to load
+	 * @param hash Table is rejected if it was built from different waypoint positions
+	 * @param nodelimit Table is rejected if it was built for a different ID range
+	 * @return true if the table was loaded
+	*/
+	bool Load(const std::string& filename, const std::uint64_t hash, const int nodelimit);
+
+	// Hash of the waypoint positions of a graph, including the eye height used for the traces
+	static std::uint64_t ComputeHash(const CWaypointGraph& graph, const float eyeheight);
+
+	std::uint64_t GetHash() const { return m_hash; }
+	int GetNodeLimit() const { return m_nodelimit; }
+	bool IsEmpty() const { return m_directory.empty(); }
+	// Memory used by the compressed table in bytes
+	size_t GetMemoryUsage() const { return m_directory.size() * sizeof(std::uint32_t) + m_pool.size() * sizeof(std::uint64_t); }
+
+	/**
+	 * @brief Checks if a waypoint can see another
+	 * @param id Waypoint ID, must be lower than the node limit
+	 * @param otherid Other waypoint ID, must be lower than the node limit
+	 * @return true if there is a clear line between the two waypoints
+	*/
+	bool CanSee(const int id, const int otherid) const;
+
+private:
+	// Replaces the raw bit rows by the block directory and pool
+	void Compress(const std::vector<std::uint64_t>& rows, const size_t rowwords);
+
+	std::uint64_t m_hash;
+	int m_nodelimit;
+	int m_blocksperrow;
+	std::vector<std::uint32_t> m_directory; // Pool block index of each row block, a row per waypoint ID
+	std::vector<std::uint64_t> m_pool; // Unique blocks, block 0 is always empty
+};
+
+/**
+ * @brief Keeps the visibility table up to date with the waypoints.
+ *
+ * The table is loaded from the sidecar file next to the waypoint file if its hash matches, otherwise it's built on
+ * background threads with the map collision and saved once finished. Main thread only.
+*/
+class CVisibilityManager
+{
+public:
+	CVisibilityManager();
+	~CVisibilityManager();
+
+	// Called every server frame
+	void Update();
+	// Stops the background build
+	void Stop();
+
+	/**
+	 * @brief Gets the current table
+	 * @param graphversion Current waypoint graph version, the table is only known to match the graph checked on the last update
+	 * @return Table or nullptr if there is no table for the current waypoint positions
+	*/
+	const CVisibilityTable* GetTable(const unsigned int graphversion) const
+	{
+		return m_tablevalid && m_graph->GetVersion() == graphversion ? m_table.get() : nullptr;
+	}
+	bool IsBuilding() const { return m_thread.joinable(); }
+	// Height of the eyes above the waypoint positions, used by the tables and by the traces done without a table
+	float GetEyeHeight() const;
+
+private:
+	void StartBuild(std::shared_ptr<const CWaypointGraph> graph, std::shared_ptr<const CBSPCollision> collision);
+	void FinishBuild();
+
+	std::shared_ptr<const CVisibilityTable> m_table;
+	std::shared_ptr<CVisibilityTable> m_building; // Table being built by the background thread
+	std::shared_ptr<const CWaypointGraph> m_graph; // Graph snapshot the hash was computed for
+	std::thread m_thread;
+	std::atomic<bool> m_buildfinished;
+	std::atomic<bool> m_cancel;
+	std::uint64_t m_hash; // Hash of the current waypoint positions
+	std::uint64_t m_loadhash; // Hash the sidecar load was tried for
+	bool m_loadtried;
+	bool m_tablevalid; // The table matches the current waypoint positions
+	float m_buildtime; // Table is built once the waypoints stay unchanged until this time
+};
+
+#endif // !WAYPOINT_VISIBILITY_H_